@@ -0,0 +1,82 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <vector>
+#include <memory>
+#include <utility>
+#include <stdexcept>
+#include <type_traits>
+
+// Arena
+//
+// Bump allocator for short lived objects that are all released together.
+// Memory comes from a list of blocks that are kept across reset(), so a
+// reused arena stops allocating once it has grown to its working size.
+// Destructors are never run, so only trivially destructible types may be
+// created in it.
+class Arena {
+private:
+    std::vector<std::unique_ptr<char[]>> blocks;
+    std::vector<size_t> sizes;
+    size_t block_size;
+    size_t current;
+    size_t offset;
+
+public:
+    explicit Arena(const size_t block_size = 1 << 16):
+        block_size(block_size), current(0), offset(0)
+    {}
+
+    Arena(const Arena&) = delete;
+    Arena& operator = (const Arena&) = delete;
+
+    void* allocate(const size_t size, const size_t align) {
+        while (current < blocks.size()) {
+            const size_t base = reinterpret_cast<size_t>(blocks[current].get());
+            const size_t start = ((base + offset + align - 1) & ~(align - 1)) - base;
+
+            if (start + size <= sizes[current]) {
+                offset = start + size;
+                return blocks[current].get() + start;
+            }
+
+            current++;
+            offset = 0;
+        }
+
+        const size_t s = std::max(block_size, size + align);
+        blocks.push_back(std::unique_ptr<char[]>(new char[s]));
+        sizes.push_back(s);
+        current = blocks.size() - 1;
+
+        const size_t base = reinterpret_cast<size_t>(blocks[current].get());
+        const size_t start = ((base + align - 1) & ~(align - 1)) - base;
+
+        offset = start + size;
+        return blocks[current].get() + start;
+    }
+
+    template <typename T, typename... Args>
+    T* create(Args&&... args) {
+        static_assert(std::is_trivially_destructible<T>::value, "arena types should be trivially destructible");
+
+        return new (allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+    }
+
+    void reset() {
+        current = 0;
+        offset = 0;
+    }
+
+    size_t capacity() const {
+        size_t r = 0;
+
+        for (size_t i = 0; i != sizes.size(); i++) {
+            r += sizes[i];
+        }
+
+        return r;
+    }
+};
+
+#endif
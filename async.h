@@ -0,0 +1,241 @@
+#ifndef ASYNC_H
+#define ASYNC_H
+
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "geometry.h"
+#include "qr.h"
+
+// Thrown by Task::get() for work that was cancelled before it started.
+class Cancelled: public std::runtime_error {
+public:
+    Cancelled(): std::runtime_error("operation cancelled") {}
+};
+
+// CancellationToken
+//
+// A flag shared by its copies. Cancelling is cooperative: work that has
+// not started when the flag is set fails with Cancelled instead of
+// running, and so does everything chained after it with then(). Work that
+// is already running finishes unless it checks the token itself.
+class CancellationToken {
+private:
+    std::shared_ptr<std::atomic<bool>> flag;
+
+public:
+    CancellationToken(): flag(std::make_shared<std::atomic<bool>>(false)) {}
+
+    void cancel() const {
+        flag->store(true);
+    }
+
+    bool cancelled() const {
+        return flag->load();
+    }
+
+    void throw_if_cancelled() const {
+        if (cancelled()) {
+            throw Cancelled();
+        }
+    }
+};
+
+// Threads that async work runs on. They only drive the operations: loops
+// inside them still split over ThreadPool::instance() as they would on the
+// calling thread, so an operation takes about as long as the blocking
+// call. The shared pool is created first so that it is destroyed last.
+inline ThreadPool& async_pool() {
+    ThreadPool::instance();
+    static ThreadPool pool(2);
+    return pool;
+}
+
+template <typename T>
+class Task;
+
+template <typename F>
+Task<std::invoke_result_t<F>> run_async(F f, CancellationToken token = CancellationToken());
+
+// Task
+//
+// The result of work started with run_async(), like a std::shared_future
+// that can be chained: then(f) runs f on the result once it is ready,
+// without any thread waiting for it, and returns a Task for what f
+// returns. An exception thrown by the work, Cancelled included, is passed
+// down the chain and thrown by get().
+//
+// Work should not wait on other tasks; chaining with then() keeps the
+// async threads free.
+template <typename T>
+class Task {
+private:
+    static_assert(!std::is_void<T>::value, "tasks should return a value");
+
+    template <typename U>
+    friend class Task;
+
+    template <typename F>
+    friend Task<std::invoke_result_t<F>> run_async(F f, CancellationToken token);
+
+    struct State {
+        std::mutex mutex;
+        std::condition_variable ready;
+        bool done = false;
+        std::optional<T> value;
+        std::exception_ptr error;
+        std::vector<std::function<void()>> continuations;
+    };
+
+    std::shared_ptr<State> state;
+    CancellationToken cancellation;
+
+    explicit Task(const CancellationToken &token): state(std::make_shared<State>()), cancellation(token) {}
+
+    // Finishes the task with what f returns or throws, then starts the
+    // continuations.
+    template <typename F>
+    void complete(F f) const {
+        std::optional<T> value;
+        std::exception_ptr error;
+
+        try {
+            value.emplace(f());
+        } catch (...) {
+            error = std::current_exception();
+        }
+
+        std::vector<std::function<void()>> next;
+
+        {
+            std::lock_guard<std::mutex> lock(state->mutex);
+            state->value = std::move(value);
+            state->error = error;
+            state->done = true;
+            next.swap(state->continuations);
+        }
+
+        state->ready.notify_all();
+        for (size_t i = 0; i != next.size(); i++) {
+            async_pool().submit(std::move(next[i]));
+        }
+    }
+
+public:
+    bool ready() const {
+        std::lock_guard<std::mutex> lock(state->mutex);
+        return state->done;
+    }
+
+    void wait() const {
+        std::unique_lock<std::mutex> lock(state->mutex);
+        state->ready.wait(lock, [this] { return state->done; });
+    }
+
+    // Waits for the result, or throws what the work threw.
+    const T& get() const {
+        wait();
+
+        if (state->error) {
+            std::rethrow_exception(state->error);
+        }
+
+        return *state->value;
+    }
+
+    // Cancels this task and everything chained to it with the same token.
+    void cancel() const {
+        cancellation.cancel();
+    }
+
+    const CancellationToken& token() const {
+        return cancellation;
+    }
+
+    // Runs f(get()) on the async threads once this task is done, unless it
+    // failed or the token was cancelled by then. The returned task shares
+    // the token.
+    template <typename F>
+    Task<std::invoke_result_t<F, const T&>> then(F f) const {
+        typedef std::invoke_result_t<F, const T&> R;
+
+        const Task<R> next(cancellation);
+        const std::shared_ptr<State> s = state;
+        const CancellationToken token = cancellation;
+
+        std::function<void()> run = [s, next, token, f = std::move(f)]() mutable {
+            next.complete([&]() -> R {
+                if (s->error) {
+                    std::rethrow_exception(s->error);
+                }
+
+                token.throw_if_cancelled();
+                return f(*s->value);
+            });
+        };
+
+        {
+            std::lock_guard<std::mutex> lock(state->mutex);
+            if (!state->done) {
+                state->continuations.push_back(std::move(run));
+                return next;
+            }
+        }
+
+        async_pool().submit(std::move(run));
+        return next;
+    }
+};
+
+// Runs f() on the async threads and returns a Task for its result. If the
+// token is cancelled before f starts, f does not run.
+template <typename F>
+Task<std::invoke_result_t<F>> run_async(F f, CancellationToken token) {
+    typedef std::invoke_result_t<F> R;
+
+    const Task<R> task(token);
+
+    async_pool().submit([task, token, f = std::move(f)]() mutable {
+        task.complete([&]() -> R {
+            token.throw_if_cancelled();
+            return f();
+        });
+    });
+
+    return task;
+}
+
+// Async matrix operations
+//
+// Same as the blocking calls, on the async threads. Operands are taken by
+// value, so they can be moved in, and the caller is free to change or
+// destroy its own copies right away.
+template <typename T, typename U>
+Task<Matrix<T>> async_multiply(Matrix<T> lhs, Matrix<U> rhs, CancellationToken token = CancellationToken()) {
+    return run_async([lhs = std::move(lhs), rhs = std::move(rhs)] { return lhs * rhs; }, token);
+}
+
+template <typename T>
+Task<Matrix<T>> async_invert(Matrix<T> m, CancellationToken token = CancellationToken()) {
+    return run_async([m = std::move(m)]() mutable {
+        m.invert();
+        return std::move(m);
+    }, token);
+}
+
+// Least squares solution of a x = b, through QR.
+template <typename T>
+Task<Matrix<T>> async_solve(Matrix<T> a, Matrix<T> b, CancellationToken token = CancellationToken()) {
+    return run_async([a = std::move(a), b = std::move(b)] { return QR<T>(a).solve(b); }, token);
+}
+
+#endif
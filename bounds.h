@@ -0,0 +1,460 @@
+#ifndef BOUNDS_H
+#define BOUNDS_H
+
+#include <vector>
+#include <limits>
+#include <cmath>
+#include <cstdint>
+#include <stdexcept>
+#include <iostream>
+
+#if defined(__SSE__)
+#include <immintrin.h>
+#endif
+
+#include "geometry.h"
+#include "parallel.h"
+#include "dispatch.h"
+
+// AABB
+template <typename T>
+class AABB {
+public:
+    Vec3<T> min, max;
+
+    AABB(): min(std::numeric_limits<T>::max()), max(std::numeric_limits<T>::lowest()) {}
+
+    AABB(const Vec3<T> &p): min(p), max(p) {}
+
+    AABB(const Vec3<T> &min, const Vec3<T> &max): min(min), max(max) {}
+
+    template <typename U>
+    AABB(const AABB<U> &b): min(b.min), max(b.max) {}
+
+    bool empty() const {
+        return min.x > max.x || min.y > max.y || min.z > max.z;
+    }
+
+    void expand(const Vec3<T> &p) {
+        for (size_t i = 0; i != 3; i++) {
+            if (p[i] < min[i]) {
+                min[i] = p[i];
+            }
+            if (p[i] > max[i]) {
+                max[i] = p[i];
+            }
+        }
+    }
+
+    void expand(const AABB<T> &b) {
+        for (size_t i = 0; i != 3; i++) {
+            if (b.min[i] < min[i]) {
+                min[i] = b.min[i];
+            }
+            if (b.max[i] > max[i]) {
+                max[i] = b.max[i];
+            }
+        }
+    }
+
+    Vec3<T> center() const {
+        return (min + max) / 2;
+    }
+
+    Vec3<T> extent() const {
+        return max - min;
+    }
+
+    T surface_area() const {
+        if (empty()) {
+            return 0;
+        }
+
+        const Vec3<T> e = extent();
+        return 2 * (e.x * e.y + e.y * e.z + e.z * e.x);
+    }
+
+    bool contains(const Vec3<T> &p) const {
+        return p.x >= min.x && p.x <= max.x &&
+               p.y >= min.y && p.y <= max.y &&
+               p.z >= min.z && p.z <= max.z;
+    }
+};
+
+template <typename T, typename U>
+bool intersects(const AABB<T> &lhs, const AABB<U> &rhs) {
+    return lhs.min.x <= rhs.max.x && rhs.min.x <= lhs.max.x &&
+           lhs.min.y <= rhs.max.y && rhs.min.y <= lhs.max.y &&
+           lhs.min.z <= rhs.max.z && rhs.min.z <= lhs.max.z;
+}
+
+template <typename T>
+std::ostream& operator << (std::ostream &os, const AABB<T> &b) {
+    os << "[" << b.min << " " << b.max << "]";
+
+    return os;
+}
+
+// Frustum
+template <typename T>
+class Frustum {
+public:
+    // left, right, bottom, top, near, far. A point p is inside a plane when
+    // plane * Vec4<T>(p) >= 0.
+    Vec4<T> planes[6];
+
+    Frustum() {}
+
+    // Extracts the clip planes of a 4x4 projection (or view-projection)
+    // matrix using the row vector convention of Vec4 * Matrix, with clip
+    // space bounded by -w <= x, y, z <= w.
+    template <typename U>
+    Frustum(const Matrix<U> &m) {
+        if (m.rows != 4 || m.cols != 4) {
+            throw std::length_error("matrix size should be 4x4");
+        }
+
+        Vec4<T> c[4];
+        for (size_t j = 0; j != 4; j++) {
+            c[j] = Vec4<T>(m[0][j], m[1][j], m[2][j], m[3][j]);
+        }
+
+        planes[0] = c[3] + c[0];
+        planes[1] = c[3] - c[0];
+        planes[2] = c[3] + c[1];
+        planes[3] = c[3] - c[1];
+        planes[4] = c[3] + c[2];
+        planes[5] = c[3] - c[2];
+
+        for (size_t i = 0; i != 6; i++) {
+            const Vec3<T> n(planes[i].x, planes[i].y, planes[i].z);
+            const T len = std::sqrt(n * n);
+
+            if (len != 0) {
+                planes[i] /= len;
+            }
+        }
+    }
+
+    bool contains(const Vec3<T> &p) const {
+        const Vec4<T> h(p.x, p.y, p.z, 1);
+
+        for (size_t i = 0; i != 6; i++) {
+            if (planes[i] * h < 0) {
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    // Conservative: a box is rejected only when it lies fully behind one
+    // plane, so some boxes near the frustum corners are reported visible.
+    template <typename U>
+    bool intersects(const AABB<U> &b) const {
+        for (size_t i = 0; i != 6; i++) {
+            const Vec4<T> &p = planes[i];
+            const Vec4<T> v(
+                p.x >= 0 ? b.max.x : b.min.x,
+                p.y >= 0 ? b.max.y : b.min.y,
+                p.z >= 0 ? b.max.z : b.min.z,
+                1
+            );
+
+            if (p * v < 0) {
+                return false;
+            }
+        }
+
+        return true;
+    }
+};
+
+// AABBBatch
+//
+// Structure of arrays storage for many boxes so batch tests can load the
+// same coordinate of several boxes into one register.
+template <typename T>
+class AABBBatch {
+public:
+    std::vector<T> min_x, min_y, min_z;
+    std::vector<T> max_x, max_y, max_z;
+
+    AABBBatch() {}
+
+    AABBBatch(const std::vector<AABB<T>> &boxes) {
+        reserve(boxes.size());
+
+        for (size_t i = 0; i != boxes.size(); i++) {
+            push_back(boxes[i]);
+        }
+    }
+
+    size_t size() const {
+        return min_x.size();
+    }
+
+    void reserve(const size_t n) {
+        min_x.reserve(n);
+        min_y.reserve(n);
+        min_z.reserve(n);
+        max_x.reserve(n);
+        max_y.reserve(n);
+        max_z.reserve(n);
+    }
+
+    void push_back(const AABB<T> &b) {
+        min_x.push_back(b.min.x);
+        min_y.push_back(b.min.y);
+        min_z.push_back(b.min.z);
+        max_x.push_back(b.max.x);
+        max_y.push_back(b.max.y);
+        max_z.push_back(b.max.z);
+    }
+
+    void set(const size_t i, const AABB<T> &b) {
+        min_x[i] = b.min.x;
+        min_y[i] = b.min.y;
+        min_z[i] = b.min.z;
+        max_x[i] = b.max.x;
+        max_y[i] = b.max.y;
+        max_z[i] = b.max.z;
+    }
+
+    AABB<T> operator [] (const size_t i) const {
+        return AABB<T>(
+            Vec3<T>(min_x[i], min_y[i], min_z[i]),
+            Vec3<T>(max_x[i], max_y[i], max_z[i])
+        );
+    }
+
+    void clear() {
+        min_x.clear();
+        min_y.clear();
+        min_z.clear();
+        max_x.clear();
+        max_y.clear();
+        max_z.clear();
+    }
+};
+
+// Visibility masks hold one bit per box, 32 boxes per word.
+inline size_t mask_words(const size_t n) {
+    return (n + 31) / 32;
+}
+
+inline bool mask_test(const std::vector<uint32_t> &mask, const size_t i) {
+    return (mask[i / 32] >> (i % 32)) & 1;
+}
+
+inline size_t mask_count(const std::vector<uint32_t> &mask) {
+    size_t r = 0;
+
+    for (size_t i = 0; i != mask.size(); i++) {
+        r += __builtin_popcount(mask[i]);
+    }
+
+    return r;
+}
+
+inline std::vector<size_t> mask_indices(const std::vector<uint32_t> &mask) {
+    std::vector<size_t> r;
+
+    for (size_t i = 0; i != mask.size(); i++) {
+        uint32_t w = mask[i];
+
+        while (w) {
+            r.push_back(i * 32 + __builtin_ctz(w));
+            w &= w - 1;
+        }
+    }
+
+    return r;
+}
+
+template <typename T>
+uint32_t cull_word(const Frustum<T> &f, const AABBBatch<T> &b, const size_t base, const size_t count) {
+    uint32_t r = 0;
+
+    for (size_t i = 0; i != count; i++) {
+        if (f.intersects(b[base + i])) {
+            r |= 1u << i;
+        }
+    }
+
+    return r;
+}
+
+template <typename T>
+uint32_t overlap_word(const AABB<T> &box, const AABBBatch<T> &b, const size_t base, const size_t count) {
+    uint32_t r = 0;
+
+    for (size_t i = 0; i != count; i++) {
+        if (intersects(box, b[base + i])) {
+            r |= 1u << i;
+        }
+    }
+
+    return r;
+}
+
+#if defined(__SSE__)
+// Visibility bits of the boxes from i on, 4 at a time. Always inlined, so
+// it takes on the target of the function it is compiled into.
+inline __attribute__((always_inline)) uint32_t cull_lanes(const Frustum<float> &f, const AABBBatch<float> &b,
+                                                          const size_t base, const size_t count, size_t i) {
+    uint32_t r = 0;
+
+    for (; i + 4 <= count; i += 4) {
+        const size_t k = base + i;
+        __m128 outside = _mm_setzero_ps();
+
+        for (size_t p = 0; p != 6; p++) {
+            const Vec4f &pl = f.planes[p];
+            const __m128 x = _mm_loadu_ps(pl.x >= 0 ? &b.max_x[k] : &b.min_x[k]);
+            const __m128 y = _mm_loadu_ps(pl.y >= 0 ? &b.max_y[k] : &b.min_y[k]);
+            const __m128 z = _mm_loadu_ps(pl.z >= 0 ? &b.max_z[k] : &b.min_z[k]);
+
+            __m128 d = _mm_mul_ps(_mm_set1_ps(pl.x), x);
+            d = _mm_add_ps(d, _mm_mul_ps(_mm_set1_ps(pl.y), y));
+            d = _mm_add_ps(d, _mm_mul_ps(_mm_set1_ps(pl.z), z));
+            d = _mm_add_ps(d, _mm_set1_ps(pl.w));
+
+            outside = _mm_or_ps(outside, _mm_cmplt_ps(d, _mm_setzero_ps()));
+        }
+
+        r |= (uint32_t)(~_mm_movemask_ps(outside) & 0xf) << i;
+    }
+
+    for (; i != count; i++) {
+        if (f.intersects(b[base + i])) {
+            r |= 1u << i;
+        }
+    }
+
+    return r;
+}
+
+// 8 boxes at a time, compiled for AVX2 whatever the build flags and only
+// called when DispatchSettings::isa() allows it. No FMA, so the bits are
+// those of the 4 wide path.
+__attribute__((target("avx2"))) inline uint32_t cull_word_avx2(const Frustum<float> &f, const AABBBatch<float> &b,
+                                                               const size_t base, const size_t count) {
+    uint32_t r = 0;
+    size_t i = 0;
+
+    for (; i + 8 <= count; i += 8) {
+        const size_t k = base + i;
+        __m256 outside = _mm256_setzero_ps();
+
+        for (size_t p = 0; p != 6; p++) {
+            const Vec4f &pl = f.planes[p];
+            const __m256 x = _mm256_loadu_ps(pl.x >= 0 ? &b.max_x[k] : &b.min_x[k]);
+            const __m256 y = _mm256_loadu_ps(pl.y >= 0 ? &b.max_y[k] : &b.min_y[k]);
+            const __m256 z = _mm256_loadu_ps(pl.z >= 0 ? &b.max_z[k] : &b.min_z[k]);
+
+            __m256 d = _mm256_mul_ps(_mm256_set1_ps(pl.x), x);
+            d = _mm256_add_ps(d, _mm256_mul_ps(_mm256_set1_ps(pl.y), y));
+            d = _mm256_add_ps(d, _mm256_mul_ps(_mm256_set1_ps(pl.z), z));
+            d = _mm256_add_ps(d, _mm256_set1_ps(pl.w));
+
+            outside = _mm256_or_ps(outside, _mm256_cmp_ps(d, _mm256_setzero_ps(), _CMP_LT_OQ));
+        }
+
+        r |= (uint32_t)(~_mm256_movemask_ps(outside) & 0xff) << i;
+    }
+
+    return r | cull_lanes(f, b, base, count, i);
+}
+
+inline uint32_t cull_word(const Frustum<float> &f, const AABBBatch<float> &b, const size_t base, const size_t count) {
+    if (DispatchSettings::isa() >= Isa::avx2) {
+        return cull_word_avx2(f, b, base, count);
+    }
+
+    return cull_lanes(f, b, base, count, 0);
+}
+
+inline uint32_t overlap_word(const AABB<float> &box, const AABBBatch<float> &b, const size_t base, const size_t count) {
+    uint32_t r = 0;
+    size_t i = 0;
+
+    const __m128 lo_x = _mm_set1_ps(box.min.x), hi_x = _mm_set1_ps(box.max.x);
+    const __m128 lo_y = _mm_set1_ps(box.min.y), hi_y = _mm_set1_ps(box.max.y);
+    const __m128 lo_z = _mm_set1_ps(box.min.z), hi_z = _mm_set1_ps(box.max.z);
+
+    for (; i + 4 <= count; i += 4) {
+        const size_t k = base + i;
+
+        __m128 hit = _mm_and_ps(
+            _mm_cmple_ps(lo_x, _mm_loadu_ps(&b.max_x[k])),
+            _mm_cmple_ps(_mm_loadu_ps(&b.min_x[k]), hi_x)
+        );
+        hit = _mm_and_ps(hit, _mm_cmple_ps(lo_y, _mm_loadu_ps(&b.max_y[k])));
+        hit = _mm_and_ps(hit, _mm_cmple_ps(_mm_loadu_ps(&b.min_y[k]), hi_y));
+        hit = _mm_and_ps(hit, _mm_cmple_ps(lo_z, _mm_loadu_ps(&b.max_z[k])));
+        hit = _mm_and_ps(hit, _mm_cmple_ps(_mm_loadu_ps(&b.min_z[k]), hi_z));
+
+        r |= (uint32_t)_mm_movemask_ps(hit) << i;
+    }
+
+    for (; i != count; i++) {
+        if (intersects(box, b[base + i])) {
+            r |= 1u << i;
+        }
+    }
+
+    return r;
+}
+#endif
+
+// Writes one visibility bit per box into mask. Each worker owns whole mask
+// words, so no two threads ever write the same word.
+template <typename T>
+void cull(const Frustum<T> &f, const AABBBatch<T> &boxes, std::vector<uint32_t> &mask) {
+    const size_t n = boxes.size();
+    mask.assign(mask_words(n), 0);
+
+    parallel_for(0, mask.size(), 256, [&](size_t lo, size_t hi) {
+        for (size_t w = lo; w != hi; w++) {
+            mask[w] = cull_word(f, boxes, w * 32, std::min<size_t>(32, n - w * 32));
+        }
+    });
+}
+
+template <typename T>
+std::vector<uint32_t> cull(const Frustum<T> &f, const AABBBatch<T> &boxes) {
+    std::vector<uint32_t> r;
+
+    cull(f, boxes, r);
+
+    return r;
+}
+
+template <typename T>
+void overlaps(const AABB<T> &box, const AABBBatch<T> &boxes, std::vector<uint32_t> &mask) {
+    const size_t n = boxes.size();
+    mask.assign(mask_words(n), 0);
+
+    parallel_for(0, mask.size(), 256, [&](size_t lo, size_t hi) {
+        for (size_t w = lo; w != hi; w++) {
+            mask[w] = overlap_word(box, boxes, w * 32, std::min<size_t>(32, n - w * 32));
+        }
+    });
+}
+
+template <typename T>
+std::vector<uint32_t> overlaps(const AABB<T> &box, const AABBBatch<T> &boxes) {
+    std::vector<uint32_t> r;
+
+    overlaps(box, boxes, r);
+
+    return r;
+}
+
+typedef AABB<int> AABBi;
+typedef AABB<float> AABBf;
+
+typedef Frustum<float> Frustumf;
+
+#endif
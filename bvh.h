@@ -0,0 +1,805 @@
+#ifndef BVH_H
+#define BVH_H
+
+#include <array>
+#include <vector>
+#include <limits>
+#include <cmath>
+#include <cstdint>
+#include <algorithm>
+#include <stdexcept>
+
+#if defined(__SSE__)
+#include <immintrin.h>
+#endif
+
+#include "geometry.h"
+#include "bounds.h"
+#include "parallel.h"
+
+// Ray
+template <typename T>
+class Ray {
+public:
+    Vec3<T> origin, direction;
+    T tmin, tmax;
+
+    Ray(): tmin(0), tmax(std::numeric_limits<T>::infinity()) {}
+
+    Ray(const Vec3<T> &origin, const Vec3<T> &direction,
+        const T tmin = 0, const T tmax = std::numeric_limits<T>::infinity()):
+        origin(origin), direction(direction), tmin(tmin), tmax(tmax)
+    {}
+
+    Vec3<T> at(const T t) const {
+        return origin + direction * t;
+    }
+};
+
+// Hit
+template <typename T>
+class Hit {
+public:
+    static constexpr size_t none = static_cast<size_t>(-1);
+
+    T t, u, v;
+    size_t triangle;
+
+    Hit(): t(std::numeric_limits<T>::infinity()), u(0), v(0), triangle(none) {}
+
+    bool found() const {
+        return triangle != none;
+    }
+};
+
+// Moller-Trumbore. Writes t, u and v into hit only when the triangle is hit
+// inside (tmin, hit.t).
+template <typename T>
+bool intersect_triangle(const Ray<T> &ray, const Vec3<T> &v0, const Vec3<T> &v1, const Vec3<T> &v2, Hit<T> &hit) {
+    const Vec3<T> e1 = v1 - v0;
+    const Vec3<T> e2 = v2 - v0;
+    const Vec3<T> p = cross(ray.direction, e2);
+    const T det = e1 * p;
+
+    if (det == 0) {
+        return false;
+    }
+
+    const T inv = 1 / det;
+    const Vec3<T> s = ray.origin - v0;
+    const T u = (s * p) * inv;
+
+    if (u < 0 || u > 1) {
+        return false;
+    }
+
+    const Vec3<T> q = cross(s, e1);
+    const T v = (ray.direction * q) * inv;
+
+    if (v < 0 || u + v > 1) {
+        return false;
+    }
+
+    const T t = (e2 * q) * inv;
+
+    if (t <= ray.tmin || t >= hit.t) {
+        return false;
+    }
+
+    hit.t = t;
+    hit.u = u;
+    hit.v = v;
+    return true;
+}
+
+// BVHNode
+//
+// A 4-wide node holding the boxes of its children in structure of arrays
+// form, so one ray can be tested against all four with a single pass.
+// A slot with count 0 is an inner node index, a slot with count > 0 is a
+// leaf covering count triangles starting at child, and an unused slot has
+// child set to BVHNode::empty.
+template <typename T>
+class BVHNode {
+public:
+    static constexpr size_t empty = static_cast<size_t>(-1);
+
+    T min_x[4], min_y[4], min_z[4];
+    T max_x[4], max_y[4], max_z[4];
+    size_t child[4];
+    uint32_t count[4];
+
+    BVHNode() {
+        for (size_t i = 0; i != 4; i++) {
+            set_bounds(i, AABB<T>());
+            child[i] = empty;
+            count[i] = 0;
+        }
+    }
+
+    AABB<T> get_bounds(const size_t i) const {
+        return AABB<T>(
+            Vec3<T>(min_x[i], min_y[i], min_z[i]),
+            Vec3<T>(max_x[i], max_y[i], max_z[i])
+        );
+    }
+
+    void set_bounds(const size_t i, const AABB<T> &b) {
+        min_x[i] = b.min.x;
+        min_y[i] = b.min.y;
+        min_z[i] = b.min.z;
+        max_x[i] = b.max.x;
+        max_y[i] = b.max.y;
+        max_z[i] = b.max.z;
+    }
+
+    AABB<T> bounds() const {
+        AABB<T> r;
+
+        for (size_t i = 0; i != 4; i++) {
+            if (child[i] != empty) {
+                r.expand(get_bounds(i));
+            }
+        }
+
+        return r;
+    }
+};
+
+// Slab test of one ray against the four child boxes of a node. Returns a bit
+// per child whose box overlaps [tmin, tmax] and writes the entry distances.
+template <typename T>
+unsigned intersect_children(const BVHNode<T> &n, const Vec3<T> &o, const Vec3<T> &inv,
+                            const T tmin, const T tmax, T *tnear) {
+    unsigned r = 0;
+
+    for (size_t i = 0; i != 4; i++) {
+        T t0 = (n.min_x[i] - o.x) * inv.x, t1 = (n.max_x[i] - o.x) * inv.x;
+        T lo = std::min(t0, t1), hi = std::max(t0, t1);
+
+        t0 = (n.min_y[i] - o.y) * inv.y;
+        t1 = (n.max_y[i] - o.y) * inv.y;
+        lo = std::max(lo, std::min(t0, t1));
+        hi = std::min(hi, std::max(t0, t1));
+
+        t0 = (n.min_z[i] - o.z) * inv.z;
+        t1 = (n.max_z[i] - o.z) * inv.z;
+        lo = std::max(lo, std::min(t0, t1));
+        hi = std::min(hi, std::max(t0, t1));
+
+        lo = std::max(lo, tmin);
+        hi = std::min(hi, tmax);
+
+        tnear[i] = lo;
+        if (lo <= hi) {
+            r |= 1u << i;
+        }
+    }
+
+    return r;
+}
+
+#if defined(__SSE__)
+inline unsigned intersect_children(const BVHNode<float> &n, const Vec3<float> &o, const Vec3<float> &inv,
+                                   const float tmin, const float tmax, float *tnear) {
+    const __m128 ox = _mm_set1_ps(o.x), ix = _mm_set1_ps(inv.x);
+    const __m128 oy = _mm_set1_ps(o.y), iy = _mm_set1_ps(inv.y);
+    const __m128 oz = _mm_set1_ps(o.z), iz = _mm_set1_ps(inv.z);
+
+    __m128 t0 = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(n.min_x), ox), ix);
+    __m128 t1 = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(n.max_x), ox), ix);
+    __m128 lo = _mm_min_ps(t0, t1), hi = _mm_max_ps(t0, t1);
+
+    t0 = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(n.min_y), oy), iy);
+    t1 = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(n.max_y), oy), iy);
+    lo = _mm_max_ps(lo, _mm_min_ps(t0, t1));
+    hi = _mm_min_ps(hi, _mm_max_ps(t0, t1));
+
+    t0 = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(n.min_z), oz), iz);
+    t1 = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(n.max_z), oz), iz);
+    lo = _mm_max_ps(lo, _mm_min_ps(t0, t1));
+    hi = _mm_min_ps(hi, _mm_max_ps(t0, t1));
+
+    lo = _mm_max_ps(lo, _mm_set1_ps(tmin));
+    hi = _mm_min_ps(hi, _mm_set1_ps(tmax));
+
+    _mm_storeu_ps(tnear, lo);
+    return _mm_movemask_ps(_mm_cmple_ps(lo, hi));
+}
+#endif
+
+// BVH
+//
+// Bounding volume hierarchy over an indexed triangle mesh. Built top down
+// with binned SAH splits into a binary tree, then collapsed into a flat
+// array of 4-wide nodes where every child is stored after its parent.
+template <typename T>
+class BVH {
+private:
+    static constexpr size_t bins = 12;
+    static constexpr size_t max_leaf = 8;
+    static constexpr size_t max_depth = 64;
+
+    class BuildNode {
+    public:
+        AABB<T> bounds;
+        size_t left, right;
+        size_t first, count;
+
+        BuildNode(): left(0), right(0), first(0), count(0) {}
+    };
+
+    class BuildJob {
+    public:
+        size_t node, first, count, depth;
+    };
+
+    std::vector<Vec3<T>> vertices;
+    std::vector<std::array<size_t, 3>> triangles;
+    std::vector<size_t> ids;
+    std::vector<BVHNode<T>> nodes;
+
+    AABB<T> triangle_bounds(const size_t i) const {
+        AABB<T> r(vertices[triangles[i][0]]);
+
+        r.expand(vertices[triangles[i][1]]);
+        r.expand(vertices[triangles[i][2]]);
+
+        return r;
+    }
+
+    size_t build_node(std::vector<BuildNode> &out, std::vector<BuildJob> *jobs, const size_t threshold,
+                      const std::vector<AABB<T>> &boxes, const std::vector<Vec3<T>> &centers,
+                      const size_t first, const size_t count, const size_t depth) {
+        const size_t index = out.size();
+        out.push_back(BuildNode());
+
+        AABB<T> bounds, cbounds;
+        for (size_t i = first; i != first + count; i++) {
+            bounds.expand(boxes[ids[i]]);
+            cbounds.expand(centers[ids[i]]);
+        }
+
+        out[index].bounds = bounds;
+
+        if (jobs && count < threshold) {
+            BuildJob job;
+            job.node = index;
+            job.first = first;
+            job.count = count;
+            job.depth = depth;
+            jobs->push_back(job);
+
+            return index;
+        }
+
+        if (count <= 2 || depth >= max_depth) {
+            out[index].first = first;
+            out[index].count = count;
+            return index;
+        }
+
+        const T leaf_cost = static_cast<T>(count);
+        T best_cost = std::numeric_limits<T>::max();
+        size_t best_axis = 0, best_bin = 0;
+
+        for (size_t axis = 0; axis != 3; axis++) {
+            const T lo = cbounds.min[axis];
+            const T extent = cbounds.max[axis] - lo;
+
+            if (extent <= 0) {
+                continue;
+            }
+
+            const T scale = bins / extent;
+            AABB<T> bin_bounds[bins];
+            size_t bin_count[bins] = {0};
+
+            for (size_t i = first; i != first + count; i++) {
+                const size_t b = std::min(bins - 1, static_cast<size_t>((centers[ids[i]][axis] - lo) * scale));
+
+                bin_bounds[b].expand(boxes[ids[i]]);
+                bin_count[b]++;
+            }
+
+            T right_area[bins];
+            size_t right_count[bins];
+            AABB<T> acc;
+            size_t n = 0;
+
+            for (size_t b = bins - 1; b != 0; b--) {
+                acc.expand(bin_bounds[b]);
+                n += bin_count[b];
+                right_area[b] = acc.surface_area();
+                right_count[b] = n;
+            }
+
+            acc = AABB<T>();
+            n = 0;
+
+            for (size_t b = 0; b != bins - 1; b++) {
+                acc.expand(bin_bounds[b]);
+                n += bin_count[b];
+
+                if (n == 0 || right_count[b + 1] == 0) {
+                    continue;
+                }
+
+                const T cost = acc.surface_area() * n + right_area[b + 1] * right_count[b + 1];
+                if (cost < best_cost) {
+                    best_cost = cost;
+                    best_axis = axis;
+                    best_bin = b;
+                }
+            }
+        }
+
+        const T area = bounds.surface_area();
+        const bool found = best_cost != std::numeric_limits<T>::max();
+
+        if (found && area > 0) {
+            best_cost = 1 + best_cost / area;
+        }
+
+        if (count <= max_leaf && (!found || best_cost >= leaf_cost)) {
+            out[index].first = first;
+            out[index].count = count;
+            return index;
+        }
+
+        size_t mid;
+
+        if (found) {
+            const T lo = cbounds.min[best_axis];
+            const T scale = bins / (cbounds.max[best_axis] - lo);
+
+            mid = std::partition(ids.begin() + first, ids.begin() + first + count, [&](size_t id) {
+                return std::min(bins - 1, static_cast<size_t>((centers[id][best_axis] - lo) * scale)) <= best_bin;
+            }) - ids.begin();
+        } else {
+            // All centroids coincide; any even split is as good as another.
+            mid = first + count / 2;
+        }
+
+        if (mid == first || mid == first + count) {
+            mid = first + count / 2;
+        }
+
+        const size_t left = build_node(out, jobs, threshold, boxes, centers, first, mid - first, depth + 1);
+        const size_t right = build_node(out, jobs, threshold, boxes, centers, mid, first + count - mid, depth + 1);
+
+        out[index].left = left;
+        out[index].right = right;
+        return index;
+    }
+
+    size_t collapse(const std::vector<BuildNode> &bn, const size_t b) {
+        const size_t index = nodes.size();
+        nodes.push_back(BVHNode<T>());
+
+        std::vector<size_t> slots;
+        if (bn[b].count) {
+            slots.push_back(b);
+        } else {
+            slots.push_back(bn[b].left);
+            slots.push_back(bn[b].right);
+        }
+
+        while (slots.size() < 4) {
+            size_t pick = slots.size();
+            T pick_area = -1;
+
+            for (size_t i = 0; i != slots.size(); i++) {
+                const BuildNode &c = bn[slots[i]];
+
+                if (c.count == 0 && c.bounds.surface_area() > pick_area) {
+                    pick = i;
+                    pick_area = c.bounds.surface_area();
+                }
+            }
+
+            if (pick == slots.size()) {
+                break;
+            }
+
+            const size_t c = slots[pick];
+            slots[pick] = bn[c].left;
+            slots.push_back(bn[c].right);
+        }
+
+        for (size_t i = 0; i != slots.size(); i++) {
+            const BuildNode &c = bn[slots[i]];
+
+            nodes[index].set_bounds(i, c.bounds);
+
+            if (c.count) {
+                nodes[index].child[i] = c.first;
+                nodes[index].count[i] = static_cast<uint32_t>(c.count);
+            } else {
+                const size_t child = collapse(bn, slots[i]);
+                nodes[index].child[i] = child;
+            }
+        }
+
+        return index;
+    }
+
+    template <bool any>
+    bool traverse(const Ray<T> &ray, Hit<T> &hit) const {
+        if (nodes.empty()) {
+            return false;
+        }
+
+        const T one = 1;
+        const Vec3<T> inv(one / ray.direction.x, one / ray.direction.y, one / ray.direction.z);
+
+        size_t stack[256];
+        size_t top = 0;
+        stack[top++] = 0;
+
+        bool found = false;
+        hit.t = ray.tmax;
+
+        while (top) {
+            const BVHNode<T> &n = nodes[stack[--top]];
+            T tnear[4];
+            const unsigned mask = intersect_children(n, ray.origin, inv, ray.tmin, hit.t, tnear);
+
+            size_t inner[4];
+            size_t inner_count = 0;
+
+            for (size_t i = 0; i != 4; i++) {
+                if (!((mask >> i) & 1) || n.child[i] == BVHNode<T>::empty) {
+                    continue;
+                }
+
+                if (n.count[i] == 0) {
+                    inner[inner_count++] = i;
+                    continue;
+                }
+
+                for (size_t k = n.child[i]; k != n.child[i] + n.count[i]; k++) {
+                    const std::array<size_t, 3> &tri = triangles[k];
+
+                    if (intersect_triangle(ray, vertices[tri[0]], vertices[tri[1]], vertices[tri[2]], hit)) {
+                        hit.triangle = ids[k];
+                        found = true;
+
+                        if (any) {
+                            return true;
+                        }
+                    }
+                }
+            }
+
+            // Push the farthest child first so the nearest one is popped next.
+            std::sort(inner, inner + inner_count, [&](size_t a, size_t b) {
+                return tnear[a] > tnear[b];
+            });
+
+            for (size_t i = 0; i != inner_count; i++) {
+                stack[top++] = n.child[inner[i]];
+            }
+        }
+
+        return found;
+    }
+
+    // Traverses up to packet rays together and returns a bit per ray that
+    // hit. Each node is fetched once for the whole packet and every child
+    // is entered with the mask of rays whose interval overlaps its box, so
+    // coherent rays share node visits, leaf loads and the stack. Children
+    // are visited nearest first by the smallest entry distance in the
+    // packet, and a ray drops out of the mask once it can no longer find a
+    // closer hit than the one it has, or, for any, once it hits.
+    template <bool any>
+    unsigned traverse_packet(const Ray<T> *rays, const size_t count, Hit<T> *hits) const {
+        if (nodes.empty() || count == 0) {
+            return 0;
+        }
+
+        const T one = 1;
+        Vec3<T> inv[packet];
+        for (size_t r = 0; r != count; r++) {
+            inv[r] = Vec3<T>(one / rays[r].direction.x, one / rays[r].direction.y, one / rays[r].direction.z);
+            hits[r].t = rays[r].tmax;
+        }
+
+        size_t stack[256];
+        unsigned stack_mask[256];
+        size_t top = 0;
+        stack[top] = 0;
+        stack_mask[top++] = (1u << count) - 1;
+
+        unsigned active = (1u << count) - 1;
+        unsigned found = 0;
+
+        while (top) {
+            top--;
+            const unsigned mask = stack_mask[top] & active;
+            if (!mask) {
+                continue;
+            }
+
+            const BVHNode<T> &n = nodes[stack[top]];
+            unsigned child_mask[4] = {0, 0, 0, 0};
+            T near[4];
+            std::fill(near, near + 4, std::numeric_limits<T>::infinity());
+
+            for (size_t r = 0; r != count; r++) {
+                if (!((mask >> r) & 1)) {
+                    continue;
+                }
+
+                T tnear[4];
+                const unsigned m = intersect_children(n, rays[r].origin, inv[r], rays[r].tmin, hits[r].t, tnear);
+
+                for (size_t i = 0; i != 4; i++) {
+                    if ((m >> i) & 1) {
+                        child_mask[i] |= 1u << r;
+                        near[i] = std::min(near[i], tnear[i]);
+                    }
+                }
+            }
+
+            size_t inner[4];
+            size_t inner_count = 0;
+
+            for (size_t i = 0; i != 4; i++) {
+                if (!child_mask[i] || n.child[i] == BVHNode<T>::empty) {
+                    continue;
+                }
+
+                if (n.count[i] == 0) {
+                    inner[inner_count++] = i;
+                    continue;
+                }
+
+                for (size_t k = n.child[i]; k != n.child[i] + n.count[i]; k++) {
+                    const std::array<size_t, 3> &tri = triangles[k];
+                    const Vec3<T> &v0 = vertices[tri[0]], &v1 = vertices[tri[1]], &v2 = vertices[tri[2]];
+
+                    for (size_t r = 0; r != count; r++) {
+                        if (!((child_mask[i] & active) >> r & 1)) {
+                            continue;
+                        }
+
+                        if (intersect_triangle(rays[r], v0, v1, v2, hits[r])) {
+                            hits[r].triangle = ids[k];
+                            found |= 1u << r;
+
+                            if (any) {
+                                active &= ~(1u << r);
+                            }
+                        }
+                    }
+                }
+
+                if (any && !active) {
+                    return found;
+                }
+            }
+
+            std::sort(inner, inner + inner_count, [&](size_t a, size_t b) {
+                return near[a] > near[b];
+            });
+
+            for (size_t i = 0; i != inner_count; i++) {
+                stack[top] = n.child[inner[i]];
+                stack_mask[top++] = child_mask[inner[i]];
+            }
+        }
+
+        return found;
+    }
+
+public:
+    // Rays the batch queries trace together.
+    static constexpr size_t packet = 4;
+
+    BVH() {}
+
+    BVH(const std::vector<Vec3<T>> &vertices, const std::vector<std::array<size_t, 3>> &triangles) {
+        build(vertices, triangles);
+    }
+
+    // Triangle soup: every three consecutive vertices form one triangle.
+    BVH(const std::vector<Vec3<T>> &vertices) {
+        if (vertices.size() % 3 != 0) {
+            throw std::length_error("vertices size should be a multiple of 3");
+        }
+
+        std::vector<std::array<size_t, 3>> t(vertices.size() / 3);
+        for (size_t i = 0; i != t.size(); i++) {
+            t[i] = {3 * i, 3 * i + 1, 3 * i + 2};
+        }
+
+        build(vertices, t);
+    }
+
+    void build(const std::vector<Vec3<T>> &v, const std::vector<std::array<size_t, 3>> &t) {
+        for (size_t i = 0; i != t.size(); i++) {
+            if (t[i][0] >= v.size() || t[i][1] >= v.size() || t[i][2] >= v.size()) {
+                throw std::out_of_range("triangle index out of bounds");
+            }
+        }
+
+        vertices = v;
+        triangles = t;
+        nodes.clear();
+
+        const size_t n = triangles.size();
+        if (n == 0) {
+            ids.clear();
+            return;
+        }
+
+        ids.resize(n);
+        std::vector<AABB<T>> boxes(n);
+        std::vector<Vec3<T>> centers(n);
+
+        parallel_for(0, n, 4096, [&](size_t lo, size_t hi) {
+            for (size_t i = lo; i != hi; i++) {
+                ids[i] = i;
+                boxes[i] = triangle_bounds(i);
+                centers[i] = boxes[i].center();
+            }
+        });
+
+        // The top of the tree is split on the calling thread until ranges are
+        // small enough to hand out, then each subtree is built independently.
+        std::vector<BuildNode> bn;
+        std::vector<BuildJob> jobs;
+        const size_t threshold = std::max<size_t>(4096, n / (8 * thread_count()));
+
+        build_node(bn, &jobs, threshold, boxes, centers, 0, n, 0);
+
+        std::vector<std::vector<BuildNode>> parts(jobs.size());
+        parallel_for(0, jobs.size(), 1, [&](size_t lo, size_t hi) {
+            for (size_t j = lo; j != hi; j++) {
+                build_node(parts[j], nullptr, 0, boxes, centers, jobs[j].first, jobs[j].count, jobs[j].depth);
+            }
+        });
+
+        for (size_t j = 0; j != jobs.size(); j++) {
+            const size_t offset = bn.size() - 1;
+
+            for (size_t i = 0; i != parts[j].size(); i++) {
+                BuildNode &p = parts[j][i];
+
+                if (p.count == 0) {
+                    p.left += offset;
+                    p.right += offset;
+                }
+            }
+
+            bn[jobs[j].node] = parts[j][0];
+            bn.insert(bn.end(), parts[j].begin() + 1, parts[j].end());
+        }
+
+        nodes.reserve(bn.size() / 2 + 1);
+        collapse(bn, 0);
+
+        std::vector<std::array<size_t, 3>> ordered(n);
+        for (size_t i = 0; i != n; i++) {
+            ordered[i] = triangles[ids[i]];
+        }
+        triangles = std::move(ordered);
+    }
+
+    // Moves the vertices of a deforming mesh and recomputes every box in
+    // place without changing the tree topology.
+    void refit(const std::vector<Vec3<T>> &v) {
+        if (v.size() != vertices.size()) {
+            throw std::length_error("vertices size should not change on refit");
+        }
+
+        vertices = v;
+
+        parallel_for(0, nodes.size(), 256, [&](size_t lo, size_t hi) {
+            for (size_t i = lo; i != hi; i++) {
+                BVHNode<T> &n = nodes[i];
+
+                for (size_t j = 0; j != 4; j++) {
+                    if (n.child[j] == BVHNode<T>::empty || n.count[j] == 0) {
+                        continue;
+                    }
+
+                    AABB<T> b;
+                    for (size_t k = n.child[j]; k != n.child[j] + n.count[j]; k++) {
+                        b.expand(triangle_bounds(k));
+                    }
+
+                    n.set_bounds(j, b);
+                }
+            }
+        });
+
+        for (size_t i = nodes.size(); i-- != 0;) {
+            BVHNode<T> &n = nodes[i];
+
+            for (size_t j = 0; j != 4; j++) {
+                if (n.child[j] != BVHNode<T>::empty && n.count[j] == 0) {
+                    n.set_bounds(j, nodes[n.child[j]].bounds());
+                }
+            }
+        }
+    }
+
+    Hit<T> intersect(const Ray<T> &ray) const {
+        Hit<T> r;
+
+        if (!traverse<false>(ray, r)) {
+            r = Hit<T>();
+        }
+
+        return r;
+    }
+
+    bool occluded(const Ray<T> &ray) const {
+        Hit<T> r;
+
+        return traverse<true>(ray, r);
+    }
+
+    // Traces consecutive rays in packets of packet, so rays that are
+    // close in the vector should also be close in space, as rays through
+    // neighboring pixels are. Packets are split over the pool. Every ray
+    // gets the same t as from intersect(ray); only when two triangles are
+    // hit at exactly the same t may the one reported differ.
+    void intersect(const std::vector<Ray<T>> &rays, std::vector<Hit<T>> &hits) const {
+        hits.assign(rays.size(), Hit<T>());
+
+        parallel_for(0, (rays.size() + packet - 1) / packet, 16, [&](size_t lo, size_t hi) {
+            for (size_t p = lo; p != hi; p++) {
+                const size_t first = p * packet;
+                const size_t count = std::min(packet, rays.size() - first);
+                const unsigned found = traverse_packet<false>(&rays[first], count, &hits[first]);
+
+                for (size_t r = 0; r != count; r++) {
+                    if (!((found >> r) & 1)) {
+                        hits[first + r] = Hit<T>();
+                    }
+                }
+            }
+        });
+    }
+
+    // One bit per ray, laid out like the visibility masks in bounds.h.
+    // Rays are traced in packets, as by intersect(rays, hits).
+    void occluded(const std::vector<Ray<T>> &rays, std::vector<uint32_t> &mask) const {
+        mask.assign(mask_words(rays.size()), 0);
+
+        parallel_for(0, mask.size(), 4, [&](size_t lo, size_t hi) {
+            Hit<T> scratch[packet];
+
+            for (size_t w = lo; w != hi; w++) {
+                const size_t end = std::min(rays.size(), w * 32 + 32);
+
+                for (size_t first = w * 32; first < end; first += packet) {
+                    const size_t count = std::min(packet, end - first);
+                    const unsigned found = traverse_packet<true>(&rays[first], count, scratch);
+
+                    mask[w] |= found << (first % 32);
+                }
+            }
+        });
+    }
+
+    AABB<T> bounds() const {
+        return nodes.empty() ? AABB<T>() : nodes[0].bounds();
+    }
+
+    size_t size() const {
+        return triangles.size();
+    }
+
+    size_t node_count() const {
+        return nodes.size();
+    }
+};
+
+typedef Ray<float> Rayf;
+typedef BVH<float> BVHf;
+
+#endif
@@ -0,0 +1,123 @@
+#ifndef CACHE_H
+#define CACHE_H
+
+#include <cstdint>
+#include <mutex>
+#include <utility>
+
+#include "geometry.h"
+
+// CachedMatrix
+//
+// A Matrix with its inverse, transpose and determinant computed on first
+// use and kept until the matrix changes. Each value is stored with the
+// version() of the matrix it came from, so mutating the matrix through
+// matrix() in any way makes the next query compute it again, and queries
+// in between are O(1).
+//
+// Writes through operator [] or data() are noticed when the pointer is
+// obtained, not when it is written through: a row pointer kept across a
+// query changes the matrix behind the cache's back, so get it again from
+// matrix() after every query.
+//
+// References returned by inverse() and transpose() stay valid, and are
+// updated in place by the next query after a mutation. Queries lock, so
+// they can be made from several threads while the matrix is not being
+// mutated.
+template <typename T>
+class CachedMatrix {
+private:
+    Matrix<T> m;
+
+    mutable std::mutex lock;
+    mutable Matrix<T> inverse_value, transpose_value;
+    mutable T determinant_value;
+    mutable bool has_inverse, has_transpose, has_determinant;
+    mutable uint64_t inverse_version, transpose_version, determinant_version;
+
+    bool current(const bool has, const uint64_t version) const {
+        return has && version == m.version();
+    }
+
+public:
+    CachedMatrix(const Matrix<T> &matrix):
+        m(matrix), determinant_value(0), has_inverse(false), has_transpose(false), has_determinant(false),
+        inverse_version(0), transpose_version(0), determinant_version(0)
+    {}
+
+    CachedMatrix(Matrix<T> &&matrix):
+        m(std::move(matrix)), determinant_value(0), has_inverse(false), has_transpose(false), has_determinant(false),
+        inverse_version(0), transpose_version(0), determinant_version(0)
+    {}
+
+    CachedMatrix(const CachedMatrix &rhs): CachedMatrix(rhs.m) {
+        std::lock_guard<std::mutex> guard(rhs.lock);
+
+        inverse_value = rhs.inverse_value;
+        transpose_value = rhs.transpose_value;
+        determinant_value = rhs.determinant_value;
+        has_inverse = rhs.has_inverse;
+        has_transpose = rhs.has_transpose;
+        has_determinant = rhs.has_determinant;
+        inverse_version = rhs.inverse_version;
+        transpose_version = rhs.transpose_version;
+        determinant_version = rhs.determinant_version;
+    }
+
+    // Assigning replaces the matrix, which drops whatever was cached.
+    CachedMatrix& operator = (const CachedMatrix &rhs) {
+        m = rhs.m;
+        return *this;
+    }
+
+    Matrix<T>& matrix() {
+        return m;
+    }
+
+    const Matrix<T>& matrix() const {
+        return m;
+    }
+
+    // Same as Matrix(matrix()).invert().
+    const Matrix<T>& inverse() const {
+        std::lock_guard<std::mutex> guard(lock);
+
+        if (!current(has_inverse, inverse_version)) {
+            has_inverse = false;
+
+            Matrix<T> r(m);
+            inverse_value = std::move(r.invert());
+            inverse_version = m.version();
+            has_inverse = true;
+        }
+
+        return inverse_value;
+    }
+
+    const Matrix<T>& transpose() const {
+        std::lock_guard<std::mutex> guard(lock);
+
+        if (!current(has_transpose, transpose_version)) {
+            Matrix<T> r(m);
+            transpose_value = std::move(r.transpose());
+            transpose_version = m.version();
+            has_transpose = true;
+        }
+
+        return transpose_value;
+    }
+
+    T determinant() const {
+        std::lock_guard<std::mutex> guard(lock);
+
+        if (!current(has_determinant, determinant_version)) {
+            determinant_value = m.determinant();
+            determinant_version = m.version();
+            has_determinant = true;
+        }
+
+        return determinant_value;
+    }
+};
+
+#endif
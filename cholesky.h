@@ -0,0 +1,413 @@
+#ifndef CHOLESKY_H
+#define CHOLESKY_H
+
+#include <vector>
+#include <cmath>
+#include <algorithm>
+#include <stdexcept>
+
+#include "geometry.h"
+#include "parallel.h"
+
+// How Cholesky factors the matrix. unblocked goes row by row; blocked
+// factors a panel of columns at a time and updates the rest of the matrix
+// with its rows split over the pool; tiled copies the matrix into square
+// tiles stored contiguously and runs the solves and updates of each step as
+// independent tile tasks on the pool.
+enum class Blocking {
+    unblocked,
+    blocked,
+    tiled
+};
+
+// Kernels on row major blocks with leading dimensions, shared by the three
+// variants. All of them read and write the lower triangle only.
+
+// In place factor of the lower triangle of the n x n block a. Returns false
+// if a pivot is not positive.
+template <typename A>
+bool cholesky_factor(A *a, const size_t lda, const size_t n) {
+    for (size_t i = 0; i != n; i++) {
+        A *ai = a + i * lda;
+
+        for (size_t j = 0; j <= i; j++) {
+            const A *aj = a + j * lda;
+            A s = ai[j];
+
+            for (size_t k = 0; k != j; k++) {
+                s -= ai[k] * aj[k];
+            }
+
+            if (j != i) {
+                ai[j] = s / aj[j];
+            } else if (s > 0) {
+                ai[i] = std::sqrt(s);
+            } else {
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
+
+// b = b L^-T for the rows x n block b and the n x n lower triangular l.
+template <typename A>
+void cholesky_solve_right(const A *l, const size_t ldl, A *b, const size_t ldb, const size_t rows, const size_t n) {
+    for (size_t r = 0; r != rows; r++) {
+        A *br = b + r * ldb;
+
+        for (size_t j = 0; j != n; j++) {
+            const A *lj = l + j * ldl;
+            A s = br[j];
+
+            for (size_t k = 0; k != j; k++) {
+                s -= br[k] * lj[k];
+            }
+
+            br[j] = s / lj[j];
+        }
+    }
+}
+
+// c = c - a b^T for the rows x cols block c, where a is rows x depth and b
+// is cols x depth. Row r of c is only updated up to column r + diagonal, so
+// diagonal blocks keep to their lower triangle.
+template <typename A>
+void cholesky_update(A *c, const size_t ldc, const A *a, const size_t lda, const A *b, const size_t ldb,
+                     const size_t rows, const size_t cols, const size_t depth, const size_t diagonal) {
+    for (size_t r = 0; r != rows; r++) {
+        A *cr = c + r * ldc;
+        const A *ar = a + r * lda;
+        const size_t last = std::min(cols, r + diagonal + 1);
+
+        for (size_t j = 0; j != last; j++) {
+            const A *bj = b + j * ldb;
+            A s = 0;
+
+            for (size_t k = 0; k != depth; k++) {
+                s += ar[k] * bj[k];
+            }
+
+            cr[j] -= s;
+        }
+    }
+}
+
+// Cholesky
+//
+// A = L L^T for a symmetric positive definite n x n matrix, of which only
+// the lower triangle is read. L is kept row major in the lower triangle of
+// an n x n array whose upper triangle is never touched. A pivot that is not
+// positive throws, so a successful factorization also proves the matrix is
+// positive definite.
+//
+// Every entry of L is computed by one thread in a fixed order, so the
+// factor does not depend on the thread count, only on the Blocking.
+template <typename T>
+class Cholesky {
+private:
+    typedef typename accumulate_type<T>::type A;
+
+    static constexpr size_t block = 64;
+
+    size_t n;
+    std::vector<A> l;
+
+    A* row(const size_t i) {
+        return l.data() + i * n;
+    }
+
+    const A* row(const size_t i) const {
+        return l.data() + i * n;
+    }
+
+    static void not_positive_definite() {
+        throw std::domain_error("matrix is not positive definite");
+    }
+
+    void factor_unblocked() {
+        if (!cholesky_factor(l.data(), n, n)) {
+            not_positive_definite();
+        }
+    }
+
+    // Right looking: factor the diagonal block of the panel, solve for the
+    // rows below it, then subtract the panel's outer product from the
+    // trailing lower triangle.
+    void factor_blocked() {
+        for (size_t k0 = 0; k0 < n; k0 += block) {
+            const size_t k1 = std::min(n, k0 + block), kb = k1 - k0;
+
+            if (!cholesky_factor(row(k0) + k0, n, kb)) {
+                not_positive_definite();
+            }
+
+            parallel_for(k1, n, 16, [&](size_t lo, size_t hi) {
+                cholesky_solve_right(row(k0) + k0, n, row(lo) + k0, n, hi - lo, kb);
+            });
+
+            parallel_for(k1, n, 16, [&](size_t lo, size_t hi) {
+                cholesky_update(row(lo) + k1, n, row(lo) + k0, n, row(k1) + k0, n, hi - lo, n - k1, kb, lo - k1);
+            });
+        }
+    }
+
+    // Tile (i, j) with j <= i of the padded matrix. The padding is the
+    // identity, whose factor is itself.
+    void factor_tiled() {
+        if (n <= block) {
+            factor_unblocked();
+            return;
+        }
+
+        const size_t count = (n + block - 1) / block;
+        const size_t area = block * block;
+        std::vector<A> tiles(count * (count + 1) / 2 * area, A(0));
+
+        auto tile = [&](size_t i, size_t j) {
+            return tiles.data() + (i * (i + 1) / 2 + j) * area;
+        };
+
+        for (size_t i = 0; i != count * block; i++) {
+            A *t = tile(i / block, i / block) + (i % block) * block;
+
+            if (i >= n) {
+                t[i % block] = 1;
+                continue;
+            }
+
+            for (size_t j = 0; j <= i; j++) {
+                tile(i / block, j / block)[(i % block) * block + j % block] = row(i)[j];
+            }
+        }
+
+        std::vector<std::pair<size_t, size_t>> updates;
+
+        for (size_t k = 0; k != count; k++) {
+            if (!cholesky_factor(tile(k, k), block, block)) {
+                not_positive_definite();
+            }
+
+            parallel_for(k + 1, count, 1, [&](size_t lo, size_t hi) {
+                for (size_t i = lo; i != hi; i++) {
+                    cholesky_solve_right(tile(k, k), block, tile(i, k), block, block, block);
+                }
+            });
+
+            updates.clear();
+            for (size_t i = k + 1; i != count; i++) {
+                for (size_t j = k + 1; j <= i; j++) {
+                    updates.push_back(std::make_pair(i, j));
+                }
+            }
+
+            parallel_for(0, updates.size(), 1, [&](size_t lo, size_t hi) {
+                for (size_t u = lo; u != hi; u++) {
+                    const size_t i = updates[u].first, j = updates[u].second;
+                    cholesky_update(tile(i, j), block, tile(i, k), block, tile(j, k), block,
+                                    block, block, block, i == j ? 0 : block);
+                }
+            });
+        }
+
+        for (size_t i = 0; i != n; i++) {
+            for (size_t j = 0; j <= i; j++) {
+                row(i)[j] = tile(i / block, j / block)[(i % block) * block + j % block];
+            }
+        }
+    }
+
+    // Solves L y = b in place for the row major n x k block c, then
+    // L^T x = y, with the columns of c split over the pool.
+    void substitute(A *c, const size_t k) const {
+        parallel_for(0, k, 64, [&](size_t lo, size_t hi) {
+            for (size_t i = 0; i != n; i++) {
+                A *ci = c + i * k;
+                const A *li = row(i);
+
+                for (size_t j = 0; j != i; j++) {
+                    const A *cj = c + j * k;
+
+                    for (size_t r = lo; r != hi; r++) {
+                        ci[r] -= li[j] * cj[r];
+                    }
+                }
+
+                for (size_t r = lo; r != hi; r++) {
+                    ci[r] /= li[i];
+                }
+            }
+
+            for (size_t i = n; i-- != 0;) {
+                A *ci = c + i * k;
+                const A *li = row(i);
+
+                for (size_t r = lo; r != hi; r++) {
+                    ci[r] /= li[i];
+                }
+
+                for (size_t j = 0; j != i; j++) {
+                    A *cj = c + j * k;
+
+                    for (size_t r = lo; r != hi; r++) {
+                        cj[r] -= li[j] * ci[r];
+                    }
+                }
+            }
+        });
+    }
+
+    std::vector<A> to_vector(const std::vector<T> &x) const {
+        if (x.size() != n) {
+            throw std::length_error("vector size should be equal to factored size");
+        }
+
+        return std::vector<A>(x.begin(), x.end());
+    }
+
+public:
+    Cholesky(const Matrix<T> &matrix, const Blocking blocking = Blocking::tiled): n(matrix.rows), l(n * n, A(0)) {
+        if (matrix.rows != matrix.cols) {
+            throw std::length_error("rows must be equal to cols for cholesky factorization");
+        }
+
+        for (size_t i = 0; i != n; i++) {
+            for (size_t j = 0; j <= i; j++) {
+                row(i)[j] = static_cast<A>(matrix[i][j]);
+            }
+        }
+
+        switch (blocking) {
+        case Blocking::unblocked:
+            factor_unblocked();
+            break;
+        case Blocking::blocked:
+            factor_blocked();
+            break;
+        case Blocking::tiled:
+            factor_tiled();
+            break;
+        }
+    }
+
+    size_t size() const {
+        return n;
+    }
+
+    // The lower triangular factor.
+    Matrix<T> factor() const {
+        Matrix<T> r(n, n);
+
+        for (size_t i = 0; i != n; i++) {
+            for (size_t j = 0; j <= i; j++) {
+                r[i][j] = static_cast<T>(row(i)[j]);
+            }
+        }
+
+        return r;
+    }
+
+    // log det A = 2 sum log L(i, i), which does not overflow where det A
+    // would.
+    A logdet() const {
+        A r = 0;
+
+        for (size_t i = 0; i != n; i++) {
+            r += std::log(row(i)[i]);
+        }
+
+        return 2 * r;
+    }
+
+    // x with A x = b for each column of b.
+    Matrix<T> solve(const Matrix<T> &b) const {
+        if (b.rows != n) {
+            throw std::length_error("matrix rows should be equal to factored size");
+        }
+
+        std::vector<A> c(n * b.cols);
+        for (size_t i = 0; i != n; i++) {
+            for (size_t j = 0; j != b.cols; j++) {
+                c[i * b.cols + j] = static_cast<A>(b[i][j]);
+            }
+        }
+
+        substitute(c.data(), b.cols);
+
+        Matrix<T> x(n, b.cols);
+        for (size_t i = 0; i != n; i++) {
+            for (size_t j = 0; j != b.cols; j++) {
+                x[i][j] = static_cast<T>(c[i * b.cols + j]);
+            }
+        }
+
+        return x;
+    }
+
+    std::vector<T> solve(const std::vector<T> &b) const {
+        std::vector<A> c = to_vector(b);
+        substitute(c.data(), 1);
+
+        return std::vector<T>(c.begin(), c.end());
+    }
+
+    // Turns the factor of A into the factor of A + x x^T, in O(n^2) with a
+    // sequence of rotations instead of refactoring.
+    void update(const std::vector<T> &x) {
+        std::vector<A> w = to_vector(x);
+
+        for (size_t k = 0; k != n; k++) {
+            const A lkk = row(k)[k];
+            const A r = std::hypot(lkk, w[k]);
+            const A c = r / lkk, s = w[k] / lkk;
+            row(k)[k] = r;
+
+            for (size_t i = k + 1; i != n; i++) {
+                A &lik = row(i)[k];
+                lik = (lik + s * w[i]) / c;
+                w[i] = c * w[i] - s * lik;
+            }
+        }
+    }
+
+    // Turns the factor of A into the factor of A - x x^T. That is positive
+    // definite exactly when |L^-1 x| < 1, which is checked first, so a
+    // downdate that throws leaves the factor as it was.
+    void downdate(const std::vector<T> &x) {
+        std::vector<A> w = to_vector(x);
+
+        A p = 0;
+        for (size_t i = 0; i != n; i++) {
+            A s = w[i];
+
+            for (size_t j = 0; j != i; j++) {
+                s -= row(i)[j] * w[j];
+            }
+
+            w[i] = s / row(i)[i];
+            p += w[i] * w[i];
+        }
+
+        if (!(p < 1)) {
+            not_positive_definite();
+        }
+
+        w.assign(x.begin(), x.end());
+
+        for (size_t k = 0; k != n; k++) {
+            const A lkk = row(k)[k];
+            const A r = std::sqrt((lkk - w[k]) * (lkk + w[k]));
+            const A c = r / lkk, s = w[k] / lkk;
+            row(k)[k] = r;
+
+            for (size_t i = k + 1; i != n; i++) {
+                A &lik = row(i)[k];
+                lik = (lik - s * w[i]) / c;
+                w[i] = c * w[i] - s * lik;
+            }
+        }
+    }
+};
+
+#endif
@@ -0,0 +1,434 @@
+#ifndef DISPATCH_H
+#define DISPATCH_H
+
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+
+// Isa
+//
+// Instruction sets the dispatched kernels are compiled for. Each kernel is
+// written once over GCC vector types of a given width and compiled into one
+// function per set with target attributes, so a binary built without any
+// -m flags carries every variant and picks one at run time.
+//
+// No variant enables FMA, and every variant does the same operations on each
+// element in the same order, so results do not depend on the set in use.
+// Only float and double have vector variants; other types use the generic
+// loops under every set.
+enum class Isa {
+    generic,
+    sse4,
+    avx2,
+    avx512
+};
+
+inline const char* isa_name(const Isa isa) {
+    switch (isa) {
+        case Isa::generic:
+            return "generic";
+        case Isa::sse4:
+            return "sse4";
+        case Isa::avx2:
+            return "avx2";
+        case Isa::avx512:
+            return "avx512";
+    }
+
+    return "generic";
+}
+
+// Best set the CPU supports, from cpuid, found once.
+inline Isa cpu_isa() {
+    static const Isa isa = [] {
+#if defined(__x86_64__) || defined(__i386__)
+        __builtin_cpu_init();
+
+        if (__builtin_cpu_supports("avx512f")) {
+            return Isa::avx512;
+        }
+
+        if (__builtin_cpu_supports("avx2")) {
+            return Isa::avx2;
+        }
+
+        if (__builtin_cpu_supports("sse4.2")) {
+            return Isa::sse4;
+        }
+#endif
+
+        return Isa::generic;
+    }();
+
+    return isa;
+}
+
+class DispatchSettings {
+private:
+    static Isa& current() {
+        static Isa isa = initial();
+        return isa;
+    }
+
+    // GEOMETRY_ISA, when it names a set, otherwise the best one.
+    static Isa initial() {
+        const char *env = std::getenv("GEOMETRY_ISA");
+
+        if (env) {
+            for (const Isa isa : {Isa::generic, Isa::sse4, Isa::avx2, Isa::avx512}) {
+                if (std::strcmp(env, isa_name(isa)) == 0) {
+                    return std::min(isa, cpu_isa());
+                }
+            }
+        }
+
+        return cpu_isa();
+    }
+
+public:
+    // Set the kernels use, from GEOMETRY_ISA when set, never above cpu_isa().
+    static Isa isa() {
+        return current();
+    }
+
+    // Switches the kernels to isa, or to cpu_isa() if the CPU does not
+    // support it, and returns the set now in use. Like the execution
+    // policy, it should not be changed while kernels are running.
+    static Isa set_isa(const Isa isa) {
+        current() = std::min(isa, cpu_isa());
+        return current();
+    }
+};
+
+// Kernel bodies over vectors of B bytes, with a scalar loop for the tail.
+// They are always inlined, so they take on the target of the function
+// they are compiled into.
+template <size_t B, typename T>
+inline __attribute__((always_inline)) void add_lanes(T *a, const T *b, const size_t n) {
+    typedef T V __attribute__((vector_size(B)));
+    const size_t w = B / sizeof(T);
+
+    size_t j = 0;
+    for (; j + w <= n; j += w) {
+        V x, y;
+        std::memcpy(&x, a + j, B);
+        std::memcpy(&y, b + j, B);
+        x += y;
+        std::memcpy(a + j, &x, B);
+    }
+
+    for (; j != n; j++) {
+        a[j] += b[j];
+    }
+}
+
+template <size_t B, typename T>
+inline __attribute__((always_inline)) void subtract_lanes(T *a, const T *b, const size_t n) {
+    typedef T V __attribute__((vector_size(B)));
+    const size_t w = B / sizeof(T);
+
+    size_t j = 0;
+    for (; j + w <= n; j += w) {
+        V x, y;
+        std::memcpy(&x, a + j, B);
+        std::memcpy(&y, b + j, B);
+        x -= y;
+        std::memcpy(a + j, &x, B);
+    }
+
+    for (; j != n; j++) {
+        a[j] -= b[j];
+    }
+}
+
+template <size_t B, typename T>
+inline __attribute__((always_inline)) void scale_lanes(T *a, const T s, const size_t n) {
+    typedef T V __attribute__((vector_size(B)));
+    const size_t w = B / sizeof(T);
+
+    size_t j = 0;
+    for (; j + w <= n; j += w) {
+        V x;
+        std::memcpy(&x, a + j, B);
+        x *= s;
+        std::memcpy(a + j, &x, B);
+    }
+
+    for (; j != n; j++) {
+        a[j] *= s;
+    }
+}
+
+template <size_t B, typename T>
+inline __attribute__((always_inline)) void divide_lanes(T *a, const T s, const size_t n) {
+    typedef T V __attribute__((vector_size(B)));
+    const size_t w = B / sizeof(T);
+
+    size_t j = 0;
+    for (; j + w <= n; j += w) {
+        V x;
+        std::memcpy(&x, a + j, B);
+        x /= s;
+        std::memcpy(a + j, &x, B);
+    }
+
+    for (; j != n; j++) {
+        a[j] /= s;
+    }
+}
+
+// y += alpha * x, the inner loop of the classical product.
+template <size_t B, typename T>
+inline __attribute__((always_inline)) void axpy_lanes(T *y, const T alpha, const T *x, const size_t n) {
+    typedef T V __attribute__((vector_size(B)));
+    const size_t w = B / sizeof(T);
+
+    size_t j = 0;
+    for (; j + w <= n; j += w) {
+        V u, v;
+        std::memcpy(&u, y + j, B);
+        std::memcpy(&v, x + j, B);
+        u += alpha * v;
+        std::memcpy(y + j, &u, B);
+    }
+
+    for (; j != n; j++) {
+        y[j] += alpha * x[j];
+    }
+}
+
+// Kernels
+//
+// Table of the dispatched kernels for T under one instruction set, filled
+// in once per set on first use. get() returns the table for
+// DispatchSettings::isa().
+template <typename T>
+class Kernels {
+public:
+    void (*add)(T *a, const T *b, size_t n);
+    void (*subtract)(T *a, const T *b, size_t n);
+    void (*scale)(T *a, T s, size_t n);
+    void (*divide)(T *a, T s, size_t n);
+    void (*axpy)(T *y, T alpha, const T *x, size_t n);
+
+    Kernels(const Isa isa);
+
+    static const Kernels& get() {
+        return table(DispatchSettings::isa());
+    }
+
+    // Out of line, so that building the tables is not inlined into every
+    // caller of get().
+    __attribute__((noinline)) static const Kernels& table(const Isa isa) {
+        static const Kernels tables[4] = {
+            Kernels(Isa::generic), Kernels(Isa::sse4), Kernels(Isa::avx2), Kernels(Isa::avx512)
+        };
+
+        return tables[static_cast<size_t>(isa)];
+    }
+};
+
+template <typename T>
+void add_generic(T *a, const T *b, const size_t n) {
+    for (size_t j = 0; j != n; j++) {
+        a[j] += b[j];
+    }
+}
+
+template <typename T>
+void subtract_generic(T *a, const T *b, const size_t n) {
+    for (size_t j = 0; j != n; j++) {
+        a[j] -= b[j];
+    }
+}
+
+template <typename T>
+void scale_generic(T *a, const T s, const size_t n) {
+    for (size_t j = 0; j != n; j++) {
+        a[j] *= s;
+    }
+}
+
+template <typename T>
+void divide_generic(T *a, const T s, const size_t n) {
+    for (size_t j = 0; j != n; j++) {
+        a[j] /= s;
+    }
+}
+
+template <typename T>
+void axpy_generic(T *y, const T alpha, const T *x, const size_t n) {
+    for (size_t j = 0; j != n; j++) {
+        y[j] += alpha * x[j];
+    }
+}
+
+// One function per kernel, type and set. The generic set uses 16 byte
+// vectors in the baseline target, which the compiler splits or scalarizes
+// where the target has no such registers.
+template <typename T>
+void add_16(T *a, const T *b, const size_t n) {
+    add_lanes<16>(a, b, n);
+}
+
+template <typename T>
+void subtract_16(T *a, const T *b, const size_t n) {
+    subtract_lanes<16>(a, b, n);
+}
+
+template <typename T>
+void scale_16(T *a, const T s, const size_t n) {
+    scale_lanes<16>(a, s, n);
+}
+
+template <typename T>
+void divide_16(T *a, const T s, const size_t n) {
+    divide_lanes<16>(a, s, n);
+}
+
+template <typename T>
+void axpy_16(T *y, const T alpha, const T *x, const size_t n) {
+    axpy_lanes<16>(y, alpha, x, n);
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+template <typename T>
+__attribute__((target("sse4.2"))) void add_sse4(T *a, const T *b, const size_t n) {
+    add_lanes<16>(a, b, n);
+}
+
+template <typename T>
+__attribute__((target("sse4.2"))) void subtract_sse4(T *a, const T *b, const size_t n) {
+    subtract_lanes<16>(a, b, n);
+}
+
+template <typename T>
+__attribute__((target("sse4.2"))) void scale_sse4(T *a, const T s, const size_t n) {
+    scale_lanes<16>(a, s, n);
+}
+
+template <typename T>
+__attribute__((target("sse4.2"))) void divide_sse4(T *a, const T s, const size_t n) {
+    divide_lanes<16>(a, s, n);
+}
+
+template <typename T>
+__attribute__((target("sse4.2"))) void axpy_sse4(T *y, const T alpha, const T *x, const size_t n) {
+    axpy_lanes<16>(y, alpha, x, n);
+}
+
+template <typename T>
+__attribute__((target("avx2"))) void add_avx2(T *a, const T *b, const size_t n) {
+    add_lanes<32>(a, b, n);
+}
+
+template <typename T>
+__attribute__((target("avx2"))) void subtract_avx2(T *a, const T *b, const size_t n) {
+    subtract_lanes<32>(a, b, n);
+}
+
+template <typename T>
+__attribute__((target("avx2"))) void scale_avx2(T *a, const T s, const size_t n) {
+    scale_lanes<32>(a, s, n);
+}
+
+template <typename T>
+__attribute__((target("avx2"))) void divide_avx2(T *a, const T s, const size_t n) {
+    divide_lanes<32>(a, s, n);
+}
+
+template <typename T>
+__attribute__((target("avx2"))) void axpy_avx2(T *y, const T alpha, const T *x, const size_t n) {
+    axpy_lanes<32>(y, alpha, x, n);
+}
+
+template <typename T>
+__attribute__((target("avx512f"))) void add_avx512(T *a, const T *b, const size_t n) {
+    add_lanes<64>(a, b, n);
+}
+
+template <typename T>
+__attribute__((target("avx512f"))) void subtract_avx512(T *a, const T *b, const size_t n) {
+    subtract_lanes<64>(a, b, n);
+}
+
+template <typename T>
+__attribute__((target("avx512f"))) void scale_avx512(T *a, const T s, const size_t n) {
+    scale_lanes<64>(a, s, n);
+}
+
+template <typename T>
+__attribute__((target("avx512f"))) void divide_avx512(T *a, const T s, const size_t n) {
+    divide_lanes<64>(a, s, n);
+}
+
+// AVX-512F has fused multiply-adds of its own, which the compiler would
+// otherwise form here from the separate multiply and add.
+template <typename T>
+__attribute__((target("avx512f"), optimize("fp-contract=off"))) void axpy_avx512(T *y, const T alpha, const T *x, const size_t n) {
+    axpy_lanes<64>(y, alpha, x, n);
+}
+#endif
+
+// Types without vector variants.
+template <typename T>
+void select_kernels(Kernels<T> &k, const Isa) {
+    k.add = add_generic<T>;
+    k.subtract = subtract_generic<T>;
+    k.scale = scale_generic<T>;
+    k.divide = divide_generic<T>;
+    k.axpy = axpy_generic<T>;
+}
+
+template <typename T>
+void select_vector_kernels(Kernels<T> &k, const Isa isa) {
+    k.add = add_16<T>;
+    k.subtract = subtract_16<T>;
+    k.scale = scale_16<T>;
+    k.divide = divide_16<T>;
+    k.axpy = axpy_16<T>;
+
+#if defined(__x86_64__) || defined(__i386__)
+    switch (isa) {
+        case Isa::generic:
+            break;
+        case Isa::sse4:
+            k.add = add_sse4<T>;
+            k.subtract = subtract_sse4<T>;
+            k.scale = scale_sse4<T>;
+            k.divide = divide_sse4<T>;
+            k.axpy = axpy_sse4<T>;
+            break;
+        case Isa::avx2:
+            k.add = add_avx2<T>;
+            k.subtract = subtract_avx2<T>;
+            k.scale = scale_avx2<T>;
+            k.divide = divide_avx2<T>;
+            k.axpy = axpy_avx2<T>;
+            break;
+        case Isa::avx512:
+            k.add = add_avx512<T>;
+            k.subtract = subtract_avx512<T>;
+            k.scale = scale_avx512<T>;
+            k.divide = divide_avx512<T>;
+            k.axpy = axpy_avx512<T>;
+            break;
+    }
+#endif
+}
+
+inline void select_kernels(Kernels<float> &k, const Isa isa) {
+    select_vector_kernels(k, isa);
+}
+
+inline void select_kernels(Kernels<double> &k, const Isa isa) {
+    select_vector_kernels(k, isa);
+}
+
+template <typename T>
+Kernels<T>::Kernels(const Isa isa) {
+    select_kernels(*this, isa);
+}
+
+#endif
@@ -0,0 +1,990 @@
+#ifndef EIGEN_H
+#define EIGEN_H
+
+#include <vector>
+#include <cmath>
+#include <limits>
+#include <algorithm>
+#include <stdexcept>
+#include <type_traits>
+
+#if defined(__SSE__)
+#include <immintrin.h>
+#endif
+
+#include "geometry.h"
+#include "parallel.h"
+
+// SymmetricEigen
+//
+// Eigenvalues and eigenvectors of a symmetric matrix: Householder reduction
+// to tridiagonal form followed by the implicit QL algorithm, after the
+// EISPACK routines tred2 and tql2. Only the lower triangle is read.
+// Eigenvalues are ascending, and column i of vectors() belongs to values()[i].
+template <typename T>
+class SymmetricEigen {
+private:
+    typedef typename accumulate_type<T>::type A;
+
+    size_t n;
+    std::vector<A> v;
+    std::vector<A> d, e;
+
+    A& at(const size_t i, const size_t j) {
+        return v[i * n + j];
+    }
+
+    void tridiagonalize() {
+        for (size_t j = 0; j != n; j++) {
+            d[j] = at(n - 1, j);
+        }
+
+        for (size_t i = n - 1; i > 0; i--) {
+            A scale = 0, h = 0;
+
+            for (size_t k = 0; k != i; k++) {
+                scale += std::fabs(d[k]);
+            }
+
+            if (scale == 0) {
+                e[i] = d[i - 1];
+
+                for (size_t j = 0; j != i; j++) {
+                    d[j] = at(i - 1, j);
+                    at(i, j) = 0;
+                    at(j, i) = 0;
+                }
+            } else {
+                for (size_t k = 0; k != i; k++) {
+                    d[k] /= scale;
+                    h += d[k] * d[k];
+                }
+
+                A f = d[i - 1];
+                A g = f > 0 ? -std::sqrt(h) : std::sqrt(h);
+
+                e[i] = scale * g;
+                h -= f * g;
+                d[i - 1] = f - g;
+
+                for (size_t j = 0; j != i; j++) {
+                    e[j] = 0;
+                }
+
+                for (size_t j = 0; j != i; j++) {
+                    f = d[j];
+                    at(j, i) = f;
+                    g = e[j] + at(j, j) * f;
+
+                    for (size_t k = j + 1; k != i; k++) {
+                        g += at(k, j) * d[k];
+                        e[k] += at(k, j) * f;
+                    }
+
+                    e[j] = g;
+                }
+
+                f = 0;
+                for (size_t j = 0; j != i; j++) {
+                    e[j] /= h;
+                    f += e[j] * d[j];
+                }
+
+                const A hh = f / (h + h);
+                for (size_t j = 0; j != i; j++) {
+                    e[j] -= hh * d[j];
+                }
+
+                for (size_t j = 0; j != i; j++) {
+                    f = d[j];
+                    g = e[j];
+
+                    for (size_t k = j; k != i; k++) {
+                        at(k, j) -= f * e[k] + g * d[k];
+                    }
+
+                    d[j] = at(i - 1, j);
+                    at(i, j) = 0;
+                }
+            }
+
+            d[i] = h;
+        }
+
+        // Accumulate the transformations.
+        for (size_t i = 0; i + 1 < n; i++) {
+            at(n - 1, i) = at(i, i);
+            at(i, i) = 1;
+
+            const A h = d[i + 1];
+            if (h != 0) {
+                for (size_t k = 0; k <= i; k++) {
+                    d[k] = at(k, i + 1) / h;
+                }
+
+                for (size_t j = 0; j <= i; j++) {
+                    A g = 0;
+
+                    for (size_t k = 0; k <= i; k++) {
+                        g += at(k, i + 1) * at(k, j);
+                    }
+
+                    for (size_t k = 0; k <= i; k++) {
+                        at(k, j) -= g * d[k];
+                    }
+                }
+            }
+
+            for (size_t k = 0; k <= i; k++) {
+                at(k, i + 1) = 0;
+            }
+        }
+
+        for (size_t j = 0; j != n; j++) {
+            d[j] = at(n - 1, j);
+            at(n - 1, j) = 0;
+        }
+
+        at(n - 1, n - 1) = 1;
+        e[0] = 0;
+    }
+
+    void diagonalize() {
+        for (size_t i = 1; i != n; i++) {
+            e[i - 1] = e[i];
+        }
+        e[n - 1] = 0;
+
+        const A eps = std::numeric_limits<A>::epsilon();
+        A f = 0, tst1 = 0;
+
+        for (size_t l = 0; l != n; l++) {
+            tst1 = std::max(tst1, std::fabs(d[l]) + std::fabs(e[l]));
+
+            size_t m = l;
+            while (m < n - 1 && std::fabs(e[m]) > eps * tst1) {
+                m++;
+            }
+
+            if (m > l) {
+                size_t iterations = 0;
+
+                do {
+                    if (++iterations > 30 * n) {
+                        throw std::domain_error("eigenvalues did not converge");
+                    }
+
+                    A g = d[l];
+                    A p = (d[l + 1] - g) / (2 * e[l]);
+                    A r = std::hypot(p, A(1));
+                    if (p < 0) {
+                        r = -r;
+                    }
+
+                    d[l] = e[l] / (p + r);
+                    d[l + 1] = e[l] * (p + r);
+
+                    const A dl1 = d[l + 1];
+                    A h = g - d[l];
+
+                    for (size_t i = l + 2; i < n; i++) {
+                        d[i] -= h;
+                    }
+                    f += h;
+
+                    p = d[m];
+                    A c = 1, c2 = 1, c3 = 1, s = 0, s2 = 0;
+                    const A el1 = e[l + 1];
+
+                    for (size_t i = m; i-- > l;) {
+                        c3 = c2;
+                        c2 = c;
+                        s2 = s;
+                        g = c * e[i];
+                        h = c * p;
+                        r = std::hypot(p, e[i]);
+                        e[i + 1] = s * r;
+                        s = e[i] / r;
+                        c = p / r;
+                        p = c * d[i] - s * g;
+                        d[i + 1] = h + s * (c * g + s * d[i]);
+
+                        for (size_t k = 0; k != n; k++) {
+                            h = at(k, i + 1);
+                            at(k, i + 1) = s * at(k, i) + c * h;
+                            at(k, i) = c * at(k, i) - s * h;
+                        }
+                    }
+
+                    p = -s * s2 * c3 * el1 * e[l] / dl1;
+                    e[l] = s * p;
+                    d[l] = c * p;
+                } while (std::fabs(e[l]) > eps * tst1);
+            }
+
+            d[l] += f;
+            e[l] = 0;
+        }
+
+        for (size_t i = 0; i + 1 < n; i++) {
+            size_t k = i;
+
+            for (size_t j = i + 1; j != n; j++) {
+                if (d[j] < d[k]) {
+                    k = j;
+                }
+            }
+
+            if (k != i) {
+                std::swap(d[i], d[k]);
+
+                for (size_t j = 0; j != n; j++) {
+                    std::swap(at(j, i), at(j, k));
+                }
+            }
+        }
+    }
+
+public:
+    SymmetricEigen(const Matrix<T> &a): n(a.rows), v(n * n), d(n), e(n) {
+        if (a.rows != a.cols) {
+            throw std::length_error("rows must be equal to cols for eigen decomposition");
+        }
+
+        for (size_t i = 0; i != n; i++) {
+            for (size_t j = 0; j <= i; j++) {
+                at(i, j) = at(j, i) = static_cast<A>(a[i][j]);
+            }
+        }
+
+        if (n != 0) {
+            tridiagonalize();
+            diagonalize();
+        }
+    }
+
+    std::vector<T> values() const {
+        return std::vector<T>(d.begin(), d.end());
+    }
+
+    Matrix<T> vectors() const {
+        Matrix<T> r(n, n);
+
+        for (size_t i = 0; i != n; i++) {
+            for (size_t j = 0; j != n; j++) {
+                r[i][j] = static_cast<T>(v[i * n + j]);
+            }
+        }
+
+        return r;
+    }
+};
+
+// SVD
+//
+// Thin singular value decomposition A = U S V^T by one-sided Jacobi: pairs
+// of columns are rotated until all of them are orthogonal, which gives
+// small singular values to high relative accuracy. Each sweep visits the
+// pairs in round robin order, so the rotations of a round touch disjoint
+// columns and run on the pool. Singular values are descending. For rank
+// deficient input the vectors of the zero singular values complete the
+// others to an orthonormal basis, so u() and v() always have orthonormal
+// columns.
+template <typename T>
+class SVD {
+private:
+    typedef typename accumulate_type<T>::type A;
+
+    size_t m, n, k;
+    std::vector<A> left, right, sigma;
+
+    // Orthogonalizes the columns of a column major rows x cols matrix w,
+    // accumulating the rotations into the cols x cols matrix z.
+    static void jacobi(const size_t rows, const size_t cols, std::vector<A> &w, std::vector<A> &z) {
+        const A eps = std::numeric_limits<A>::epsilon();
+        const size_t players = cols + cols % 2;
+        const size_t grain = std::max<size_t>(1, 16384 / std::max<size_t>(rows, 1));
+
+        z.assign(cols * cols, A(0));
+        for (size_t j = 0; j != cols; j++) {
+            z[j * cols + j] = 1;
+        }
+
+        std::vector<size_t> ring(players);
+        std::vector<char> rotated(players / 2);
+
+        for (size_t sweep = 0; sweep != 64; sweep++) {
+            bool any = false;
+
+            for (size_t i = 0; i != players; i++) {
+                ring[i] = i;
+            }
+
+            for (size_t round = 0; round + 1 < players; round++) {
+                parallel_for(0, players / 2, grain, [&](size_t lo, size_t hi) {
+                    for (size_t pair = lo; pair != hi; pair++) {
+                        const size_t p = std::min(ring[pair], ring[players - 1 - pair]);
+                        const size_t q = std::max(ring[pair], ring[players - 1 - pair]);
+                        rotated[pair] = 0;
+
+                        if (q >= cols) {
+                            continue;
+                        }
+
+                        A *wp = w.data() + p * rows, *wq = w.data() + q * rows;
+                        A alpha = 0, beta = 0, gamma = 0;
+
+                        for (size_t i = 0; i != rows; i++) {
+                            alpha += wp[i] * wp[i];
+                            beta += wq[i] * wq[i];
+                            gamma += wp[i] * wq[i];
+                        }
+
+                        if (std::fabs(gamma) <= eps * std::sqrt(alpha * beta)) {
+                            continue;
+                        }
+
+                        const A zeta = (beta - alpha) / (2 * gamma);
+                        const A t = std::copysign(A(1), zeta) / (std::fabs(zeta) + std::sqrt(1 + zeta * zeta));
+                        const A c = 1 / std::sqrt(1 + t * t);
+                        const A sn = c * t;
+
+                        for (size_t i = 0; i != rows; i++) {
+                            const A x = wp[i];
+                            wp[i] = c * x - sn * wq[i];
+                            wq[i] = sn * x + c * wq[i];
+                        }
+
+                        A *zp = z.data() + p * cols, *zq = z.data() + q * cols;
+                        for (size_t i = 0; i != cols; i++) {
+                            const A x = zp[i];
+                            zp[i] = c * x - sn * zq[i];
+                            zq[i] = sn * x + c * zq[i];
+                        }
+
+                        rotated[pair] = 1;
+                    }
+                });
+
+                for (size_t pair = 0; pair != players / 2; pair++) {
+                    any = any || rotated[pair];
+                }
+
+                // Keep the first player fixed and rotate the others.
+                std::rotate(ring.begin() + 1, ring.end() - 1, ring.end());
+            }
+
+            if (!any) {
+                return;
+            }
+        }
+    }
+
+    // Fills the zero columns of the column major rows x cols matrix w, which
+    // zero singular values leave behind, so that all columns are
+    // orthonormal. Each gets the first unit vector whose part outside the
+    // columns so far is at least the average over all unit vectors, so
+    // never small, orthogonalized against them by Gram-Schmidt done twice.
+    static void complete(const size_t rows, const size_t cols, std::vector<A> &w, const std::vector<A> &sigma) {
+        std::vector<char> filled(cols);
+        size_t used = 0;
+
+        for (size_t j = 0; j != cols; j++) {
+            filled[j] = sigma[j] != 0;
+            used += filled[j];
+        }
+
+        std::vector<A> x(rows), best(rows);
+
+        for (size_t j = 0; j != cols; j++) {
+            if (filled[j]) {
+                continue;
+            }
+
+            A best_norm = -1;
+
+            for (size_t e = 0; e != rows; e++) {
+                std::fill(x.begin(), x.end(), A(0));
+                x[e] = 1;
+
+                for (size_t pass = 0; pass != 2; pass++) {
+                    for (size_t c = 0; c != cols; c++) {
+                        if (!filled[c]) {
+                            continue;
+                        }
+
+                        const A *wc = w.data() + c * rows;
+                        A d = 0;
+
+                        for (size_t i = 0; i != rows; i++) {
+                            d += wc[i] * x[i];
+                        }
+
+                        for (size_t i = 0; i != rows; i++) {
+                            x[i] -= d * wc[i];
+                        }
+                    }
+                }
+
+                A r = 0;
+                for (size_t i = 0; i != rows; i++) {
+                    r += x[i] * x[i];
+                }
+
+                if (r > best_norm) {
+                    best_norm = r;
+                    best.swap(x);
+                }
+
+                if (best_norm * rows >= rows - used) {
+                    break;
+                }
+            }
+
+            const A scale = 1 / std::sqrt(best_norm);
+            for (size_t i = 0; i != rows; i++) {
+                w[j * rows + i] = best[i] * scale;
+            }
+
+            filled[j] = 1;
+            used++;
+        }
+    }
+
+public:
+    SVD(const Matrix<T> &a): m(a.rows), n(a.cols), k(std::min(m, n)) {
+        // Work on the transpose of wide matrices so that there are never
+        // more columns than rows.
+        const bool wide = m < n;
+        const size_t rows = wide ? n : m, cols = wide ? m : n;
+
+        std::vector<A> w(rows * cols), z;
+        for (size_t i = 0; i != m; i++) {
+            for (size_t j = 0; j != n; j++) {
+                if (wide) {
+                    w[i * rows + j] = static_cast<A>(a[i][j]);
+                } else {
+                    w[j * rows + i] = static_cast<A>(a[i][j]);
+                }
+            }
+        }
+
+        jacobi(rows, cols, w, z);
+
+        std::vector<A> norms(cols);
+        std::vector<size_t> order(cols);
+        for (size_t j = 0; j != cols; j++) {
+            A r = 0;
+
+            for (size_t i = 0; i != rows; i++) {
+                r += w[j * rows + i] * w[j * rows + i];
+            }
+
+            norms[j] = std::sqrt(r);
+            order[j] = j;
+        }
+
+        std::stable_sort(order.begin(), order.end(), [&](size_t x, size_t y) {
+            return norms[x] > norms[y];
+        });
+
+        // Columns of w normalized are the left vectors of whatever was
+        // factored, z holds the right ones; swap the roles back for wide.
+        std::vector<A> w_sorted(rows * cols, A(0)), z_sorted(cols * cols);
+        sigma.resize(cols);
+
+        for (size_t j = 0; j != cols; j++) {
+            const size_t o = order[j];
+            sigma[j] = norms[o];
+
+            if (norms[o] != 0) {
+                for (size_t i = 0; i != rows; i++) {
+                    w_sorted[j * rows + i] = w[o * rows + i] / norms[o];
+                }
+            }
+
+            for (size_t i = 0; i != cols; i++) {
+                z_sorted[j * cols + i] = z[o * cols + i];
+            }
+        }
+
+        complete(rows, cols, w_sorted, sigma);
+
+        left = std::move(wide ? z_sorted : w_sorted);
+        right = std::move(wide ? w_sorted : z_sorted);
+    }
+
+    std::vector<T> singular_values() const {
+        return std::vector<T>(sigma.begin(), sigma.end());
+    }
+
+    // m x min(m, n) with orthonormal columns.
+    Matrix<T> u() const {
+        Matrix<T> r(m, k);
+
+        for (size_t i = 0; i != m; i++) {
+            for (size_t j = 0; j != k; j++) {
+                r[i][j] = static_cast<T>(left[j * m + i]);
+            }
+        }
+
+        return r;
+    }
+
+    // n x min(m, n) with orthonormal columns.
+    Matrix<T> v() const {
+        Matrix<T> r(n, k);
+
+        for (size_t i = 0; i != n; i++) {
+            for (size_t j = 0; j != k; j++) {
+                r[i][j] = static_cast<T>(right[j * n + i]);
+            }
+        }
+
+        return r;
+    }
+
+    // Singular values above tolerance, which defaults to
+    // max(m, n) * epsilon * largest singular value.
+    size_t rank(A tolerance = -1) const {
+        if (sigma.empty()) {
+            return 0;
+        }
+
+        if (tolerance < 0) {
+            tolerance = std::max(m, n) * std::numeric_limits<A>::epsilon() * sigma[0];
+        }
+
+        return std::count_if(sigma.begin(), sigma.end(), [&](A x) { return x > tolerance; });
+    }
+};
+
+// Matrix3Batch
+//
+// Structure of arrays storage for many 3x3 matrices, element (i, j) of
+// matrix k at m[3 * i + j][k].
+template <typename T>
+class Matrix3Batch {
+public:
+    std::vector<T> m[9];
+
+    Matrix3Batch() {}
+
+    Matrix3Batch(const std::vector<Matrix<T>> &matrices) {
+        reserve(matrices.size());
+
+        for (size_t i = 0; i != matrices.size(); i++) {
+            push_back(matrices[i]);
+        }
+    }
+
+    size_t size() const {
+        return m[0].size();
+    }
+
+    void reserve(const size_t n) {
+        for (size_t e = 0; e != 9; e++) {
+            m[e].reserve(n);
+        }
+    }
+
+    void resize(const size_t n) {
+        for (size_t e = 0; e != 9; e++) {
+            m[e].resize(n);
+        }
+    }
+
+    void push_back(const Matrix<T> &a) {
+        if (a.rows != 3 || a.cols != 3) {
+            throw std::length_error("matrix size should be 3x3");
+        }
+
+        for (size_t e = 0; e != 9; e++) {
+            m[e].push_back(a[e / 3][e % 3]);
+        }
+    }
+
+    Matrix<T> operator [] (const size_t k) const {
+        Matrix<T> r(3, 3);
+
+        for (size_t e = 0; e != 9; e++) {
+            r[e / 3][e % 3] = m[e][k];
+        }
+
+        return r;
+    }
+
+    void clear() {
+        for (size_t e = 0; e != 9; e++) {
+            m[e].clear();
+        }
+    }
+};
+
+// Lane operations for the batched 3x3 kernels, which are written once over
+// a lane type: T for one matrix at a time, Float4 for four floats in SSE
+// registers. Comparisons give a mask that select() uses, so the kernels
+// have no data dependent branches.
+template <typename T>
+T lane_sqrt(const T x) {
+    return std::sqrt(x);
+}
+
+template <typename T>
+T lane_abs(const T x) {
+    return std::fabs(x);
+}
+
+template <typename T>
+T lane_sign(const T x) {
+    return std::copysign(T(1), x);
+}
+
+template <typename T>
+bool lane_less(const T a, const T b) {
+    return a < b;
+}
+
+template <typename T>
+T lane_select(const bool mask, const T a, const T b) {
+    return mask ? a : b;
+}
+
+#if defined(__SSE__)
+class Float4 {
+public:
+    __m128 v;
+
+    Float4() {}
+
+    Float4(const float f): v(_mm_set1_ps(f)) {}
+
+    Float4(const __m128 v): v(v) {}
+};
+
+inline Float4 operator + (const Float4 a, const Float4 b) {
+    return _mm_add_ps(a.v, b.v);
+}
+
+inline Float4 operator - (const Float4 a, const Float4 b) {
+    return _mm_sub_ps(a.v, b.v);
+}
+
+inline Float4 operator - (const Float4 a) {
+    return _mm_xor_ps(a.v, _mm_set1_ps(-0.0f));
+}
+
+inline Float4 operator * (const Float4 a, const Float4 b) {
+    return _mm_mul_ps(a.v, b.v);
+}
+
+inline Float4 operator / (const Float4 a, const Float4 b) {
+    return _mm_div_ps(a.v, b.v);
+}
+
+inline Float4 lane_sqrt(const Float4 x) {
+    return _mm_sqrt_ps(x.v);
+}
+
+inline Float4 lane_abs(const Float4 x) {
+    return _mm_andnot_ps(_mm_set1_ps(-0.0f), x.v);
+}
+
+inline Float4 lane_sign(const Float4 x) {
+    return _mm_or_ps(_mm_set1_ps(1.0f), _mm_and_ps(_mm_set1_ps(-0.0f), x.v));
+}
+
+inline Float4 lane_less(const Float4 a, const Float4 b) {
+    return _mm_cmplt_ps(a.v, b.v);
+}
+
+inline Float4 lane_select(const Float4 mask, const Float4 a, const Float4 b) {
+    return _mm_or_ps(_mm_and_ps(mask.v, a.v), _mm_andnot_ps(mask.v, b.v));
+}
+#endif
+
+// Cyclic Jacobi on the symmetric a, accumulating the rotations into v, for
+// a fixed number of sweeps. Each rotation uses the stable tangent formula
+// with a tiny term in the denominator, so a zero off diagonal entry gives
+// the identity rotation instead of a branch.
+template <typename V>
+void jacobi3(V a[3][3], V v[3][3], const size_t sweeps, const V tiny) {
+    static const size_t pairs[3][3] = {{0, 1, 2}, {0, 2, 1}, {1, 2, 0}};
+
+    for (size_t sweep = 0; sweep != sweeps; sweep++) {
+        for (size_t k = 0; k != 3; k++) {
+            const size_t p = pairs[k][0], q = pairs[k][1], r = pairs[k][2];
+
+            const V apq = a[p][q];
+            const V tau = a[q][q] - a[p][p];
+            const V t = V(2) * apq * lane_sign(tau) / (lane_abs(tau) + lane_sqrt(tau * tau + V(4) * apq * apq) + tiny);
+            const V c = V(1) / lane_sqrt(V(1) + t * t);
+            const V s = t * c;
+
+            a[p][p] = a[p][p] - t * apq;
+            a[q][q] = a[q][q] + t * apq;
+            a[p][q] = a[q][p] = V(0);
+
+            const V arp = a[r][p], arq = a[r][q];
+            a[r][p] = a[p][r] = c * arp - s * arq;
+            a[r][q] = a[q][r] = s * arp + c * arq;
+
+            for (size_t i = 0; i != 3; i++) {
+                const V vip = v[i][p], viq = v[i][q];
+                v[i][p] = c * vip - s * viq;
+                v[i][q] = s * vip + c * viq;
+            }
+        }
+    }
+}
+
+// Orders the diagonal of a ascending, or descending, with the columns of v.
+template <typename V>
+void sort3(V a[3][3], V v[3][3], const bool descending) {
+    static const size_t pairs[3][2] = {{0, 1}, {0, 2}, {1, 2}};
+
+    for (size_t k = 0; k != 3; k++) {
+        const size_t p = pairs[k][0], q = pairs[k][1];
+        const auto swap = descending ? lane_less(a[p][p], a[q][q]) : lane_less(a[q][q], a[p][p]);
+
+        const V ap = a[p][p], aq = a[q][q];
+        a[p][p] = lane_select(swap, aq, ap);
+        a[q][q] = lane_select(swap, ap, aq);
+
+        for (size_t i = 0; i != 3; i++) {
+            const V vp = v[i][p], vq = v[i][q];
+            v[i][p] = lane_select(swap, vq, vp);
+            v[i][q] = lane_select(swap, vp, vq);
+        }
+    }
+}
+
+template <typename V>
+void identity3(V v[3][3]) {
+    for (size_t i = 0; i != 3; i++) {
+        for (size_t j = 0; j != 3; j++) {
+            v[i][j] = V(i == j ? 1 : 0);
+        }
+    }
+}
+
+// Eigen decomposition of a symmetric 3x3: values ascending on the diagonal
+// of a, unit eigenvectors in the columns of v.
+template <typename V>
+void eigen3_kernel(V a[3][3], V v[3][3], const size_t sweeps, const V tiny) {
+    identity3(v);
+    jacobi3(a, v, sweeps, tiny);
+    sort3(a, v, false);
+}
+
+// SVD of a 3x3 after McAdams et al.: Jacobi on a^T a gives V with the
+// squared singular values sorted descending, then Givens QR of a V gives
+// U and the singular values, made non negative by flipping columns of U.
+template <typename V>
+void svd3_kernel(const V a[3][3], V u[3][3], V s[3], V v[3][3], const size_t sweeps, const V tiny) {
+    V ata[3][3];
+    for (size_t i = 0; i != 3; i++) {
+        for (size_t j = 0; j != 3; j++) {
+            ata[i][j] = a[0][i] * a[0][j] + a[1][i] * a[1][j] + a[2][i] * a[2][j];
+        }
+    }
+
+    identity3(v);
+    jacobi3(ata, v, sweeps, tiny);
+    sort3(ata, v, true);
+
+    V b[3][3];
+    for (size_t i = 0; i != 3; i++) {
+        for (size_t j = 0; j != 3; j++) {
+            b[i][j] = a[i][0] * v[0][j] + a[i][1] * v[1][j] + a[i][2] * v[2][j];
+        }
+    }
+
+    identity3(u);
+
+    static const size_t rotations[3][3] = {{0, 1, 0}, {0, 2, 0}, {1, 2, 1}};
+    for (size_t k = 0; k != 3; k++) {
+        const size_t p = rotations[k][0], q = rotations[k][1], col = rotations[k][2];
+
+        // Testing the squared norm keeps c and s accurate when the squares
+        // are subnormal.
+        const V x = b[p][col], y = b[q][col];
+        const V r2 = x * x + y * y;
+        const V r = lane_sqrt(r2);
+        const auto valid = lane_less(tiny, r2);
+        const V c = lane_select(valid, x / (r + tiny), V(1));
+        const V sn = lane_select(valid, y / (r + tiny), V(0));
+
+        for (size_t j = 0; j != 3; j++) {
+            const V bp = b[p][j], bq = b[q][j];
+            b[p][j] = c * bp + sn * bq;
+            b[q][j] = c * bq - sn * bp;
+        }
+
+        for (size_t i = 0; i != 3; i++) {
+            const V up = u[i][p], uq = u[i][q];
+            u[i][p] = c * up + sn * uq;
+            u[i][q] = c * uq - sn * up;
+        }
+    }
+
+    for (size_t j = 0; j != 3; j++) {
+        const V sign = lane_sign(b[j][j]);
+
+        s[j] = b[j][j] * sign;
+        for (size_t i = 0; i != 3; i++) {
+            u[i][j] = u[i][j] * sign;
+        }
+    }
+
+    // Rounding can leave values that are zero in exact arithmetic out of
+    // order, so sort once more with both sets of vectors.
+    static const size_t pairs[3][2] = {{0, 1}, {0, 2}, {1, 2}};
+    for (size_t k = 0; k != 3; k++) {
+        const size_t p = pairs[k][0], q = pairs[k][1];
+        const auto swap = lane_less(s[p], s[q]);
+
+        const V sp = s[p], sq = s[q];
+        s[p] = lane_select(swap, sq, sp);
+        s[q] = lane_select(swap, sp, sq);
+
+        for (size_t i = 0; i != 3; i++) {
+            const V up = u[i][p], uq = u[i][q];
+            u[i][p] = lane_select(swap, uq, up);
+            u[i][q] = lane_select(swap, up, uq);
+
+            const V vp = v[i][p], vq = v[i][q];
+            v[i][p] = lane_select(swap, vq, vp);
+            v[i][q] = lane_select(swap, vp, vq);
+        }
+    }
+}
+
+template <typename T>
+size_t jacobi3_sweeps() {
+    return sizeof(T) <= 4 ? 5 : 8;
+}
+
+// Eigen decompositions of symmetric 3x3 matrices, reading the upper
+// triangle: values[k] ascending, eigenvectors in the columns of vectors[k].
+template <typename T>
+void eigen3(const Matrix3Batch<T> &a, std::vector<Vec3<T>> &values, Matrix3Batch<T> &vectors) {
+    const size_t n = a.size();
+    const size_t sweeps = jacobi3_sweeps<T>();
+    const T tiny = std::numeric_limits<T>::min();
+
+    values.resize(n);
+    vectors.resize(n);
+
+    parallel_for(0, n, 4096, [&](size_t lo, size_t hi) {
+        size_t k = lo;
+
+#if defined(__SSE__)
+        if constexpr (std::is_same<T, float>::value) {
+            for (; k + 4 <= hi; k += 4) {
+                Float4 m[3][3], v[3][3];
+
+                for (size_t i = 0; i != 3; i++) {
+                    for (size_t j = i; j != 3; j++) {
+                        m[i][j] = m[j][i] = Float4(_mm_loadu_ps(reinterpret_cast<const float*>(&a.m[3 * i + j][k])));
+                    }
+                }
+
+                eigen3_kernel(m, v, sweeps, Float4(static_cast<float>(tiny)));
+
+                float d[3][4];
+                for (size_t i = 0; i != 3; i++) {
+                    _mm_storeu_ps(d[i], m[i][i].v);
+
+                    for (size_t j = 0; j != 3; j++) {
+                        _mm_storeu_ps(reinterpret_cast<float*>(&vectors.m[3 * i + j][k]), v[i][j].v);
+                    }
+                }
+
+                for (size_t l = 0; l != 4; l++) {
+                    values[k + l] = Vec3<T>(d[0][l], d[1][l], d[2][l]);
+                }
+            }
+        }
+#endif
+
+        for (; k != hi; k++) {
+            T m[3][3], v[3][3];
+
+            for (size_t i = 0; i != 3; i++) {
+                for (size_t j = i; j != 3; j++) {
+                    m[i][j] = m[j][i] = a.m[3 * i + j][k];
+                }
+            }
+
+            eigen3_kernel(m, v, sweeps, tiny);
+
+            values[k] = Vec3<T>(m[0][0], m[1][1], m[2][2]);
+            for (size_t e = 0; e != 9; e++) {
+                vectors.m[e][k] = v[e / 3][e % 3];
+            }
+        }
+    });
+}
+
+// Singular value decompositions of 3x3 matrices, a[k] = u[k] diag(s[k])
+// v[k]^T with s[k] descending and non negative.
+template <typename T>
+void svd3(const Matrix3Batch<T> &a, Matrix3Batch<T> &u, std::vector<Vec3<T>> &s, Matrix3Batch<T> &v) {
+    const size_t n = a.size();
+    const size_t sweeps = jacobi3_sweeps<T>();
+    const T tiny = std::numeric_limits<T>::min();
+
+    u.resize(n);
+    s.resize(n);
+    v.resize(n);
+
+    parallel_for(0, n, 4096, [&](size_t lo, size_t hi) {
+        size_t k = lo;
+
+#if defined(__SSE__)
+        if constexpr (std::is_same<T, float>::value) {
+            for (; k + 4 <= hi; k += 4) {
+                Float4 m[3][3], um[3][3], sm[3], vm[3][3];
+
+                for (size_t e = 0; e != 9; e++) {
+                    m[e / 3][e % 3] = Float4(_mm_loadu_ps(reinterpret_cast<const float*>(&a.m[e][k])));
+                }
+
+                svd3_kernel(m, um, sm, vm, sweeps, Float4(static_cast<float>(tiny)));
+
+                float d[3][4];
+                for (size_t e = 0; e != 9; e++) {
+                    _mm_storeu_ps(reinterpret_cast<float*>(&u.m[e][k]), um[e / 3][e % 3].v);
+                    _mm_storeu_ps(reinterpret_cast<float*>(&v.m[e][k]), vm[e / 3][e % 3].v);
+                }
+                for (size_t i = 0; i != 3; i++) {
+                    _mm_storeu_ps(d[i], sm[i].v);
+                }
+
+                for (size_t l = 0; l != 4; l++) {
+                    s[k + l] = Vec3<T>(d[0][l], d[1][l], d[2][l]);
+                }
+            }
+        }
+#endif
+
+        for (; k != hi; k++) {
+            T m[3][3], um[3][3], sm[3], vm[3][3];
+
+            for (size_t e = 0; e != 9; e++) {
+                m[e / 3][e % 3] = a.m[e][k];
+            }
+
+            svd3_kernel(m, um, sm, vm, sweeps, tiny);
+
+            s[k] = Vec3<T>(sm[0], sm[1], sm[2]);
+            for (size_t e = 0; e != 9; e++) {
+                u.m[e][k] = um[e / 3][e % 3];
+                v.m[e][k] = vm[e / 3][e % 3];
+            }
+        }
+    });
+}
+
+#endif
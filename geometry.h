@@ -1,11 +1,46 @@
 #ifndef GEOMETRY_H
 #define GEOMETRY_H
 
+#include <algorithm>
 #include <array>
+#include <atomic>
+#include <cstdint>
 #include <vector>
 #include <initializer_list>
 #include <stdexcept>
 #include <iostream>
+#include <cmath>
+#include <type_traits>
+
+#include "parallel.h"
+#include "dispatch.h"
+
+// Type that sums of products of T are accumulated in. Storage only types
+// such as half specialize it to a wider type.
+template <typename T>
+struct accumulate_type {
+    typedef T type;
+};
+
+template <>
+struct accumulate_type<int8_t> {
+    typedef int32_t type;
+};
+
+template <>
+struct accumulate_type<int16_t> {
+    typedef int32_t type;
+};
+
+template <>
+struct accumulate_type<uint8_t> {
+    typedef uint32_t type;
+};
+
+template <>
+struct accumulate_type<uint16_t> {
+    typedef uint32_t type;
+};
 
 template <typename T, typename U>
 T dot(std::vector<T> &lhs, std::vector<U> &rhs) {
@@ -13,7 +48,7 @@ T dot(std::vector<T> &lhs, std::vector<U> &rhs) {
         throw std::length_error("vector lhs and vector rhs should be of same size");
     }
 
-    T r = 0;
+    typename accumulate_type<T>::type r = 0;
 
     for (size_t i = 0; i != lhs.size(); i++) {
         r += lhs[i] * rhs[i];
@@ -22,6 +57,93 @@ T dot(std::vector<T> &lhs, std::vector<U> &rhs) {
     return r;
 }
 
+// Summation methods for the accumulation policy below.
+class NaiveSum {};
+class KahanSum {};
+class PairwiseSum {};
+
+// Accumulation policy: sums of products are formed in A using Method, and
+// only the final sum is converted back to the storage type. Passed to the
+// dot and multiply overloads, e.g. Accumulate<double, KahanSum>() for float
+// storage or Accumulate<int32_t>() for int16_t storage.
+template <typename A, typename Method = NaiveSum>
+class Accumulate {};
+
+template <typename A, typename T, typename U>
+A sum_products(const T *lhs, const U *rhs, const size_t n, Accumulate<A, NaiveSum>) {
+    A r = 0;
+
+    for (size_t i = 0; i != n; i++) {
+        r += static_cast<A>(lhs[i]) * static_cast<A>(rhs[i]);
+    }
+
+    return r;
+}
+
+template <typename A, typename T, typename U>
+A sum_products(const T *lhs, const U *rhs, const size_t n, Accumulate<A, KahanSum>) {
+    A r = 0;
+    A c = 0;
+
+    for (size_t i = 0; i != n; i++) {
+        const A y = static_cast<A>(lhs[i]) * static_cast<A>(rhs[i]) - c;
+        const A t = r + y;
+
+        c = (t - r) - y;
+        r = t;
+    }
+
+    return r;
+}
+
+// Blocks of up to 32 terms are summed directly and the block sums are
+// added in a balanced tree, so the error grows with log n instead of n.
+template <typename A, typename T, typename U>
+A sum_products(const T *lhs, const U *rhs, const size_t n, Accumulate<A, PairwiseSum>) {
+    if (n <= 32) {
+        return sum_products(lhs, rhs, n, Accumulate<A, NaiveSum>());
+    }
+
+    const size_t half = n / 2;
+
+    return sum_products(lhs, rhs, half, Accumulate<A, PairwiseSum>()) +
+           sum_products(lhs + half, rhs + half, n - half, Accumulate<A, PairwiseSum>());
+}
+
+template <typename A, typename M, typename T, typename U>
+A dot(const std::vector<T> &lhs, const std::vector<U> &rhs, Accumulate<A, M> policy) {
+    if (lhs.size() != rhs.size()) {
+        throw std::length_error("vector lhs and vector rhs should be of same size");
+    }
+
+    return sum_products(lhs.data(), rhs.data(), lhs.size(), policy);
+}
+
+// Execution
+//
+// How element-wise Matrix operations and reductions run. The operators use
+// ExecutionSettings::policy(), and the named member functions take a policy
+// explicitly. Matrices with fewer than ExecutionSettings::threshold()
+// elements always run serially.
+enum class Execution {
+    sequential,
+    parallel,
+    parallel_vectorized
+};
+
+class ExecutionSettings {
+public:
+    static Execution& policy() {
+        static Execution p = Execution::parallel;
+        return p;
+    }
+
+    static size_t& threshold() {
+        static size_t t = 65536;
+        return t;
+    }
+};
+
 template <typename T>
 class Matrix;
 
@@ -34,182 +156,813 @@ class Vec3;
 template <typename T>
 class Vec4;
 
+// Fixed size kernels
+//
+// Row-major N x N products, determinants and inverses for N = 2, 3 and 4,
+// unrolled by the compiler. Products form each sum in A in the same order
+// as the general loop, so they give the same result; inverses return false
+// and leave r unset when the determinant is 0.
+template <typename A, size_t N, typename T, typename U>
+void multiply_fixed(const T *a, const U *b, T *r) {
+    for (size_t i = 0; i != N; i++) {
+        for (size_t j = 0; j != N; j++) {
+            A s = 0;
+
+            for (size_t k = 0; k != N; k++) {
+                s += a[i * N + k] * b[k * N + j];
+            }
+
+            r[i * N + j] = s;
+        }
+    }
+}
+
+template <typename T>
+T determinant2(const T *a) {
+    return a[0] * a[3] - a[1] * a[2];
+}
+
+template <typename T>
+T determinant3(const T *a) {
+    return a[0] * (a[4] * a[8] - a[5] * a[7]) -
+           a[1] * (a[3] * a[8] - a[5] * a[6]) +
+           a[2] * (a[3] * a[7] - a[4] * a[6]);
+}
+
+// By the 2x2 minors of the top and bottom two rows.
+template <typename T>
+T determinant4(const T *a) {
+    const T s0 = a[0] * a[5] - a[4] * a[1];
+    const T s1 = a[0] * a[6] - a[4] * a[2];
+    const T s2 = a[0] * a[7] - a[4] * a[3];
+    const T s3 = a[1] * a[6] - a[5] * a[2];
+    const T s4 = a[1] * a[7] - a[5] * a[3];
+    const T s5 = a[2] * a[7] - a[6] * a[3];
+
+    const T c5 = a[10] * a[15] - a[14] * a[11];
+    const T c4 = a[9] * a[15] - a[13] * a[11];
+    const T c3 = a[9] * a[14] - a[13] * a[10];
+    const T c2 = a[8] * a[15] - a[12] * a[11];
+    const T c1 = a[8] * a[14] - a[12] * a[10];
+    const T c0 = a[8] * a[13] - a[12] * a[9];
+
+    return s0 * c5 - s1 * c4 + s2 * c3 + s3 * c2 - s4 * c1 + s5 * c0;
+}
+
+template <typename T>
+bool invert2(const T *a, T *r) {
+    const T d = determinant2(a);
+    if (d == 0) {
+        return false;
+    }
+
+    r[0] = a[3] / d;
+    r[1] = -a[1] / d;
+    r[2] = -a[2] / d;
+    r[3] = a[0] / d;
+
+    return true;
+}
+
+template <typename T>
+bool invert3(const T *a, T *r) {
+    const T c0 = a[4] * a[8] - a[5] * a[7];
+    const T c1 = a[5] * a[6] - a[3] * a[8];
+    const T c2 = a[3] * a[7] - a[4] * a[6];
+
+    const T d = a[0] * c0 + a[1] * c1 + a[2] * c2;
+    if (d == 0) {
+        return false;
+    }
+
+    r[0] = c0 / d;
+    r[1] = (a[2] * a[7] - a[1] * a[8]) / d;
+    r[2] = (a[1] * a[5] - a[2] * a[4]) / d;
+    r[3] = c1 / d;
+    r[4] = (a[0] * a[8] - a[2] * a[6]) / d;
+    r[5] = (a[2] * a[3] - a[0] * a[5]) / d;
+    r[6] = c2 / d;
+    r[7] = (a[1] * a[6] - a[0] * a[7]) / d;
+    r[8] = (a[0] * a[4] - a[1] * a[3]) / d;
+
+    return true;
+}
+
+template <typename T>
+bool invert4(const T *a, T *r) {
+    const T s0 = a[0] * a[5] - a[4] * a[1];
+    const T s1 = a[0] * a[6] - a[4] * a[2];
+    const T s2 = a[0] * a[7] - a[4] * a[3];
+    const T s3 = a[1] * a[6] - a[5] * a[2];
+    const T s4 = a[1] * a[7] - a[5] * a[3];
+    const T s5 = a[2] * a[7] - a[6] * a[3];
+
+    const T c5 = a[10] * a[15] - a[14] * a[11];
+    const T c4 = a[9] * a[15] - a[13] * a[11];
+    const T c3 = a[9] * a[14] - a[13] * a[10];
+    const T c2 = a[8] * a[15] - a[12] * a[11];
+    const T c1 = a[8] * a[14] - a[12] * a[10];
+    const T c0 = a[8] * a[13] - a[12] * a[9];
+
+    const T d = s0 * c5 - s1 * c4 + s2 * c3 + s3 * c2 - s4 * c1 + s5 * c0;
+    if (d == 0) {
+        return false;
+    }
+
+    r[0] = (a[5] * c5 - a[6] * c4 + a[7] * c3) / d;
+    r[1] = (-a[1] * c5 + a[2] * c4 - a[3] * c3) / d;
+    r[2] = (a[13] * s5 - a[14] * s4 + a[15] * s3) / d;
+    r[3] = (-a[9] * s5 + a[10] * s4 - a[11] * s3) / d;
+
+    r[4] = (-a[4] * c5 + a[6] * c2 - a[7] * c1) / d;
+    r[5] = (a[0] * c5 - a[2] * c2 + a[3] * c1) / d;
+    r[6] = (-a[12] * s5 + a[14] * s2 - a[15] * s1) / d;
+    r[7] = (a[8] * s5 - a[10] * s2 + a[11] * s1) / d;
+
+    r[8] = (a[4] * c4 - a[5] * c2 + a[7] * c0) / d;
+    r[9] = (-a[0] * c4 + a[1] * c2 - a[3] * c0) / d;
+    r[10] = (a[12] * s4 - a[13] * s2 + a[15] * s0) / d;
+    r[11] = (-a[8] * s4 + a[9] * s2 - a[11] * s0) / d;
+
+    r[12] = (-a[4] * c3 + a[5] * c1 - a[6] * c0) / d;
+    r[13] = (a[0] * c3 - a[1] * c1 + a[2] * c0) / d;
+    r[14] = (-a[12] * s3 + a[13] * s1 - a[14] * s0) / d;
+    r[15] = (a[8] * s3 - a[9] * s1 + a[10] * s0) / d;
+
+    return true;
+}
+
+// MatrixRow
+//
+// A row of a Matrix, as returned by its operator []. It reads and writes
+// the matrix in place and offers the parts of std::vector that rows had
+// before they shared one block: size(), begin() and end(), operator [],
+// data(), conversion to a vector, and assignment from a vector or another
+// row of the same length, which copies the elements.
+template <typename T>
+class MatrixRow {
+private:
+    T *p;
+    size_t n;
+
+public:
+    typedef typename std::remove_const<T>::type value_type;
+    typedef T* iterator;
+
+    MatrixRow(T *p, const size_t n): p(p), n(n) {}
+
+    MatrixRow(const MatrixRow&) = default;
+
+    size_t size() const {
+        return n;
+    }
+
+    bool empty() const {
+        return n == 0;
+    }
+
+    T* data() const {
+        return p;
+    }
+
+    T* begin() const {
+        return p;
+    }
+
+    T* end() const {
+        return p + n;
+    }
+
+    T& operator [] (const size_t i) const {
+        return p[i];
+    }
+
+    T& at(const size_t i) const {
+        if (i >= n) {
+            throw std::out_of_range("row index out of bounds");
+        }
+
+        return p[i];
+    }
+
+    operator std::vector<value_type> () const {
+        return std::vector<value_type>(p, p + n);
+    }
+
+    const MatrixRow& operator = (const MatrixRow &rhs) const {
+        if (rhs.n != n) {
+            throw std::length_error("row size should not change");
+        }
+
+        std::copy(rhs.p, rhs.p + n, p);
+        return *this;
+    }
+
+    template <typename U>
+    const MatrixRow& operator = (const MatrixRow<U> &rhs) const {
+        if (rhs.size() != n) {
+            throw std::length_error("row size should not change");
+        }
+
+        std::copy(rhs.begin(), rhs.end(), p);
+        return *this;
+    }
+
+    template <typename U>
+    const MatrixRow& operator = (const std::vector<U> &v) const {
+        if (v.size() != n) {
+            throw std::length_error("row size should not change");
+        }
+
+        std::copy(v.begin(), v.end(), p);
+        return *this;
+    }
+};
+
+template <typename T, typename U>
+bool operator == (const MatrixRow<T> &lhs, const MatrixRow<U> &rhs) {
+    return lhs.size() == rhs.size() && std::equal(lhs.begin(), lhs.end(), rhs.begin());
+}
+
+template <typename T, typename U>
+bool operator != (const MatrixRow<T> &lhs, const MatrixRow<U> &rhs) {
+    return !(lhs == rhs);
+}
+
+template <typename T, typename U>
+bool operator == (const MatrixRow<T> &lhs, const std::vector<U> &rhs) {
+    return lhs.size() == rhs.size() && std::equal(lhs.begin(), lhs.end(), rhs.begin());
+}
+
+template <typename T, typename U>
+bool operator != (const MatrixRow<T> &lhs, const std::vector<U> &rhs) {
+    return !(lhs == rhs);
+}
+
+// Printed like a std::vector.
+template <typename T>
+std::ostream& operator << (std::ostream &os, const MatrixRow<T> &row) {
+    for (size_t i = 0; i != row.size(); i++) {
+        os << row[i] << " ";
+    }
+
+    return os;
+}
+
 // Matrix
+//
+// Elements are stored row-major in one block, and operator [] returns a
+// MatrixRow over one row of it. Matrices of up to 16 elements keep the
+// block inside the object, so creating, copying and multiplying small
+// matrices does not allocate; square products, inverses and determinants
+// of 2x2, 3x3 and 4x4 matrices run through the fixed size kernels above.
 template <typename T>
 class Matrix {
 private:
-    std::vector<std::vector<T>> m;
+    template <typename U>
+    friend class Matrix;
+
+    static const size_t inline_size = 16;
+
+    typedef std::vector<T, FirstTouchAllocator<T>> Storage;
+
+    T local[inline_size];
+    Storage heap;
+    T *p;
+
+    // Set by every mutation and turned into a new version by the next
+    // version() call. Setting it is a load and a branch once it is set, so
+    // writes through operator [] stay cheap on many threads at once. Both
+    // are atomic because version() is const and may run on several threads.
+    mutable std::atomic<bool> changed{false};
+    mutable std::atomic<uint64_t> stamp{0};
+
+    void touch() {
+        if (!changed.load(std::memory_order_relaxed)) {
+            changed.store(true, std::memory_order_release);
+        }
+    }
+
+    // Sizes the heap block to n elements without writing them, placing new
+    // pages as NumaSettings says. allocate() and copy() then write the
+    // block by rows on the pool, so with first_touch placement each page
+    // lands on the node of the thread whose rows it holds.
+    void resize_heap(const size_t n) {
+        if (heap.capacity() < n) {
+            Storage().swap(heap);
+            heap.reserve(n);
+            place(heap.data(), n * sizeof(T), NumaSettings::placement());
+        }
+
+        heap.resize(n);
+        p = heap.data();
+    }
+
+    // Makes this an r x c matrix of value, inline when it fits.
+    void allocate(const size_t r, const size_t c, const T value = 0) {
+        rows = r;
+        cols = c;
+
+        if (r * c <= inline_size) {
+            Storage().swap(heap);
+            std::fill(local, local + r * c, value);
+            p = local;
+        } else {
+            resize_heap(r * c);
+            for_rows(ExecutionSettings::policy(), [&](size_t lo, size_t hi) {
+                std::fill(p + lo * cols, p + hi * cols, value);
+            });
+        }
+    }
+
+    void copy(const Matrix &rhs) {
+        rows = rhs.rows;
+        cols = rhs.cols;
+
+        if (rhs.p == rhs.local) {
+            Storage().swap(heap);
+            std::copy(rhs.local, rhs.local + rows * cols, local);
+            p = local;
+        } else {
+            resize_heap(rows * cols);
+            for_rows(ExecutionSettings::policy(), [&](size_t lo, size_t hi) {
+                std::copy(rhs.p + lo * cols, rhs.p + hi * cols, p + lo * cols);
+            });
+        }
+    }
+
+    // Takes the elements of rhs, leaving it 0 x 0.
+    void take(Matrix &rhs) {
+        rows = rhs.rows;
+        cols = rhs.cols;
+
+        if (rhs.p == rhs.local) {
+            Storage().swap(heap);
+            std::copy(rhs.local, rhs.local + rows * cols, local);
+            p = local;
+        } else {
+            heap = std::move(rhs.heap);
+            p = heap.data();
+        }
+
+        rhs.rows = 0;
+        rhs.cols = 0;
+        rhs.p = rhs.local;
+    }
+
+    // Changes the size to r x c, keeping the elements both sizes have and
+    // setting the others to value. Adding or removing rows of a matrix on
+    // the heap only resizes the block, so it is amortized O(cols).
+    void reshape(const size_t r, const size_t c, const T value) {
+        if (c == cols && p != local && r * c > inline_size) {
+            heap.resize(r * c, value);
+            p = heap.data();
+            rows = r;
+            return;
+        }
+
+        Matrix n(r, c, value);
+        for (size_t i = 0; i != std::min(r, rows); i++) {
+            std::copy(p + i * cols, p + i * cols + std::min(c, cols), n.p + i * c);
+        }
+
+        take(n);
+    }
+
+    // Calls f(lo, hi) over row ranges, on the pool when e allows it and the
+    // matrix is large enough.
+    template <typename F>
+    void for_rows(const Execution e, F f) const {
+        if (e == Execution::sequential || rows * cols < ExecutionSettings::threshold()) {
+            f(0, rows);
+            return;
+        }
+
+        parallel_for(0, rows, std::max<size_t>(1, 16384 / std::max<size_t>(cols, 1)), f);
+    }
+
+    template <typename U, typename Op>
+    static void apply_row(T *a, const U *b, const size_t n, const Execution e, Op op) {
+        if (e == Execution::parallel_vectorized) {
+#pragma GCC ivdep
+            for (size_t j = 0; j < n; j++) {
+                op(a[j], b[j]);
+            }
+        } else {
+            for (size_t j = 0; j != n; j++) {
+                op(a[j], b[j]);
+            }
+        }
+    }
+
+    template <typename Op>
+    static void apply_row(T *a, const size_t n, const Execution e, Op op) {
+        if (e == Execution::parallel_vectorized) {
+#pragma GCC ivdep
+            for (size_t j = 0; j < n; j++) {
+                op(a[j]);
+            }
+        } else {
+            for (size_t j = 0; j != n; j++) {
+                op(a[j]);
+            }
+        }
+    }
+
+    // Row operations go through the dispatched kernels when both operands
+    // are T, and element by element otherwise, where the arithmetic happens
+    // in the wider of the two types. Rows shorter than kernel_length stay
+    // inline, where the indirect call would cost more than it saves.
+    static const size_t kernel_length = 16;
+
+    static void row_add(T *a, const T *b, const size_t n, const Execution) {
+        if (n < kernel_length) {
+            for (size_t j = 0; j != n; j++) {
+                a[j] += b[j];
+            }
+
+            return;
+        }
+
+        Kernels<T>::get().add(a, b, n);
+    }
+
+    template <typename U>
+    static void row_add(T *a, const U *b, const size_t n, const Execution e) {
+        apply_row(a, b, n, e, [](T &a, const U &b) { a += b; });
+    }
+
+    static void row_subtract(T *a, const T *b, const size_t n, const Execution) {
+        if (n < kernel_length) {
+            for (size_t j = 0; j != n; j++) {
+                a[j] -= b[j];
+            }
+
+            return;
+        }
+
+        Kernels<T>::get().subtract(a, b, n);
+    }
+
+    template <typename U>
+    static void row_subtract(T *a, const U *b, const size_t n, const Execution e) {
+        apply_row(a, b, n, e, [](T &a, const U &b) { a -= b; });
+    }
+
+    static void row_scale(T *a, const T s, const size_t n, const Execution) {
+        if (n < kernel_length) {
+            for (size_t j = 0; j != n; j++) {
+                a[j] *= s;
+            }
+
+            return;
+        }
+
+        Kernels<T>::get().scale(a, s, n);
+    }
+
+    template <typename U>
+    static void row_scale(T *a, const U s, const size_t n, const Execution e) {
+        apply_row(a, n, e, [&](T &a) { a *= s; });
+    }
+
+    static void row_divide(T *a, const T s, const size_t n, const Execution) {
+        if (n < kernel_length) {
+            for (size_t j = 0; j != n; j++) {
+                a[j] /= s;
+            }
+
+            return;
+        }
+
+        Kernels<T>::get().divide(a, s, n);
+    }
+
+    template <typename U>
+    static void row_divide(T *a, const U s, const size_t n, const Execution e) {
+        apply_row(a, n, e, [&](T &a) { a /= s; });
+    }
 
 public:
     size_t rows;
     size_t cols;
 
-    Matrix(): m(1, std::vector<T>(1, 0)), rows(1), cols(1) {}
+    Matrix() {
+        allocate(1, 1);
+    }
+
+    Matrix(const size_t size) {
+        allocate(size, size);
 
-    Matrix(const size_t size): m(size, std::vector<T>(size)), rows(size), cols(size) {
-        for (int i = 0; i != size; i++) {
-            m[i][i] = 1;
+        for (size_t i = 0; i != size; i++) {
+            p[i * size + i] = 1;
         }
     }
 
-    Matrix(const size_t rows, const size_t cols): 
-        m(rows, std::vector<T>(cols, 0)), rows(rows), cols(cols) 
-    {}
+    Matrix(const size_t rows, const size_t cols) {
+        allocate(rows, cols);
+    }
 
-    Matrix(const size_t rows, const size_t cols, const T n): 
-        m(rows, std::vector<T>(cols, n)), rows(rows), cols(cols) 
-    {}
+    Matrix(const size_t rows, const size_t cols, const T n) {
+        allocate(rows, cols, n);
+    }
 
-    Matrix(const T* v, const size_t s): m(1, std::vector<T>(v, v + s)), rows(1), cols(s) {}
+    Matrix(const T* v, const size_t s) {
+        allocate(1, s);
+        std::copy(v, v + s, p);
+    }
 
     template <size_t S>
-    Matrix(const std::array<T, S> &v): 
-        m(1, std::vector<T>(v.begin(), v.end())), rows(1), cols(v.size()) 
-    {}
+    Matrix(const std::array<T, S> &v) {
+        allocate(1, S);
+        std::copy(v.begin(), v.end(), p);
+    }
 
-    Matrix(const std::initializer_list<T> &v): 
-        m(1, std::vector<T>(v.begin(), v.end())), rows(1), cols(v.size()) 
-    {}
+    Matrix(const std::initializer_list<T> &v) {
+        allocate(1, v.size());
+        std::copy(v.begin(), v.end(), p);
+    }
 
     template <size_t C>
-    Matrix(const T v[][C], const size_t rows, const size_t cols): 
-        m(rows, std::vector<T>(cols)), rows(rows), cols(cols) 
-    {
+    Matrix(const T v[][C], const size_t rows, const size_t cols) {
+        allocate(rows, cols);
+
         for (size_t i = 0; i != rows; i++) {
             for (size_t j = 0; j != cols; j++) {
-                m[i][j] = v[i][j];
+                p[i * cols + j] = v[i][j];
             }
         }
     }
 
     template <size_t R, size_t C>
-    Matrix(const std::array<std::array<T, C>, R> &v): 
-        m(R, std::vector<T>(C)), rows(v.size()), cols(v.begin()->size()) 
-    {
+    Matrix(const std::array<std::array<T, C>, R> &v) {
+        allocate(R, C);
+
         for (size_t i = 0; i != R; i++) {
             for (size_t j = 0; j != C; j++) {
-                m[i][j] = v[i][j];
+                p[i * C + j] = v[i][j];
             }
         }
     }
 
-    Matrix(Vec2<T> &v);
-    Matrix(Vec3<T> &v);
-    Matrix(Vec4<T> &v);
+    Matrix(const Matrix &rhs):
+        changed(rhs.changed.load(std::memory_order_relaxed)), stamp(rhs.stamp.load(std::memory_order_relaxed))
+    {
+        copy(rhs);
+    }
 
-    Matrix(const std::initializer_list<std::initializer_list<T>> &v): 
-        m(v.size(), std::vector<T>(v.begin()->size())), 
-        rows(v.size()), 
-        cols(v.begin()->size()) 
+    Matrix(Matrix &&rhs) noexcept:
+        changed(rhs.changed.load(std::memory_order_relaxed)), stamp(rhs.stamp.load(std::memory_order_relaxed))
     {
-        for (size_t i = 0; i != v.size(); i++) {
-            for (size_t j = 0; j != v.begin()->size(); j++) {
-                m[i][j] = v.begin()[i].begin()[j];
+        take(rhs);
+    }
+
+    // Assignment is a mutation of this matrix; the version of rhs is not
+    // carried over.
+    Matrix& operator = (const Matrix &rhs) {
+        touch();
+
+        if (this != &rhs) {
+            copy(rhs);
+        }
+
+        return *this;
+    }
+
+    Matrix& operator = (Matrix &&rhs) noexcept {
+        touch();
+
+        if (this != &rhs) {
+            take(rhs);
+        }
+
+        return *this;
+    }
+
+    Matrix(const Vec2<T> &v);
+    Matrix(const Vec3<T> &v);
+    Matrix(const Vec4<T> &v);
+
+    Matrix(const std::initializer_list<std::initializer_list<T>> &v) {
+        allocate(v.size(), v.begin()->size());
+
+        for (size_t i = 0; i != rows; i++) {
+            for (size_t j = 0; j != cols; j++) {
+                p[i * cols + j] = v.begin()[i].begin()[j];
             }
         }
     }
 
-    const std::vector<T>& operator [] (const size_t i) const {
-        return m[i];
+    MatrixRow<const T> operator [] (const size_t i) const {
+        return MatrixRow<const T>(p + i * cols, cols);
     }
 
-    std::vector<T>& operator [] (const size_t i) {
-        return m[i];
+    // Counts as a mutation, since the row can be written through. The
+    // mutation is recorded when the row is handed out, not when it is
+    // written through, so code that tracks version() should not keep the
+    // row past its next version() call.
+    MatrixRow<T> operator [] (const size_t i) {
+        touch();
+        return MatrixRow<T>(p + i * cols, cols);
+    }
+
+    // The rows * cols elements, row-major.
+    const T* data() const {
+        return p;
+    }
+
+    T* data() {
+        touch();
+        return p;
+    }
+
+    // Changes whenever the matrix has been mutated since the last call, and
+    // never goes back to an earlier value, so a value derived from the
+    // matrix can be stored with the version it was derived at. Safe to call
+    // from several threads at once; a call racing with the one that takes
+    // the new version may still return the old one, which only makes a
+    // cache compute its value again later.
+    uint64_t version() const {
+        if (changed.exchange(false, std::memory_order_acq_rel)) {
+            return stamp.fetch_add(1, std::memory_order_acq_rel) + 1;
+        }
+
+        return stamp.load(std::memory_order_acquire);
     }
 
     template <typename U>
     Matrix& operator += (const Matrix<U> &rhs) {
-        for (size_t i = 0; i != rows; i++) {
-            for (int j = 0; j != cols; j++) {
-                m[i][j] += rhs[i][j];
+        return add(rhs, ExecutionSettings::policy());
+    }
+
+    template <typename U>
+    Matrix& operator += (const U rhs) {
+        return add(rhs, ExecutionSettings::policy());
+    }
+
+    template <typename U>
+    Matrix& add(const Matrix<U> &rhs, const Execution e) {
+        touch();
+
+        for_rows(e, [&](size_t lo, size_t hi) {
+            for (size_t i = lo; i != hi; i++) {
+                row_add(p + i * cols, rhs[i].data(), cols, e);
             }
-        }
+        });
 
         return *this;
     }
 
     template <typename U>
-    Matrix& operator += (const U rhs) {
-        for(size_t i = 0; i != rows; i++) {
-            for (size_t j = 0; j != cols; j++) {
-                m[i][j] += rhs;
+    Matrix& add(const U rhs, const Execution e) {
+        touch();
+
+        for_rows(e, [&](size_t lo, size_t hi) {
+            for (size_t i = lo; i != hi; i++) {
+                apply_row(p + i * cols, cols, e, [&](T &a) { a += rhs; });
             }
-        }
+        });
 
         return *this;
     }
 
     template <typename U>
     Matrix& operator -= (const Matrix<U> &rhs) {
-        for (size_t i = 0; i != rows; i++) {
-            for (size_t j = 0; j != cols; j++) {
-                m[i][j] -= rhs[i][j];
+        return subtract(rhs, ExecutionSettings::policy());
+    }
+
+    template <typename U>
+    Matrix& operator -= (const U rhs) {
+        return subtract(rhs, ExecutionSettings::policy());
+    }
+
+    template <typename U>
+    Matrix& subtract(const Matrix<U> &rhs, const Execution e) {
+        touch();
+
+        for_rows(e, [&](size_t lo, size_t hi) {
+            for (size_t i = lo; i != hi; i++) {
+                row_subtract(p + i * cols, rhs[i].data(), cols, e);
             }
-        }
+        });
 
         return *this;
     }
 
     template <typename U>
-    Matrix& operator -= (const U rhs) {
-        for(size_t i = 0; i != rows; i++) {
-            for (size_t j = 0; j != cols; j++) {
-                m[i][j] -= rhs;
+    Matrix& subtract(const U rhs, const Execution e) {
+        touch();
+
+        for_rows(e, [&](size_t lo, size_t hi) {
+            for (size_t i = lo; i != hi; i++) {
+                apply_row(p + i * cols, cols, e, [&](T &a) { a -= rhs; });
             }
-        }
+        });
 
         return *this;
     }
 
     template <typename U>
     Matrix& operator *= (const Matrix<U> &rhs) {
-        if (cols != rhs.m.size()) {
+        touch();
+
+        if (cols != rhs.rows) {
             throw std::length_error("first matrices columns should be equal to second matrices rows");
         }
 
-        size_t rhs_cols = rhs.m.begin()->size();
-        std::vector<std::vector<T>> r(rows, std::vector<T>(rhs_cols, 0));
+        typedef typename accumulate_type<T>::type A;
+
+        Matrix r(rows, rhs.cols);
+
+        if (rows == cols && cols == rhs.cols && rows >= 2 && rows <= 4) {
+            switch (rows) {
+                case 2:
+                    multiply_fixed<A, 2>(p, rhs.p, r.p);
+                    break;
+                case 3:
+                    multiply_fixed<A, 3>(p, rhs.p, r.p);
+                    break;
+                case 4:
+                    multiply_fixed<A, 4>(p, rhs.p, r.p);
+                    break;
+            }
+        } else {
+            for (size_t i = 0; i != rows; i++) {
+                for (size_t j = 0; j != rhs.cols; j++) {
+                    A s = 0;
 
-        for (size_t i = 0; i != rows; i++) {
-            for (size_t j = 0; j != rhs_cols; j++) {
-                std::vector<T> row(cols, 0);
-                std::vector<U> col(cols, 0);
+                    for (size_t k = 0; k != cols; k++) {
+                        s += p[i * cols + k] * rhs.p[k * rhs.cols + j];
+                    }
 
-                for (size_t k = 0; k != cols; k++) {
-                    row[k] = m[i][k];
+                    r.p[i * rhs.cols + j] = s;
                 }
+            }
+        }
+
+        take(r);
+        return *this;
+    }
+
+    // Same as *= with the sums formed according to policy.
+    template <typename U, typename A, typename M>
+    Matrix& multiply(const Matrix<U> &rhs, Accumulate<A, M> policy) {
+        touch();
+
+        if (cols != rhs.rows) {
+            throw std::length_error("first matrices columns should be equal to second matrices rows");
+        }
 
-                for (size_t k = 0; k != cols; k++) {
-                    col[k] = rhs.m[k][j];
-                }
+        std::vector<U> rhs_t(rhs.cols * rhs.rows);
+        for (size_t i = 0; i != rhs.rows; i++) {
+            for (size_t j = 0; j != rhs.cols; j++) {
+                rhs_t[j * rhs.rows + i] = rhs[i][j];
+            }
+        }
 
-                r[i][j] = dot(row, col);
+        Matrix r(rows, rhs.cols);
+        for (size_t i = 0; i != rows; i++) {
+            for (size_t j = 0; j != rhs.cols; j++) {
+                r.p[i * rhs.cols + j] = static_cast<T>(sum_products(p + i * cols, rhs_t.data() + j * rhs.rows, cols, policy));
             }
         }
 
-        m = std::move(r);
-        cols = rhs_cols;
+        take(r);
         return *this;
     }
 
     template <typename U>
     Matrix& operator *= (const U rhs) {
-        for(size_t i = 0; i != rows; i++) {
-            for (size_t j = 0; j != cols; j++) {
-                m[i][j] *= rhs;
+        return scale(rhs, ExecutionSettings::policy());
+    }
+
+    template <typename U>
+    Matrix& scale(const U rhs, const Execution e) {
+        touch();
+
+        for_rows(e, [&](size_t lo, size_t hi) {
+            for (size_t i = lo; i != hi; i++) {
+                row_scale(p + i * cols, rhs, cols, e);
             }
-        }
+        });
 
         return *this;
     }
 
     template <typename U>
     Matrix& operator /= (const U rhs) {
-        for(size_t i = 0; i != rows; i++) {
-            for (size_t j = 0; j != cols; j++) {
-                m[i][j] /= rhs;
+        return divide(rhs, ExecutionSettings::policy());
+    }
+
+    template <typename U>
+    Matrix& divide(const U rhs, const Execution e) {
+        touch();
+
+        for_rows(e, [&](size_t lo, size_t hi) {
+            for (size_t i = lo; i != hi; i++) {
+                row_divide(p + i * cols, rhs, cols, e);
             }
-        }
+        });
 
         return *this;
     }
@@ -218,54 +971,79 @@ public:
         std::vector<T> r(rows);
 
         for (size_t j = 0; j != rows; j++) {
-            r[j] = m[j][i];
+            r[j] = p[j * cols + i];
         }
 
         return r;
     }
 
     std::vector<T> get_row(const size_t i) const {
-        std::vector<T> r(cols);
-
-        for (size_t j = 0; j != cols; j++) {
-            r[j] = m[i][j];
-        }
-
-        return r;
+        return std::vector<T>(p + i * cols, p + (i + 1) * cols);
     }
 
     Matrix& transpose() {
-        std::vector<std::vector<T> > r(cols, std::vector<T>(rows, 0));
+        touch();
+
+        if (rows == cols) {
+            for (size_t i = 0; i != rows; i++) {
+                for (size_t j = i + 1; j != cols; j++) {
+                    std::swap(p[i * cols + j], p[j * cols + i]);
+                }
+            }
+
+            return *this;
+        }
+
+        Matrix r(cols, rows);
 
         for (size_t i = 0; i != rows; i++) {
             for (size_t j = 0; j != cols; j++) {
-                r[j][i] = m[i][j];
+                r.p[j * rows + i] = p[i * cols + j];
             }
         }
 
-        size_t old_rows = rows;
-        rows = cols;
-        cols = old_rows;
-
-        m = std::move(r);
+        take(r);
         return *this;
     }
 
     Matrix& invert() {
+        touch();
+
         if (rows != cols) {
             throw std::length_error("rows must be equal to cols for inversion");
         }
 
-        std::vector<std::vector<T>> r(rows, std::vector<T>(cols, 0));
-        for (size_t i = 0; i != rows; i++) {
-            r[i][i] = 1;
+        // The closed forms divide by the determinant, so singular matrices
+        // go through elimination to fail the same way at any size.
+        if (std::is_floating_point<T>::value && rows >= 2 && rows <= 4) {
+            T r[inline_size];
+            bool inverted = false;
+
+            switch (rows) {
+                case 2:
+                    inverted = invert2(p, r);
+                    break;
+                case 3:
+                    inverted = invert3(p, r);
+                    break;
+                case 4:
+                    inverted = invert4(p, r);
+                    break;
+            }
+
+            if (inverted) {
+                std::copy(r, r + rows * cols, p);
+                return *this;
+            }
         }
 
+        Matrix r(rows);
+
         for (size_t i = 0; i != cols; i++) {
-            if (m[i][i] == 0) {
+            if (p[i * cols + i] == 0) {
                 size_t row = i;
                 for (size_t j = 0; j != rows; j++) {
-                    if (m[j][i] > m[row][i]) {
+                    if (p[j * cols + i] > p[row * cols + i]) {
                         row = j;
                     }
                 }
@@ -273,144 +1051,213 @@ public:
                 if (row == i) {
                     throw std::logic_error("one or more matrix columns has all 0 values");
                 } else {
-                    std::swap(m[i], m[row]);
-                    std::swap(r[i], r[row]);
+                    std::swap_ranges(p + i * cols, p + (i + 1) * cols, p + row * cols);
+                    std::swap_ranges(r.p + i * cols, r.p + (i + 1) * cols, r.p + row * cols);
                 }
             }
         }
 
         for (size_t i = 0; i != cols - 1; i++) {
             for (size_t j = i + 1; j != rows; j++) {
-                const T val = m[j][i] / m[i][i];
+                const T val = p[j * cols + i] / p[i * cols + i];
 
                 for (size_t k = 0; k != cols; k++) {
-                    m[j][k] -= val * m[i][k]; 
-                    r[j][k] -= val * r[i][k];
+                    p[j * cols + k] -= val * p[i * cols + k];
+                    r.p[j * cols + k] -= val * r.p[i * cols + k];
                 }
 
-                m[j][i] = 0;
+                p[j * cols + i] = 0;
             }
         }
 
         for (size_t i = 0; i != rows; i++) {
-            const T val = m[i][i];
+            const T val = p[i * cols + i];
 
             for (size_t j = 0; j != cols; j++) {
-                m[i][j] /= val;
-                r[i][j] /= val;
+                p[i * cols + j] /= val;
+                r.p[i * cols + j] /= val;
             }
 
-            m[i][i] = 1;
+            p[i * cols + i] = 1;
         }
 
         for (size_t i = 0; i != rows; i++) {
             for (size_t j = i + 1; j != cols; j++) {
-                const T val = m[i][j];
+                const T val = p[i * cols + j];
 
                 for (size_t k = 0; k != cols; k++) {
-                    m[i][k] -= val * m[j][k];  
-                    r[i][k] -= val * r[j][k];
+                    p[i * cols + k] -= val * p[j * cols + k];
+                    r.p[i * cols + k] -= val * r.p[j * cols + k];
                 }
 
-                m[i][j] = 0;
+                p[i * cols + j] = 0;
             }
         }
 
-        m = std::move(r);
+        take(r);
         return *this;
     }
 
-    void clear() {
-        for (size_t i = 0; i != rows; i++) {
-            for (size_t j = 0; j != cols; j++) {
-                m[i][j] = 0;
+    // By LU decomposition with partial pivoting, or the closed form up to
+    // 4x4, in accumulate_type<T>, or in double rounded back for integer
+    // matrices.
+    T determinant() const {
+        if (rows != cols) {
+            throw std::length_error("rows must be equal to cols for determinant");
+        }
+
+        typedef typename accumulate_type<T>::type A;
+        typedef typename std::conditional<std::is_integral<A>::value, double, A>::type D;
+
+        D r = 1;
+
+        if (rows >= 2 && rows <= 4) {
+            D a[inline_size];
+            for (size_t i = 0; i != rows * cols; i++) {
+                a[i] = static_cast<D>(p[i]);
+            }
+
+            switch (rows) {
+                case 2:
+                    r = determinant2(a);
+                    break;
+                case 3:
+                    r = determinant3(a);
+                    break;
+                case 4:
+                    r = determinant4(a);
+                    break;
             }
+
+            if (std::is_integral<A>::value) {
+                return static_cast<T>(std::llround(r));
+            }
+
+            return static_cast<T>(r);
         }
-    }
 
-    void to_identity(size_t size) {
-        std::vector<std::vector<T> > r(size, std::vector<T>(size, 0));
+        std::vector<D> a(rows * cols);
+        for (size_t i = 0; i != rows * cols; i++) {
+            a[i] = static_cast<D>(p[i]);
+        }
 
-        for (size_t i = 0; i != size; i++) {
-            r[i][i] = 1;
+        for (size_t k = 0; k != rows; k++) {
+            size_t pivot = k;
+            for (size_t i = k + 1; i != rows; i++) {
+                if (std::fabs(a[i * cols + k]) > std::fabs(a[pivot * cols + k])) {
+                    pivot = i;
+                }
+            }
+
+            if (a[pivot * cols + k] == 0) {
+                return T(0);
+            }
+
+            if (pivot != k) {
+                for (size_t j = k; j != cols; j++) {
+                    std::swap(a[k * cols + j], a[pivot * cols + j]);
+                }
+
+                r = -r;
+            }
+
+            r *= a[k * cols + k];
+
+            for (size_t i = k + 1; i != rows; i++) {
+                const D f = a[i * cols + k] / a[k * cols + k];
+
+                for (size_t j = k + 1; j != cols; j++) {
+                    a[i * cols + j] -= f * a[k * cols + j];
+                }
+            }
         }
 
-        rows = size;
-        cols = size;
+        if (std::is_integral<A>::value) {
+            return static_cast<T>(std::llround(r));
+        }
+
+        return static_cast<T>(r);
+    }
+
+    void clear(const Execution e = ExecutionSettings::policy()) {
+        touch();
+
+        for_rows(e, [&](size_t lo, size_t hi) {
+            for (size_t i = lo; i != hi; i++) {
+                apply_row(p + i * cols, cols, e, [](T &a) { a = 0; });
+            }
+        });
+    }
+
+    void to_identity(size_t size) {
+        touch();
 
-        m = std::move(r);
+        Matrix r(size);
+        take(r);
     }
 
     void add_row(T value = 0) {
-        m.push_back(std::vector<T>(cols, value));
+        touch();
 
-        rows++;
+        reshape(rows + 1, cols, value);
     }
 
     void add_rows(size_t arows, T value = 0) {
-        m.insert(m.end(), arows, std::vector<T>(cols, value));
+        touch();
 
-        rows += arows;
+        reshape(rows + arows, cols, value);
     }
 
     void remove_row() {
+        touch();
+
         if (rows == 1) {
             throw std::length_error("matrix rows can not be below 1");
         }
 
-        m.pop_back();
-
-        rows--;
+        reshape(rows - 1, cols, 0);
     }
 
     void remove_rows(size_t arows) {
+        touch();
+
         if (rows <= arows) {
             throw std::length_error("arows should not be greater then rows");
         }
 
-        m.erase(m.end() - arows, m.end());
-
-        rows -= arows;
+        reshape(rows - arows, cols, 0);
     }
 
     void add_col(T value = 0) {
-        for (size_t i = 0; i != rows; i++) {
-            m[i].push_back(value);
-        }
+        touch();
 
-        cols++;
+        reshape(rows, cols + 1, value);
     }
 
     void add_cols(size_t acols, T value = 0) {
-        for (size_t i = 0; i != rows; i++) {
-            m[i].insert(m[i].end(), acols, value);
-        }
+        touch();
 
-        cols += acols;
+        reshape(rows, cols + acols, value);
     }
 
     void remove_col() {
+        touch();
+
         if (cols == 1) {
             throw std::length_error("matrix cols can not be below 1");
         }
 
-        for (size_t i = 0; i != rows; i++) {
-            m[i].pop_back();
-        }
-
-        cols--;
+        reshape(rows, cols - 1, 0);
     }
 
     void remove_cols(size_t acols) {
+        touch();
+
         if (cols <= acols) {
             throw std::length_error("acols should not be greater then cols");
         }
 
-        for (size_t i = 0; i != rows; i++) {
-            m[i].erase(m[i].end() - acols, m[i].end());
-        }
-
-        cols -= acols;
+        reshape(rows, cols - acols, 0);
     }
 };
 
@@ -459,6 +1306,15 @@ Matrix<T> operator * (const Matrix<T> &lhs, const Matrix<U> &rhs) {
     return r;
 }
 
+template <typename T, typename U, typename A, typename M>
+Matrix<T> multiply(const Matrix<T> &lhs, const Matrix<U> &rhs, Accumulate<A, M> policy) {
+    Matrix<T> r(lhs);
+
+    r.multiply(rhs, policy);
+
+    return r;
+}
+
 template <typename T, typename U>
 Matrix<T> operator * (const Matrix<T> &lhs, const U rhs) {
     Matrix<T> r(lhs);
@@ -477,6 +1333,69 @@ Matrix<T> operator / (const Matrix<T> &lhs, const U rhs) {
     return r;
 }
 
+// Sums f(row, cols) over fixed blocks of rows in block order, so the result
+// does not depend on the policy or the number of threads.
+template <typename T, typename F>
+typename accumulate_type<T>::type reduce_rows(const Matrix<T> &m, const Execution e, F f) {
+    typedef typename accumulate_type<T>::type A;
+
+    const size_t block = std::max<size_t>(1, 16384 / std::max<size_t>(m.cols, 1));
+    const size_t blocks = (m.rows + block - 1) / block;
+    std::vector<A> partial(blocks, 0);
+
+    const bool serial = e == Execution::sequential || m.rows * m.cols < ExecutionSettings::threshold();
+
+    parallel_for(0, blocks, serial ? blocks : 1, [&](size_t lo, size_t hi) {
+        for (size_t b = lo; b != hi; b++) {
+            const size_t end = std::min(m.rows, (b + 1) * block);
+
+            for (size_t i = b * block; i != end; i++) {
+                partial[b] += f(&m[i][0], m.cols);
+            }
+        }
+    });
+
+    A r = 0;
+    for (size_t b = 0; b != blocks; b++) {
+        r += partial[b];
+    }
+
+    return r;
+}
+
+template <typename T>
+typename accumulate_type<T>::type sum(const Matrix<T> &m, const Execution e = ExecutionSettings::policy()) {
+    typedef typename accumulate_type<T>::type A;
+
+    return reduce_rows(m, e, [](const T *row, const size_t n) {
+        A r = 0;
+
+        for (size_t j = 0; j != n; j++) {
+            r += row[j];
+        }
+
+        return r;
+    });
+}
+
+// Frobenius norm.
+template <typename T>
+typename accumulate_type<T>::type norm(const Matrix<T> &m, const Execution e = ExecutionSettings::policy()) {
+    typedef typename accumulate_type<T>::type A;
+
+    const A r = reduce_rows(m, e, [](const T *row, const size_t n) {
+        A r = 0;
+
+        for (size_t j = 0; j != n; j++) {
+            r += static_cast<A>(row[j]) * static_cast<A>(row[j]);
+        }
+
+        return r;
+    });
+
+    return static_cast<A>(std::sqrt(r));
+}
+
 template <typename T>
 std::ostream& operator << (std::ostream &os, const Matrix<T> &m) {
     for (size_t i = 0; i != m.rows; i++) {
@@ -498,6 +1417,215 @@ std::ostream& operator << (std::ostream &os, const Matrix<T> &m) {
     return os;
 }
 
+// VectorView
+//
+// size elements of T, stride elements apart, over storage owned elsewhere:
+// a std::vector, a row or column of a Matrix, or every k-th value of a
+// buffer. T is const for views that are only read.
+template <typename T>
+class VectorView {
+public:
+    T *data;
+    size_t size;
+    size_t stride;
+
+    VectorView(T *data, const size_t size, const size_t stride = 1): data(data), size(size), stride(stride) {}
+
+    T& operator [] (const size_t i) const {
+        return data[i * stride];
+    }
+};
+
+// MatrixView
+//
+// rows x cols elements of T with rows stride elements apart and the
+// elements of a row next to each other, such as a Matrix or a block of one.
+template <typename T>
+class MatrixView {
+public:
+    T *data;
+    size_t rows;
+    size_t cols;
+    size_t stride;
+
+    MatrixView(T *data, const size_t rows, const size_t cols, const size_t stride):
+        data(data), rows(rows), cols(cols), stride(stride) {}
+
+    T* operator [] (const size_t i) const {
+        return data + i * stride;
+    }
+};
+
+template <typename T>
+VectorView<T> view(std::vector<T> &v) {
+    return VectorView<T>(v.data(), v.size());
+}
+
+template <typename T>
+VectorView<const T> view(const std::vector<T> &v) {
+    return VectorView<const T>(v.data(), v.size());
+}
+
+template <typename T>
+MatrixView<T> view(Matrix<T> &m) {
+    return MatrixView<T>(m.data(), m.rows, m.cols, m.cols);
+}
+
+template <typename T>
+MatrixView<const T> view(const Matrix<T> &m) {
+    return MatrixView<const T>(m.data(), m.rows, m.cols, m.cols);
+}
+
+template <typename T>
+VectorView<T> row_view(Matrix<T> &m, const size_t i) {
+    return VectorView<T>(m[i].data(), m.cols);
+}
+
+template <typename T>
+VectorView<const T> row_view(const Matrix<T> &m, const size_t i) {
+    return VectorView<const T>(m[i].data(), m.cols);
+}
+
+template <typename T>
+VectorView<T> col_view(Matrix<T> &m, const size_t j) {
+    return VectorView<T>(m.data() + j, m.rows, m.cols);
+}
+
+template <typename T>
+VectorView<const T> col_view(const Matrix<T> &m, const size_t j) {
+    return VectorView<const T>(m.data() + j, m.rows, m.cols);
+}
+
+// acc += alpha * a over n elements, through the dispatched kernel when the
+// types match.
+template <typename S>
+void gevm_row(S *acc, const S alpha, const S *a, const size_t n) {
+    if (n < 16) {
+        for (size_t j = 0; j != n; j++) {
+            acc[j] += alpha * a[j];
+        }
+
+        return;
+    }
+
+    Kernels<S>::get().axpy(acc, alpha, a, n);
+}
+
+template <typename S, typename A>
+void gevm_row(S *acc, const S alpha, const A *a, const size_t n) {
+    for (size_t j = 0; j != n; j++) {
+        acc[j] += alpha * a[j];
+    }
+}
+
+// y = a x, for an m x n a, n long x and m long y. Each element is summed in
+// accumulate_type of y over k in order, like a row of operator *=, four
+// rows at a time so the sums run side by side. Rows are split over the pool
+// when a is large enough for the policy. Nothing is allocated.
+template <typename A, typename X, typename Y>
+void gemv(const MatrixView<A> &a, const VectorView<X> &x, const VectorView<Y> &y,
+          const Execution e = ExecutionSettings::policy()) {
+    if (a.cols != x.size || a.rows != y.size) {
+        throw std::length_error("x should have a.cols elements and y a.rows");
+    }
+
+    typedef typename std::remove_const<Y>::type R;
+    typedef typename accumulate_type<R>::type S;
+
+    const bool serial = e == Execution::sequential || a.rows * a.cols < ExecutionSettings::threshold();
+    const size_t n = a.cols;
+
+    parallel_for(0, a.rows, serial ? a.rows : std::max<size_t>(4, 16384 / std::max<size_t>(n, 1)), [&](size_t lo, size_t hi) {
+        size_t i = lo;
+
+        for (; i + 4 <= hi; i += 4) {
+            const A *a0 = a[i], *a1 = a[i + 1], *a2 = a[i + 2], *a3 = a[i + 3];
+            S s0 = 0, s1 = 0, s2 = 0, s3 = 0;
+
+            for (size_t k = 0; k != n; k++) {
+                const X &xk = x[k];
+
+                s0 += a0[k] * xk;
+                s1 += a1[k] * xk;
+                s2 += a2[k] * xk;
+                s3 += a3[k] * xk;
+            }
+
+            y[i] = static_cast<R>(s0);
+            y[i + 1] = static_cast<R>(s1);
+            y[i + 2] = static_cast<R>(s2);
+            y[i + 3] = static_cast<R>(s3);
+        }
+
+        for (; i != hi; i++) {
+            const A *ai = a[i];
+            S s = 0;
+
+            for (size_t k = 0; k != n; k++) {
+                s += ai[k] * x[k];
+            }
+
+            y[i] = static_cast<R>(s);
+        }
+    });
+}
+
+// y = x a, for an m long x, m x n a and n long y. Each element is summed in
+// accumulate_type of y over i in order, as rows of a scaled by x are added
+// into a block of sums on the stack, with the dispatched axpy kernel when
+// every type is the same. Blocks of columns are split over the pool when a
+// is large enough for the policy. Nothing is allocated.
+template <typename X, typename A, typename Y>
+void gevm(const VectorView<X> &x, const MatrixView<A> &a, const VectorView<Y> &y,
+          const Execution e = ExecutionSettings::policy()) {
+    if (a.rows != x.size || a.cols != y.size) {
+        throw std::length_error("x should have a.rows elements and y a.cols");
+    }
+
+    typedef typename std::remove_const<Y>::type R;
+    typedef typename accumulate_type<R>::type S;
+    typedef typename std::remove_const<A>::type E;
+
+    const size_t block = 256;
+    const bool serial = e == Execution::sequential || a.rows * a.cols < ExecutionSettings::threshold();
+
+    parallel_for(0, a.cols, serial ? a.cols : block, [&](size_t lo, size_t hi) {
+        S acc[block];
+
+        for (size_t j0 = lo; j0 < hi; j0 += block) {
+            const size_t m = std::min(block, hi - j0);
+            std::fill(acc, acc + m, S(0));
+
+            for (size_t i = 0; i != a.rows; i++) {
+                gevm_row(acc, static_cast<S>(x[i]), static_cast<const E*>(a[i] + j0), m);
+            }
+
+            for (size_t j = 0; j != m; j++) {
+                y[j0 + j] = static_cast<R>(acc[j]);
+            }
+        }
+    });
+}
+
+// Matrix times a column vector, and a row vector times a matrix.
+template <typename T, typename U>
+std::vector<T> operator * (const Matrix<T> &lhs, const std::vector<U> &rhs) {
+    std::vector<T> r(lhs.rows);
+
+    gemv(view(lhs), view(rhs), view(r));
+
+    return r;
+}
+
+template <typename T, typename U>
+std::vector<T> operator * (const std::vector<T> &lhs, const Matrix<U> &rhs) {
+    std::vector<T> r(rhs.cols);
+
+    gevm(view(lhs), view(rhs), view(r));
+
+    return r;
+}
+
 // Vec2
 template <typename T>
 class Vec2 {
@@ -684,13 +1812,9 @@ Matrix<T> operator * (const Vec2<T> &lhs, const Matrix<U> &rhs) {
     }
 
     Matrix<T> r(1, rhs.cols);
+    const T row[2] = {lhs.x, lhs.y};
 
-    std::vector<T> row({lhs.x, lhs.y});
-    for (size_t i = 0; i != rhs.cols; i++) {
-        std::vector<U> col({rhs[0][i], rhs[1][i]});
-
-        r[0][i] = dot(row, col);
-    }
+    gevm(VectorView<const T>(row, 2), view(rhs), row_view(r, 0));
 
     return r;
 }
@@ -922,13 +2046,9 @@ Matrix<T> operator * (const Vec3<T> &lhs, const Matrix<U> &rhs) {
     }
 
     Matrix<T> r(1, rhs.cols);
+    const T row[3] = {lhs.x, lhs.y, lhs.z};
 
-    std::vector<T> row({lhs.x, lhs.y, lhs.z});
-    for (size_t i = 0; i != rhs.cols; i++) {
-        std::vector<U> col({rhs[0][i], rhs[1][i], rhs[2][i]});
-
-        r[0][i] = dot(row, col);
-    }
+    gevm(VectorView<const T>(row, 3), view(rhs), row_view(r, 0));
 
     return r;
 }
@@ -938,6 +2058,15 @@ T operator * (const Vec3<T> &lhs, const Vec3<U> &rhs) {
     return lhs.x * rhs.x + lhs.y * rhs.y + lhs.z * rhs.z;
 }
 
+template <typename T, typename U>
+Vec3<T> cross(const Vec3<T> &lhs, const Vec3<U> &rhs) {
+    return Vec3<T>(
+        lhs.y * rhs.z - lhs.z * rhs.y,
+        lhs.z * rhs.x - lhs.x * rhs.z,
+        lhs.x * rhs.y - lhs.y * rhs.x
+    );
+}
+
 template <typename T, typename U>
 Vec3<T> operator * (const Vec3<T> &lhs, const U rhs) {
     Vec3<T> r(lhs);
@@ -1166,13 +2295,9 @@ Matrix<T> operator * (const Vec4<T> &lhs, const Matrix<U> &rhs) {
     }
 
     Matrix<T> r(1, rhs.cols);
+    const T row[4] = {lhs.x, lhs.y, lhs.z, lhs.w};
 
-    std::vector<T> row({lhs.x, lhs.y, lhs.z, lhs.w});
-    for (size_t i = 0; i != rhs.cols; i++) {
-        std::vector<U> col({rhs[0][i], rhs[1][i], rhs[2][i], rhs[3][i]});
-
-        r[0][i] = dot(row, col);
-    }
+    gevm(VectorView<const T>(row, 4), view(rhs), row_view(r, 0));
 
     return r;
 }
@@ -1207,13 +2332,13 @@ template <typename T> std::ostream& operator << (std::ostream &os, const Vec4<T>
 }
 
 template <typename T>
-Matrix<T>::Matrix(Vec2<T> &v): m({v.x, v.y}), rows(1), cols(2) {}
+Matrix<T>::Matrix(const Vec2<T> &v): Matrix({v.x, v.y}) {}
 
 template <typename T>
-Matrix<T>::Matrix(Vec3<T> &v): m({v.x, v.y, v.z}), rows(1), cols(3) {}
+Matrix<T>::Matrix(const Vec3<T> &v): Matrix({v.x, v.y, v.z}) {}
 
 template <typename T>
-Matrix<T>::Matrix(Vec4<T> &v): m({v.x, v.y, v.z, v.w}), rows(1), cols(4) {}
+Matrix<T>::Matrix(const Vec4<T> &v): Matrix({v.x, v.y, v.z, v.w}) {}
 
 template <typename T>
 Vec2<T>::Vec2(const Vec3<T> &v): x(v.x/v.z), y(v.y/v.z) {}
@@ -1227,6 +2352,79 @@ Vec3<T>::Vec3(const Vec4<T> &v): Vec2<T>(v.x/v.w, v.y/v.w), z(v.z/v.w) {}
 template <typename T>
 Vec4<T>::Vec4(const Vec3<T> &v): Vec3<T>(v.x, v.y, v.z), w(1) {}
 
+// Compile time size and element type of the Vec classes, for code that is
+// written once over Vec2 and Vec3.
+template <typename V>
+struct vec_traits;
+
+template <typename T>
+struct vec_traits<Vec2<T>> {
+    typedef T value_type;
+    static constexpr size_t size = 2;
+};
+
+template <typename T>
+struct vec_traits<Vec3<T>> {
+    typedef T value_type;
+    static constexpr size_t size = 3;
+};
+
+template <typename T>
+struct vec_traits<Vec4<T>> {
+    typedef T value_type;
+    static constexpr size_t size = 4;
+};
+
+template <typename V>
+typename vec_traits<V>::value_type distance2(const V &lhs, const V &rhs) {
+    typename vec_traits<V>::value_type r = 0;
+
+    for (size_t i = 0; i != vec_traits<V>::size; i++) {
+        const typename vec_traits<V>::value_type d = lhs[i] - rhs[i];
+        r += d * d;
+    }
+
+    return r;
+}
+
+// Vec dot products and Vec * Matrix with an accumulation policy.
+template <typename V, typename A, typename M, size_t N = vec_traits<V>::size>
+A dot(const V &lhs, const V &rhs, Accumulate<A, M> policy) {
+    typename vec_traits<V>::value_type l[N], r[N];
+
+    for (size_t i = 0; i != N; i++) {
+        l[i] = lhs[i];
+        r[i] = rhs[i];
+    }
+
+    return sum_products(l, r, N, policy);
+}
+
+template <typename V, typename U, typename A, typename M, size_t N = vec_traits<V>::size>
+Matrix<typename vec_traits<V>::value_type> multiply(const V &lhs, const Matrix<U> &rhs, Accumulate<A, M> policy) {
+    if (rhs.rows != N) {
+        throw std::length_error("rhs.rows should be equal to vector size");
+    }
+
+    Matrix<typename vec_traits<V>::value_type> r(1, rhs.cols);
+
+    typename vec_traits<V>::value_type row[N];
+    for (size_t i = 0; i != N; i++) {
+        row[i] = lhs[i];
+    }
+
+    for (size_t j = 0; j != rhs.cols; j++) {
+        U col[N];
+        for (size_t i = 0; i != N; i++) {
+            col[i] = rhs[i][j];
+        }
+
+        r[0][j] = static_cast<typename vec_traits<V>::value_type>(sum_products(row, col, N, policy));
+    }
+
+    return r;
+}
+
 typedef Vec2<int> Vec2i;
 typedef Vec2<float> Vec2f;
 
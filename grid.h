@@ -0,0 +1,362 @@
+#ifndef GRID_H
+#define GRID_H
+
+#include <vector>
+#include <cmath>
+#include <cstdint>
+#include <utility>
+#include <algorithm>
+#include <stdexcept>
+
+#include "geometry.h"
+#include "parallel.h"
+
+// SpatialGrid
+//
+// Uniform grid broadphase over Vec2 or Vec3 positions. Objects are kept
+// sorted by cell, with their coordinates copied into structure of arrays
+// storage in the same order, and an open addressing table maps each
+// occupied cell to its run of objects. Cell coordinates are packed into a
+// 64 bit key (32 bits per axis in 2D, 21 in 3D); coordinates outside that
+// range wrap, which only adds candidates that the distance test removes.
+template <typename V>
+class SpatialGrid {
+private:
+    typedef typename vec_traits<V>::value_type T;
+
+    static constexpr size_t dims = vec_traits<V>::size;
+    static constexpr size_t bits = 64 / dims;
+    static constexpr uint32_t empty = static_cast<uint32_t>(-1);
+
+    T cell;
+    T inv;
+
+    std::vector<std::pair<uint64_t, size_t>> slots;
+    std::vector<T> coords[dims];
+
+    std::vector<uint64_t> cell_keys;
+    std::vector<uint32_t> cell_start;
+    std::vector<uint32_t> table;
+    size_t table_shift;
+
+    static uint64_t pack(const int64_t *c) {
+        const uint64_t mask = bits == 64 ? ~0ull : (1ull << bits) - 1;
+        uint64_t r = 0;
+
+        for (size_t d = 0; d != dims; d++) {
+            r |= (static_cast<uint64_t>(c[d] + (1ll << (bits - 1))) & mask) << (d * bits);
+        }
+
+        return r;
+    }
+
+    void cell_of(const V &p, int64_t *c) const {
+        for (size_t d = 0; d != dims; d++) {
+            c[d] = static_cast<int64_t>(std::floor(p[d] * inv));
+        }
+    }
+
+    uint64_t key_of(const V &p) const {
+        int64_t c[dims];
+
+        cell_of(p, c);
+
+        return pack(c);
+    }
+
+    size_t hash(const uint64_t key) const {
+        return static_cast<size_t>((key * 0x9E3779B97F4A7C15ull) >> table_shift);
+    }
+
+    uint32_t find(const uint64_t key) const {
+        const size_t mask = table.size() - 1;
+
+        for (size_t h = hash(key);; h = (h + 1) & mask) {
+            const uint32_t c = table[h];
+
+            if (c == empty || cell_keys[c] == key) {
+                return c;
+            }
+        }
+    }
+
+    void rebuild_cells() {
+        cell_keys.clear();
+        cell_start.clear();
+
+        for (size_t i = 0; i != slots.size(); i++) {
+            if (i == 0 || slots[i].first != slots[i - 1].first) {
+                cell_keys.push_back(slots[i].first);
+                cell_start.push_back(static_cast<uint32_t>(i));
+            }
+        }
+        cell_start.push_back(static_cast<uint32_t>(slots.size()));
+
+        size_t capacity = 16;
+        table_shift = 60;
+        while (capacity < 2 * cell_keys.size()) {
+            capacity *= 2;
+            table_shift--;
+        }
+
+        table.assign(capacity, empty);
+        for (size_t c = 0; c != cell_keys.size(); c++) {
+            size_t h = hash(cell_keys[c]);
+
+            while (table[h] != empty) {
+                h = (h + 1) & (capacity - 1);
+            }
+            table[h] = static_cast<uint32_t>(c);
+        }
+    }
+
+    // Offsets to the neighboring cells that come after the origin in
+    // lexicographic order, so each pair of adjacent cells is visited once.
+    static std::vector<std::vector<int64_t>> forward_offsets() {
+        std::vector<std::vector<int64_t>> r;
+        std::vector<int64_t> o(dims, -1);
+
+        while (true) {
+            for (size_t d = dims; d-- != 0;) {
+                if (o[d] != 0) {
+                    if (o[d] > 0) {
+                        r.push_back(o);
+                    }
+                    break;
+                }
+            }
+
+            size_t d = 0;
+            while (d != dims && o[d] == 1) {
+                o[d] = -1;
+                d++;
+            }
+
+            if (d == dims) {
+                return r;
+            }
+            o[d]++;
+        }
+    }
+
+    T distance2(const size_t a, const size_t b) const {
+        T r = 0;
+
+        for (size_t d = 0; d != dims; d++) {
+            const T diff = coords[d][a] - coords[d][b];
+            r += diff * diff;
+        }
+
+        return r;
+    }
+
+public:
+    SpatialGrid(const T cell_size): cell(cell_size), inv(1 / cell_size), table_shift(60) {
+        if (!(cell_size > 0)) {
+            throw std::domain_error("cell size should be greater than 0");
+        }
+    }
+
+    // Moves every object to positions[i]. When the object count is unchanged
+    // the previous cell order is reused, so only objects that changed cell
+    // are sorted and the rest is a linear merge.
+    void update(const std::vector<V> &positions) {
+        const size_t n = positions.size();
+        bool changed = false;
+
+        if (n != slots.size()) {
+            slots.resize(n);
+
+            parallel_for(0, n, 4096, [&](size_t lo, size_t hi) {
+                for (size_t i = lo; i != hi; i++) {
+                    slots[i] = std::make_pair(key_of(positions[i]), i);
+                }
+            });
+
+            std::sort(slots.begin(), slots.end());
+            changed = true;
+        } else {
+            std::vector<uint64_t> keys(n);
+
+            parallel_for(0, n, 4096, [&](size_t lo, size_t hi) {
+                for (size_t i = lo; i != hi; i++) {
+                    keys[i] = key_of(positions[slots[i].second]);
+                }
+            });
+
+            // Objects that kept their cell are still in order; only the ones
+            // that moved are sorted, then merged back in.
+            std::vector<std::pair<uint64_t, size_t>> stay, moved;
+            stay.reserve(n);
+
+            for (size_t i = 0; i != n; i++) {
+                if (keys[i] == slots[i].first) {
+                    stay.push_back(slots[i]);
+                } else {
+                    moved.push_back(std::make_pair(keys[i], slots[i].second));
+                }
+            }
+
+            if (!moved.empty()) {
+                std::sort(moved.begin(), moved.end());
+                std::merge(stay.begin(), stay.end(), moved.begin(), moved.end(), slots.begin());
+                changed = true;
+            }
+        }
+
+        for (size_t d = 0; d != dims; d++) {
+            coords[d].resize(n);
+        }
+
+        parallel_for(0, n, 4096, [&](size_t lo, size_t hi) {
+            for (size_t i = lo; i != hi; i++) {
+                const V &p = positions[slots[i].second];
+
+                for (size_t d = 0; d != dims; d++) {
+                    coords[d][i] = p[d];
+                }
+            }
+        });
+
+        if (changed) {
+            rebuild_cells();
+        }
+    }
+
+    size_t size() const {
+        return slots.size();
+    }
+
+    size_t cell_count() const {
+        return cell_keys.size();
+    }
+
+    T cell_size() const {
+        return cell;
+    }
+
+    // Every pair of objects closer than radius, as (smaller id, larger id).
+    // radius must not exceed the cell size, since only adjacent cells are
+    // searched. The output order is the same for any number of threads.
+    void pairs(const T radius, std::vector<std::pair<size_t, size_t>> &out) const {
+        if (radius > cell) {
+            throw std::domain_error("radius should not be greater than cell size");
+        }
+
+        const T r2 = radius * radius;
+        const std::vector<std::vector<int64_t>> offsets = forward_offsets();
+        const size_t block = 256;
+        const size_t blocks = (cell_keys.size() + block - 1) / block;
+        std::vector<std::vector<std::pair<size_t, size_t>>> found(blocks);
+
+        parallel_for(0, blocks, 1, [&](size_t lo, size_t hi) {
+            for (size_t b = lo; b != hi; b++) {
+                std::vector<std::pair<size_t, size_t>> &f = found[b];
+                const size_t end = std::min(cell_keys.size(), (b + 1) * block);
+
+                for (size_t c = b * block; c != end; c++) {
+                    const size_t first = cell_start[c], last = cell_start[c + 1];
+
+                    for (size_t i = first; i != last; i++) {
+                        for (size_t j = i + 1; j != last; j++) {
+                            if (distance2(i, j) <= r2) {
+                                f.push_back(std::minmax(slots[i].second, slots[j].second));
+                            }
+                        }
+                    }
+
+                    int64_t base[dims];
+                    for (size_t d = 0; d != dims; d++) {
+                        base[d] = static_cast<int64_t>(std::floor(coords[d][first] * inv));
+                    }
+
+                    for (size_t o = 0; o != offsets.size(); o++) {
+                        int64_t n[dims];
+                        for (size_t d = 0; d != dims; d++) {
+                            n[d] = base[d] + offsets[o][d];
+                        }
+
+                        const uint32_t nc = find(pack(n));
+                        if (nc == empty) {
+                            continue;
+                        }
+
+                        for (size_t i = first; i != last; i++) {
+                            for (size_t j = cell_start[nc]; j != cell_start[nc + 1]; j++) {
+                                if (distance2(i, j) <= r2) {
+                                    f.push_back(std::minmax(slots[i].second, slots[j].second));
+                                }
+                            }
+                        }
+                    }
+                }
+            }
+        });
+
+        out.clear();
+        for (size_t b = 0; b != blocks; b++) {
+            out.insert(out.end(), found[b].begin(), found[b].end());
+        }
+    }
+
+    std::vector<std::pair<size_t, size_t>> pairs(const T radius) const {
+        std::vector<std::pair<size_t, size_t>> r;
+
+        pairs(radius, r);
+
+        return r;
+    }
+
+    // Every object within radius of p.
+    void query(const V &p, const T radius, std::vector<size_t> &out) const {
+        out.clear();
+
+        if (slots.empty()) {
+            return;
+        }
+
+        int64_t lo[dims], hi[dims], c[dims];
+        for (size_t d = 0; d != dims; d++) {
+            lo[d] = static_cast<int64_t>(std::floor((p[d] - radius) * inv));
+            hi[d] = static_cast<int64_t>(std::floor((p[d] + radius) * inv));
+            c[d] = lo[d];
+        }
+
+        const T r2 = radius * radius;
+
+        while (true) {
+            const uint32_t cc = find(pack(c));
+
+            if (cc != empty) {
+                for (size_t i = cell_start[cc]; i != cell_start[cc + 1]; i++) {
+                    T dist = 0;
+
+                    for (size_t d = 0; d != dims; d++) {
+                        const T diff = coords[d][i] - p[d];
+                        dist += diff * diff;
+                    }
+
+                    if (dist <= r2) {
+                        out.push_back(slots[i].second);
+                    }
+                }
+            }
+
+            size_t d = 0;
+            while (d != dims && c[d] == hi[d]) {
+                c[d] = lo[d];
+                d++;
+            }
+
+            if (d == dims) {
+                return;
+            }
+            c[d]++;
+        }
+    }
+};
+
+typedef SpatialGrid<Vec2f> SpatialGrid2f;
+typedef SpatialGrid<Vec3f> SpatialGrid3f;
+
+#endif
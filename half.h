@@ -0,0 +1,357 @@
+#ifndef HALF_H
+#define HALF_H
+
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+#include "geometry.h"
+#include "parallel.h"
+#include "dispatch.h"
+
+// 16 bit storage types. Both convert implicitly to and from float, so any
+// arithmetic on them is done in float and only the stored result is
+// rounded back, to nearest even.
+
+inline uint32_t float_bits(const float f) {
+    uint32_t u;
+    std::memcpy(&u, &f, sizeof(u));
+    return u;
+}
+
+inline float bits_float(const uint32_t u) {
+    float f;
+    std::memcpy(&f, &u, sizeof(f));
+    return f;
+}
+
+inline uint16_t float_to_half(const float f) {
+#if defined(__F16C__)
+    return _cvtss_sh(f, _MM_FROUND_TO_NEAREST_INT);
+#else
+    uint32_t u = float_bits(f);
+    const uint16_t sign = (u >> 16) & 0x8000;
+    u &= 0x7fffffff;
+
+    // Infinity and nan, keeping nans quiet.
+    if (u >= 0x7f800000) {
+        return sign | 0x7c00 | (u > 0x7f800000 ? 0x200 | ((u >> 13) & 0x3ff) : 0);
+    }
+
+    // Anything from 65520 up rounds to infinity.
+    if (u >= 0x477ff000) {
+        return sign | 0x7c00;
+    }
+
+    // Subnormal results: adding 0.5 lines the half precision ulp up with
+    // the float one, so the float addition does the rounding.
+    if (u < 0x38800000) {
+        return sign | static_cast<uint16_t>(float_bits(bits_float(u) + 0.5f) - 0x3f000000);
+    }
+
+    u += 0xc8000fff + ((u >> 13) & 1);
+    return sign | static_cast<uint16_t>(u >> 13);
+#endif
+}
+
+inline float half_to_float(const uint16_t h) {
+#if defined(__F16C__)
+    return _cvtsh_ss(h);
+#else
+    const uint32_t sign = static_cast<uint32_t>(h & 0x8000) << 16;
+    const uint32_t e = (h >> 10) & 0x1f;
+    const uint32_t m = h & 0x3ff;
+
+    if (e == 0) {
+        const float f = m * 5.9604644775390625e-8f;
+        return sign ? -f : f;
+    }
+
+    if (e == 31) {
+        return bits_float(sign | 0x7f800000 | (m << 13) | (m ? 0x400000 : 0));
+    }
+
+    return bits_float(sign | ((e + 112) << 23) | (m << 13));
+#endif
+}
+
+inline uint16_t float_to_bfloat16(const float f) {
+    const uint32_t u = float_bits(f);
+
+    if ((u & 0x7fffffff) > 0x7f800000) {
+        return static_cast<uint16_t>((u >> 16) | 0x40);
+    }
+
+    return static_cast<uint16_t>((u + 0x7fff + ((u >> 16) & 1)) >> 16);
+}
+
+inline float bfloat16_to_float(const uint16_t b) {
+    return bits_float(static_cast<uint32_t>(b) << 16);
+}
+
+// half
+//
+// IEEE 754 binary16: 5 exponent bits, 10 mantissa bits, largest finite
+// value 65504.
+class half {
+private:
+    uint16_t h;
+
+public:
+    half(): h(0) {}
+
+    half(const float f): h(float_to_half(f)) {}
+
+    operator float() const {
+        return half_to_float(h);
+    }
+
+    static half from_bits(const uint16_t bits) {
+        half r;
+        r.h = bits;
+        return r;
+    }
+
+    uint16_t bits() const {
+        return h;
+    }
+
+    half& operator += (const float rhs) {
+        return *this = float(*this) + rhs;
+    }
+
+    half& operator -= (const float rhs) {
+        return *this = float(*this) - rhs;
+    }
+
+    half& operator *= (const float rhs) {
+        return *this = float(*this) * rhs;
+    }
+
+    half& operator /= (const float rhs) {
+        return *this = float(*this) / rhs;
+    }
+};
+
+// bfloat16
+//
+// The upper half of a float: the same 8 exponent bits and range, with 7
+// mantissa bits.
+class bfloat16 {
+private:
+    uint16_t h;
+
+public:
+    bfloat16(): h(0) {}
+
+    bfloat16(const float f): h(float_to_bfloat16(f)) {}
+
+    operator float() const {
+        return bfloat16_to_float(h);
+    }
+
+    static bfloat16 from_bits(const uint16_t bits) {
+        bfloat16 r;
+        r.h = bits;
+        return r;
+    }
+
+    uint16_t bits() const {
+        return h;
+    }
+
+    bfloat16& operator += (const float rhs) {
+        return *this = float(*this) + rhs;
+    }
+
+    bfloat16& operator -= (const float rhs) {
+        return *this = float(*this) - rhs;
+    }
+
+    bfloat16& operator *= (const float rhs) {
+        return *this = float(*this) * rhs;
+    }
+
+    bfloat16& operator /= (const float rhs) {
+        return *this = float(*this) / rhs;
+    }
+};
+
+inline std::ostream& operator << (std::ostream &os, const half &h) {
+    return os << float(h);
+}
+
+inline std::ostream& operator << (std::ostream &os, const bfloat16 &b) {
+    return os << float(b);
+}
+
+// dot() and the Matrix and Vec products sum in float.
+template <>
+struct accumulate_type<half> {
+    typedef float type;
+};
+
+template <>
+struct accumulate_type<bfloat16> {
+    typedef float type;
+};
+
+#if defined(__x86_64__) || defined(__i386__)
+// The half kernels with F16C, which converts 8 values per instruction.
+// They are compiled for AVX2 and F16C whatever the build flags, and only
+// called when DispatchSettings::isa() allows AVX2; every CPU with AVX2 also
+// has F16C.
+__attribute__((target("avx2,f16c"))) inline void to_float_f16c(const half *src, float *dst, const size_t n) {
+    size_t i = 0;
+
+    for (; i + 8 <= n; i += 8) {
+        const __m128i h = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+        _mm256_storeu_ps(dst + i, _mm256_cvtph_ps(h));
+    }
+
+    for (; i != n; i++) {
+        dst[i] = src[i];
+    }
+}
+
+__attribute__((target("avx2,f16c"))) inline void from_float_f16c(const float *src, half *dst, const size_t n) {
+    size_t i = 0;
+
+    for (; i + 8 <= n; i += 8) {
+        const __m128i h = _mm256_cvtps_ph(_mm256_loadu_ps(src + i), _MM_FROUND_TO_NEAREST_INT);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), h);
+    }
+
+    for (; i != n; i++) {
+        dst[i] = src[i];
+    }
+}
+
+// Sums in the same 8 lanes and order as the generic dot(), without FMA, so
+// both give the same bits.
+__attribute__((target("avx2,f16c"))) inline float dot_f16c(const half *lhs, const half *rhs, const size_t n) {
+    size_t i = 0;
+    float r = 0;
+    __m256 sum = _mm256_setzero_ps();
+
+    for (; i + 8 <= n; i += 8) {
+        const __m256 a = _mm256_cvtph_ps(_mm_loadu_si128(reinterpret_cast<const __m128i*>(lhs + i)));
+        const __m256 b = _mm256_cvtph_ps(_mm_loadu_si128(reinterpret_cast<const __m128i*>(rhs + i)));
+        sum = _mm256_add_ps(sum, _mm256_mul_ps(a, b));
+    }
+
+    float lanes[8];
+    _mm256_storeu_ps(lanes, sum);
+    for (size_t j = 0; j != 8; j++) {
+        r += lanes[j];
+    }
+
+    for (; i != n; i++) {
+        r += float(lhs[i]) * float(rhs[i]);
+    }
+
+    return r;
+}
+#endif
+
+// Bulk conversion between float and 16 bit arrays, split over the pool for
+// large n.
+inline void to_float(const half *src, float *dst, const size_t n) {
+    parallel_for(0, n, 65536, [&](size_t lo, size_t hi) {
+#if defined(__x86_64__) || defined(__i386__)
+        if (DispatchSettings::isa() >= Isa::avx2) {
+            to_float_f16c(src + lo, dst + lo, hi - lo);
+            return;
+        }
+#endif
+
+        for (size_t i = lo; i != hi; i++) {
+            dst[i] = src[i];
+        }
+    });
+}
+
+inline void from_float(const float *src, half *dst, const size_t n) {
+    parallel_for(0, n, 65536, [&](size_t lo, size_t hi) {
+#if defined(__x86_64__) || defined(__i386__)
+        if (DispatchSettings::isa() >= Isa::avx2) {
+            from_float_f16c(src + lo, dst + lo, hi - lo);
+            return;
+        }
+#endif
+
+        for (size_t i = lo; i != hi; i++) {
+            dst[i] = src[i];
+        }
+    });
+}
+
+inline void to_float(const bfloat16 *src, float *dst, const size_t n) {
+    parallel_for(0, n, 65536, [&](size_t lo, size_t hi) {
+        for (size_t i = lo; i != hi; i++) {
+            dst[i] = src[i];
+        }
+    });
+}
+
+inline void from_float(const float *src, bfloat16 *dst, const size_t n) {
+    parallel_for(0, n, 65536, [&](size_t lo, size_t hi) {
+        for (size_t i = lo; i != hi; i++) {
+            dst[i] = src[i];
+        }
+    });
+}
+
+// Dot product of 16 bit arrays, converted in registers and summed in float
+// over 8 lanes.
+inline float dot(const half *lhs, const half *rhs, const size_t n) {
+#if defined(__x86_64__) || defined(__i386__)
+    if (DispatchSettings::isa() >= Isa::avx2) {
+        return dot_f16c(lhs, rhs, n);
+    }
+#endif
+
+    size_t i = 0;
+    float r = 0;
+    float lanes[8] = {};
+
+    for (; i + 8 <= n; i += 8) {
+        for (size_t j = 0; j != 8; j++) {
+            lanes[j] += float(lhs[i + j]) * float(rhs[i + j]);
+        }
+    }
+
+    for (size_t j = 0; j != 8; j++) {
+        r += lanes[j];
+    }
+
+    for (; i != n; i++) {
+        r += float(lhs[i]) * float(rhs[i]);
+    }
+
+    return r;
+}
+
+inline float dot(const bfloat16 *lhs, const bfloat16 *rhs, const size_t n) {
+    float r = 0;
+
+    for (size_t i = 0; i != n; i++) {
+        r += float(lhs[i]) * float(rhs[i]);
+    }
+
+    return r;
+}
+
+typedef Vec2<half> Vec2h;
+typedef Vec3<half> Vec3h;
+typedef Vec4<half> Vec4h;
+
+typedef Vec2<bfloat16> Vec2bf;
+typedef Vec3<bfloat16> Vec3bf;
+typedef Vec4<bfloat16> Vec4bf;
+
+#endif
@@ -0,0 +1,678 @@
+#ifndef HULL_H
+#define HULL_H
+
+#include <array>
+#include <vector>
+#include <cmath>
+#include <cfloat>
+#include <cstdint>
+#include <algorithm>
+#include <unordered_map>
+#include <stdexcept>
+
+#include "geometry.h"
+#include "parallel.h"
+#include "arena.h"
+
+// Convex hull of a 2D point set, as indices into points in counter clockwise
+// order starting from the lowest x. Collinear points on the boundary are
+// dropped.
+//
+// Points strictly inside the octagon spanned by the extremes in x, y, x + y
+// and x - y cannot be on the hull; they are discarded in parallel before the
+// remaining points are sorted for Andrew's monotone chain.
+template <typename T>
+std::vector<size_t> convex_hull(const std::vector<Vec2<T>> &points) {
+    const size_t n = points.size();
+
+    if (n < 3) {
+        std::vector<size_t> r;
+        for (size_t i = 0; i != n; i++) {
+            r.push_back(i);
+        }
+        return r;
+    }
+
+    // Extreme points in the directions -x, x, -y, y, -(x + y), x + y,
+    // -(x - y) and x - y, found per block and then combined, so ties go to
+    // the lowest index whatever the thread count.
+    const auto key = [&](size_t i, size_t k) {
+        const double x = points[i].x, y = points[i].y;
+        const double v[8] = {-x, x, -y, y, -(x + y), x + y, y - x, x - y};
+        return v[k];
+    };
+
+    const size_t block = 1 << 16;
+    std::vector<std::array<size_t, 8>> found((n + block - 1) / block);
+
+    parallel_for(0, found.size(), 1, [&](size_t lo, size_t hi) {
+        for (size_t b = lo; b != hi; b++) {
+            std::array<size_t, 8> &e = found[b];
+            double best[8];
+
+            e.fill(b * block);
+            for (size_t k = 0; k != 8; k++) {
+                best[k] = key(b * block, k);
+            }
+
+            for (size_t i = b * block + 1; i != std::min(n, (b + 1) * block); i++) {
+                const double x = points[i].x, y = points[i].y;
+                const double v[8] = {-x, x, -y, y, -(x + y), x + y, y - x, x - y};
+
+                for (size_t k = 0; k != 8; k++) {
+                    const bool greater = v[k] > best[k];
+
+                    best[k] = greater ? v[k] : best[k];
+                    e[k] = greater ? i : e[k];
+                }
+            }
+        }
+    });
+
+    std::array<size_t, 8> ext = found[0];
+    for (size_t b = 1; b != found.size(); b++) {
+        for (size_t k = 0; k != 8; k++) {
+            if (key(found[b][k], k) > key(ext[k], k)) {
+                ext[k] = found[b][k];
+            }
+        }
+    }
+
+    // Walk the extremes by the angle of their direction to get the corners
+    // of the octagon in counter clockwise order.
+    const size_t order[8] = {0, 4, 2, 7, 1, 5, 3, 6};
+    std::vector<size_t> corners;
+    for (size_t k = 0; k != 8; k++) {
+        if (corners.empty() || corners.back() != ext[order[k]]) {
+            corners.push_back(ext[order[k]]);
+        }
+    }
+    while (corners.size() > 1 && corners.back() == corners.front()) {
+        corners.pop_back();
+    }
+
+    // Edge k of the octagon as the line ex[k] * x + ey[k] * y + ec[k] = 0,
+    // with a unit normal, positive on the inside and with a margin so
+    // nothing near an edge is dropped. Missing edges repeat the last one.
+    const size_t m = corners.size();
+    double scale = 0;
+    for (size_t i = 0; i != m; i++) {
+        scale = std::max(scale, std::fabs((double)points[corners[i]].x) + std::fabs((double)points[corners[i]].y));
+    }
+
+    double ex[8], ey[8], ec[8];
+    for (size_t k = 0; k != 8; k++) {
+        const Vec2<T> &a = points[corners[std::min(k, m - 1) % m]];
+        const Vec2<T> &b = points[corners[(std::min(k, m - 1) + 1) % m]];
+        const double nx = -((double)b.y - a.y), ny = (double)b.x - a.x;
+        const double len = std::sqrt(nx * nx + ny * ny);
+
+        ex[k] = len > 0 ? nx / len : 0;
+        ey[k] = len > 0 ? ny / len : 0;
+        ec[k] = len > 0 ? -(ex[k] * a.x + ey[k] * a.y) - 64 * scale * DBL_EPSILON : 0;
+    }
+
+    std::vector<uint8_t> keep(n, 1);
+    if (m >= 3) {
+        parallel_for(0, n, 1 << 16, [&](size_t lo, size_t hi) {
+            // Local copies, since stores through uint8_t may alias anything.
+            double lx[8], ly[8], lc[8];
+            std::copy(ex, ex + 8, lx);
+            std::copy(ey, ey + 8, ly);
+            std::copy(ec, ec + 8, lc);
+
+            const Vec2<T> *p = points.data();
+            uint8_t *out = keep.data();
+
+            for (size_t i = lo; i != hi; i++) {
+                const double x = p[i].x, y = p[i].y;
+                double margin = lx[0] * x + ly[0] * y + lc[0];
+
+                for (size_t k = 1; k != 8; k++) {
+                    margin = std::min(margin, lx[k] * x + ly[k] * y + lc[k]);
+                }
+
+                out[i] = !(margin > 0);
+            }
+        });
+    }
+
+    std::vector<size_t> idx;
+    for (size_t i = 0; i != n; i++) {
+        if (keep[i]) {
+            idx.push_back(i);
+        }
+    }
+
+    parallel_sort(idx.begin(), idx.end(), [&](size_t a, size_t b) {
+        return points[a].x < points[b].x || (points[a].x == points[b].x && points[a].y < points[b].y);
+    });
+
+    const auto turn = [&](size_t o, size_t a, size_t b) {
+        return ((double)points[a].x - points[o].x) * ((double)points[b].y - points[o].y) -
+               ((double)points[a].y - points[o].y) * ((double)points[b].x - points[o].x);
+    };
+
+    std::vector<size_t> r(2 * idx.size());
+    size_t k = 0;
+
+    for (size_t i = 0; i != idx.size(); i++) {
+        while (k >= 2 && turn(r[k - 2], r[k - 1], idx[i]) <= 0) {
+            k--;
+        }
+        r[k++] = idx[i];
+    }
+
+    for (size_t i = idx.size() - 1, t = k + 1; i-- != 0;) {
+        while (k >= t && turn(r[k - 2], r[k - 1], idx[i]) <= 0) {
+            k--;
+        }
+        r[k++] = idx[i];
+    }
+
+    r.resize(k > 1 ? k - 1 : k);
+    return r;
+}
+
+// HullFace
+//
+// Working triangle of the 3D quickhull, allocated from an arena. Edge i runs
+// from v[i] to v[(i + 1) % 3] and is shared with neighbor[i]. The points
+// still outside the face form a linked list through QuickHull::next.
+class HullFace {
+public:
+    size_t v[3];
+    HullFace *neighbor[3];
+    double normal[3];
+    double offset;
+    size_t head;
+    size_t count;
+    size_t furthest;
+    double furthest_distance;
+    size_t visit;
+    bool dead;
+};
+
+// QuickHull
+template <typename T>
+class QuickHull {
+private:
+    static constexpr size_t none = static_cast<size_t>(-1);
+
+    const std::vector<Vec3<T>> &points;
+    Arena arena;
+    std::vector<HullFace*> faces;
+    std::vector<size_t> next;
+    double eps;
+    size_t tag;
+
+    double distance(const HullFace *f, const size_t i) const {
+        const Vec3<T> &p = points[i];
+
+        return f->normal[0] * p.x + f->normal[1] * p.y + f->normal[2] * p.z - f->offset;
+    }
+
+    HullFace* make_face(const size_t a, const size_t b, const size_t c) {
+        HullFace *f = arena.create<HullFace>();
+
+        f->v[0] = a;
+        f->v[1] = b;
+        f->v[2] = c;
+        f->neighbor[0] = f->neighbor[1] = f->neighbor[2] = nullptr;
+        f->head = none;
+        f->count = 0;
+        f->furthest = none;
+        f->furthest_distance = 0;
+        f->visit = 0;
+        f->dead = false;
+
+        const Vec3<T> &pa = points[a], &pb = points[b], &pc = points[c];
+        const double ux = (double)pb.x - pa.x, uy = (double)pb.y - pa.y, uz = (double)pb.z - pa.z;
+        const double vx = (double)pc.x - pa.x, vy = (double)pc.y - pa.y, vz = (double)pc.z - pa.z;
+        double nx = uy * vz - uz * vy, ny = uz * vx - ux * vz, nz = ux * vy - uy * vx;
+        const double len = std::sqrt(nx * nx + ny * ny + nz * nz);
+
+        if (len > 0) {
+            nx /= len;
+            ny /= len;
+            nz /= len;
+        }
+
+        f->normal[0] = nx;
+        f->normal[1] = ny;
+        f->normal[2] = nz;
+        f->offset = nx * pa.x + ny * pa.y + nz * pa.z;
+
+        faces.push_back(f);
+        return f;
+    }
+
+    void add_outside(HullFace *f, const size_t i, const double d) {
+        next[i] = f->head;
+        f->head = i;
+        f->count++;
+
+        if (d > f->furthest_distance) {
+            f->furthest_distance = d;
+            f->furthest = i;
+        }
+    }
+
+    // Hands each candidate point to the first face it lies above. Large sets
+    // are classified on the pool and only linked on this thread.
+    void assign(const std::vector<size_t> &candidates, const std::vector<HullFace*> &targets) {
+        std::vector<uint32_t> owner(candidates.size());
+        std::vector<double> dist(candidates.size());
+
+        parallel_for(0, candidates.size(), 8192, [&](size_t lo, size_t hi) {
+            for (size_t k = lo; k != hi; k++) {
+                owner[k] = static_cast<uint32_t>(-1);
+
+                for (size_t f = 0; f != targets.size(); f++) {
+                    const double d = distance(targets[f], candidates[k]);
+
+                    if (d > eps) {
+                        owner[k] = static_cast<uint32_t>(f);
+                        dist[k] = d;
+                        break;
+                    }
+                }
+            }
+        });
+
+        for (size_t k = 0; k != candidates.size(); k++) {
+            if (owner[k] != static_cast<uint32_t>(-1)) {
+                add_outside(targets[owner[k]], candidates[k], dist[k]);
+            }
+        }
+    }
+
+    static void link(HullFace *f, const size_t a, const size_t b, HullFace *g) {
+        for (size_t i = 0; i != 3; i++) {
+            if (f->v[i] == a && f->v[(i + 1) % 3] == b) {
+                f->neighbor[i] = g;
+                return;
+            }
+        }
+
+        throw std::logic_error("hull faces are not adjacent");
+    }
+
+    // Index of the point with the largest score, scanned in fixed blocks on
+    // the pool so ties always go to the lowest index.
+    template <typename F>
+    std::pair<double, size_t> arg_max(F score) const {
+        const size_t n = points.size();
+        const size_t block = 1 << 16;
+        std::vector<std::pair<double, size_t>> found((n + block - 1) / block);
+
+        parallel_for(0, found.size(), 1, [&](size_t lo, size_t hi) {
+            for (size_t b = lo; b != hi; b++) {
+                std::pair<double, size_t> r(score(b * block), b * block);
+
+                for (size_t i = b * block + 1; i != std::min(n, (b + 1) * block); i++) {
+                    const double s = score(i);
+
+                    if (s > r.first) {
+                        r = std::make_pair(s, i);
+                    }
+                }
+
+                found[b] = r;
+            }
+        });
+
+        std::pair<double, size_t> r = found[0];
+        for (size_t b = 1; b != found.size(); b++) {
+            if (found[b].first > r.first) {
+                r = found[b];
+            }
+        }
+
+        return r;
+    }
+
+    void simplex() {
+        const size_t n = points.size();
+        const size_t lo = arg_max([&](size_t i) { return -(double)points[i].x; }).second;
+        const size_t hi = arg_max([&](size_t i) { return (double)points[i].x; }).second;
+
+        double scale = 0;
+        for (size_t d = 0; d != 3; d++) {
+            scale += arg_max([&](size_t i) { return std::fabs((double)points[i][d]); }).first;
+        }
+
+        eps = 3 * scale * DBL_EPSILON;
+
+        // Farthest from the line lo-hi, then farthest from that plane.
+        const Vec3<double> a(points[lo].x, points[lo].y, points[lo].z);
+        const Vec3<double> ab = Vec3<double>(points[hi].x, points[hi].y, points[hi].z) - a;
+
+        const std::pair<double, size_t> far_line = arg_max([&](size_t i) {
+            const Vec3<double> x = cross(ab, Vec3<double>(points[i].x, points[i].y, points[i].z) - a);
+            return x * x;
+        });
+
+        if (lo == hi || far_line.first <= eps * eps) {
+            throw std::domain_error("points should not all be collinear");
+        }
+
+        const size_t c = far_line.second;
+        HullFace *base = make_face(lo, hi, c);
+
+        const std::pair<double, size_t> far_plane = arg_max([&](size_t i) {
+            return std::fabs(distance(base, i));
+        });
+
+        const size_t d = far_plane.first > eps ? far_plane.second : none;
+
+        if (d == none) {
+            throw std::domain_error("points should not all be coplanar");
+        }
+
+        size_t v0 = lo, v1 = hi, v2 = c;
+        if (distance(base, d) > 0) {
+            std::swap(v1, v2);
+        }
+
+        faces.clear();
+        arena.reset();
+
+        HullFace *f0 = make_face(v0, v1, v2);
+        HullFace *f1 = make_face(v0, d, v1);
+        HullFace *f2 = make_face(v1, d, v2);
+        HullFace *f3 = make_face(v2, d, v0);
+
+        link(f0, v0, v1, f1);
+        link(f1, v1, v0, f0);
+        link(f0, v1, v2, f2);
+        link(f2, v2, v1, f0);
+        link(f0, v2, v0, f3);
+        link(f3, v0, v2, f0);
+        link(f1, v0, d, f3);
+        link(f3, d, v0, f1);
+        link(f1, d, v1, f2);
+        link(f2, v1, d, f1);
+        link(f2, d, v2, f3);
+        link(f3, v2, d, f2);
+
+        std::vector<size_t> all(n);
+        for (size_t i = 0; i != n; i++) {
+            all[i] = i;
+        }
+
+        assign(all, std::vector<HullFace*>({f0, f1, f2, f3}));
+    }
+
+    void add_point(HullFace *start, const size_t apex) {
+        tag++;
+
+        // Depth first search over the faces that can see the apex, recording
+        // the horizon edges where a visible face meets a hidden one.
+        std::vector<HullFace*> visible;
+        std::vector<std::pair<HullFace*, size_t>> horizon;
+        std::vector<std::pair<HullFace*, size_t>> stack;
+
+        start->visit = tag;
+        visible.push_back(start);
+        stack.push_back(std::make_pair(start, 0));
+
+        while (!stack.empty()) {
+            HullFace *f = stack.back().first;
+            const size_t e = stack.back().second;
+            stack.pop_back();
+
+            for (size_t i = e; i != 3; i++) {
+                HullFace *g = f->neighbor[i];
+
+                if (g->visit == tag) {
+                    continue;
+                }
+
+                if (distance(g, apex) > eps) {
+                    g->visit = tag;
+                    visible.push_back(g);
+                    stack.push_back(std::make_pair(f, i + 1));
+                    stack.push_back(std::make_pair(g, 0));
+                    break;
+                }
+
+                horizon.push_back(std::make_pair(f, i));
+            }
+        }
+
+        std::unordered_map<size_t, HullFace*> by_start, by_end;
+        std::vector<HullFace*> created;
+
+        for (size_t k = 0; k != horizon.size(); k++) {
+            HullFace *f = horizon[k].first;
+            const size_t i = horizon[k].second;
+            const size_t a = f->v[i], b = f->v[(i + 1) % 3];
+            HullFace *g = f->neighbor[i];
+            HullFace *h = make_face(a, b, apex);
+
+            h->neighbor[0] = g;
+            link(g, b, a, h);
+
+            by_start[a] = h;
+            by_end[b] = h;
+            created.push_back(h);
+        }
+
+        for (size_t k = 0; k != created.size(); k++) {
+            HullFace *h = created[k];
+
+            h->neighbor[1] = by_start.at(h->v[1]);
+            h->neighbor[2] = by_end.at(h->v[0]);
+        }
+
+        std::vector<size_t> orphans;
+        for (size_t k = 0; k != visible.size(); k++) {
+            HullFace *f = visible[k];
+
+            for (size_t i = f->head; i != none; i = next[i]) {
+                if (i != apex) {
+                    orphans.push_back(i);
+                }
+            }
+
+            f->dead = true;
+        }
+
+        assign(orphans, created);
+    }
+
+public:
+    QuickHull(const std::vector<Vec3<T>> &points):
+        points(points), next(points.size(), none), eps(0), tag(0)
+    {}
+
+    std::vector<std::array<size_t, 3>> run() {
+        simplex();
+
+        std::vector<HullFace*> pending(faces.begin(), faces.end());
+
+        while (!pending.empty()) {
+            HullFace *f = pending.back();
+            pending.pop_back();
+
+            if (f->dead || f->count == 0) {
+                continue;
+            }
+
+            const size_t first = faces.size();
+            add_point(f, f->furthest);
+
+            for (size_t i = first; i != faces.size(); i++) {
+                if (faces[i]->count) {
+                    pending.push_back(faces[i]);
+                }
+            }
+        }
+
+        std::vector<std::array<size_t, 3>> r;
+        for (size_t i = 0; i != faces.size(); i++) {
+            if (!faces[i]->dead) {
+                r.push_back({faces[i]->v[0], faces[i]->v[1], faces[i]->v[2]});
+            }
+        }
+
+        return r;
+    }
+};
+
+// Convex hull of a 3D point set as outward facing counter clockwise
+// triangles of indices into points. Throws std::domain_error when the points
+// are all collinear or coplanar.
+//
+// As in 2D, the extremes in 14 directions (the axes and the cube diagonals)
+// are hulled first, and every point strictly inside that polytope is
+// discarded in parallel before the full quickhull runs on the rest.
+template <typename T>
+std::vector<std::array<size_t, 3>> convex_hull(const std::vector<Vec3<T>> &points) {
+    const size_t n = points.size();
+
+    if (n < 4) {
+        throw std::length_error("3d hull needs at least 4 points");
+    }
+
+    const size_t block = 1 << 16;
+    std::vector<std::array<size_t, 14>> found((n + block - 1) / block);
+
+    const auto keys = [&](size_t i, double *v) {
+        const double x = points[i].x, y = points[i].y, z = points[i].z;
+
+        v[0] = x;  v[1] = -x;
+        v[2] = y;  v[3] = -y;
+        v[4] = z;  v[5] = -z;
+        v[6] = x + y + z;   v[7] = -v[6];
+        v[8] = x + y - z;   v[9] = -v[8];
+        v[10] = x - y + z;  v[11] = -v[10];
+        v[12] = -x + y + z; v[13] = -v[12];
+    };
+
+    parallel_for(0, found.size(), 1, [&](size_t lo, size_t hi) {
+        for (size_t b = lo; b != hi; b++) {
+            std::array<size_t, 14> &e = found[b];
+            double best[14], v[14];
+
+            e.fill(b * block);
+            keys(b * block, best);
+
+            for (size_t i = b * block + 1; i != std::min(n, (b + 1) * block); i++) {
+                keys(i, v);
+
+                for (size_t k = 0; k != 14; k++) {
+                    const bool greater = v[k] > best[k];
+
+                    best[k] = greater ? v[k] : best[k];
+                    e[k] = greater ? i : e[k];
+                }
+            }
+        }
+    });
+
+    std::vector<size_t> ext;
+    for (size_t k = 0; k != 14; k++) {
+        size_t e = found[0][k];
+        double ve[14], vb[14];
+
+        for (size_t b = 1; b != found.size(); b++) {
+            keys(found[b][k], vb);
+            keys(e, ve);
+
+            if (vb[k] > ve[k]) {
+                e = found[b][k];
+            }
+        }
+
+        ext.push_back(e);
+    }
+
+    std::sort(ext.begin(), ext.end());
+    ext.erase(std::unique(ext.begin(), ext.end()), ext.end());
+
+    std::vector<uint8_t> keep(n, 1);
+
+    if (ext.size() >= 4) {
+        std::vector<Vec3<T>> corners(ext.size());
+        for (size_t i = 0; i != ext.size(); i++) {
+            corners[i] = points[ext[i]];
+        }
+
+        std::vector<std::array<size_t, 3>> inner;
+        try {
+            QuickHull<T> q(corners);
+            inner = q.run();
+        } catch (const std::domain_error&) {
+            inner.clear();
+        }
+
+        // Plane of each face as nx * x + ny * y + nz * z + w, negative on
+        // the inside, with a margin so nothing near a face is dropped.
+        std::vector<Vec4<double>> planes;
+        double scale = 0;
+        for (size_t i = 0; i != corners.size(); i++) {
+            scale = std::max(scale, std::fabs((double)corners[i].x) + std::fabs((double)corners[i].y) + std::fabs((double)corners[i].z));
+        }
+
+        for (size_t f = 0; f != inner.size(); f++) {
+            const Vec3<T> &pa = corners[inner[f][0]], &pb = corners[inner[f][1]], &pc = corners[inner[f][2]];
+            const Vec3<double> a(pa.x, pa.y, pa.z);
+            const Vec3<double> nrm = cross(Vec3<double>(pb.x, pb.y, pb.z) - a, Vec3<double>(pc.x, pc.y, pc.z) - a);
+            const double len = std::sqrt(nrm * nrm);
+
+            if (len > 0) {
+                const Vec3<double> u = nrm / len;
+                planes.push_back(Vec4<double>(u.x, u.y, u.z, -(u * a) + 64 * scale * DBL_EPSILON));
+            }
+        }
+
+        if (planes.size() >= 4) {
+            parallel_for(0, n, 1 << 16, [&](size_t lo, size_t hi) {
+                const Vec3<T> *p = points.data();
+                uint8_t *out = keep.data();
+
+                for (size_t i = lo; i != hi; i++) {
+                    const double x = p[i].x, y = p[i].y, z = p[i].z;
+                    double margin = -(planes[0].x * x + planes[0].y * y + planes[0].z * z + planes[0].w);
+
+                    for (size_t f = 1; f != planes.size(); f++) {
+                        margin = std::min(margin, -(planes[f].x * x + planes[f].y * y + planes[f].z * z + planes[f].w));
+                    }
+
+                    out[i] = !(margin > 0);
+                }
+            });
+        }
+    }
+
+    std::vector<size_t> ids;
+    for (size_t i = 0; i != n; i++) {
+        if (keep[i]) {
+            ids.push_back(i);
+        }
+    }
+
+    std::vector<Vec3<T>> rest(ids.size());
+    for (size_t i = 0; i != ids.size(); i++) {
+        rest[i] = points[ids[i]];
+    }
+
+    if (rest.size() < 4) {
+        throw std::domain_error("points should not all be coplanar");
+    }
+
+    QuickHull<T> q(rest);
+    std::vector<std::array<size_t, 3>> r = q.run();
+
+    for (size_t f = 0; f != r.size(); f++) {
+        for (size_t k = 0; k != 3; k++) {
+            r[f][k] = ids[r[f][k]];
+        }
+    }
+
+    return r;
+}
+
+#endif
@@ -0,0 +1,480 @@
+#ifndef INVERSE_H
+#define INVERSE_H
+
+#include <vector>
+#include <cmath>
+#include <limits>
+#include <algorithm>
+#include <stdexcept>
+
+#include "geometry.h"
+#include "parallel.h"
+#include "qr.h"
+
+// MaintainedInverse
+//
+// A square matrix together with its inverse, kept up to date through low
+// rank changes with the Sherman-Morrison-Woodbury formula,
+//
+//   (A + U V^T)^-1 = A^-1 - A^-1 U (I + V^T A^-1 U)^-1 V^T A^-1,
+//
+// in O(n^2 k) for a rank k change instead of O(n^3) for a new inverse.
+//
+// The changes are not written into the n x n arrays one at a time: both
+// the matrix and its inverse are kept as a base plus a list of rank one
+// terms, and the terms are folded into the bases once there are
+// fold_size of them. An update then reads the inverse once, for A^-1 u
+// and v^T A^-1 together, and the passes that write it are shared by many
+// updates.
+//
+// Rounding accumulates with every update, so every interval updates the
+// residual |A (A^-1 p) - p| is measured for a fixed probe p, and when it
+// is above the tolerance the inverse is computed again from the matrix
+// with QR.
+template <typename T>
+class MaintainedInverse {
+private:
+    typedef typename accumulate_type<T>::type A;
+
+    static constexpr size_t fold_size = 16;
+    static constexpr size_t row_block = 64;
+
+    size_t n;
+    size_t interval;
+    A tolerance;
+    size_t count;
+
+    // The matrix is a + sum u_i v_i^T and the inverse b - sum x_i y_i^T,
+    // all row major, with the pending vectors stored one after the other.
+    std::vector<A> a, b;
+    std::vector<A> pu, pv, px, py;
+
+    size_t pending() const {
+        return px.size() / n;
+    }
+
+    // x_c = A^-1 u_c and y_c = v_c^T A^-1 for k vectors u and v, in one
+    // pass over the rows of b; y is skipped when v is null. Each block of
+    // rows adds into its own partial y, and the partials are added in block
+    // order, so the result does not depend on the thread count.
+    void apply(const A *u, const A *v, const size_t k, A *x, A *y) const {
+        const size_t blocks = (n + row_block - 1) / row_block;
+        std::vector<A> partial(v ? blocks * k * n : 0, A(0));
+
+        parallel_for(0, blocks, 1, [&](size_t lo, size_t hi) {
+            for (size_t blk = lo; blk != hi; blk++) {
+                for (size_t r = blk * row_block; r != std::min(n, (blk + 1) * row_block); r++) {
+                    const A *br = b.data() + r * n;
+
+                    for (size_t c = 0; c != k; c++) {
+                        const A *uc = u + c * n;
+
+                        // Four sums, so the dot product does not wait on
+                        // the latency of each addition.
+                        A s[4] = {0, 0, 0, 0};
+                        size_t j = 0;
+
+                        if (v) {
+                            A *yc = partial.data() + (blk * k + c) * n;
+                            const A vr = v[c * n + r];
+
+                            for (; j + 4 <= n; j += 4) {
+                                s[0] += br[j] * uc[j];
+                                s[1] += br[j + 1] * uc[j + 1];
+                                s[2] += br[j + 2] * uc[j + 2];
+                                s[3] += br[j + 3] * uc[j + 3];
+
+                                yc[j] += vr * br[j];
+                                yc[j + 1] += vr * br[j + 1];
+                                yc[j + 2] += vr * br[j + 2];
+                                yc[j + 3] += vr * br[j + 3];
+                            }
+
+                            for (; j != n; j++) {
+                                s[0] += br[j] * uc[j];
+                                yc[j] += vr * br[j];
+                            }
+                        } else {
+                            for (; j + 4 <= n; j += 4) {
+                                s[0] += br[j] * uc[j];
+                                s[1] += br[j + 1] * uc[j + 1];
+                                s[2] += br[j + 2] * uc[j + 2];
+                                s[3] += br[j + 3] * uc[j + 3];
+                            }
+
+                            for (; j != n; j++) {
+                                s[0] += br[j] * uc[j];
+                            }
+                        }
+
+                        x[c * n + r] = (s[0] + s[1]) + (s[2] + s[3]);
+                    }
+                }
+            }
+        });
+
+        if (v) {
+            std::fill(y, y + k * n, A(0));
+
+            for (size_t blk = 0; blk != blocks; blk++) {
+                const A *block_y = partial.data() + blk * k * n;
+
+                for (size_t i = 0; i != k * n; i++) {
+                    y[i] += block_y[i];
+                }
+            }
+        }
+
+        // The pending terms of the inverse.
+        for (size_t p = 0; p != pending(); p++) {
+            const A *xp = px.data() + p * n, *yp = py.data() + p * n;
+
+            for (size_t c = 0; c != k; c++) {
+                A yu = 0;
+                for (size_t j = 0; j != n; j++) {
+                    yu += yp[j] * u[c * n + j];
+                }
+
+                for (size_t j = 0; j != n; j++) {
+                    x[c * n + j] -= xp[j] * yu;
+                }
+
+                if (v) {
+                    A vx = 0;
+                    for (size_t j = 0; j != n; j++) {
+                        vx += v[c * n + j] * xp[j];
+                    }
+
+                    for (size_t j = 0; j != n; j++) {
+                        y[c * n + j] -= vx * yp[j];
+                    }
+                }
+            }
+        }
+    }
+
+    // m += sign * sum l_i r_i^T over the rows of m.
+    void add_terms(std::vector<A> &m, const std::vector<A> &l, const std::vector<A> &r, const A sign) {
+        const size_t k = l.size() / n;
+
+        parallel_for(0, n, row_block, [&](size_t lo, size_t hi) {
+            for (size_t i = lo; i != hi; i++) {
+                A *mi = m.data() + i * n;
+
+                for (size_t p = 0; p != k; p++) {
+                    const A f = sign * l[p * n + i];
+                    const A *rp = r.data() + p * n;
+
+                    for (size_t j = 0; j != n; j++) {
+                        mi[j] += f * rp[j];
+                    }
+                }
+            }
+        });
+    }
+
+    void fold() {
+        if (pending() == 0) {
+            return;
+        }
+
+        add_terms(a, pu, pv, A(1));
+        add_terms(b, px, py, A(-1));
+
+        pu.clear();
+        pv.clear();
+        px.clear();
+        py.clear();
+    }
+
+    // max |A (A^-1 p) - p| for p alternating +1 and -1.
+    A residual() {
+        fold();
+
+        std::vector<A> p(n), z(n, A(0));
+        for (size_t i = 0; i != n; i++) {
+            p[i] = i % 2 ? -1 : 1;
+        }
+
+        parallel_for(0, n, row_block, [&](size_t lo, size_t hi) {
+            for (size_t i = lo; i != hi; i++) {
+                for (size_t j = 0; j != n; j++) {
+                    z[i] += b[i * n + j] * p[j];
+                }
+            }
+        });
+
+        A r = 0;
+        for (size_t i = 0; i != n; i++) {
+            A s = 0;
+
+            for (size_t j = 0; j != n; j++) {
+                s += a[i * n + j] * z[j];
+            }
+
+            r = std::max(r, std::fabs(s - p[i]));
+        }
+
+        return r;
+    }
+
+    // Solves the k x k system c x = r in place, with partial pivoting. A
+    // pivot not above threshold counts as zero.
+    static void solve_small(std::vector<A> c, A *r, const size_t k, const size_t columns, const A threshold) {
+        for (size_t i = 0; i != k; i++) {
+            size_t pivot = i;
+            for (size_t j = i + 1; j != k; j++) {
+                if (std::fabs(c[j * k + i]) > std::fabs(c[pivot * k + i])) {
+                    pivot = j;
+                }
+            }
+
+            if (std::fabs(c[pivot * k + i]) <= threshold) {
+                throw std::domain_error("update makes the matrix singular");
+            }
+
+            if (pivot != i) {
+                std::swap_ranges(c.begin() + i * k, c.begin() + (i + 1) * k, c.begin() + pivot * k);
+                std::swap_ranges(r + i * columns, r + (i + 1) * columns, r + pivot * columns);
+            }
+
+            for (size_t j = i + 1; j != k; j++) {
+                const A f = c[j * k + i] / c[i * k + i];
+
+                for (size_t l = i; l != k; l++) {
+                    c[j * k + l] -= f * c[i * k + l];
+                }
+
+                for (size_t l = 0; l != columns; l++) {
+                    r[j * columns + l] -= f * r[i * columns + l];
+                }
+            }
+        }
+
+        for (size_t i = k; i-- != 0;) {
+            for (size_t j = i + 1; j != k; j++) {
+                for (size_t l = 0; l != columns; l++) {
+                    r[i * columns + l] -= c[i * k + j] * r[j * columns + l];
+                }
+            }
+
+            for (size_t l = 0; l != columns; l++) {
+                r[i * columns + l] /= c[i * k + i];
+            }
+        }
+    }
+
+    // A += sum u_c v_c^T for the k vectors stored one after the other.
+    void update(const std::vector<A> &u, const std::vector<A> &v, const size_t k) {
+        std::vector<A> x(k * n), y(k * n);
+        apply(u.data(), v.data(), k, x.data(), y.data());
+
+        // c = I + V^T A^-1 U, then y = c^-1 V^T A^-1 so that the new
+        // inverse is A^-1 - sum x_c y_c^T. Throws before anything changes
+        // when c is singular.
+        // The threshold for a zero pivot is the rounding error of the sums
+        // that make up c.
+        std::vector<A> c(k * k);
+        A scale = 1;
+
+        for (size_t i = 0; i != k; i++) {
+            for (size_t j = 0; j != k; j++) {
+                A s = i == j ? 1 : 0, magnitude = 0;
+
+                for (size_t l = 0; l != n; l++) {
+                    s += v[i * n + l] * x[j * n + l];
+                    magnitude += std::fabs(v[i * n + l] * x[j * n + l]);
+                }
+
+                c[i * k + j] = s;
+                scale = std::max(scale, magnitude);
+            }
+        }
+
+        solve_small(c, y.data(), k, n, n * std::numeric_limits<A>::epsilon() * scale);
+
+        pu.insert(pu.end(), u.begin(), u.end());
+        pv.insert(pv.end(), v.begin(), v.end());
+        px.insert(px.end(), x.begin(), x.end());
+        py.insert(py.end(), y.begin(), y.end());
+
+        if (pending() >= fold_size) {
+            fold();
+        }
+
+        count += k;
+        if (count >= interval) {
+            count = 0;
+
+            if (!(residual() <= tolerance)) {
+                refactor();
+            }
+        }
+    }
+
+    std::vector<A> to_vector(const std::vector<T> &v) const {
+        if (v.size() != n) {
+            throw std::length_error("vector size should be equal to matrix size");
+        }
+
+        return std::vector<A>(v.begin(), v.end());
+    }
+
+    // Column j of m, for each column, one after the other.
+    std::vector<A> to_columns(const Matrix<T> &m) const {
+        if (m.rows != n) {
+            throw std::length_error("matrix rows should be equal to matrix size");
+        }
+
+        std::vector<A> r(m.cols * n);
+        for (size_t i = 0; i != n; i++) {
+            for (size_t j = 0; j != m.cols; j++) {
+                r[j * n + i] = m[i][j];
+            }
+        }
+
+        return r;
+    }
+
+    A element(const size_t i, const size_t j) const {
+        A r = a[i * n + j];
+
+        for (size_t p = 0; p != pu.size() / n; p++) {
+            r += pu[p * n + i] * pv[p * n + j];
+        }
+
+        return r;
+    }
+
+public:
+    MaintainedInverse(const Matrix<T> &m, const size_t interval = 64, const A tolerance = -1):
+        n(m.rows), interval(std::max<size_t>(interval, 1)),
+        tolerance(tolerance < 0 ? std::sqrt(std::numeric_limits<A>::epsilon()) : tolerance),
+        count(0), a(n * n), b(n * n)
+    {
+        if (m.rows != m.cols) {
+            throw std::length_error("rows must be equal to cols for inversion");
+        }
+
+        for (size_t i = 0; i != n; i++) {
+            for (size_t j = 0; j != n; j++) {
+                a[i * n + j] = m[i][j];
+            }
+        }
+
+        refactor();
+    }
+
+    size_t size() const {
+        return n;
+    }
+
+    // Computes the inverse again from the matrix, which throws
+    // domain_error if it is singular.
+    void refactor() {
+        fold();
+
+        Matrix<A> m(n, n), identity(n, n);
+        for (size_t i = 0; i != n; i++) {
+            for (size_t j = 0; j != n; j++) {
+                m[i][j] = a[i * n + j];
+            }
+
+            identity[i][i] = 1;
+        }
+
+        const Matrix<A> r = QR<A>(m).solve(identity);
+        for (size_t i = 0; i != n; i++) {
+            for (size_t j = 0; j != n; j++) {
+                b[i * n + j] = r[i][j];
+            }
+        }
+
+        count = 0;
+    }
+
+    // A += u v^T.
+    void update(const std::vector<T> &u, const std::vector<T> &v) {
+        update(to_vector(u), to_vector(v), 1);
+    }
+
+    // A += U V^T for n x k matrices U and V.
+    void update(const Matrix<T> &u, const Matrix<T> &v) {
+        if (u.cols != v.cols) {
+            throw std::length_error("update matrices should have the same cols");
+        }
+
+        update(to_columns(u), to_columns(v), u.cols);
+    }
+
+    void set_row(const size_t i, const std::vector<T> &row) {
+        std::vector<A> u(n, A(0)), v = to_vector(row);
+
+        u[i] = 1;
+        for (size_t j = 0; j != n; j++) {
+            v[j] -= element(i, j);
+        }
+
+        update(u, v, 1);
+    }
+
+    void set_column(const size_t j, const std::vector<T> &column) {
+        std::vector<A> u = to_vector(column), v(n, A(0));
+
+        v[j] = 1;
+        for (size_t i = 0; i != n; i++) {
+            u[i] -= element(i, j);
+        }
+
+        update(u, v, 1);
+    }
+
+    void set(const size_t i, const size_t j, const T value) {
+        std::vector<A> u(n, A(0)), v(n, A(0));
+
+        u[i] = 1;
+        v[j] = value - element(i, j);
+
+        update(u, v, 1);
+    }
+
+    // x = A^-1 b in O(n^2).
+    std::vector<T> solve(const std::vector<T> &rhs) const {
+        std::vector<A> u = to_vector(rhs), x(n);
+        apply(u.data(), nullptr, 1, x.data(), nullptr);
+
+        return std::vector<T>(x.begin(), x.end());
+    }
+
+    Matrix<T> matrix() const {
+        Matrix<T> r(n, n);
+
+        for (size_t i = 0; i != n; i++) {
+            for (size_t j = 0; j != n; j++) {
+                r[i][j] = static_cast<T>(element(i, j));
+            }
+        }
+
+        return r;
+    }
+
+    Matrix<T> inverse() const {
+        Matrix<T> r(n, n);
+
+        for (size_t i = 0; i != n; i++) {
+            for (size_t j = 0; j != n; j++) {
+                A s = b[i * n + j];
+
+                for (size_t p = 0; p != pending(); p++) {
+                    s -= px[p * n + i] * py[p * n + j];
+                }
+
+                r[i][j] = static_cast<T>(s);
+            }
+        }
+
+        return r;
+    }
+};
+
+#endif
@@ -0,0 +1,338 @@
+#ifndef KDTREE_H
+#define KDTREE_H
+
+#include <vector>
+#include <limits>
+#include <cstdint>
+#include <algorithm>
+#include <stdexcept>
+
+#include "geometry.h"
+#include "parallel.h"
+
+// KDTree
+//
+// Implicit k-d tree over Vec2 or Vec3 points. The tree is the point array
+// itself: the range [lo, hi) has its splitting point at mid = (lo + hi) / 2,
+// with the left subtree in [lo, mid) and the right one in (mid, hi). Ranges
+// of at most leaf_size points are left unsorted and scanned linearly.
+template <typename V>
+class KDTree {
+private:
+    typedef typename vec_traits<V>::value_type T;
+
+    static constexpr size_t dims = vec_traits<V>::size;
+    static constexpr size_t leaf_size = 8;
+
+    class Range {
+    public:
+        size_t lo, hi;
+    };
+
+    std::vector<V> points;
+    std::vector<size_t> ids;
+    std::vector<uint8_t> axis;
+
+    void build_range(const std::vector<V> &src, size_t lo, size_t hi, std::vector<Range> *jobs, const size_t threshold) {
+        while (hi - lo > leaf_size) {
+            if (jobs && hi - lo < threshold) {
+                Range r;
+                r.lo = lo;
+                r.hi = hi;
+                jobs->push_back(r);
+                return;
+            }
+
+            V min = src[ids[lo]], max = src[ids[lo]];
+            for (size_t i = lo + 1; i != hi; i++) {
+                const V &p = src[ids[i]];
+
+                for (size_t d = 0; d != dims; d++) {
+                    min[d] = std::min(min[d], p[d]);
+                    max[d] = std::max(max[d], p[d]);
+                }
+            }
+
+            size_t split = 0;
+            for (size_t d = 1; d != dims; d++) {
+                if (max[d] - min[d] > max[split] - min[split]) {
+                    split = d;
+                }
+            }
+
+            const size_t mid = lo + (hi - lo) / 2;
+            std::nth_element(ids.begin() + lo, ids.begin() + mid, ids.begin() + hi, [&](size_t a, size_t b) {
+                return src[a][split] < src[b][split];
+            });
+
+            axis[mid] = static_cast<uint8_t>(split);
+
+            build_range(src, lo, mid, jobs, threshold);
+            lo = mid + 1;
+        }
+    }
+
+    // Max-heap of the k best candidates seen so far, worst on top.
+    class Candidates {
+    public:
+        size_t k;
+        std::vector<std::pair<T, size_t>> heap;
+
+        Candidates(const size_t k): k(k) {
+            heap.reserve(k);
+        }
+
+        T bound() const {
+            return heap.size() < k ? std::numeric_limits<T>::max() : heap.front().first;
+        }
+
+        void offer(const T d, const size_t i) {
+            if (heap.size() < k) {
+                heap.push_back(std::make_pair(d, i));
+                std::push_heap(heap.begin(), heap.end());
+            } else if (d < heap.front().first) {
+                std::pop_heap(heap.begin(), heap.end());
+                heap.back() = std::make_pair(d, i);
+                std::push_heap(heap.begin(), heap.end());
+            }
+        }
+    };
+
+    void search_knn(const V &q, size_t lo, size_t hi, Candidates &c) const {
+        while (hi - lo > leaf_size) {
+            const size_t mid = lo + (hi - lo) / 2;
+            const size_t d = axis[mid];
+
+            c.offer(distance2(q, points[mid]), mid);
+
+            const T diff = q[d] - points[mid][d];
+            if (diff < 0) {
+                search_knn(q, lo, mid, c);
+
+                if (diff * diff >= c.bound()) {
+                    return;
+                }
+                lo = mid + 1;
+            } else {
+                search_knn(q, mid + 1, hi, c);
+
+                if (diff * diff >= c.bound()) {
+                    return;
+                }
+                hi = mid;
+            }
+        }
+
+        for (size_t i = lo; i != hi; i++) {
+            c.offer(distance2(q, points[i]), i);
+        }
+    }
+
+    void search_nearest(const V &q, size_t lo, size_t hi, T &best, size_t &found) const {
+        while (hi - lo > leaf_size) {
+            const size_t mid = lo + (hi - lo) / 2;
+            const size_t d = axis[mid];
+
+            const T dm = distance2(q, points[mid]);
+            if (dm < best) {
+                best = dm;
+                found = mid;
+            }
+
+            const T diff = q[d] - points[mid][d];
+            if (diff < 0) {
+                search_nearest(q, lo, mid, best, found);
+                lo = mid + 1;
+            } else {
+                search_nearest(q, mid + 1, hi, best, found);
+                hi = mid;
+            }
+
+            if (diff * diff >= best) {
+                return;
+            }
+        }
+
+        for (size_t i = lo; i != hi; i++) {
+            const T di = distance2(q, points[i]);
+
+            if (di < best) {
+                best = di;
+                found = i;
+            }
+        }
+    }
+
+    void search_radius(const V &q, const T r2, size_t lo, size_t hi, std::vector<size_t> &out) const {
+        while (hi - lo > leaf_size) {
+            const size_t mid = lo + (hi - lo) / 2;
+            const size_t d = axis[mid];
+
+            if (distance2(q, points[mid]) <= r2) {
+                out.push_back(ids[mid]);
+            }
+
+            const T diff = q[d] - points[mid][d];
+            if (diff < 0) {
+                if (diff * diff <= r2) {
+                    search_radius(q, r2, mid + 1, hi, out);
+                }
+                hi = mid;
+            } else {
+                if (diff * diff <= r2) {
+                    search_radius(q, r2, lo, mid, out);
+                }
+                lo = mid + 1;
+            }
+        }
+
+        for (size_t i = lo; i != hi; i++) {
+            if (distance2(q, points[i]) <= r2) {
+                out.push_back(ids[i]);
+            }
+        }
+    }
+
+public:
+    KDTree() {}
+
+    KDTree(const std::vector<V> &p) {
+        build(p);
+    }
+
+    void build(const std::vector<V> &p) {
+        ids.resize(p.size());
+        axis.assign(p.size(), 0);
+
+        for (size_t i = 0; i != ids.size(); i++) {
+            ids[i] = i;
+        }
+
+        // Split the first levels here, then build the disjoint subranges
+        // that are left over on the pool.
+        std::vector<Range> jobs;
+        const size_t threshold = std::max<size_t>(16384, p.size() / (4 * thread_count()));
+
+        build_range(p, 0, p.size(), &jobs, threshold);
+
+        parallel_for(0, jobs.size(), 1, [&](size_t lo, size_t hi) {
+            for (size_t j = lo; j != hi; j++) {
+                build_range(p, jobs[j].lo, jobs[j].hi, nullptr, 0);
+            }
+        });
+
+        points.resize(p.size());
+        for (size_t i = 0; i != p.size(); i++) {
+            points[i] = p[ids[i]];
+        }
+    }
+
+    size_t size() const {
+        return points.size();
+    }
+
+    // Index into the original point array of the closest point to q.
+    size_t nearest(const V &q) const {
+        if (points.empty()) {
+            throw std::length_error("kd tree should not be empty");
+        }
+
+        T best = std::numeric_limits<T>::max();
+        size_t found = 0;
+        search_nearest(q, 0, points.size(), best, found);
+
+        return ids[found];
+    }
+
+    // The k closest points to q, nearest first. dist2 receives the squared
+    // distances when given.
+    void nearest(const V &q, const size_t k, std::vector<size_t> &out, std::vector<T> *dist2 = nullptr) const {
+        Candidates c(std::min(k, points.size()));
+
+        out.clear();
+        if (c.k == 0) {
+            if (dist2) {
+                dist2->clear();
+            }
+            return;
+        }
+
+        search_knn(q, 0, points.size(), c);
+        std::sort_heap(c.heap.begin(), c.heap.end());
+
+        out.resize(c.heap.size());
+        for (size_t i = 0; i != c.heap.size(); i++) {
+            out[i] = ids[c.heap[i].second];
+        }
+
+        if (dist2) {
+            dist2->resize(c.heap.size());
+            for (size_t i = 0; i != c.heap.size(); i++) {
+                (*dist2)[i] = c.heap[i].first;
+            }
+        }
+    }
+
+    std::vector<size_t> nearest(const V &q, const size_t k) const {
+        std::vector<size_t> r;
+
+        nearest(q, k, r);
+
+        return r;
+    }
+
+    // Every point within distance r of q, in no particular order.
+    void radius(const V &q, const T r, std::vector<size_t> &out) const {
+        out.clear();
+        search_radius(q, r * r, 0, points.size(), out);
+    }
+
+    std::vector<size_t> radius(const V &q, const T r) const {
+        std::vector<size_t> out;
+
+        radius(q, r, out);
+
+        return out;
+    }
+
+    void nearest(const std::vector<V> &queries, std::vector<size_t> &out) const {
+        out.resize(queries.size());
+
+        parallel_for(0, queries.size(), 1024, [&](size_t lo, size_t hi) {
+            for (size_t i = lo; i != hi; i++) {
+                out[i] = nearest(queries[i]);
+            }
+        });
+    }
+
+    // Row i of out holds the k nearest neighbors of queries[i], so out is
+    // queries.size() * min(k, size()) long.
+    void nearest(const std::vector<V> &queries, const size_t k, std::vector<size_t> &out) const {
+        const size_t kk = std::min(k, points.size());
+        out.resize(queries.size() * kk);
+
+        parallel_for(0, queries.size(), 256, [&](size_t lo, size_t hi) {
+            std::vector<size_t> r;
+
+            for (size_t i = lo; i != hi; i++) {
+                nearest(queries[i], kk, r);
+                std::copy(r.begin(), r.end(), out.begin() + i * kk);
+            }
+        });
+    }
+
+    void radius(const std::vector<V> &queries, const T r, std::vector<std::vector<size_t>> &out) const {
+        out.resize(queries.size());
+
+        parallel_for(0, queries.size(), 256, [&](size_t lo, size_t hi) {
+            for (size_t i = lo; i != hi; i++) {
+                radius(queries[i], r, out[i]);
+            }
+        });
+    }
+};
+
+typedef KDTree<Vec2f> KDTree2f;
+typedef KDTree<Vec3f> KDTree3f;
+
+#endif
@@ -1,8 +1,29 @@
 #include <iostream>
 #include <initializer_list>
 #include <vector>
+#include <algorithm>
+#include <limits>
 
 #include "geometry.h"
+#include "bounds.h"
+#include "bvh.h"
+#include "kdtree.h"
+#include "grid.h"
+#include "hull.h"
+#include "predicates.h"
+#include "half.h"
+#include "multiply.h"
+#include "qr.h"
+#include "eigen.h"
+#include "cholesky.h"
+#include "structured.h"
+#include "inverse.h"
+#include "streaming.h"
+#include "cache.h"
+#include "shared.h"
+#include "reductions.h"
+#include "numa.h"
+#include "async.h"
 #include "print.h"
 
 void test_matrix() {
@@ -177,6 +198,93 @@ void test_matrix() {
     cout << "l / 2: " << endl << l / 2 << endl << endl;
 }
 
+void test_storage() {
+    using namespace std;
+
+    // 4 x 4 fits inline, 4 x 5 does not, 3 x 5 fits again.
+    Matrix<int> a(4, 4);
+    for (size_t i = 0; i != 16; i++) {
+        a.data()[i] = i;
+    }
+    a.add_col(-1);
+    cout << "a.add_col(-1): " << endl << a << endl;
+    a.remove_rows(1);
+    cout << "a.remove_rows(1): " << endl << a << endl;
+    a.add_rows(2, 7);
+    cout << "a.add_rows(2, 7): " << endl << a << endl;
+    a.remove_cols(3);
+    cout << "a.remove_cols(3): " << endl << a << endl;
+
+    Matrix<double> b({{1, 2, 3}, {4, 5, 6}});
+    b.transpose();
+    cout << "b.transpose(): " << endl << b << endl;
+
+    // Rows keep the std::vector interface.
+    double row_sum = 0;
+    for (const double x : b[2]) {
+        row_sum += x;
+    }
+    b[0] = vector<double>({7, 8});
+    b[1] = b[0];
+    const vector<double> last = b[2];
+    cout << "b[2].size(), sum of b[2]: " << b[2].size() << " " << row_sum << endl;
+    cout << "b[0], b[1], last: " << b[0] << "| " << b[1] << "| " << last << endl;
+    cout << "b[0] == b[1]: " << (b[0] == b[1]) << endl;
+    try {
+        b[0] = vector<double>(3);
+    } catch (const length_error &e) {
+        cout << "b[0] = vector(3): " << e.what() << endl;
+    }
+
+    const Matrix<int> c({{2, -1, 0}, {1, 3, 2}, {0, 1, 4}});
+    cout << "c.determinant(): " << c.determinant() << endl;
+
+    Vec3<double> u(1, 2, 3);
+    Matrix<double> v(u);
+    cout << "Matrix(u).data()[2]: " << v.data()[2] << endl;
+
+    // The fixed 2, 3 and 4 kernels against the general loop, which a 5 x 5
+    // matrix with the n x n block in its corner and 1 on the rest of the
+    // diagonal goes through.
+    for (size_t n = 2; n != 5; n++) {
+        Matrix<double> s(n, n), t(n, n);
+        for (size_t i = 0; i != n; i++) {
+            for (size_t j = 0; j != n; j++) {
+                s[i][j] = 1.0 / (i + 2 * j + 1) + (i == j ? 2 : 0);
+                t[i][j] = 0.5 * i - 0.25 * j + (i == j ? 1 : 0);
+            }
+        }
+
+        Matrix<double> big_s(5), big_t(5);
+        for (size_t i = 0; i != n; i++) {
+            for (size_t j = 0; j != n; j++) {
+                big_s[i][j] = s[i][j];
+                big_t[i][j] = t[i][j];
+            }
+        }
+
+        Matrix<double> product(s), inverse(s), big_product(big_s), big_inverse(big_s);
+        product *= t;
+        inverse.invert();
+        big_product *= big_t;
+        big_inverse.invert();
+
+        size_t product_differs = 0;
+        double inverse_error = 0;
+        for (size_t i = 0; i != n; i++) {
+            for (size_t j = 0; j != n; j++) {
+                product_differs += product[i][j] != big_product[i][j];
+                inverse_error = max(inverse_error, fabs(inverse[i][j] - big_inverse[i][j]));
+            }
+        }
+
+        cout << n << "x" << n << " products differing: " << product_differs
+             << ", inverse error < 1e-12: " << (inverse_error < 1e-12)
+             << ", determinant error < 1e-12: " << (fabs(s.determinant() - big_s.determinant()) < 1e-12) << endl;
+    }
+    cout << endl;
+}
+
 void test_vec2() {
     using namespace std;
 
@@ -553,9 +661,942 @@ void test_vec4() {
     Vec4f vec = uf * mm;
 }
 
+void test_bounds() {
+    using namespace std;
+
+    AABBf a(Vec3f(-1, -1, -1), Vec3f(1, 1, 1));
+    cout << "a: " << a << endl << endl;
+
+    AABBf b;
+    b.expand(Vec3f(0.5, 0.5, 0.5));
+    b.expand(Vec3f(3, 2, 1));
+    cout << "b: " << b << endl << endl;
+    cout << "intersects(a, b): " << intersects(a, b) << endl << endl;
+    cout << "b.center(): " << b.center() << endl << endl;
+    cout << "b.surface_area(): " << b.surface_area() << endl << endl;
+
+    Matrix<float> proj(4);
+    Frustumf f(proj);
+    cout << "f.contains(Vec3f(0, 0, 0)): " << f.contains(Vec3f(0, 0, 0)) << endl;
+    cout << "f.contains(Vec3f(2, 0, 0)): " << f.contains(Vec3f(2, 0, 0)) << endl << endl;
+
+    AABBBatch<float> boxes;
+    for (int i = 0; i != 40; i++) {
+        const float x = i * 0.1f - 2;
+        boxes.push_back(AABBf(Vec3f(x, 0, 0), Vec3f(x + 0.05f, 0.05f, 0.05f)));
+    }
+
+    vector<uint32_t> visible = cull(f, boxes);
+    cout << "cull(f, boxes) count: " << mask_count(visible) << endl;
+    cout << "cull(f, boxes) indices: " << mask_indices(visible) << endl << endl;
+
+    vector<uint32_t> hit = overlaps(a, boxes);
+    cout << "overlaps(a, boxes) indices: " << mask_indices(hit) << endl << endl;
+}
+
+void test_bvh() {
+    using namespace std;
+
+    vector<Vec3f> v;
+    vector<array<size_t, 3>> t;
+    for (int i = 0; i != 16; i++) {
+        for (int j = 0; j != 16; j++) {
+            v.push_back(Vec3f(i, j, (i + j) % 3));
+        }
+    }
+    for (size_t i = 0; i != 15; i++) {
+        for (size_t j = 0; j != 15; j++) {
+            t.push_back({i * 16 + j, i * 16 + j + 1, (i + 1) * 16 + j});
+            t.push_back({i * 16 + j + 1, (i + 1) * 16 + j + 1, (i + 1) * 16 + j});
+        }
+    }
+
+    BVHf bvh(v, t);
+    cout << "bvh.size(): " << bvh.size() << endl;
+    cout << "bvh.node_count(): " << bvh.node_count() << endl;
+    cout << "bvh.bounds(): " << bvh.bounds() << endl << endl;
+
+    Rayf r(Vec3f(3.25, 4.5, 10), Vec3f(0, 0, -1));
+    Hit<float> h = bvh.intersect(r);
+    cout << "bvh.intersect(r): " << h.triangle << " " << h.t << endl;
+    cout << "bvh.occluded(r): " << bvh.occluded(r) << endl;
+
+    Hit<float> brute;
+    for (size_t i = 0; i != t.size(); i++) {
+        if (intersect_triangle(r, v[t[i][0]], v[t[i][1]], v[t[i][2]], brute)) {
+            brute.triangle = i;
+        }
+    }
+    cout << "brute force: " << brute.triangle << " " << brute.t << endl << endl;
+
+    vector<Rayf> rays;
+    for (int i = 0; i != 8; i++) {
+        rays.push_back(Rayf(Vec3f(i * 2.5f - 1, 7.5, 10), Vec3f(0, 0, -1)));
+    }
+    vector<Hit<float>> hits;
+    bvh.intersect(rays, hits);
+    cout << "bvh.intersect(rays): ";
+    for (size_t i = 0; i != hits.size(); i++) {
+        cout << hits[i].t << " ";
+    }
+    cout << endl;
+
+    vector<uint32_t> blocked;
+    bvh.occluded(rays, blocked);
+    cout << "bvh.occluded(rays): " << mask_indices(blocked) << endl;
+
+    // Packets against one ray at a time, with rays of varying direction
+    // and some that miss the mesh.
+    vector<Rayf> fan;
+    for (int i = 0; i != 1000; i++) {
+        const float a = i * 0.0137f, b = i * 0.0291f;
+        fan.push_back(Rayf(Vec3f(7.5, 7.5, 10), Vec3f(sin(a) * 1.2f, cos(b) * 1.2f, -1), 0, i % 7 == 0 ? 5 : 100));
+    }
+    vector<Hit<float>> fan_hits;
+    vector<uint32_t> fan_blocked;
+    bvh.intersect(fan, fan_hits);
+    bvh.occluded(fan, fan_blocked);
+    size_t fan_differ = 0, fan_found = 0;
+    for (size_t i = 0; i != fan.size(); i++) {
+        const Hit<float> single = bvh.intersect(fan[i]);
+        fan_found += single.found();
+        fan_differ += single.t != fan_hits[i].t || single.found() != fan_hits[i].found();
+        fan_differ += bvh.occluded(fan[i]) != bool((fan_blocked[i / 32] >> (i % 32)) & 1);
+    }
+    cout << "packets differing from single rays: " << fan_differ << " of " << fan.size() << " (" << fan_found << " hit)" << endl << endl;
+
+    for (size_t i = 0; i != v.size(); i++) {
+        v[i].z += 5;
+    }
+    bvh.refit(v);
+    cout << "bvh.refit(v) bounds: " << bvh.bounds() << endl;
+    cout << "bvh.intersect(r): " << bvh.intersect(r).t << endl << endl;
+}
+
+void test_kdtree() {
+    using namespace std;
+
+    vector<Vec2f> p;
+    for (int i = 0; i != 10; i++) {
+        for (int j = 0; j != 10; j++) {
+            p.push_back(Vec2f(i, j));
+        }
+    }
+
+    KDTree2f a(p);
+    cout << "a.size(): " << a.size() << endl << endl;
+
+    Vec2f q(3.2, 6.9);
+    cout << "q: " << q << endl;
+    cout << "a.nearest(q): " << p[a.nearest(q)] << endl;
+
+    vector<size_t> k = a.nearest(q, 3);
+    cout << "a.nearest(q, 3): ";
+    for (size_t i = 0; i != k.size(); i++) {
+        cout << p[k[i]] << " ";
+    }
+    cout << endl;
+
+    vector<size_t> r = a.radius(q, 1);
+    sort(r.begin(), r.end());
+    cout << "a.radius(q, 1): ";
+    for (size_t i = 0; i != r.size(); i++) {
+        cout << p[r[i]] << " ";
+    }
+    cout << endl << endl;
+
+    vector<Vec3f> c;
+    for (int i = 0; i != 1000; i++) {
+        c.push_back(Vec3f(i % 10, (i / 10) % 10, i / 100));
+    }
+
+    KDTree3f b(c);
+    vector<Vec3f> qs({Vec3f(0.1, 0.2, 0.3), Vec3f(4.6, 5.4, 8.8), Vec3f(20, 20, 20)});
+    vector<size_t> nn;
+    b.nearest(qs, nn);
+    cout << "b.nearest(qs): ";
+    for (size_t i = 0; i != nn.size(); i++) {
+        cout << c[nn[i]] << " ";
+    }
+    cout << endl << endl;
+}
+
+void test_grid() {
+    using namespace std;
+
+    vector<Vec2f> p({Vec2f(0, 0), Vec2f(0.5, 0), Vec2f(3, 3), Vec2f(3.2, 3.9), Vec2f(-0.3, -0.2)});
+    SpatialGrid2f a(1);
+    a.update(p);
+    cout << "a.size(): " << a.size() << endl;
+    cout << "a.cell_count(): " << a.cell_count() << endl;
+
+    vector<pair<size_t, size_t>> c = a.pairs(1);
+    cout << "a.pairs(1): ";
+    for (size_t i = 0; i != c.size(); i++) {
+        cout << "(" << c[i].first << " " << c[i].second << ") ";
+    }
+    cout << endl;
+
+    p[2] = Vec2f(0.2, 0.7);
+    a.update(p);
+    c = a.pairs(1);
+    cout << "a.pairs(1) after moving 2: ";
+    for (size_t i = 0; i != c.size(); i++) {
+        cout << "(" << c[i].first << " " << c[i].second << ") ";
+    }
+    cout << endl;
+
+    vector<size_t> q;
+    a.query(Vec2f(3, 3.5), 1, q);
+    cout << "a.query(Vec2f(3, 3.5), 1): " << q << endl << endl;
+}
+
+void test_hull() {
+    using namespace std;
+
+    vector<Vec2f> p({
+        Vec2f(0, 0), Vec2f(2, 0), Vec2f(1, 1), Vec2f(2, 2),
+        Vec2f(0, 2), Vec2f(1, 0), Vec2f(0.5, 1.5)
+    });
+
+    vector<size_t> h = convex_hull(p);
+    cout << "convex_hull(p): ";
+    for (size_t i = 0; i != h.size(); i++) {
+        cout << p[h[i]] << " ";
+    }
+    cout << endl << endl;
+
+    // Points along the edges of quadrilaterals of several sizes and
+    // offsets, rounded on either side of the edges. The octagon prefilter
+    // must leave every one near an edge to the monotone chain, so the sizes
+    // match those of the chain run on all points: 12 8 11 13 26 22 23 22 21
+    // 27 23 22.
+    cout << "convex_hull(q).size() for points along quadrilateral edges: ";
+    for (int t = 0; t != 12; t++) {
+        const double s = pow(10.0, t % 4), o = 1000 * s * (t / 4);
+        const Vec2<double> corner[4] = {
+            Vec2<double>(o, o), Vec2<double>(o + 1.7 * s, o + 0.2 * s),
+            Vec2<double>(o + 1.3 * s, o + 1.9 * s), Vec2<double>(o + 0.1 * s, o + 1.1 * s)
+        };
+
+        vector<Vec2<double>> q;
+        for (int i = 0; i != 400; i++) {
+            const Vec2<double> &a = corner[i % 4], &b = corner[(i + 1) % 4];
+            const double l = fmod(i * 0.618034, 1.0);
+            q.push_back(Vec2<double>(a.x + l * (b.x - a.x), a.y + l * (b.y - a.y)));
+        }
+
+        cout << convex_hull(q).size() << " ";
+    }
+    cout << endl << endl;
+
+    vector<Vec3f> c;
+    for (int i = 0; i != 27; i++) {
+        c.push_back(Vec3f(i % 3, (i / 3) % 3, i / 9));
+    }
+
+    vector<array<size_t, 3>> f = convex_hull(c);
+    vector<size_t> v;
+    for (size_t i = 0; i != f.size(); i++) {
+        v.insert(v.end(), f[i].begin(), f[i].end());
+    }
+    sort(v.begin(), v.end());
+    v.erase(unique(v.begin(), v.end()), v.end());
+
+    cout << "convex_hull(c) faces: " << f.size() << endl;
+    cout << "convex_hull(c) vertices: ";
+    for (size_t i = 0; i != v.size(); i++) {
+        cout << c[v[i]] << " ";
+    }
+    cout << endl << endl;
+}
+
+void test_predicates() {
+    using namespace std;
+
+    typedef Vec2<double> Vec2d;
+    typedef Vec3<double> Vec3d;
+
+    Vec2d a(0, 0), b(1, 0), c(0, 1);
+    cout << "orient2d(a, b, c): " << orient2d(a, b, c) << endl;
+    cout << "orient2d(a, c, b): " << orient2d(a, c, b) << endl;
+
+    // Nearly collinear: the double determinant rounds to zero.
+    Vec2d p(0.5, 0.5), q(12, 12), r(24, 24);
+    p.x = nextafter(0.5, 1.0);
+    cout << "orient2d(p, q, r): " << orient2d(p, q, r) << endl;
+    cout << "orient2d(q, q, r): " << orient2d(q, q, r) << endl << endl;
+
+    cout << "incircle(a, b, c, Vec2d(0.5, 0.5)): " << incircle(a, b, c, Vec2d(0.5, 0.5)) << endl;
+    cout << "incircle(a, b, c, Vec2d(1, 1)): " << incircle(a, b, c, Vec2d(1, 1)) << endl;
+    cout << "incircle(a, b, c, Vec2d(2, 2)): " << incircle(a, b, c, Vec2d(2, 2)) << endl << endl;
+
+    Vec3d s(0, 0, 0), t(1, 0, 0), u(0, 1, 0), v(0, 0, 1);
+    cout << "orient3d(s, t, u, v): " << orient3d(s, t, u, v) << endl;
+    cout << "orient3d(s, u, t, v): " << orient3d(s, u, t, v) << endl;
+    cout << "orient3d(s, t, u, Vec3d(3, 5, 0)): " << orient3d(s, t, u, Vec3d(3, 5, 0)) << endl << endl;
+
+    cout << "insphere(s, u, t, v, Vec3d(0.25, 0.25, 0.25)): " << insphere(s, u, t, v, Vec3d(0.25, 0.25, 0.25)) << endl;
+    cout << "insphere(s, u, t, v, Vec3d(1, 1, 0)): " << insphere(s, u, t, v, Vec3d(1, 1, 0)) << endl;
+    cout << "insphere(s, u, t, v, Vec3d(2, 2, 2)): " << insphere(s, u, t, v, Vec3d(2, 2, 2)) << endl << endl;
+
+    // Points on the line y = x, z = x, of mixed magnitudes so that their
+    // differences round, one coordinate nudged by an ulp in two of three
+    // cases: the filters fail on nearly all of them, and the adaptive stages
+    // should agree with the exact determinants of the raw coordinates.
+    size_t adapt_differ = 0, adapt_zero = 0;
+    for (int i = 0; i != 1000; i++) {
+        double w[5][3];
+        for (int j = 0; j != 5; j++) {
+            const double x = sin(i * 7.0 + j) * pow(10.0, (i + j) % 9 - 4);
+            w[j][0] = x;
+            w[j][1] = x;
+            w[j][2] = x;
+        }
+        if (i % 3 != 2) {
+            w[i % 5][1 + i % 3] = nextafter(w[i % 5][1 + i % 3], 1.0);
+        }
+
+        double e[12];
+        const int exact[4] = {
+            Expansion::sign(orient2d_expansion(w[0], w[1], w[2], e), e),
+            orient3d_exact(w[0], w[1], w[2], w[3]),
+            incircle_exact(w[0], w[1], w[2], w[3]),
+            insphere_exact(w[0], w[1], w[2], w[3], w[4])
+        };
+        adapt_differ += orient2d_adapt(w[0], w[1], w[2]) != exact[0];
+        adapt_differ += orient3d_adapt(w[0], w[1], w[2], w[3]) != exact[1];
+        adapt_differ += incircle_adapt(w[0], w[1], w[2], w[3]) != exact[2];
+        adapt_differ += insphere_adapt(w[0], w[1], w[2], w[3], w[4]) != exact[3];
+        adapt_zero += (exact[0] == 0) + (exact[1] == 0) + (exact[2] == 0) + (exact[3] == 0);
+    }
+    cout << "adaptive differing from exact: " << adapt_differ << " of 4000 (" << adapt_zero << " degenerate)" << endl << endl;
+
+    vector<Vec2d> pa(3, a), pb(3, b), pc({Vec2d(0, 1), Vec2d(0, -1), Vec2d(2, 0)});
+    vector<int8_t> o;
+    orient2d(pa, pb, pc, o);
+    cout << "orient2d(pa, pb, pc): ";
+    for (size_t i = 0; i != o.size(); i++) {
+        cout << (int)o[i] << " ";
+    }
+    cout << endl << endl;
+}
+
+void test_half() {
+    using namespace std;
+
+    half h(0.1f);
+    bfloat16 b(0.1f);
+    cout << "half(0.1f): " << h << endl;
+    cout << "bfloat16(0.1f): " << b << endl;
+    cout << "half(70000.0f): " << half(70000.0f) << endl;
+    cout << "half(1e-7f): " << half(1e-7f) << endl << endl;
+
+    Vec3h v(1, 2, 3), w(0.5f, 0.25f, 0.125f);
+    cout << "v + w: " << v + w << endl;
+    cout << "v * w: " << v * w << endl;
+    cout << "cross(v, w): " << cross(v, w) << endl << endl;
+
+    Matrix<half> a({{1, 2}, {3, 4}});
+    Matrix<half> c(a);
+    c *= a;
+    cout << "a * a: " << endl << c << endl;
+    cout << "a.invert(): " << endl << a.invert() << endl << endl;
+
+    // 4096 products of 1 sum to 4096 in float; summed in half, the total
+    // would stop growing at 2048.
+    vector<half> x(4096, half(1.0f)), y(4096, half(1.0f));
+    cout << "dot(x, y): " << dot(x, y) << endl;
+    cout << "dot(x.data(), y.data(), 4096): " << dot(x.data(), y.data(), 4096) << endl;
+
+    vector<float> f(10);
+    for (size_t i = 0; i != f.size(); i++) {
+        f[i] = i / 3.0f;
+    }
+    vector<bfloat16> g(f.size());
+    from_float(f.data(), g.data(), f.size());
+    to_float(g.data(), f.data(), f.size());
+    cout << "bfloat16 round trip: ";
+    for (size_t i = 0; i != f.size(); i++) {
+        cout << f[i] << " ";
+    }
+    cout << endl << endl;
+}
+
+void test_accumulate() {
+    using namespace std;
+
+    vector<float> a(1000000, 0.1f), b(1000000, 1.0f);
+    cout << "dot(a, b): " << dot(a, b) << endl;
+    cout << "dot(a, b, Accumulate<float, KahanSum>()): " << dot(a, b, Accumulate<float, KahanSum>()) << endl;
+    cout << "dot(a, b, Accumulate<float, PairwiseSum>()): " << dot(a, b, Accumulate<float, PairwiseSum>()) << endl;
+    cout << "dot(a, b, Accumulate<double>()): " << dot(a, b, Accumulate<double>()) << endl << endl;
+
+    vector<int16_t> c(1000, 300), d(1000, 300);
+    cout << "dot(c, d, Accumulate<int32_t>()): " << dot(c, d, Accumulate<int32_t>()) << endl << endl;
+
+    Vec3f v(1e8f, 1, -1e8f), w(1, 1, 1);
+    cout << "v * w: " << v * w << endl;
+    cout << "dot(v, w, Accumulate<double>()): " << dot(v, w, Accumulate<double>()) << endl;
+
+    Matrix<float> m({{1e8f, 1, -1e8f}, {1, 2, 3}});
+    Matrix<float> n(3, 1, 1);
+    cout << "m * n: " << m * n << endl;
+    cout << "multiply(m, n, Accumulate<double>()): " << multiply(m, n, Accumulate<double>()) << endl;
+    cout << "multiply(v, n, Accumulate<double>()): " << multiply(v, n, Accumulate<double>()) << endl << endl;
+}
+
+void test_execution() {
+    using namespace std;
+
+    Matrix<float> a(512, 512, 1), b(512, 512, 2);
+
+    a += b;
+    a.scale(0.5f, Execution::parallel_vectorized);
+    a.subtract(b, Execution::sequential);
+    cout << "a[0][0], a[511][511]: " << a[0][0] << " " << a[511][511] << endl;
+    cout << "sum(b): " << sum(b) << endl;
+    cout << "sum(b, Execution::sequential): " << sum(b, Execution::sequential) << endl;
+    cout << "norm(b): " << norm(b) << endl;
+
+    ExecutionSettings::policy() = Execution::sequential;
+    b.clear();
+    cout << "sum(b) after clear: " << sum(b) << endl << endl;
+    ExecutionSettings::policy() = Execution::parallel;
+}
+
+void test_multiply() {
+    using namespace std;
+
+    Matrix<int> a(100, 100), b(100, 100);
+    for (size_t i = 0; i != 100; i++) {
+        for (size_t j = 0; j != 100; j++) {
+            a[i][j] = (i * 7 + j) % 13 - 6;
+            b[i][j] = (i + 3 * j) % 11 - 5;
+        }
+    }
+
+    Matrix<int> c = a * b;
+    Matrix<int> d = multiply(a, b, Blocked());
+    Matrix<int> e = multiply(a, b, Strassen(16));
+
+    size_t differ = 0;
+    for (size_t i = 0; i != 100; i++) {
+        for (size_t j = 0; j != 100; j++) {
+            differ += (c[i][j] != d[i][j]) + (c[i][j] != e[i][j]);
+        }
+    }
+    cout << "a * b: " << c[0][0] << " " << c[50][50] << " " << c[99][99] << endl;
+    cout << "elements differing from a * b: " << differ << endl;
+
+    // The default crossover is fixed, not measured, so Strassen() is
+    // reproducible.
+    cout << "StrassenSettings::crossover(): " << StrassenSettings::crossover() << endl;
+    StrassenSettings::set_crossover(16);
+    const Matrix<int> defaulted = multiply(a, b, Strassen());
+    StrassenSettings::set_crossover(256);
+    cout << "Strassen() with crossover 16 equals Strassen(16): " << (defaulted[7] == e[7] && defaulted[93] == e[93]) << endl;
+
+    Arena workspace;
+    Matrix<float> f(3), g({{1, 2, 3}, {4, 5, 6}, {7, 8, 9}});
+    cout << "multiply(f, g, Strassen(1, &workspace)): " << endl << multiply(f, g, Strassen(1, &workspace)) << endl << endl;
+
+    size_t misaligned = 0;
+    for (size_t i = 0; i != 3; i++) {
+        workspace.reset();
+        for (size_t j = 0; j != 20; j++) {
+            misaligned += reinterpret_cast<size_t>(workspace.allocate(24 + j, 64)) % 64 != 0;
+        }
+    }
+    cout << "misaligned workspace allocations: " << misaligned << endl;
+
+    Matrix<int> p(200, 2, 1), q(2, 200, 2), r(200, 3, 1), s(3, 1, 3);
+    MatrixChain<int> chain({&p, &q, &r, &s});
+    cout << "chain.order(): " << chain.order() << endl;
+    cout << "chain.flops(): " << chain.flops() << endl;
+
+    Matrix<int> t = multiply_chain(p, q, r, s);
+    Matrix<int> u = p * q * r * s;
+    cout << "multiply_chain(p, q, r, s) rows, cols: " << t.rows << " " << t.cols << endl;
+    cout << "multiply_chain(p, q, r, s)[0][0], p * q * r * s[0][0]: " << t[0][0] << " " << u[0][0] << endl << endl;
+}
+
+void test_qr() {
+    using namespace std;
+
+    // Fit y = 1 + 2x to points with alternating noise.
+    Matrix<double> a(6, 2), b(6, 1);
+    for (size_t i = 0; i != 6; i++) {
+        a[i][0] = 1;
+        a[i][1] = i;
+        b[i][0] = 1 + 2.0 * i + (i % 2 ? 0.1 : -0.1);
+    }
+
+    QR<double> qr(a);
+    cout << "qr.r(): " << endl << qr.r() << endl;
+    cout << "qr.solve(b): " << endl << qr.solve(b) << endl;
+
+    Matrix<double> c(b);
+    qr.apply_qt(c);
+    qr.apply_q(c);
+    cout << "norm(qr.apply_q(qr.apply_qt(b)) - b) < 1e-12: " << (norm(c - b) < 1e-12) << endl << endl;
+
+    // The third column is the sum of the first two.
+    Matrix<double> d({{1, 0, 1}, {0, 1, 1}, {1, 1, 2}, {2, 0, 2}});
+    QR<double> pivoted(d, true);
+    cout << "pivoted.rank(): " << pivoted.rank() << endl;
+    cout << "pivoted.permutation(): " << pivoted.permutation() << endl << endl;
+}
+
+void test_eigen() {
+    using namespace std;
+
+    Matrix<double> a({{2, 1, 0}, {1, 2, 0}, {0, 0, 5}});
+    SymmetricEigen<double> eigen(a);
+    cout << "eigen.values(): " << eigen.values() << endl;
+
+    Matrix<double> v = eigen.vectors();
+    Matrix<double> lambda(3, 3);
+    for (size_t i = 0; i != 3; i++) {
+        lambda[i][i] = eigen.values()[i];
+    }
+    cout << "norm(a * v - v * lambda) < 1e-12: " << (norm(a * v - v * lambda) < 1e-12) << endl << endl;
+
+    Matrix<double> b({{3, 2, 2}, {2, 3, -2}});
+    SVD<double> svd(b);
+    cout << "svd.singular_values(): " << svd.singular_values() << endl;
+
+    Matrix<double> sigma(2, 2);
+    for (size_t i = 0; i != 2; i++) {
+        sigma[i][i] = svd.singular_values()[i];
+    }
+    cout << "norm(u * sigma * v^T - b) < 1e-12: " << (norm(svd.u() * sigma * svd.v().transpose() - b) < 1e-12) << endl;
+    cout << "svd.rank(): " << svd.rank() << endl << endl;
+
+    // Rank 1, tall and wide: the zero singular values still come with
+    // orthonormal vectors.
+    Matrix<double> rank_one({{1, 2, 0}, {2, 4, 0}, {0, 0, 0}, {3, 6, 0}});
+    for (int wide = 0; wide != 2; wide++) {
+        SVD<double> deficient(rank_one);
+        Matrix<double> u = deficient.u(), w = deficient.v();
+        const Matrix<double> u_t = Matrix<double>(u).transpose(), w_t = Matrix<double>(w).transpose();
+
+        Matrix<double> s(3, 3);
+        for (size_t i = 0; i != 3; i++) {
+            s[i][i] = deficient.singular_values()[i];
+        }
+
+        cout << (wide ? "wide" : "tall") << " rank(): " << deficient.rank() << ", ";
+        cout << "u^T u and v^T v identity: " << (norm(u_t * u - Matrix<double>(3)) < 1e-12 && norm(w_t * w - Matrix<double>(3)) < 1e-12) << ", ";
+        cout << "norm(u * sigma * v^T - a) < 1e-12: " << (norm(u * s * w_t - rank_one) < 1e-12) << endl;
+
+        rank_one.transpose();
+    }
+    cout << endl;
+
+    // A batch of 3x3 matrices with known singular values.
+    Matrix3Batch<float> batch;
+    for (size_t k = 0; k != 6; k++) {
+        Matrix<float> m(3, 3);
+        m[0][0] = 4 + k;
+        m[1][1] = -2;
+        m[2][2] = 1;
+        m[0][1] = m[1][0] = 0.5f * k;
+        batch.push_back(m);
+    }
+
+    Matrix3Batch<float> u, w;
+    vector<Vec3<float>> s;
+    svd3(batch, u, s, w);
+    cout << "s[0]: " << s[0] << endl;
+
+    float error = 0;
+    for (size_t k = 0; k != batch.size(); k++) {
+        Matrix<float> d(3, 3);
+        for (size_t i = 0; i != 3; i++) {
+            d[i][i] = s[k][i];
+        }
+        error = max(error, norm(u[k] * d * w[k].transpose() - batch[k]));
+    }
+    cout << "max reconstruction error < 1e-5: " << (error < 1e-5f) << endl << endl;
+}
+
+void test_cholesky() {
+    using namespace std;
+
+    Matrix<double> a({{4, 2, 2}, {2, 5, 3}, {2, 3, 6}});
+    Cholesky<double> cholesky(a);
+    cout << "cholesky.factor(): " << endl << cholesky.factor() << endl;
+
+    vector<double> b = {8, 10, 11};
+    cout << "cholesky.solve(b): " << cholesky.solve(b) << endl;
+    cout << "cholesky.logdet(): " << cholesky.logdet() << endl;
+
+    // Each variant gives the same factor up to rounding.
+    Matrix<double> c(150, 150);
+    for (size_t i = 0; i != 150; i++) {
+        for (size_t j = 0; j != 150; j++) {
+            c[i][j] = 1.0 / (1 + (i > j ? i - j : j - i));
+        }
+        c[i][i] += 150;
+    }
+
+    Matrix<double> unblocked = Cholesky<double>(c, Blocking::unblocked).factor();
+    cout << "norm(blocked - unblocked) < 1e-12: " << (norm(Cholesky<double>(c, Blocking::blocked).factor() - unblocked) < 1e-12) << endl;
+    cout << "norm(tiled - unblocked) < 1e-12: " << (norm(Cholesky<double>(c, Blocking::tiled).factor() - unblocked) < 1e-12) << endl;
+
+    vector<double> x = {1, -1, 2};
+    cholesky.update(x);
+    cholesky.downdate(x);
+    cout << "norm(downdate(update(l)) - l) < 1e-12: " << (norm(cholesky.factor() - Cholesky<double>(a).factor()) < 1e-12) << endl << endl;
+}
+
+void test_structured() {
+    using namespace std;
+
+    Matrix<double> a({{4, 1, 0, 0}, {1, 4, 1, 0}, {0, 1, 4, 1}, {0, 0, 1, 4}});
+
+    DiagonalMatrix<double> d(vector<double>{1, 2, 3, 4});
+    cout << "d * a: " << endl << d * a << endl;
+
+    TriangularMatrix<double> l(a);
+    cout << "l.to_matrix(): " << endl << l.to_matrix() << endl;
+    cout << "l.transpose()(0, 1): " << l.transpose()(0, 1) << endl;
+
+    BandedMatrix<double> b(a, 1, 1);
+    vector<double> x = {1, 2, 3, 4};
+    cout << "b * x: " << b * x << endl;
+    cout << "b.solve(b * x): " << b.solve(b * x) << endl;
+    cout << "(b * b).lower(), (b * b).upper(): " << (b * b).lower() << " " << (b * b).upper() << endl;
+
+    SymmetricMatrix<double> s(a);
+    cout << "s.solve(s * x): " << s.solve(s * x) << endl;
+
+    Vec4<double> v(1, 0, 0, 1);
+    cout << "v * d: " << v * d << endl << endl;
+}
+
+void test_inverse() {
+    using namespace std;
+
+    Matrix<double> a({{4, 1, 0}, {1, 3, 1}, {0, 1, 2}});
+    MaintainedInverse<double> inverse(a);
+    cout << "inverse.solve({5, 5, 3}): " << inverse.solve(vector<double>{5, 5, 3}) << endl;
+
+    inverse.set_row(0, {2, 0, 0});
+    inverse.set(2, 2, 5);
+    inverse.update(vector<double>{1, 0, 1}, vector<double>{0, 1, 0});
+    cout << "inverse.matrix(): " << endl << inverse.matrix() << endl;
+
+    Matrix<double> identity(3, 3);
+    for (size_t i = 0; i != 3; i++) {
+        identity[i][i] = 1;
+    }
+    cout << "norm(matrix * inverse - identity) < 1e-12: " << (norm(inverse.matrix() * inverse.inverse() - identity) < 1e-12) << endl;
+
+    // Row 0 becoming a multiple of row 1 leaves no inverse.
+    try {
+        inverse.set_row(0, {2, 6, 2});
+    } catch (const domain_error &e) {
+        cout << "inverse.set_row(0, {2, 6, 2}): " << e.what() << endl;
+    }
+    cout << endl;
+}
+
+void test_streaming() {
+    using namespace std;
+
+    // y = 1 + 2x, with the last three rows following y = 5 - x.
+    StreamingQR<double> all(2), window(2, 3);
+    for (size_t i = 0; i != 8; i++) {
+        const double x = i;
+        const double y = i < 5 ? 1 + 2 * x : 5 - x;
+
+        all.add_row({1, x}, y);
+        window.add_row({1, x}, y);
+    }
+
+    cout << "all.size(), window.size(): " << all.size() << " " << window.size() << endl;
+    cout << "all.residual() > 0: " << (all.residual() > 0) << endl;
+    cout << "window.solve(): " << window.solve() << endl;
+    cout << "window.residual() < 1e-12: " << (window.residual() < 1e-12) << endl;
+
+    Matrix<double> x(4, 2);
+    vector<double> y(4);
+    for (size_t i = 0; i != 4; i++) {
+        x[i][0] = 1;
+        x[i][1] = i;
+        y[i] = 3 - 0.5 * i;
+    }
+
+    StreamingQR<double> batch(2);
+    batch.add_rows(x, y);
+    cout << "batch.solve(): " << batch.solve() << endl << endl;
+}
+
+void test_cache() {
+    using namespace std;
+
+    Matrix<double> a({{2, 0, 1}, {1, 3, 0}, {0, 1, 4}});
+    cout << "a.determinant(): " << a.determinant() << endl;
+
+    const uint64_t version = a.version();
+    a.add_row();
+    a.remove_row();
+    cout << "a.version() != version: " << (a.version() != version) << endl;
+    cout << "a.version() == a.version(): " << (a.version() == a.version()) << endl;
+
+    CachedMatrix<double> cached(a);
+    const Matrix<double> &inverse = cached.inverse();
+    cout << "&cached.inverse() == &inverse: " << (&cached.inverse() == &inverse) << endl;
+    cout << "cached.transpose(): " << endl << cached.transpose() << endl;
+
+    // Writes through operator [] drop the cached values.
+    cached.matrix()[0][0] = 4;
+    cout << "cached.determinant(): " << cached.determinant() << endl;
+    cout << "norm(cached.matrix() * cached.inverse() - identity) < 1e-12: " << (norm(cached.matrix() * cached.inverse() - Matrix<double>(3)) < 1e-12) << endl;
+
+    Matrix<int> b({{1, 2}, {3, 4}});
+    cout << "b.determinant(): " << b.determinant() << endl << endl;
+}
+
+void test_shared() {
+    using namespace std;
+
+    SharedMatrix<double> a(Matrix<double>({{1, 2}, {3, 4}}));
+    SharedMatrix<double> b = a;
+    cout << "&a.matrix() == &b.matrix(): " << (&a.matrix() == &b.matrix()) << endl;
+    cout << "a.unique(): " << a.unique() << endl;
+
+    // The first write to b clones it, so a keeps its values.
+    b[0][0] = 5;
+    cout << "&a.matrix() == &b.matrix(): " << (&a.matrix() == &b.matrix()) << endl;
+    cout << "a.unique(): " << a.unique() << endl;
+    cout << "a: " << endl << a << endl;
+    cout << "b: " << endl << b << endl;
+
+    SharedMatrix<double> c = a * b + 1;
+    cout << "a * b + 1: " << endl << c << endl;
+    cout << "a * 2: " << endl << a * 2.0 << endl;
+
+    const Matrix<double> &m = c;
+    cout << "m.determinant(): " << m.determinant() << endl << endl;
+}
+
+void test_dispatch() {
+    using namespace std;
+
+    const Isa initial = DispatchSettings::isa();
+    cout << "DispatchSettings::isa() <= cpu_isa(): " << (initial <= cpu_isa()) << endl;
+    cout << "set_isa(Isa::avx512) <= cpu_isa(): " << (DispatchSettings::set_isa(Isa::avx512) <= cpu_isa()) << endl;
+
+    Matrix<double> a(40, 37), b(37, 40);
+    for (size_t i = 0; i != 40; i++) {
+        for (size_t j = 0; j != 37; j++) {
+            a[i][j] = sin(i + 2.0 * j);
+            b[j][i] = cos(3.0 * i - j);
+        }
+    }
+
+    // Frustum planes of all signs against boxes partly inside, and half
+    // values of mixed magnitude, with counts that leave tails.
+    Matrix<float> proj({{1, 0.2f, 0, 0}, {-0.1f, 1, 0, 0}, {0, 0, -0.5f, 0}, {0, 0, 0, 1}});
+    const Frustumf frustum(proj);
+    AABBBatch<float> boxes;
+    for (int i = 0; i != 1003; i++) {
+        const Vec3f p(sin(i * 0.37f) * 1.5f, cos(i * 0.61f) * 1.5f, sin(i * 0.11f) * 2.5f);
+        boxes.push_back(AABBf(p, p + Vec3f(0.1f, 0.2f, 0.3f)));
+    }
+
+    vector<float> x(1003);
+    for (size_t i = 0; i != x.size(); i++) {
+        x[i] = sin(i * 1.3f) * pow(2.0f, float(i % 23) - 11);
+    }
+
+    // Every instruction set gives the same bits.
+    bool same = true;
+    Matrix<double> expected;
+    vector<uint32_t> expected_mask;
+    vector<float> expected_x;
+    float expected_dot = 0;
+    for (const Isa isa : {Isa::generic, Isa::sse4, Isa::avx2, Isa::avx512}) {
+        if (isa > cpu_isa()) {
+            continue;
+        }
+
+        DispatchSettings::set_isa(isa);
+
+        Matrix<double> c = multiply(a, b, Blocked());
+        c += c;
+        c *= 0.3;
+        c /= 7.0;
+        c -= Matrix<double>(40);
+
+        const vector<uint32_t> mask = cull(frustum, boxes);
+
+        vector<half> h(x.size());
+        vector<float> y(x.size());
+        from_float(x.data(), h.data(), x.size());
+        to_float(h.data(), y.data(), y.size());
+        const float d = dot(h.data(), h.data(), h.size());
+
+        if (isa == Isa::generic) {
+            expected = c;
+            expected_mask = mask;
+            expected_x = y;
+            expected_dot = d;
+        } else {
+            same = same && norm(c - expected) == 0;
+            same = same && mask == expected_mask && y == expected_x && d == expected_dot;
+        }
+    }
+    cout << "same result for every isa: " << same << endl;
+    cout << "cull(frustum, boxes) count: " << mask_count(expected_mask) << endl << endl;
+
+    DispatchSettings::set_isa(initial);
+}
+
+void test_gemv() {
+    using namespace std;
+
+    const Matrix<double> a({{1, 2, 3}, {4, 5, 6}});
+    const vector<double> x({1, 0, -1}), w({2, -1});
+
+    cout << "a * x: " << a * x << endl;
+    cout << "w * a: " << w * a << endl;
+
+    // The second column of a times a, into the first column of b.
+    Matrix<double> b(3, 2);
+    gevm(col_view(a, 1), view(a), col_view(b, 0));
+    cout << "b: " << endl << b << endl;
+
+    vector<float> y(2);
+    gemv(view(a), VectorView<const double>(a[1].data(), 3), view(y));
+    cout << "a * a[1]: " << y << endl;
+
+    Vec3<double> v(1, 2, 3);
+    cout << "v * transpose(a): " << v * Matrix<double>(a).transpose() << endl << endl;
+}
+
+void test_reductions() {
+    using namespace std;
+
+    // 1 followed by many terms below half an ulp of the running sum.
+    vector<float> x(100001, 1e-8f);
+    x[0] = 1;
+    cout << "sum(x): " << sum(view(x)) << endl;
+    cout << "sum(x, KahanSum): " << sum(view(x), Accumulate<float, KahanSum>()) << endl;
+    cout << "sum(x, NaiveSum): " << sum(view(x), Accumulate<float, NaiveSum>()) << endl;
+
+    const vector<double> y({3e200, -4e200});
+    cout << "norm(y): " << norm(view(y)) << endl;
+    cout << "norm_1(y), norm_inf(y): " << norm_1(view(y)) << " " << norm_inf(view(y)) << endl;
+
+    const Matrix<double> a({{1, -2, 3}, {-4, 5, -6}});
+    cout << "norm_1(a), norm_inf(a): " << norm_1(a) << " " << norm_inf(a) << endl;
+
+    // A NaN in the middle of the data, in a block of its own.
+    const double nan = numeric_limits<double>::quiet_NaN();
+    vector<double> z(10000, 1);
+    z[5000] = nan;
+    const Matrix<double> n({{1, nan}, {3, 4}});
+    cout << "max_abs(z), norm_inf(z): " << max_abs(view(z)) << " " << norm_inf(view(z)) << endl;
+    cout << "norm_1(n), norm_inf(n): " << norm_1(n) << " " << norm_inf(n) << endl;
+    cout << "sum(Matrix(3, 0)), norm_inf(Matrix(3, 0)): " << sum(Matrix<double>(3, 0)) << " " << norm_inf(Matrix<double>(3, 0)) << endl;
+    cout << "norm(a, PairwiseSum): " << norm(a, Accumulate<double, PairwiseSum>()) << endl;
+
+    const IndexedValue<double> lo = min_index(a), hi = max_index(a);
+    cout << "min_index(a): " << lo.value << " at " << lo.index / a.cols << ", " << lo.index % a.cols << endl;
+    cout << "max_index(a): " << hi.value << " at " << hi.index / a.cols << ", " << hi.index % a.cols << endl;
+
+    vector<Vec3<double>> points;
+    for (size_t i = 0; i != 1000; i++) {
+        const double t = i / 999.0 - 0.5;
+        points.push_back(Vec3<double>(1e9 + t, 1e9 + 2 * t, 1e9 - t));
+    }
+    cout << "mean(points) - 1e9: " << mean(points) - 1e9 << endl;
+    cout << "covariance(points) * 12: " << endl << covariance(points) * 12 << endl << endl;
+}
+
+void test_numa() {
+    using namespace std;
+
+    const NumaTopology &topology = NumaTopology::instance();
+    cout << "nodes() >= 1: " << (topology.nodes() >= 1) << endl;
+    cout << "node_of_thread(0), node_of_thread(last): " << topology.node_of_thread(0, 8) << " "
+         << (topology.node_of_thread(7, 8) == topology.nodes() - 1) << endl;
+
+    // Once pinned, the same range is split over the same threads every time.
+    cout << "pin(): " << ThreadPool::instance().pin() << " " << ThreadPool::instance().pinned() << endl;
+    vector<thread::id> first(thread_count()), second(thread_count());
+    parallel_for(0, thread_count(), 1, [&](size_t lo, size_t hi) {
+        for (size_t i = lo; i != hi; i++) {
+            first[i] = this_thread::get_id();
+        }
+    });
+    parallel_for(0, thread_count(), 1, [&](size_t lo, size_t hi) {
+        for (size_t i = lo; i != hi; i++) {
+            second[i] = this_thread::get_id();
+        }
+    });
+    cout << "same threads: " << (first == second) << endl;
+
+    for (const Placement placement : {Placement::first_touch, Placement::interleaved, Placement::partitioned}) {
+        NumaSettings::set_placement(placement);
+
+        const Matrix<double> a(600, 600, 2);
+        const Matrix<double> b(a);
+        cout << placement_name(placement) << ": " << sum(b) << endl;
+    }
+    NumaSettings::set_placement(Placement::first_touch);
+
+    vector<double> v(1 << 20);
+    cout << "place(v, interleaved): " << place(v.data(), v.size() * sizeof(double), Placement::interleaved) << endl << endl;
+}
+
+void test_async() {
+    using namespace std;
+
+    const Matrix<double> a({{2, 1}, {1, 3}}), b({{1, 2}, {0, 1}});
+    Matrix<double> y(2, 1);
+    y[0][0] = 1;
+    y[1][0] = 2;
+
+    // (a * b)^-1 x = y, without waiting in between.
+    const Task<Matrix<double>> x = async_multiply(a, b).then([](const Matrix<double> &m) {
+        Matrix<double> r(m);
+        r.invert();
+        return r;
+    }).then([y](const Matrix<double> &inverse) {
+        return QR<double>(inverse).solve(y);
+    });
+    cout << "x: " << endl << x.get() << endl;
+    cout << "async_solve(a, a * b * x): " << endl << async_solve(a, Matrix<double>(a * b * x.get())).get() << endl;
+
+    CancellationToken token;
+    token.cancel();
+    const Task<Matrix<double>> cancelled = async_invert(a, token).then([](const Matrix<double> &m) { return m * 2; });
+    try {
+        cancelled.get();
+    } catch (const Cancelled &e) {
+        cout << "cancelled: " << e.what() << endl;
+    }
+
+    const Task<double> failed = async_invert(Matrix<double>(2, 3)).then([](const Matrix<double> &m) { return m.determinant(); });
+    try {
+        failed.get();
+    } catch (const length_error &e) {
+        cout << "failed: " << e.what() << endl;
+    }
+    cout << endl;
+}
+
 int main() {
     using namespace std;
 
+    cout << "Storage: " << endl;
+    test_storage();
+
     cout << "Vec2: " << endl;
     test_vec2();
 
@@ -564,4 +1605,73 @@ int main() {
 
     cout << "Vec4: " << endl;
     test_vec4();
+
+    cout << "Bounds: " << endl;
+    test_bounds();
+
+    cout << "BVH: " << endl;
+    test_bvh();
+
+    cout << "KDTree: " << endl;
+    test_kdtree();
+
+    cout << "SpatialGrid: " << endl;
+    test_grid();
+
+    cout << "Hull: " << endl;
+    test_hull();
+
+    cout << "Predicates: " << endl;
+    test_predicates();
+
+    cout << "Half: " << endl;
+    test_half();
+
+    cout << "Accumulate: " << endl;
+    test_accumulate();
+
+    cout << "Execution: " << endl;
+    test_execution();
+
+    cout << "Dispatch: " << endl;
+    test_dispatch();
+
+    cout << "GEMV: " << endl;
+    test_gemv();
+
+    cout << "Reductions: " << endl;
+    test_reductions();
+
+    cout << "NUMA: " << endl;
+    test_numa();
+
+    cout << "Async: " << endl;
+    test_async();
+
+    cout << "Multiply: " << endl;
+    test_multiply();
+
+    cout << "QR: " << endl;
+    test_qr();
+
+    cout << "Eigen: " << endl;
+    test_eigen();
+
+    cout << "Cholesky: " << endl;
+    test_cholesky();
+
+    cout << "Structured: " << endl;
+    test_structured();
+
+    cout << "MaintainedInverse: " << endl;
+    test_inverse();
+
+    cout << "StreamingQR: " << endl;
+    test_streaming();
+
+    cout << "CachedMatrix: " << endl;
+    test_cache();
+
+    cout << "SharedMatrix: " << endl;
+    test_shared();
 }
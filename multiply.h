@@ -0,0 +1,640 @@
+#ifndef MULTIPLY_H
+#define MULTIPLY_H
+
+#include <vector>
+#include <string>
+#include <mutex>
+#include <chrono>
+#include <algorithm>
+#include <cstdlib>
+#include <stdexcept>
+
+#include "geometry.h"
+#include "parallel.h"
+#include "arena.h"
+
+// Large matrix products. Operands are copied into contiguous row major
+// buffers of accumulate_type<T>::type, multiplied there and converted back.
+
+// Policy for the cache blocked classical product.
+class Blocked {};
+
+// Policy for the Strassen-Winograd product of square matrices: 7 half size
+// products and 15 additions per level instead of 8 products. It rounds
+// differently from the classical product, with a somewhat larger error
+// bound, so it is only used when asked for.
+//
+// Recursion stops at crossover, or at StrassenSettings::crossover() when
+// left at 0, so the summation order, and with it the result, only depends
+// on the inputs and these settings. Workspace, when given, supplies every
+// buffer, so a reused arena stops allocating after the first product; it
+// is reset on return, also when the product throws.
+class Strassen {
+public:
+    size_t crossover;
+    Arena *workspace;
+
+    Strassen(const size_t crossover = 0, Arena *workspace = nullptr):
+        crossover(crossover), workspace(workspace)
+    {}
+};
+
+// c = a * b for an n x m a and m x p b, with row strides lda, ldb and ldc.
+// Rows of c are split over the pool; each element is summed in k order
+// whatever the blocking and the instruction set the axpy kernel runs with,
+// so the result matches the plain triple loop.
+template <typename A>
+void gemm_blocked(const size_t n, const size_t m, const size_t p,
+                  const A *a, const size_t lda, const A *b, const size_t ldb, A *c, const size_t ldc) {
+    const size_t kb = 128;
+    const size_t jb = 512;
+    const Kernels<A> &kernels = Kernels<A>::get();
+
+    parallel_for(0, n, 16, [&](size_t lo, size_t hi) {
+        for (size_t i = lo; i != hi; i++) {
+            std::fill(c + i * ldc, c + i * ldc + p, A(0));
+        }
+
+        for (size_t kk = 0; kk < m; kk += kb) {
+            const size_t kend = std::min(kk + kb, m);
+
+            for (size_t jj = 0; jj < p; jj += jb) {
+                const size_t jend = std::min(jj + jb, p);
+
+                for (size_t i = lo; i != hi; i++) {
+                    A *ci = c + i * ldc;
+
+                    for (size_t k = kk; k != kend; k++) {
+                        kernels.axpy(ci + jj, a[i * lda + k], b + k * ldb + jj, jend - jj);
+                    }
+                }
+            }
+        }
+    });
+}
+
+// z = x + y and z = x - y over n x n blocks.
+template <typename A>
+void block_add(const size_t n, const A *x, const size_t ldx, const A *y, const size_t ldy, A *z, const size_t ldz) {
+    for (size_t i = 0; i != n; i++) {
+        for (size_t j = 0; j != n; j++) {
+            z[i * ldz + j] = x[i * ldx + j] + y[i * ldy + j];
+        }
+    }
+}
+
+template <typename A>
+void block_sub(const size_t n, const A *x, const size_t ldx, const A *y, const size_t ldy, A *z, const size_t ldz) {
+    for (size_t i = 0; i != n; i++) {
+        for (size_t j = 0; j != n; j++) {
+            z[i * ldz + j] = x[i * ldx + j] - y[i * ldy + j];
+        }
+    }
+}
+
+// Elements of scratch space strassen_serial needs for an n x n product.
+inline size_t strassen_workspace(const size_t n, const size_t crossover) {
+    if (n <= crossover || n % 2) {
+        return 0;
+    }
+
+    return 2 * (n / 2) * (n / 2) + strassen_workspace(n / 2, crossover);
+}
+
+// Winograd's variant, scheduled after Douglas et al. so that two quarter
+// size temporaries x and y are all the scratch space each level needs.
+template <typename A>
+void strassen_serial(const size_t n, const A *a, const size_t lda, const A *b, const size_t ldb,
+                     A *c, const size_t ldc, A *work, const size_t crossover) {
+    if (n <= crossover || n % 2) {
+        gemm_blocked(n, n, n, a, lda, b, ldb, c, ldc);
+        return;
+    }
+
+    const size_t h = n / 2;
+    const A *a11 = a, *a12 = a + h, *a21 = a + h * lda, *a22 = a + h * lda + h;
+    const A *b11 = b, *b12 = b + h, *b21 = b + h * ldb, *b22 = b + h * ldb + h;
+    A *c11 = c, *c12 = c + h, *c21 = c + h * ldc, *c22 = c + h * ldc + h;
+
+    A *x = work;
+    A *y = work + h * h;
+    A *rest = work + 2 * h * h;
+
+    block_sub(h, a11, lda, a21, lda, x, h);
+    block_sub(h, b22, ldb, b12, ldb, y, h);
+    strassen_serial(h, x, h, y, h, c21, ldc, rest, crossover);
+
+    block_add(h, a21, lda, a22, lda, x, h);
+    block_sub(h, b12, ldb, b11, ldb, y, h);
+    strassen_serial(h, x, h, y, h, c22, ldc, rest, crossover);
+
+    block_sub(h, x, h, a11, lda, x, h);
+    block_sub(h, b22, ldb, y, h, y, h);
+    strassen_serial(h, x, h, y, h, c12, ldc, rest, crossover);
+
+    block_sub(h, a12, lda, x, h, x, h);
+    strassen_serial(h, x, h, b22, ldb, c11, ldc, rest, crossover);
+
+    strassen_serial(h, a11, lda, b11, ldb, x, h, rest, crossover);
+
+    block_add(h, x, h, c12, ldc, c12, ldc);
+    block_add(h, c12, ldc, c21, ldc, c21, ldc);
+    block_add(h, c12, ldc, c22, ldc, c12, ldc);
+    block_add(h, c21, ldc, c22, ldc, c22, ldc);
+    block_add(h, c12, ldc, c11, ldc, c12, ldc);
+
+    block_sub(h, y, h, b21, ldb, y, h);
+    strassen_serial(h, a22, lda, y, h, c11, ldc, rest, crossover);
+    block_sub(h, c21, ldc, c11, ldc, c21, ldc);
+
+    strassen_serial(h, a12, lda, b21, ldb, c11, ldc, rest, crossover);
+    block_add(h, x, h, c11, ldc, c11, ldc);
+}
+
+// Scratch space for strassen_parallel: per product, its operand and output
+// temporaries followed by the space its own recursion needs.
+inline size_t strassen_parallel_workspace(const size_t n, const size_t crossover) {
+    const size_t q = (n / 2) * (n / 2);
+
+    return 11 * q + 7 * strassen_workspace(n / 2, crossover);
+}
+
+// One level with the 7 products on the pool. Operands are formed in the
+// same order as in strassen_serial, so both give bitwise equal results.
+template <typename A>
+void strassen_parallel(const size_t n, const A *a, const size_t lda, const A *b, const size_t ldb,
+                       A *c, const size_t ldc, A *work, const size_t crossover) {
+    if (n <= crossover || n % 2) {
+        gemm_blocked(n, n, n, a, lda, b, ldb, c, ldc);
+        return;
+    }
+
+    const size_t h = n / 2;
+    const size_t q = h * h;
+    const size_t w = strassen_workspace(h, crossover);
+
+    const A *a11 = a, *a12 = a + h, *a21 = a + h * lda, *a22 = a + h * lda + h;
+    const A *b11 = b, *b12 = b + h, *b21 = b + h * ldb, *b22 = b + h * ldb + h;
+    A *c11 = c, *c12 = c + h, *c21 = c + h * ldc, *c22 = c + h * ldc + h;
+
+    const size_t temps[7] = {1, 1, 1, 2, 2, 2, 2};
+    A *slice[7];
+    A *p = work;
+    for (size_t t = 0; t != 7; t++) {
+        slice[t] = p;
+        p += temps[t] * q + w;
+    }
+
+    A *p1 = slice[0];
+    A *p2 = slice[1];
+    A *p4 = slice[3] + q;
+
+    parallel_for(0, 7, 1, [&](size_t lo, size_t hi) {
+        for (size_t t = lo; t != hi; t++) {
+            A *x = slice[t];
+            A *y = slice[t] + q;
+            A *rest = slice[t] + temps[t] * q;
+
+            switch (t) {
+            case 0:
+                strassen_serial(h, a11, lda, b11, ldb, p1, h, rest, crossover);
+                break;
+            case 1:
+                strassen_serial(h, a12, lda, b21, ldb, p2, h, rest, crossover);
+                break;
+            case 2:
+                block_add(h, a21, lda, a22, lda, x, h);
+                block_sub(h, x, h, a11, lda, x, h);
+                block_sub(h, a12, lda, x, h, x, h);
+                strassen_serial(h, x, h, b22, ldb, c11, ldc, rest, crossover);
+                break;
+            case 3:
+                block_sub(h, b12, ldb, b11, ldb, x, h);
+                block_sub(h, b22, ldb, x, h, x, h);
+                block_sub(h, x, h, b21, ldb, x, h);
+                strassen_serial(h, a22, lda, x, h, p4, h, rest, crossover);
+                break;
+            case 4:
+                block_add(h, a21, lda, a22, lda, x, h);
+                block_sub(h, b12, ldb, b11, ldb, y, h);
+                strassen_serial(h, x, h, y, h, c22, ldc, rest, crossover);
+                break;
+            case 5:
+                block_add(h, a21, lda, a22, lda, x, h);
+                block_sub(h, x, h, a11, lda, x, h);
+                block_sub(h, b12, ldb, b11, ldb, y, h);
+                block_sub(h, b22, ldb, y, h, y, h);
+                strassen_serial(h, x, h, y, h, c12, ldc, rest, crossover);
+                break;
+            case 6:
+                block_sub(h, a11, lda, a21, lda, x, h);
+                block_sub(h, b22, ldb, b12, ldb, y, h);
+                strassen_serial(h, x, h, y, h, c21, ldc, rest, crossover);
+                break;
+            }
+        }
+    });
+
+    // c11 holds p3, c12 p6, c21 p7 and c22 p5.
+    parallel_for(0, h, 64, [&](size_t lo, size_t hi) {
+        for (size_t i = lo; i != hi; i++) {
+            for (size_t j = 0; j != h; j++) {
+                const A u2 = p1[i * h + j] + c12[i * ldc + j];
+                const A u3 = u2 + c21[i * ldc + j];
+                const A u4 = u2 + c22[i * ldc + j];
+
+                c22[i * ldc + j] = u3 + c22[i * ldc + j];
+                c12[i * ldc + j] = u4 + c11[i * ldc + j];
+                c21[i * ldc + j] = u3 - p4[i * h + j];
+                c11[i * ldc + j] = p1[i * h + j] + p2[i * h + j];
+            }
+        }
+    });
+}
+
+// StrassenSettings
+//
+// Default crossover of the Strassen policy: 256, or GEOMETRY_STRASSEN when
+// it holds a positive number. It is never measured behind the caller's
+// back; tune_crossover() measures one for this machine, for callers that
+// accept results that differ between machines, e.g.
+// StrassenSettings::set_crossover(tune_crossover<double>()).
+class StrassenSettings {
+private:
+    static size_t& current() {
+        static size_t crossover = initial();
+        return crossover;
+    }
+
+    static size_t initial() {
+        const char *env = std::getenv("GEOMETRY_STRASSEN");
+
+        if (env && std::atoi(env) > 0) {
+            return std::atoi(env);
+        }
+
+        return 256;
+    }
+
+public:
+    static size_t crossover() {
+        return current();
+    }
+
+    // Like the execution policy, it should not be changed while products
+    // are running.
+    static void set_crossover(const size_t crossover) {
+        current() = std::max<size_t>(crossover, 1);
+    }
+};
+
+// Smallest block size at which one Strassen level beats the classical
+// kernel, tried at 64, 128 and 256. Each call times products of up to
+// 1024 x 1024, so it is meant to run once, when the caller asks for it.
+template <typename A>
+size_t tune_crossover() {
+    for (size_t s = 64; s != 512; s *= 2) {
+        const size_t n = 2 * s;
+        std::vector<A> a(n * n), b(n * n), c(n * n), work(strassen_workspace(n, s));
+
+        for (size_t i = 0; i != n * n; i++) {
+            a[i] = static_cast<A>(static_cast<int>(i * 7 % 13) - 6);
+            b[i] = static_cast<A>(static_cast<int>(i * 5 % 11) - 5);
+        }
+
+        double classical = 1e300, strassen = 1e300;
+        for (size_t r = 0; r != 2; r++) {
+            std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+            gemm_blocked(n, n, n, a.data(), n, b.data(), n, c.data(), n);
+
+            std::chrono::steady_clock::time_point t1 = std::chrono::steady_clock::now();
+            strassen_serial(n, a.data(), n, b.data(), n, c.data(), n, work.data(), s);
+
+            std::chrono::steady_clock::time_point t2 = std::chrono::steady_clock::now();
+            classical = std::min(classical, std::chrono::duration<double>(t1 - t0).count());
+            strassen = std::min(strassen, std::chrono::duration<double>(t2 - t1).count());
+        }
+
+        if (strassen < classical) {
+            return s;
+        }
+    }
+
+    return 512;
+}
+
+template <typename T, typename U>
+Matrix<T> multiply(const Matrix<T> &lhs, const Matrix<U> &rhs, Blocked) {
+    typedef typename accumulate_type<T>::type A;
+
+    if (lhs.cols != rhs.rows) {
+        throw std::length_error("first matrices columns should be equal to second matrices rows");
+    }
+
+    const size_t n = lhs.rows, m = lhs.cols, p = rhs.cols;
+    std::vector<A> a(n * m), b(m * p), c(n * p);
+
+    for (size_t i = 0; i != n; i++) {
+        for (size_t j = 0; j != m; j++) {
+            a[i * m + j] = static_cast<A>(lhs[i][j]);
+        }
+    }
+
+    for (size_t i = 0; i != m; i++) {
+        for (size_t j = 0; j != p; j++) {
+            b[i * p + j] = static_cast<A>(rhs[i][j]);
+        }
+    }
+
+    gemm_blocked(n, m, p, a.data(), m, b.data(), p, c.data(), p);
+
+    Matrix<T> r(n, p);
+    for (size_t i = 0; i != n; i++) {
+        for (size_t j = 0; j != p; j++) {
+            r[i][j] = static_cast<T>(c[i * p + j]);
+        }
+    }
+
+    return r;
+}
+
+// Products that are not square, or not above the crossover, use the
+// classical kernel. Otherwise the operands are zero padded to leaf << levels
+// with leaf at most the crossover, so every level splits evenly.
+template <typename T, typename U>
+Matrix<T> multiply(const Matrix<T> &lhs, const Matrix<U> &rhs, const Strassen &policy) {
+    typedef typename accumulate_type<T>::type A;
+
+    if (lhs.cols != rhs.rows) {
+        throw std::length_error("first matrices columns should be equal to second matrices rows");
+    }
+
+    const size_t n = lhs.rows;
+    if (lhs.cols != n || rhs.cols != n) {
+        return multiply(lhs, rhs, Blocked());
+    }
+
+    const size_t crossover = policy.crossover ? policy.crossover : StrassenSettings::crossover();
+    if (n <= crossover) {
+        return multiply(lhs, rhs, Blocked());
+    }
+
+    size_t levels = 0, leaf = n;
+    while (leaf > crossover) {
+        levels++;
+        leaf = (n + (1ull << levels) - 1) >> levels;
+    }
+    const size_t size = leaf << levels;
+
+    const bool parallel = thread_count() > 1 && !ThreadPool::in_worker();
+    const size_t scratch = parallel ? strassen_parallel_workspace(size, crossover) : strassen_workspace(size, crossover);
+    const size_t total = 3 * size * size + scratch;
+
+    // Resets the workspace however this returns.
+    struct Reset {
+        Arena *arena;
+
+        ~Reset() {
+            if (arena) {
+                arena->reset();
+            }
+        }
+    };
+
+    std::vector<A> owned;
+    A *buffer;
+    if (policy.workspace) {
+        buffer = static_cast<A*>(policy.workspace->allocate(total * sizeof(A), 64));
+    } else {
+        owned.resize(total);
+        buffer = owned.data();
+    }
+
+    const Reset reset{policy.workspace};
+
+    A *a = buffer;
+    A *b = a + size * size;
+    A *c = b + size * size;
+    A *work = c + size * size;
+
+    parallel_for(0, size, 64, [&](size_t lo, size_t hi) {
+        for (size_t i = lo; i != hi; i++) {
+            for (size_t j = 0; j != size; j++) {
+                const bool inside = i < n && j < n;
+
+                a[i * size + j] = inside ? static_cast<A>(lhs[i][j]) : A(0);
+                b[i * size + j] = inside ? static_cast<A>(rhs[i][j]) : A(0);
+            }
+        }
+    });
+
+    if (parallel) {
+        strassen_parallel(size, a, size, b, size, c, size, work, crossover);
+    } else {
+        strassen_serial(size, a, size, b, size, c, size, work, crossover);
+    }
+
+    Matrix<T> r(n, n);
+    for (size_t i = 0; i != n; i++) {
+        for (size_t j = 0; j != n; j++) {
+            r[i][j] = static_cast<T>(c[i * size + j]);
+        }
+    }
+
+    return r;
+}
+
+// MatrixChain
+//
+// Product of a chain of matrices in the order with the fewest scalar
+// multiplications, found by the classic dynamic program over the runtime
+// dimensions. Intermediate products live in buffers that are returned to a
+// pool once consumed and reused for later products, and the two halves of
+// a split are evaluated concurrently when both are large.
+template <typename T>
+class MatrixChain {
+private:
+    typedef typename accumulate_type<T>::type A;
+
+    class Product {
+    public:
+        std::vector<A> owned;
+        const A *data;
+    };
+
+    std::vector<const Matrix<T>*> operands;
+    std::vector<size_t> dims;
+    std::vector<double> cost;
+    std::vector<size_t> split;
+    std::vector<std::vector<A>> leaves;
+    std::vector<std::vector<A>> pool;
+    std::mutex mutex;
+
+    size_t count() const {
+        return operands.size();
+    }
+
+    std::vector<A> acquire(const size_t size) {
+        std::lock_guard<std::mutex> lock(mutex);
+
+        size_t best = pool.size();
+        for (size_t i = 0; i != pool.size(); i++) {
+            if (pool[i].capacity() >= size && (best == pool.size() || pool[i].capacity() < pool[best].capacity())) {
+                best = i;
+            }
+        }
+
+        std::vector<A> r;
+        if (best != pool.size()) {
+            r = std::move(pool[best]);
+            pool.erase(pool.begin() + best);
+        }
+
+        r.resize(size);
+        return r;
+    }
+
+    void release(std::vector<A> &b) {
+        if (b.empty()) {
+            return;
+        }
+
+        std::lock_guard<std::mutex> lock(mutex);
+        pool.push_back(std::move(b));
+    }
+
+    void evaluate(const size_t i, const size_t j, Product &out) {
+        if (i == j) {
+            out.data = leaves[i].data();
+            return;
+        }
+
+        const size_t k = split[i * count() + j];
+        Product l, r;
+
+        const bool both = i != k && k + 1 != j;
+        const double work = std::min(cost[i * count() + k], cost[(k + 1) * count() + j]);
+
+        if (both && work >= 1 << 20 && thread_count() > 1 && !ThreadPool::in_worker()) {
+            parallel_for(0, 2, 1, [&](size_t lo, size_t hi) {
+                for (size_t s = lo; s != hi; s++) {
+                    if (s == 0) {
+                        evaluate(i, k, l);
+                    } else {
+                        evaluate(k + 1, j, r);
+                    }
+                }
+            });
+        } else {
+            evaluate(i, k, l);
+            evaluate(k + 1, j, r);
+        }
+
+        out.owned = acquire(dims[i] * dims[j + 1]);
+        out.data = out.owned.data();
+
+        gemm_blocked(dims[i], dims[k + 1], dims[j + 1], l.data, dims[k + 1], r.data, dims[j + 1],
+                     out.owned.data(), dims[j + 1]);
+
+        release(l.owned);
+        release(r.owned);
+    }
+
+    std::string order(const size_t i, const size_t j) const {
+        if (i == j) {
+            return std::to_string(i);
+        }
+
+        const size_t k = split[i * count() + j];
+        return "(" + order(i, k) + " " + order(k + 1, j) + ")";
+    }
+
+public:
+    MatrixChain(const std::vector<const Matrix<T>*> &operands): operands(operands) {
+        const size_t n = operands.size();
+
+        if (n == 0) {
+            throw std::length_error("matrix chain should not be empty");
+        }
+
+        dims.resize(n + 1);
+        dims[0] = operands[0]->rows;
+        for (size_t i = 0; i != n; i++) {
+            if (operands[i]->rows != dims[i]) {
+                throw std::length_error("first matrices columns should be equal to second matrices rows");
+            }
+            dims[i + 1] = operands[i]->cols;
+        }
+
+        cost.assign(n * n, 0);
+        split.assign(n * n, 0);
+
+        for (size_t len = 1; len != n; len++) {
+            for (size_t i = 0; i + len != n; i++) {
+                const size_t j = i + len;
+                cost[i * n + j] = -1;
+
+                for (size_t k = i; k != j; k++) {
+                    const double c = cost[i * n + k] + cost[(k + 1) * n + j] +
+                                     static_cast<double>(dims[i]) * dims[k + 1] * dims[j + 1];
+
+                    if (cost[i * n + j] < 0 || c < cost[i * n + j]) {
+                        cost[i * n + j] = c;
+                        split[i * n + j] = k;
+                    }
+                }
+            }
+        }
+    }
+
+    // Scalar multiplications of the chosen order.
+    double flops() const {
+        return cost[count() - 1];
+    }
+
+    // The chosen order with operands numbered from 0, e.g. "(0 (1 2))".
+    std::string order() const {
+        return order(0, count() - 1);
+    }
+
+    Matrix<T> evaluate() {
+        const size_t n = count();
+
+        leaves.resize(n);
+        for (size_t o = 0; o != n; o++) {
+            const Matrix<T> &m = *operands[o];
+            leaves[o].resize(m.rows * m.cols);
+
+            for (size_t i = 0; i != m.rows; i++) {
+                for (size_t j = 0; j != m.cols; j++) {
+                    leaves[o][i * m.cols + j] = static_cast<A>(m[i][j]);
+                }
+            }
+        }
+
+        Product p;
+        evaluate(0, n - 1, p);
+
+        Matrix<T> r(dims[0], dims[n]);
+        for (size_t i = 0; i != r.rows; i++) {
+            for (size_t j = 0; j != r.cols; j++) {
+                r[i][j] = static_cast<T>(p.data[i * r.cols + j]);
+            }
+        }
+
+        leaves.clear();
+        pool.clear();
+
+        return r;
+    }
+};
+
+// a * b * c * ... evaluated in the cheapest order.
+template <typename T, typename... Ms>
+Matrix<T> multiply_chain(const Matrix<T> &first, const Ms&... rest) {
+    MatrixChain<T> chain({&first, &rest...});
+
+    return chain.evaluate();
+}
+
+#endif
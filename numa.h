@@ -0,0 +1,293 @@
+#ifndef NUMA_H
+#define NUMA_H
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <new>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+// NumaTopology
+//
+// The NUMA nodes of the machine and the CPUs on each, read once from
+// /sys/devices/system/node. Where that is not available the machine is
+// taken to be one node holding every CPU.
+class NumaTopology {
+private:
+    std::vector<int> ids;
+    std::vector<std::vector<int>> node_cpus;
+
+    // Parses a list such as "0-3,8,10-11".
+    static std::vector<int> parse_list(const std::string &s) {
+        std::vector<int> r;
+        std::stringstream ss(s);
+        std::string range;
+
+        while (std::getline(ss, range, ',')) {
+            if (range.empty()) {
+                continue;
+            }
+
+            const size_t dash = range.find('-');
+            const int lo = std::atoi(range.c_str());
+            const int hi = dash == std::string::npos ? lo : std::atoi(range.c_str() + dash + 1);
+
+            for (int i = lo; i <= hi; i++) {
+                r.push_back(i);
+            }
+        }
+
+        return r;
+    }
+
+    static std::string read_line(const std::string &path) {
+        std::ifstream in(path);
+        std::string line;
+        std::getline(in, line);
+        return line;
+    }
+
+    NumaTopology() {
+        const std::string root = "/sys/devices/system/node/";
+
+        for (const int id : parse_list(read_line(root + "online"))) {
+            std::vector<int> cpus = parse_list(read_line(root + "node" + std::to_string(id) + "/cpulist"));
+
+            // Memory only nodes have no CPUs to run on.
+            if (!cpus.empty()) {
+                ids.push_back(id);
+                node_cpus.push_back(cpus);
+            }
+        }
+
+        if (ids.empty()) {
+            std::vector<int> cpus;
+            for (unsigned i = 0; i != std::max(1u, std::thread::hardware_concurrency()); i++) {
+                cpus.push_back(i);
+            }
+
+            ids.push_back(0);
+            node_cpus.push_back(cpus);
+        }
+    }
+
+public:
+    static const NumaTopology& instance() {
+        static NumaTopology topology;
+        return topology;
+    }
+
+    size_t nodes() const {
+        return ids.size();
+    }
+
+    // Kernel number of the i-th node; numbers can have gaps.
+    int id(const size_t node) const {
+        return ids[node];
+    }
+
+    const std::vector<int>& cpus(const size_t node) const {
+        return node_cpus[node];
+    }
+
+    // Node that thread t of threads works on when the pool is pinned: the
+    // threads are split into nodes() contiguous groups, the first group on
+    // the first node.
+    size_t node_of_thread(const size_t t, const size_t threads) const {
+        return t * nodes() / std::max<size_t>(threads, 1);
+    }
+};
+
+// Placement
+//
+// Where the pages of large Matrix blocks go. first_touch leaves it to the
+// kernel, which puts each page on the node of the thread that writes it
+// first; blocks are filled in parallel by the same row ranges the kernels
+// use, so with a pinned pool each thread's rows end up local to it.
+// interleaved spreads pages round robin over all nodes, which suits data
+// every thread reads all of, such as the right hand side of a product.
+// partitioned splits the block into nodes() equal parts, part i preferring
+// node i, which matches the rows the pinned threads work on when the
+// thread count is a multiple of the node count.
+enum class Placement {
+    first_touch,
+    interleaved,
+    partitioned
+};
+
+inline const char* placement_name(const Placement placement) {
+    switch (placement) {
+    case Placement::interleaved:
+        return "interleaved";
+    case Placement::partitioned:
+        return "partitioned";
+    default:
+        return "first_touch";
+    }
+}
+
+class NumaSettings {
+private:
+    static Placement& current() {
+        static Placement placement = initial();
+        return placement;
+    }
+
+    // GEOMETRY_PLACEMENT, when it names a policy, otherwise first_touch.
+    static Placement initial() {
+        const char *env = std::getenv("GEOMETRY_PLACEMENT");
+
+        if (env) {
+            for (const Placement p : {Placement::first_touch, Placement::interleaved, Placement::partitioned}) {
+                if (std::strcmp(env, placement_name(p)) == 0) {
+                    return p;
+                }
+            }
+        }
+
+        return Placement::first_touch;
+    }
+
+public:
+    static Placement placement() {
+        return current();
+    }
+
+    // Applies to blocks allocated afterwards; existing ones stay where they
+    // are.
+    static void set_placement(const Placement placement) {
+        current() = placement;
+    }
+
+    // Whether the pool pins its threads when it starts, from GEOMETRY_PIN.
+    static bool pin() {
+        const char *env = std::getenv("GEOMETRY_PIN");
+        return env && std::atoi(env) > 0;
+    }
+};
+
+// Restricts the calling thread to the CPUs of node. Returns false where
+// affinity cannot be set.
+#ifdef __linux__
+inline bool pin_thread(const size_t node) {
+    const NumaTopology &topology = NumaTopology::instance();
+    cpu_set_t set;
+    CPU_ZERO(&set);
+
+    for (const int cpu : topology.cpus(node)) {
+        if (cpu < CPU_SETSIZE) {
+            CPU_SET(cpu, &set);
+        }
+    }
+
+    return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+}
+#else
+inline bool pin_thread(const size_t) {
+    return false;
+}
+#endif
+
+// Sets the placement policy of the whole pages in [p, p + bytes). Pages
+// that were already written keep their node. This calls mbind directly,
+// so libnuma is not needed; returns false where it is not available.
+inline bool place(void *p, const size_t bytes, const Placement placement) {
+#ifdef __linux__
+    const NumaTopology &topology = NumaTopology::instance();
+
+    if (placement == Placement::first_touch) {
+        return true;
+    }
+
+    const int mpol_preferred = 1;
+    const int mpol_interleave = 3;
+    const size_t bits = 8 * sizeof(unsigned long);
+    const uintptr_t page = sysconf(_SC_PAGESIZE);
+
+    int top = 0;
+    for (size_t i = 0; i != topology.nodes(); i++) {
+        top = std::max(top, topology.id(i));
+    }
+
+    std::vector<unsigned long> mask(top / bits + 1);
+
+    auto bind = [&](const uintptr_t lo, const uintptr_t hi, const int mode) {
+        const uintptr_t first = (lo + page - 1) / page * page;
+        const uintptr_t last = hi / page * page;
+
+        if (last <= first) {
+            return true;
+        }
+
+        return syscall(SYS_mbind, first, last - first, mode, mask.data(), mask.size() * bits + 1, 0) == 0;
+    };
+
+    const uintptr_t begin = reinterpret_cast<uintptr_t>(p);
+
+    if (placement == Placement::interleaved) {
+        for (size_t i = 0; i != topology.nodes(); i++) {
+            mask[topology.id(i) / bits] |= 1ul << (topology.id(i) % bits);
+        }
+
+        return bind(begin, begin + bytes, mpol_interleave);
+    }
+
+    bool ok = true;
+    for (size_t i = 0; i != topology.nodes(); i++) {
+        std::fill(mask.begin(), mask.end(), 0);
+        mask[topology.id(i) / bits] |= 1ul << (topology.id(i) % bits);
+
+        ok = bind(begin + bytes * i / topology.nodes(), begin + bytes * (i + 1) / topology.nodes(), mpol_preferred) && ok;
+    }
+
+    return ok;
+#else
+    return placement == Placement::first_touch;
+#endif
+}
+
+// FirstTouchAllocator
+//
+// Allocator that default-initializes, so a std::vector of arithmetic T
+// can be resized without writing the new elements. Fresh pages are then
+// placed by whichever thread writes them first, instead of all landing on
+// the node of the thread that allocated them.
+template <typename T>
+class FirstTouchAllocator: public std::allocator<T> {
+public:
+    template <typename U>
+    struct rebind {
+        typedef FirstTouchAllocator<U> other;
+    };
+
+    FirstTouchAllocator() = default;
+
+    template <typename U>
+    FirstTouchAllocator(const FirstTouchAllocator<U>&) {}
+
+    template <typename U>
+    void construct(U *p) {
+        ::new (static_cast<void*>(p)) U;
+    }
+
+    template <typename U, typename... Args>
+    void construct(U *p, Args&&... args) {
+        ::new (static_cast<void*>(p)) U(std::forward<Args>(args)...);
+    }
+};
+
+#endif
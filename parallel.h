@@ -0,0 +1,309 @@
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <exception>
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <iterator>
+
+#include "numa.h"
+
+// ThreadPool
+//
+// Tasks go to a shared queue that any worker takes from, or to the queue
+// of one worker. Once the pool is pinned, parallel_for gives chunk k to
+// worker k - 1 every time, so a thread keeps working on the same rows from
+// one loop to the next and those rows stay on its NUMA node. Unpinned,
+// chunks go to whichever workers are idle.
+class ThreadPool {
+private:
+    std::vector<std::thread> workers;
+    std::deque<std::function<void()>> tasks;
+    std::vector<std::deque<std::function<void()>>> queues;
+    std::mutex mutex;
+    std::condition_variable cv;
+    bool stop;
+    std::atomic<bool> bound;
+
+    // Pool the calling thread works for, if any.
+    static ThreadPool*& owner() {
+        static thread_local ThreadPool *pool = nullptr;
+        return pool;
+    }
+
+    void run(const size_t index, const bool pin) {
+        owner() = this;
+
+        if (pin) {
+            pin_thread(NumaTopology::instance().node_of_thread(index + 1, queues.size() + 1));
+        }
+
+        std::deque<std::function<void()>> &own = queues[index];
+
+        while (true) {
+            std::function<void()> task;
+
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                cv.wait(lock, [&] { return stop || !own.empty() || !tasks.empty(); });
+
+                if (!own.empty()) {
+                    task = std::move(own.front());
+                    own.pop_front();
+                } else if (!tasks.empty()) {
+                    task = std::move(tasks.front());
+                    tasks.pop_front();
+                } else {
+                    return;
+                }
+            }
+
+            task();
+        }
+    }
+
+public:
+    // With pin, each worker and the calling thread are pinned to a NUMA
+    // node as they start, see pin().
+    explicit ThreadPool(const size_t size, const bool pin = false): queues(size), stop(false), bound(pin) {
+        if (pin) {
+            pin_thread(NumaTopology::instance().node_of_thread(0, size + 1));
+        }
+
+        for (size_t i = 0; i != size; i++) {
+            workers.emplace_back([this, i, pin] { run(i, pin); });
+        }
+    }
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator = (const ThreadPool&) = delete;
+
+    ~ThreadPool() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stop = true;
+        }
+
+        cv.notify_all();
+        for (size_t i = 0; i != workers.size(); i++) {
+            workers[i].join();
+        }
+    }
+
+    void submit(std::function<void()> task) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            tasks.push_back(std::move(task));
+        }
+
+        cv.notify_one();
+    }
+
+    // Runs task on the given worker, after the tasks already queued for it.
+    void submit(std::function<void()> task, const size_t worker) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            queues[worker].push_back(std::move(task));
+        }
+
+        cv.notify_all();
+    }
+
+    // Pins the calling thread and every worker to a NUMA node, splitting
+    // the threads evenly over the nodes in order, so chunk k of a
+    // parallel_for always runs on the node of thread k. Returns false if
+    // any thread could not be pinned. Called at startup when GEOMETRY_PIN
+    // is set.
+    bool pin() {
+        const NumaTopology &topology = NumaTopology::instance();
+        const size_t threads = workers.size() + 1;
+
+        std::mutex m;
+        std::condition_variable done;
+        size_t pending = workers.size();
+        bool ok = pin_thread(topology.node_of_thread(0, threads));
+
+        for (size_t i = 0; i != workers.size(); i++) {
+            submit([&, i] {
+                const bool worker_ok = pin_thread(topology.node_of_thread(i + 1, threads));
+
+                std::lock_guard<std::mutex> lock(m);
+                ok = ok && worker_ok;
+                if (--pending == 0) {
+                    done.notify_one();
+                }
+            }, i);
+        }
+
+        std::unique_lock<std::mutex> lock(m);
+        done.wait(lock, [&] { return pending == 0; });
+
+        bound = true;
+        return ok;
+    }
+
+    // True once pin() has run, or the pool was created pinned.
+    bool pinned() const {
+        return bound;
+    }
+
+    size_t size() const {
+        return workers.size();
+    }
+
+    // True when called from one of the threads of instance(). Nested
+    // parallel loops run serially there instead of waiting on workers that
+    // are busy; threads of other pools still split their loops over it.
+    static bool in_worker() {
+        return owner() != nullptr && owner() == &instance();
+    }
+
+    // Sized from GEOMETRY_THREADS when set, otherwise from the hardware. The
+    // calling thread always works too, so the pool holds one thread less.
+    // Pinned from the start when GEOMETRY_PIN is set.
+    static ThreadPool& instance() {
+        static ThreadPool pool(default_size() - 1, NumaSettings::pin());
+        return pool;
+    }
+
+    static size_t default_size() {
+        const char *env = std::getenv("GEOMETRY_THREADS");
+
+        if (env && std::atoi(env) > 0) {
+            return std::atoi(env);
+        }
+
+        return std::max(1u, std::thread::hardware_concurrency());
+    }
+};
+
+inline size_t thread_count() {
+    return ThreadPool::instance().size() + 1;
+}
+
+// Calls f(lo, hi) over disjoint chunks of [begin, end). Chunks are never
+// smaller than grain, and the calling thread takes the first one itself.
+// On a pinned pool chunk k goes to worker k - 1, so loops over the same
+// range split it the same way over the same threads; otherwise chunks go
+// to whichever workers are free.
+template <typename F>
+void parallel_for(const size_t begin, const size_t end, const size_t grain, F f) {
+    if (end <= begin) {
+        return;
+    }
+
+    ThreadPool &pool = ThreadPool::instance();
+    const size_t n = end - begin;
+    const size_t g = std::max<size_t>(grain, 1);
+    const size_t chunks = std::min((n + g - 1) / g, pool.size() + 1);
+
+    if (chunks <= 1 || ThreadPool::in_worker()) {
+        f(begin, end);
+        return;
+    }
+
+    const size_t step = (n + chunks - 1) / chunks;
+
+    std::mutex mutex;
+    std::condition_variable done;
+    size_t pending = 0;
+    std::exception_ptr error;
+    const bool pinned = pool.pinned();
+
+    for (size_t k = 1, lo = begin + step; lo < end; k++, lo += step) {
+        const size_t hi = std::min(lo + step, end);
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            pending++;
+        }
+
+        std::function<void()> task = [&, lo, hi] {
+            try {
+                f(lo, hi);
+            } catch (...) {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (!error) {
+                    error = std::current_exception();
+                }
+            }
+
+            std::lock_guard<std::mutex> lock(mutex);
+            if (--pending == 0) {
+                done.notify_one();
+            }
+        };
+
+        if (pinned) {
+            pool.submit(std::move(task), k - 1);
+        } else {
+            pool.submit(std::move(task));
+        }
+    }
+
+    try {
+        f(begin, std::min(begin + step, end));
+    } catch (...) {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!error) {
+            error = std::current_exception();
+        }
+    }
+
+    std::unique_lock<std::mutex> lock(mutex);
+    done.wait(lock, [&] { return pending == 0; });
+
+    if (error) {
+        std::rethrow_exception(error);
+    }
+}
+
+// Sorts each of up to thread_count() chunks on its own thread, then merges
+// neighboring runs pairwise, also in parallel, until one run is left.
+template <typename It, typename Compare>
+void parallel_sort(It first, It last, Compare comp) {
+    const size_t n = last - first;
+    const size_t chunks = std::min(thread_count(), n / 8192);
+
+    if (chunks <= 1 || ThreadPool::in_worker()) {
+        std::sort(first, last, comp);
+        return;
+    }
+
+    std::vector<It> bounds(chunks + 1);
+    for (size_t i = 0; i != chunks + 1; i++) {
+        bounds[i] = first + n * i / chunks;
+    }
+
+    parallel_for(0, chunks, 1, [&](size_t lo, size_t hi) {
+        for (size_t i = lo; i != hi; i++) {
+            std::sort(bounds[i], bounds[i + 1], comp);
+        }
+    });
+
+    for (size_t width = 1; width < chunks; width *= 2) {
+        parallel_for(0, (chunks + 2 * width - 1) / (2 * width), 1, [&](size_t lo, size_t hi) {
+            for (size_t i = lo; i != hi; i++) {
+                const size_t a = 2 * width * i;
+                const size_t b = std::min(a + width, chunks);
+                const size_t c = std::min(a + 2 * width, chunks);
+
+                std::inplace_merge(bounds[a], bounds[b], bounds[c], comp);
+            }
+        });
+    }
+}
+
+template <typename It>
+void parallel_sort(It first, It last) {
+    parallel_sort(first, last, std::less<typename std::iterator_traits<It>::value_type>());
+}
+
+#endif
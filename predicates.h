@@ -0,0 +1,836 @@
+#ifndef PREDICATES_H
+#define PREDICATES_H
+
+#include <algorithm>
+#include <vector>
+#include <cmath>
+#include <cfloat>
+#include <cstdint>
+#include <stdexcept>
+
+#include "geometry.h"
+#include "parallel.h"
+
+// Robust geometric predicates after Shewchuk. Each predicate first evaluates
+// its determinant in double precision together with a bound on the rounding
+// error, and only when the result is within that bound refines it in stages
+// of floating point expansions, each more exact than the last, stopping at
+// the first whose error bound settles the sign. Coordinates are converted to
+// double, which is exact for float and int inputs.
+//
+// orient2d(a, b, c)        > 0 when a, b, c turn counter clockwise.
+// orient3d(a, b, c, d)     > 0 when d lies below the plane through a, b, c,
+//                          where a, b, c appear counter clockwise from above.
+// incircle(a, b, c, d)     > 0 when d lies inside the circle through a, b, c,
+//                          which must be counter clockwise.
+// insphere(a, b, c, d, e)  > 0 when e lies inside the sphere through a, b, c,
+//                          d, which must have orient3d(a, b, c, d) > 0.
+//
+// All of them return -1, 0 or 1.
+
+// Expansion
+//
+// Exact arithmetic on expansions: sums of doubles stored in increasing
+// order of magnitude with no two components overlapping, so the sign of
+// the sum is the sign of the last component. Expansions live in arrays the
+// caller provides, sized for the longest result the operation can give,
+// so the predicates never allocate. Every expansion has at least one
+// component, which is 0 for an empty sum.
+class Expansion {
+public:
+    // x + y == a + b exactly, x being the rounded sum.
+    static void two_sum(const double a, const double b, double &x, double &y) {
+        x = a + b;
+        const double bv = x - a;
+        const double av = x - bv;
+        y = (a - av) + (b - bv);
+    }
+
+    // Rounding error of x, the rounded a - b.
+    static double two_diff_tail(const double a, const double b, const double x) {
+        const double bv = a - x;
+        const double av = x + bv;
+        return (a - av) + (bv - b);
+    }
+
+    static void two_diff(const double a, const double b, double &x, double &y) {
+        x = a - b;
+        y = two_diff_tail(a, b, x);
+    }
+
+    static void split(const double a, double &hi, double &lo) {
+        const double c = 134217729.0 * a;
+        hi = c - (c - a);
+        lo = a - hi;
+    }
+
+    // x + y == a * b exactly, x being the rounded product.
+    static void two_product(const double a, const double b, double &x, double &y) {
+        x = a * b;
+
+        double ahi, alo, bhi, blo;
+        split(a, ahi, alo);
+        split(b, bhi, blo);
+
+        const double err1 = x - ahi * bhi;
+        const double err2 = err1 - alo * bhi;
+        const double err3 = err2 - ahi * blo;
+        y = alo * blo - err3;
+    }
+
+    // The 4 components of (a1 + a0) - (b1 + b0), zeros included.
+    static void two_two_diff(const double a1, const double a0, const double b1, const double b0, double *h) {
+        double i, j, k;
+
+        two_diff(a0, b0, i, h[0]);
+        two_sum(a1, i, j, k);
+        two_diff(k, b1, i, h[1]);
+        two_sum(j, i, h[3], h[2]);
+    }
+
+    // The 4 components of ax * by - bx * ay.
+    static void cross(const double ax, const double ay, const double bx, const double by, double *h) {
+        double l1, l0, r1, r0;
+
+        two_product(ax, by, l1, l0);
+        two_product(bx, ay, r1, r0);
+        two_two_diff(l1, l0, r1, r0, h);
+    }
+
+    // h = e + f, at most elen + flen components.
+    static size_t sum(const size_t elen, const double *e, const size_t flen, const double *f, double *h) {
+        size_t i = 0, j = 0, n = 0;
+
+        // Components of either are taken by increasing magnitude.
+        auto next = [&]() {
+            if (j == flen || (i != elen && (f[j] > e[i]) == (f[j] > -e[i]))) {
+                return e[i++];
+            }
+            return f[j++];
+        };
+
+        double q = next();
+        while (i != elen || j != flen) {
+            double y;
+            two_sum(q, next(), q, y);
+
+            if (y != 0) {
+                h[n++] = y;
+            }
+        }
+
+        if (q != 0 || n == 0) {
+            h[n++] = q;
+        }
+
+        return n;
+    }
+
+    // h = e * b, at most 2 * elen components.
+    static size_t scale(const size_t elen, const double *e, const double b, double *h) {
+        size_t n = 0;
+        double q, y;
+
+        two_product(e[0], b, q, y);
+        if (y != 0) {
+            h[n++] = y;
+        }
+
+        for (size_t i = 1; i != elen; i++) {
+            double p1, p0, s;
+
+            two_product(e[i], b, p1, p0);
+            two_sum(q, p0, s, y);
+            if (y != 0) {
+                h[n++] = y;
+            }
+
+            two_sum(p1, s, q, y);
+            if (y != 0) {
+                h[n++] = y;
+            }
+        }
+
+        if (q != 0 || n == 0) {
+            h[n++] = q;
+        }
+
+        return n;
+    }
+
+    static void negate(const size_t elen, double *e) {
+        for (size_t i = 0; i != elen; i++) {
+            e[i] = -e[i];
+        }
+    }
+
+    // The sum rounded to double.
+    static double estimate(const size_t elen, const double *e) {
+        double r = 0;
+
+        for (size_t i = 0; i != elen; i++) {
+            r += e[i];
+        }
+
+        return r;
+    }
+
+    static int sign(const size_t elen, const double *e) {
+        return (e[elen - 1] > 0) - (e[elen - 1] < 0);
+    }
+};
+
+// Error bound factors. The A bounds are for the double precision filters,
+// B for the exact determinant of the rounded coordinate differences and C
+// for that plus the first order terms in the differences' rounding errors.
+const double predicate_epsilon = DBL_EPSILON / 2;
+const double result_bound = (3 + 8 * predicate_epsilon) * predicate_epsilon;
+const double ccw_bound = (3 + 16 * predicate_epsilon) * predicate_epsilon;
+const double ccw_bound_b = (2 + 12 * predicate_epsilon) * predicate_epsilon;
+const double ccw_bound_c = (9 + 64 * predicate_epsilon) * predicate_epsilon * predicate_epsilon;
+const double o3d_bound = (7 + 56 * predicate_epsilon) * predicate_epsilon;
+const double o3d_bound_b = (3 + 28 * predicate_epsilon) * predicate_epsilon;
+const double o3d_bound_c = (26 + 288 * predicate_epsilon) * predicate_epsilon * predicate_epsilon;
+const double icc_bound = (10 + 96 * predicate_epsilon) * predicate_epsilon;
+const double icc_bound_b = (4 + 48 * predicate_epsilon) * predicate_epsilon;
+const double icc_bound_c = (44 + 576 * predicate_epsilon) * predicate_epsilon * predicate_epsilon;
+const double isp_bound = (16 + 224 * predicate_epsilon) * predicate_epsilon;
+const double isp_bound_b = (5 + 72 * predicate_epsilon) * predicate_epsilon;
+const double isp_bound_c = (71 + 1408 * predicate_epsilon) * predicate_epsilon * predicate_epsilon;
+
+inline int predicate_sign(const double det) {
+    return (det > 0) - (det < 0);
+}
+
+// Whether det is certain to have the sign of the exact determinant.
+inline bool predicate_certain(const double det, const double bound) {
+    return det >= bound || -det >= bound;
+}
+
+// Exact determinants of the raw coordinates, the last stage of the
+// adaptive predicates. orient2d_expansion is the determinant of the rows
+// (x, y, 1) of a, b, c, at most 12 components; orient3d_expansion that of
+// the rows (x, y, z, 1) of a, b, c, d, at most 96.
+inline size_t orient2d_expansion(const double *a, const double *b, const double *c, double *h) {
+    double ab[4], bc[4], ca[4], t[8];
+
+    Expansion::cross(a[0], a[1], b[0], b[1], ab);
+    Expansion::cross(b[0], b[1], c[0], c[1], bc);
+    Expansion::cross(c[0], c[1], a[0], a[1], ca);
+
+    return Expansion::sum(Expansion::sum(4, ab, 4, bc, t), t, 4, ca, h);
+}
+
+inline size_t orient3d_expansion(const double *a, const double *b, const double *c, const double *d, double *h) {
+    double m[12], t[4][24], ab[48], cd[48];
+    size_t n[4];
+
+    n[0] = Expansion::scale(orient2d_expansion(b, c, d, m), m, a[2], t[0]);
+    n[1] = Expansion::scale(orient2d_expansion(a, c, d, m), m, -b[2], t[1]);
+    n[2] = Expansion::scale(orient2d_expansion(a, b, d, m), m, c[2], t[2]);
+    n[3] = Expansion::scale(orient2d_expansion(a, b, c, m), m, -d[2], t[3]);
+
+    return Expansion::sum(Expansion::sum(n[0], t[0], n[1], t[1], ab), ab, Expansion::sum(n[2], t[2], n[3], t[3], cd), cd, h);
+}
+
+// h = e * (p[0]^2 + ... + p[D - 1]^2), for e of at most N components;
+// at most 4 * N * D components.
+template <size_t N, size_t D>
+size_t lift_expansion(const size_t elen, const double *e, const double *p, double *h) {
+    double t[2 * N], tt[4 * N], s[4 * N * D];
+    size_t n = 0;
+
+    for (size_t k = 0; k != D; k++) {
+        const size_t ttlen = Expansion::scale(Expansion::scale(elen, e, p[k], t), t, p[k], tt);
+
+        if (k == 0) {
+            std::copy(tt, tt + ttlen, h);
+            n = ttlen;
+        } else {
+            n = Expansion::sum(n, h, ttlen, tt, s);
+            std::copy(s, s + n, h);
+        }
+    }
+
+    return n;
+}
+
+inline int orient3d_exact(const double *a, const double *b, const double *c, const double *d) {
+    double h[96];
+    const size_t n = orient3d_expansion(a, b, c, d, h);
+
+    return Expansion::sign(n, h);
+}
+
+inline int incircle_exact(const double *a, const double *b, const double *c, const double *d) {
+    double m[12], t[4][96], ab[192], cd[192], h[384];
+    size_t n[4];
+
+    n[0] = lift_expansion<12, 2>(orient2d_expansion(b, c, d, m), m, a, t[0]);
+    n[1] = lift_expansion<12, 2>(orient2d_expansion(a, c, d, m), m, b, t[1]);
+    n[2] = lift_expansion<12, 2>(orient2d_expansion(a, b, d, m), m, c, t[2]);
+    n[3] = lift_expansion<12, 2>(orient2d_expansion(a, b, c, m), m, d, t[3]);
+    Expansion::negate(n[1], t[1]);
+    Expansion::negate(n[3], t[3]);
+
+    const size_t len = Expansion::sum(Expansion::sum(n[0], t[0], n[1], t[1], ab), ab, Expansion::sum(n[2], t[2], n[3], t[3], cd), cd, h);
+    return Expansion::sign(len, h);
+}
+
+// The longest of the exact stages, with over 100 KB of buffers; it only
+// runs when the first three stages cannot decide.
+inline int insphere_exact(const double *a, const double *b, const double *c, const double *d, const double *e) {
+    const double *p[5] = {a, b, c, d, e};
+    double o[96], t[1152], h[2][5760];
+    size_t n = 0;
+
+    for (size_t i = 0; i != 5; i++) {
+        const double *q[4];
+        for (size_t j = 0, k = 0; j != 5; j++) {
+            if (j != i) {
+                q[k++] = p[j];
+            }
+        }
+
+        const size_t len = lift_expansion<96, 3>(orient3d_expansion(q[0], q[1], q[2], q[3], o), o, p[i], t);
+        if (i % 2 == 0) {
+            Expansion::negate(len, t);
+        }
+
+        if (i == 0) {
+            std::copy(t, t + len, h[0]);
+            n = len;
+        } else {
+            n = Expansion::sum(n, h[(i + 1) % 2], len, t, h[i % 2]);
+        }
+    }
+
+    return Expansion::sign(n, h[0]);
+}
+
+// Adaptive determinants, used when the filters cannot decide. Each first
+// computes the determinant of the rounded coordinate differences exactly,
+// then corrects it by the first order terms in the rounding errors of the
+// differences, and only when neither is certain falls back to the exact
+// determinant of the raw coordinates. Nearly degenerate input is mostly
+// settled by the first two stages, which cost a few times the filter.
+inline int orient2d_adapt(const double *a, const double *b, const double *c) {
+    const double acx = a[0] - c[0], bcx = b[0] - c[0];
+    const double acy = a[1] - c[1], bcy = b[1] - c[1];
+
+    double fin[4];
+    Expansion::cross(acx, acy, bcx, bcy, fin);
+
+    double det = Expansion::estimate(4, fin);
+    const double permanent = std::fabs(acx * bcy) + std::fabs(acy * bcx);
+    double bound = ccw_bound_b * permanent;
+    if (predicate_certain(det, bound)) {
+        return predicate_sign(det);
+    }
+
+    const double acxtail = Expansion::two_diff_tail(a[0], c[0], acx);
+    const double bcxtail = Expansion::two_diff_tail(b[0], c[0], bcx);
+    const double acytail = Expansion::two_diff_tail(a[1], c[1], acy);
+    const double bcytail = Expansion::two_diff_tail(b[1], c[1], bcy);
+    if (acxtail == 0 && acytail == 0 && bcxtail == 0 && bcytail == 0) {
+        return predicate_sign(det);
+    }
+
+    bound = ccw_bound_c * permanent + result_bound * std::fabs(det);
+    det += (acx * bcytail + bcy * acxtail) - (acy * bcxtail + bcx * acytail);
+    if (predicate_certain(det, bound)) {
+        return predicate_sign(det);
+    }
+
+    // The tail products complete the exact determinant.
+    double u[4], c1[8], c2[12], d[16];
+
+    Expansion::cross(acxtail, acytail, bcx, bcy, u);
+    const size_t c1len = Expansion::sum(4, fin, 4, u, c1);
+
+    Expansion::cross(acx, acy, bcxtail, bcytail, u);
+    const size_t c2len = Expansion::sum(c1len, c1, 4, u, c2);
+
+    Expansion::cross(acxtail, acytail, bcxtail, bcytail, u);
+    const size_t dlen = Expansion::sum(c2len, c2, 4, u, d);
+
+    return Expansion::sign(dlen, d);
+}
+
+inline int orient3d_adapt(const double *a, const double *b, const double *c, const double *d) {
+    const double adx = a[0] - d[0], ady = a[1] - d[1], adz = a[2] - d[2];
+    const double bdx = b[0] - d[0], bdy = b[1] - d[1], bdz = b[2] - d[2];
+    const double cdx = c[0] - d[0], cdy = c[1] - d[1], cdz = c[2] - d[2];
+
+    double bc[4], ca[4], ab[4];
+    Expansion::cross(bdx, bdy, cdx, cdy, bc);
+    Expansion::cross(cdx, cdy, adx, ady, ca);
+    Expansion::cross(adx, ady, bdx, bdy, ab);
+
+    double adet[8], bdet[8], cdet[8], abdet[16], fin[24];
+    const size_t alen = Expansion::scale(4, bc, adz, adet);
+    const size_t blen = Expansion::scale(4, ca, bdz, bdet);
+    const size_t clen = Expansion::scale(4, ab, cdz, cdet);
+    const size_t ablen = Expansion::sum(alen, adet, blen, bdet, abdet);
+    const size_t finlen = Expansion::sum(ablen, abdet, clen, cdet, fin);
+
+    double det = Expansion::estimate(finlen, fin);
+    const double permanent =
+        (std::fabs(bdx * cdy) + std::fabs(cdx * bdy)) * std::fabs(adz) +
+        (std::fabs(cdx * ady) + std::fabs(adx * cdy)) * std::fabs(bdz) +
+        (std::fabs(adx * bdy) + std::fabs(bdx * ady)) * std::fabs(cdz);
+    double bound = o3d_bound_b * permanent;
+    if (predicate_certain(det, bound)) {
+        return predicate_sign(det);
+    }
+
+    const double adxtail = Expansion::two_diff_tail(a[0], d[0], adx);
+    const double adytail = Expansion::two_diff_tail(a[1], d[1], ady);
+    const double adztail = Expansion::two_diff_tail(a[2], d[2], adz);
+    const double bdxtail = Expansion::two_diff_tail(b[0], d[0], bdx);
+    const double bdytail = Expansion::two_diff_tail(b[1], d[1], bdy);
+    const double bdztail = Expansion::two_diff_tail(b[2], d[2], bdz);
+    const double cdxtail = Expansion::two_diff_tail(c[0], d[0], cdx);
+    const double cdytail = Expansion::two_diff_tail(c[1], d[1], cdy);
+    const double cdztail = Expansion::two_diff_tail(c[2], d[2], cdz);
+    if (adxtail == 0 && adytail == 0 && adztail == 0 &&
+        bdxtail == 0 && bdytail == 0 && bdztail == 0 &&
+        cdxtail == 0 && cdytail == 0 && cdztail == 0) {
+        return predicate_sign(det);
+    }
+
+    bound = o3d_bound_c * permanent + result_bound * std::fabs(det);
+    det += (adz * ((bdx * cdytail + cdy * bdxtail) - (bdy * cdxtail + cdx * bdytail)) +
+            adztail * (bdx * cdy - bdy * cdx)) +
+           (bdz * ((cdx * adytail + ady * cdxtail) - (cdy * adxtail + adx * cdytail)) +
+            bdztail * (cdx * ady - cdy * adx)) +
+           (cdz * ((adx * bdytail + bdy * adxtail) - (ady * bdxtail + bdx * adytail)) +
+            cdztail * (adx * bdy - ady * bdx));
+    if (predicate_certain(det, bound)) {
+        return predicate_sign(det);
+    }
+
+    return orient3d_exact(a, b, c, d);
+}
+
+inline int incircle_adapt(const double *a, const double *b, const double *c, const double *d) {
+    const double adx = a[0] - d[0], ady = a[1] - d[1];
+    const double bdx = b[0] - d[0], bdy = b[1] - d[1];
+    const double cdx = c[0] - d[0], cdy = c[1] - d[1];
+
+    double bc[4], ca[4], ab[4];
+    Expansion::cross(bdx, bdy, cdx, cdy, bc);
+    Expansion::cross(cdx, cdy, adx, ady, ca);
+    Expansion::cross(adx, ady, bdx, bdy, ab);
+
+    const double ad[2] = {adx, ady}, bd[2] = {bdx, bdy}, cd[2] = {cdx, cdy};
+    double adet[32], bdet[32], cdet[32], abdet[64], fin[96];
+    const size_t alen = lift_expansion<4, 2>(4, bc, ad, adet);
+    const size_t blen = lift_expansion<4, 2>(4, ca, bd, bdet);
+    const size_t clen = lift_expansion<4, 2>(4, ab, cd, cdet);
+    const size_t ablen = Expansion::sum(alen, adet, blen, bdet, abdet);
+    const size_t finlen = Expansion::sum(ablen, abdet, clen, cdet, fin);
+
+    double det = Expansion::estimate(finlen, fin);
+    const double alift = adx * adx + ady * ady;
+    const double blift = bdx * bdx + bdy * bdy;
+    const double clift = cdx * cdx + cdy * cdy;
+    const double permanent =
+        (std::fabs(bdx * cdy) + std::fabs(cdx * bdy)) * alift +
+        (std::fabs(cdx * ady) + std::fabs(adx * cdy)) * blift +
+        (std::fabs(adx * bdy) + std::fabs(bdx * ady)) * clift;
+    double bound = icc_bound_b * permanent;
+    if (predicate_certain(det, bound)) {
+        return predicate_sign(det);
+    }
+
+    const double adxtail = Expansion::two_diff_tail(a[0], d[0], adx);
+    const double adytail = Expansion::two_diff_tail(a[1], d[1], ady);
+    const double bdxtail = Expansion::two_diff_tail(b[0], d[0], bdx);
+    const double bdytail = Expansion::two_diff_tail(b[1], d[1], bdy);
+    const double cdxtail = Expansion::two_diff_tail(c[0], d[0], cdx);
+    const double cdytail = Expansion::two_diff_tail(c[1], d[1], cdy);
+    if (adxtail == 0 && adytail == 0 && bdxtail == 0 && bdytail == 0 && cdxtail == 0 && cdytail == 0) {
+        return predicate_sign(det);
+    }
+
+    bound = icc_bound_c * permanent + result_bound * std::fabs(det);
+    det += (alift * ((bdx * cdytail + cdy * bdxtail) - (bdy * cdxtail + cdx * bdytail)) +
+            2 * (adx * adxtail + ady * adytail) * (bdx * cdy - bdy * cdx)) +
+           (blift * ((cdx * adytail + ady * cdxtail) - (cdy * adxtail + adx * cdytail)) +
+            2 * (bdx * bdxtail + bdy * bdytail) * (cdx * ady - cdy * adx)) +
+           (clift * ((adx * bdytail + bdy * adxtail) - (ady * bdxtail + bdx * adytail)) +
+            2 * (cdx * cdxtail + cdy * cdytail) * (adx * bdy - ady * bdx));
+    if (predicate_certain(det, bound)) {
+        return predicate_sign(det);
+    }
+
+    return incircle_exact(a, b, c, d);
+}
+
+inline int insphere_adapt(const double *a, const double *b, const double *c, const double *d, const double *e) {
+    const double ae[3] = {a[0] - e[0], a[1] - e[1], a[2] - e[2]};
+    const double be[3] = {b[0] - e[0], b[1] - e[1], b[2] - e[2]};
+    const double ce[3] = {c[0] - e[0], c[1] - e[1], c[2] - e[2]};
+    const double de[3] = {d[0] - e[0], d[1] - e[1], d[2] - e[2]};
+
+    double ab[4], bc[4], cd[4], da[4], ac[4], bd[4];
+    Expansion::cross(ae[0], ae[1], be[0], be[1], ab);
+    Expansion::cross(be[0], be[1], ce[0], ce[1], bc);
+    Expansion::cross(ce[0], ce[1], de[0], de[1], cd);
+    Expansion::cross(de[0], de[1], ae[0], ae[1], da);
+    Expansion::cross(ae[0], ae[1], ce[0], ce[1], ac);
+    Expansion::cross(be[0], be[1], de[0], de[1], bd);
+
+    // x * p - y * q + z * r, at most 24 components.
+    auto triple = [](const double *p, const double x, const double *q, const double y, const double *r, const double z,
+                     double *h) {
+        double t[3][8], pq[16];
+        const size_t plen = Expansion::scale(4, p, x, t[0]);
+        const size_t qlen = Expansion::scale(4, q, -y, t[1]);
+        const size_t rlen = Expansion::scale(4, r, z, t[2]);
+
+        return Expansion::sum(Expansion::sum(plen, t[0], qlen, t[1], pq), pq, rlen, t[2], h);
+    };
+
+    double abc[24], bcd[24], cda[24], dab[24];
+    const size_t abclen = triple(bc, ae[2], ac, be[2], ab, ce[2], abc);
+    const size_t bcdlen = triple(cd, be[2], bd, ce[2], bc, de[2], bcd);
+    const size_t cdalen = triple(da, ce[2], ac, -de[2], cd, ae[2], cda);
+    const size_t dablen = triple(ab, de[2], bd, -ae[2], da, be[2], dab);
+
+    double adet[288], bdet[288], cdet[288], ddet[288], abdet[576], cddet[576], fin[1152];
+    const size_t alen = lift_expansion<24, 3>(bcdlen, bcd, ae, adet);
+    const size_t blen = lift_expansion<24, 3>(cdalen, cda, be, bdet);
+    const size_t clen = lift_expansion<24, 3>(dablen, dab, ce, cdet);
+    const size_t dlen = lift_expansion<24, 3>(abclen, abc, de, ddet);
+    Expansion::negate(alen, adet);
+    Expansion::negate(clen, cdet);
+    const size_t ablen = Expansion::sum(alen, adet, blen, bdet, abdet);
+    const size_t cdlen = Expansion::sum(clen, cdet, dlen, ddet, cddet);
+    const size_t finlen = Expansion::sum(ablen, abdet, cdlen, cddet, fin);
+
+    double det = Expansion::estimate(finlen, fin);
+
+    const double aex = ae[0], aey = ae[1], aez = ae[2];
+    const double bex = be[0], bey = be[1], bez = be[2];
+    const double cex = ce[0], cey = ce[1], cez = ce[2];
+    const double dex = de[0], dey = de[1], dez = de[2];
+    const double alift = aex * aex + aey * aey + aez * aez;
+    const double blift = bex * bex + bey * bey + bez * bez;
+    const double clift = cex * cex + cey * cey + cez * cez;
+    const double dlift = dex * dex + dey * dey + dez * dez;
+
+    const double az = std::fabs(aez), bz = std::fabs(bez), cz = std::fabs(cez), dz = std::fabs(dez);
+    const double pab = std::fabs(aex * bey) + std::fabs(bex * aey);
+    const double pbc = std::fabs(bex * cey) + std::fabs(cex * bey);
+    const double pcd = std::fabs(cex * dey) + std::fabs(dex * cey);
+    const double pda = std::fabs(dex * aey) + std::fabs(aex * dey);
+    const double pac = std::fabs(aex * cey) + std::fabs(cex * aey);
+    const double pbd = std::fabs(bex * dey) + std::fabs(dex * bey);
+    const double permanent =
+        (pcd * bz + pbd * cz + pbc * dz) * alift +
+        (pda * cz + pac * dz + pcd * az) * blift +
+        (pab * dz + pbd * az + pda * bz) * clift +
+        (pbc * az + pac * bz + pab * cz) * dlift;
+    double bound = isp_bound_b * permanent;
+    if (predicate_certain(det, bound)) {
+        return predicate_sign(det);
+    }
+
+    const double aext = Expansion::two_diff_tail(a[0], e[0], aex);
+    const double aeyt = Expansion::two_diff_tail(a[1], e[1], aey);
+    const double aezt = Expansion::two_diff_tail(a[2], e[2], aez);
+    const double bext = Expansion::two_diff_tail(b[0], e[0], bex);
+    const double beyt = Expansion::two_diff_tail(b[1], e[1], bey);
+    const double bezt = Expansion::two_diff_tail(b[2], e[2], bez);
+    const double cext = Expansion::two_diff_tail(c[0], e[0], cex);
+    const double ceyt = Expansion::two_diff_tail(c[1], e[1], cey);
+    const double cezt = Expansion::two_diff_tail(c[2], e[2], cez);
+    const double dext = Expansion::two_diff_tail(d[0], e[0], dex);
+    const double deyt = Expansion::two_diff_tail(d[1], e[1], dey);
+    const double dezt = Expansion::two_diff_tail(d[2], e[2], dez);
+    if (aext == 0 && aeyt == 0 && aezt == 0 && bext == 0 && beyt == 0 && bezt == 0 &&
+        cext == 0 && ceyt == 0 && cezt == 0 && dext == 0 && deyt == 0 && dezt == 0) {
+        return predicate_sign(det);
+    }
+
+    // First order terms of the minors and of the lifts.
+    const double abeps = (aex * beyt + bey * aext) - (aey * bext + bex * aeyt);
+    const double bceps = (bex * ceyt + cey * bext) - (bey * cext + cex * beyt);
+    const double cdeps = (cex * deyt + dey * cext) - (cey * dext + dex * ceyt);
+    const double daeps = (dex * aeyt + aey * dext) - (dey * aext + aex * deyt);
+    const double aceps = (aex * ceyt + cey * aext) - (aey * cext + cex * aeyt);
+    const double bdeps = (bex * deyt + dey * bext) - (bey * dext + dex * beyt);
+
+    const double ab3 = ab[3], bc3 = bc[3], cd3 = cd[3], da3 = da[3], ac3 = ac[3], bd3 = bd[3];
+
+    bound = isp_bound_c * permanent + result_bound * std::fabs(det);
+    det += ((blift * ((cez * daeps + dez * aceps + aez * cdeps) + (cezt * da3 + dezt * ac3 + aezt * cd3)) +
+             dlift * ((aez * bceps - bez * aceps + cez * abeps) + (aezt * bc3 - bezt * ac3 + cezt * ab3))) -
+            (alift * ((bez * cdeps - cez * bdeps + dez * bceps) + (bezt * cd3 - cezt * bd3 + dezt * bc3)) +
+             clift * ((dez * abeps + aez * bdeps + bez * daeps) + (dezt * ab3 + aezt * bd3 + bezt * da3)))) +
+           2 * (((bex * bext + bey * beyt + bez * bezt) * (cez * da3 + dez * ac3 + aez * cd3) +
+                 (dex * dext + dey * deyt + dez * dezt) * (aez * bc3 - bez * ac3 + cez * ab3)) -
+                ((aex * aext + aey * aeyt + aez * aezt) * (bez * cd3 - cez * bd3 + dez * bc3) +
+                 (cex * cext + cey * ceyt + cez * cezt) * (dez * ab3 + aez * bd3 + bez * da3)));
+    if (predicate_certain(det, bound)) {
+        return predicate_sign(det);
+    }
+
+    return insphere_exact(a, b, c, d, e);
+}
+
+// Filtered determinants. Each returns the sign when the double precision
+// result is certain and 2 when the exact path is needed. They have no
+// branches on the data so batched loops over them vectorize.
+inline int orient2d_filter(const double *a, const double *b, const double *c) {
+    const double detleft = (a[0] - c[0]) * (b[1] - c[1]);
+    const double detright = (a[1] - c[1]) * (b[0] - c[0]);
+    const double det = detleft - detright;
+    const double bound = ccw_bound * (std::fabs(detleft) + std::fabs(detright));
+
+    return det > bound ? 1 : det < -bound ? -1 : (bound == 0 ? 0 : 2);
+}
+
+inline int orient3d_filter(const double *a, const double *b, const double *c, const double *d) {
+    const double adx = a[0] - d[0], ady = a[1] - d[1], adz = a[2] - d[2];
+    const double bdx = b[0] - d[0], bdy = b[1] - d[1], bdz = b[2] - d[2];
+    const double cdx = c[0] - d[0], cdy = c[1] - d[1], cdz = c[2] - d[2];
+
+    const double bdxcdy = bdx * cdy, cdxbdy = cdx * bdy;
+    const double cdxady = cdx * ady, adxcdy = adx * cdy;
+    const double adxbdy = adx * bdy, bdxady = bdx * ady;
+
+    const double det = adz * (bdxcdy - cdxbdy) + bdz * (cdxady - adxcdy) + cdz * (adxbdy - bdxady);
+    const double permanent =
+        (std::fabs(bdxcdy) + std::fabs(cdxbdy)) * std::fabs(adz) +
+        (std::fabs(cdxady) + std::fabs(adxcdy)) * std::fabs(bdz) +
+        (std::fabs(adxbdy) + std::fabs(bdxady)) * std::fabs(cdz);
+    const double bound = o3d_bound * permanent;
+
+    return det > bound ? 1 : det < -bound ? -1 : (bound == 0 ? 0 : 2);
+}
+
+inline int incircle_filter(const double *a, const double *b, const double *c, const double *d) {
+    const double adx = a[0] - d[0], ady = a[1] - d[1];
+    const double bdx = b[0] - d[0], bdy = b[1] - d[1];
+    const double cdx = c[0] - d[0], cdy = c[1] - d[1];
+
+    const double bdxcdy = bdx * cdy, cdxbdy = cdx * bdy, alift = adx * adx + ady * ady;
+    const double cdxady = cdx * ady, adxcdy = adx * cdy, blift = bdx * bdx + bdy * bdy;
+    const double adxbdy = adx * bdy, bdxady = bdx * ady, clift = cdx * cdx + cdy * cdy;
+
+    const double det = alift * (bdxcdy - cdxbdy) + blift * (cdxady - adxcdy) + clift * (adxbdy - bdxady);
+    const double permanent =
+        (std::fabs(bdxcdy) + std::fabs(cdxbdy)) * alift +
+        (std::fabs(cdxady) + std::fabs(adxcdy)) * blift +
+        (std::fabs(adxbdy) + std::fabs(bdxady)) * clift;
+    const double bound = icc_bound * permanent;
+
+    return det > bound ? 1 : det < -bound ? -1 : (bound == 0 ? 0 : 2);
+}
+
+inline int insphere_filter(const double *a, const double *b, const double *c, const double *d, const double *e) {
+    const double aex = a[0] - e[0], aey = a[1] - e[1], aez = a[2] - e[2];
+    const double bex = b[0] - e[0], bey = b[1] - e[1], bez = b[2] - e[2];
+    const double cex = c[0] - e[0], cey = c[1] - e[1], cez = c[2] - e[2];
+    const double dex = d[0] - e[0], dey = d[1] - e[1], dez = d[2] - e[2];
+
+    const double aexbey = aex * bey, bexaey = bex * aey;
+    const double bexcey = bex * cey, cexbey = cex * bey;
+    const double cexdey = cex * dey, dexcey = dex * cey;
+    const double dexaey = dex * aey, aexdey = aex * dey;
+    const double aexcey = aex * cey, cexaey = cex * aey;
+    const double bexdey = bex * dey, dexbey = dex * bey;
+
+    const double ab = aexbey - bexaey, bc = bexcey - cexbey;
+    const double cd = cexdey - dexcey, da = dexaey - aexdey;
+    const double ac = aexcey - cexaey, bd = bexdey - dexbey;
+
+    const double abc = aez * bc - bez * ac + cez * ab;
+    const double bcd = bez * cd - cez * bd + dez * bc;
+    const double cda = cez * da + dez * ac + aez * cd;
+    const double dab = dez * ab + aez * bd + bez * da;
+
+    const double alift = aex * aex + aey * aey + aez * aez;
+    const double blift = bex * bex + bey * bey + bez * bez;
+    const double clift = cex * cex + cey * cey + cez * cez;
+    const double dlift = dex * dex + dey * dey + dez * dez;
+
+    const double det = (dlift * abc - clift * dab) + (blift * cda - alift * bcd);
+
+    const double az = std::fabs(aez), bz = std::fabs(bez), cz = std::fabs(cez), dz = std::fabs(dez);
+    const double pab = std::fabs(aexbey) + std::fabs(bexaey);
+    const double pbc = std::fabs(bexcey) + std::fabs(cexbey);
+    const double pcd = std::fabs(cexdey) + std::fabs(dexcey);
+    const double pda = std::fabs(dexaey) + std::fabs(aexdey);
+    const double pac = std::fabs(aexcey) + std::fabs(cexaey);
+    const double pbd = std::fabs(bexdey) + std::fabs(dexbey);
+
+    const double permanent =
+        (pcd * bz + pbd * cz + pbc * dz) * alift +
+        (pda * cz + pac * dz + pcd * az) * blift +
+        (pab * dz + pbd * az + pda * bz) * clift +
+        (pbc * az + pac * bz + pab * cz) * dlift;
+    const double bound = isp_bound * permanent;
+
+    return det > bound ? 1 : det < -bound ? -1 : (bound == 0 ? 0 : 2);
+}
+
+template <typename T>
+int orient2d(const Vec2<T> &a, const Vec2<T> &b, const Vec2<T> &c) {
+    const double pa[2] = {(double)a.x, (double)a.y};
+    const double pb[2] = {(double)b.x, (double)b.y};
+    const double pc[2] = {(double)c.x, (double)c.y};
+
+    const int r = orient2d_filter(pa, pb, pc);
+    return r != 2 ? r : orient2d_adapt(pa, pb, pc);
+}
+
+template <typename T>
+int orient3d(const Vec3<T> &a, const Vec3<T> &b, const Vec3<T> &c, const Vec3<T> &d) {
+    const double pa[3] = {(double)a.x, (double)a.y, (double)a.z};
+    const double pb[3] = {(double)b.x, (double)b.y, (double)b.z};
+    const double pc[3] = {(double)c.x, (double)c.y, (double)c.z};
+    const double pd[3] = {(double)d.x, (double)d.y, (double)d.z};
+
+    const int r = orient3d_filter(pa, pb, pc, pd);
+    return r != 2 ? r : orient3d_adapt(pa, pb, pc, pd);
+}
+
+template <typename T>
+int incircle(const Vec2<T> &a, const Vec2<T> &b, const Vec2<T> &c, const Vec2<T> &d) {
+    const double pa[2] = {(double)a.x, (double)a.y};
+    const double pb[2] = {(double)b.x, (double)b.y};
+    const double pc[2] = {(double)c.x, (double)c.y};
+    const double pd[2] = {(double)d.x, (double)d.y};
+
+    const int r = incircle_filter(pa, pb, pc, pd);
+    return r != 2 ? r : incircle_adapt(pa, pb, pc, pd);
+}
+
+template <typename T>
+int insphere(const Vec3<T> &a, const Vec3<T> &b, const Vec3<T> &c, const Vec3<T> &d, const Vec3<T> &e) {
+    const double pa[3] = {(double)a.x, (double)a.y, (double)a.z};
+    const double pb[3] = {(double)b.x, (double)b.y, (double)b.z};
+    const double pc[3] = {(double)c.x, (double)c.y, (double)c.z};
+    const double pd[3] = {(double)d.x, (double)d.y, (double)d.z};
+    const double pe[3] = {(double)e.x, (double)e.y, (double)e.z};
+
+    const int r = insphere_filter(pa, pb, pc, pd, pe);
+    return r != 2 ? r : insphere_adapt(pa, pb, pc, pd, pe);
+}
+
+// Batched predicates over equally sized arrays, out[i] being the predicate
+// of the i-th element of each. The filter pass runs branch free over blocks
+// on the pool; the few uncertain entries are then resolved exactly.
+template <typename T>
+void orient2d(const std::vector<Vec2<T>> &a, const std::vector<Vec2<T>> &b, const std::vector<Vec2<T>> &c,
+              std::vector<int8_t> &out) {
+    if (a.size() != b.size() || a.size() != c.size()) {
+        throw std::length_error("point arrays should be of same size");
+    }
+
+    out.resize(a.size());
+
+    parallel_for(0, a.size(), 4096, [&](size_t lo, size_t hi) {
+        for (size_t i = lo; i != hi; i++) {
+            const double pa[2] = {(double)a[i].x, (double)a[i].y};
+            const double pb[2] = {(double)b[i].x, (double)b[i].y};
+            const double pc[2] = {(double)c[i].x, (double)c[i].y};
+
+            out[i] = static_cast<int8_t>(orient2d_filter(pa, pb, pc));
+        }
+
+        for (size_t i = lo; i != hi; i++) {
+            if (out[i] == 2) {
+                out[i] = static_cast<int8_t>(orient2d(a[i], b[i], c[i]));
+            }
+        }
+    });
+}
+
+template <typename T>
+void orient3d(const std::vector<Vec3<T>> &a, const std::vector<Vec3<T>> &b, const std::vector<Vec3<T>> &c,
+              const std::vector<Vec3<T>> &d, std::vector<int8_t> &out) {
+    if (a.size() != b.size() || a.size() != c.size() || a.size() != d.size()) {
+        throw std::length_error("point arrays should be of same size");
+    }
+
+    out.resize(a.size());
+
+    parallel_for(0, a.size(), 4096, [&](size_t lo, size_t hi) {
+        for (size_t i = lo; i != hi; i++) {
+            const double pa[3] = {(double)a[i].x, (double)a[i].y, (double)a[i].z};
+            const double pb[3] = {(double)b[i].x, (double)b[i].y, (double)b[i].z};
+            const double pc[3] = {(double)c[i].x, (double)c[i].y, (double)c[i].z};
+            const double pd[3] = {(double)d[i].x, (double)d[i].y, (double)d[i].z};
+
+            out[i] = static_cast<int8_t>(orient3d_filter(pa, pb, pc, pd));
+        }
+
+        for (size_t i = lo; i != hi; i++) {
+            if (out[i] == 2) {
+                out[i] = static_cast<int8_t>(orient3d(a[i], b[i], c[i], d[i]));
+            }
+        }
+    });
+}
+
+template <typename T>
+void incircle(const std::vector<Vec2<T>> &a, const std::vector<Vec2<T>> &b, const std::vector<Vec2<T>> &c,
+              const std::vector<Vec2<T>> &d, std::vector<int8_t> &out) {
+    if (a.size() != b.size() || a.size() != c.size() || a.size() != d.size()) {
+        throw std::length_error("point arrays should be of same size");
+    }
+
+    out.resize(a.size());
+
+    parallel_for(0, a.size(), 4096, [&](size_t lo, size_t hi) {
+        for (size_t i = lo; i != hi; i++) {
+            const double pa[2] = {(double)a[i].x, (double)a[i].y};
+            const double pb[2] = {(double)b[i].x, (double)b[i].y};
+            const double pc[2] = {(double)c[i].x, (double)c[i].y};
+            const double pd[2] = {(double)d[i].x, (double)d[i].y};
+
+            out[i] = static_cast<int8_t>(incircle_filter(pa, pb, pc, pd));
+        }
+
+        for (size_t i = lo; i != hi; i++) {
+            if (out[i] == 2) {
+                out[i] = static_cast<int8_t>(incircle(a[i], b[i], c[i], d[i]));
+            }
+        }
+    });
+}
+
+template <typename T>
+void insphere(const std::vector<Vec3<T>> &a, const std::vector<Vec3<T>> &b, const std::vector<Vec3<T>> &c,
+              const std::vector<Vec3<T>> &d, const std::vector<Vec3<T>> &e, std::vector<int8_t> &out) {
+    if (a.size() != b.size() || a.size() != c.size() || a.size() != d.size() || a.size() != e.size()) {
+        throw std::length_error("point arrays should be of same size");
+    }
+
+    out.resize(a.size());
+
+    parallel_for(0, a.size(), 4096, [&](size_t lo, size_t hi) {
+        for (size_t i = lo; i != hi; i++) {
+            const double pa[3] = {(double)a[i].x, (double)a[i].y, (double)a[i].z};
+            const double pb[3] = {(double)b[i].x, (double)b[i].y, (double)b[i].z};
+            const double pc[3] = {(double)c[i].x, (double)c[i].y, (double)c[i].z};
+            const double pd[3] = {(double)d[i].x, (double)d[i].y, (double)d[i].z};
+            const double pe[3] = {(double)e[i].x, (double)e[i].y, (double)e[i].z};
+
+            out[i] = static_cast<int8_t>(insphere_filter(pa, pb, pc, pd, pe));
+        }
+
+        for (size_t i = lo; i != hi; i++) {
+            if (out[i] == 2) {
+                out[i] = static_cast<int8_t>(insphere(a[i], b[i], c[i], d[i], e[i]));
+            }
+        }
+    });
+}
+
+#endif
@@ -0,0 +1,520 @@
+#ifndef QR_H
+#define QR_H
+
+#include <vector>
+#include <cmath>
+#include <limits>
+#include <algorithm>
+#include <stdexcept>
+
+#include "geometry.h"
+#include "parallel.h"
+
+// QR
+//
+// Householder QR of an m x n matrix with m >= n, A P = Q R. The matrix is
+// copied into column major storage where R ends up on and above the
+// diagonal and the Householder vectors below it, each with an implicit
+// leading 1. Q is never formed: it is kept as one compact WY block
+// I - V T V^T per panel of columns and applied from those.
+//
+// Without pivoting the columns are factored in panels, and the rest of the
+// matrix is updated once per panel with the block reflector, which is made
+// of matrix products. With pivoting each step first moves the remaining
+// column of largest norm to the front, which needs the updated norms after
+// every column, so the update is column by column; the rank can then be
+// read off the diagonal of R.
+//
+// All loops over rows run on the pool in fixed blocks, with reductions
+// added in block order, so the factors do not depend on the thread count.
+template <typename T>
+class QR {
+private:
+    typedef typename accumulate_type<T>::type A;
+
+    static constexpr size_t panel = 32;
+    static constexpr size_t row_block = 8192;
+
+    size_t m, n;
+    bool pivoting;
+    std::vector<A> a;
+    std::vector<A> tau;
+    std::vector<size_t> perm;
+    std::vector<std::vector<A>> blocks;
+
+    A* column(const size_t j) {
+        return a.data() + j * m;
+    }
+
+    const A* column(const size_t j) const {
+        return a.data() + j * m;
+    }
+
+    // Calls f(lo, hi, partial) over fixed blocks of rows in [begin, end),
+    // each with its own zeroed partial of the given width, and adds the
+    // partials into out in block order.
+    template <typename F>
+    static void block_reduce(const size_t begin, const size_t end, const size_t width, A *out, F f) {
+        std::fill(out, out + width, A(0));
+
+        if (end <= begin) {
+            return;
+        }
+
+        const size_t count = (end - begin + row_block - 1) / row_block;
+        std::vector<A> partial(count * width, A(0));
+
+        parallel_for(0, count, 1, [&](size_t lo, size_t hi) {
+            for (size_t b = lo; b != hi; b++) {
+                f(begin + b * row_block, std::min(end, begin + (b + 1) * row_block), partial.data() + b * width);
+            }
+        });
+
+        for (size_t b = 0; b != count; b++) {
+            for (size_t w = 0; w != width; w++) {
+                out[w] += partial[b * width + w];
+            }
+        }
+    }
+
+    A norm2(const size_t j, const size_t begin) const {
+        const A *x = column(j);
+        A r;
+
+        block_reduce(begin, m, 1, &r, [&](size_t lo, size_t hi, A *s) {
+            for (size_t i = lo; i != hi; i++) {
+                s[0] += x[i] * x[i];
+            }
+        });
+
+        return r;
+    }
+
+    // Householder reflector that zeroes column j below the diagonal, applied
+    // to columns j + 1 up to last.
+    void reflect(const size_t j, const size_t last) {
+        A *x = column(j);
+        const A alpha = x[j];
+        const A sigma = norm2(j, j + 1);
+
+        if (sigma == 0) {
+            tau[j] = 0;
+            return;
+        }
+
+        const A beta = -std::copysign(std::sqrt(alpha * alpha + sigma), alpha);
+        const A scale = 1 / (alpha - beta);
+
+        tau[j] = (beta - alpha) / beta;
+
+        parallel_for(j + 1, m, row_block, [&](size_t lo, size_t hi) {
+            for (size_t i = lo; i != hi; i++) {
+                x[i] *= scale;
+            }
+        });
+        x[j] = beta;
+
+        const size_t width = last - j - 1;
+        if (width == 0) {
+            return;
+        }
+
+        std::vector<A> w(width);
+        block_reduce(j + 1, m, width, w.data(), [&](size_t lo, size_t hi, A *s) {
+            for (size_t k = 0; k != width; k++) {
+                const A *c = column(j + 1 + k);
+
+                for (size_t i = lo; i != hi; i++) {
+                    s[k] += x[i] * c[i];
+                }
+            }
+        });
+
+        for (size_t k = 0; k != width; k++) {
+            w[k] = tau[j] * (w[k] + column(j + 1 + k)[j]);
+            column(j + 1 + k)[j] -= w[k];
+        }
+
+        parallel_for(j + 1, m, row_block, [&](size_t lo, size_t hi) {
+            for (size_t k = 0; k != width; k++) {
+                A *c = column(j + 1 + k);
+
+                for (size_t i = lo; i != hi; i++) {
+                    c[i] -= w[k] * x[i];
+                }
+            }
+        });
+    }
+
+    // Triangular factor of the panel starting at column j0, from the Gram
+    // matrix of its Householder vectors.
+    void build_block(const size_t j0, const size_t jb) {
+        std::vector<A> g(jb * jb);
+
+        block_reduce(j0 + 1, m, jb * jb, g.data(), [&](size_t lo, size_t hi, A *s) {
+            for (size_t q = 1; q != jb; q++) {
+                const A *vq = column(j0 + q);
+
+                for (size_t p = 0; p != q; p++) {
+                    const A *vp = column(j0 + p);
+                    A r = 0;
+
+                    for (size_t i = std::max(lo, j0 + q + 1); i < hi; i++) {
+                        r += vp[i] * vq[i];
+                    }
+
+                    s[p * jb + q] += r;
+                }
+            }
+        });
+
+        for (size_t q = 1; q != jb; q++) {
+            for (size_t p = 0; p != q; p++) {
+                g[p * jb + q] += column(j0 + p)[j0 + q];
+            }
+        }
+
+        std::vector<A> t(jb * jb, A(0));
+        for (size_t i = 0; i != jb; i++) {
+            t[i * jb + i] = tau[j0 + i];
+
+            for (size_t r = 0; r != i; r++) {
+                A s = 0;
+
+                for (size_t c = r; c != i; c++) {
+                    s += t[r * jb + c] * g[c * jb + i];
+                }
+
+                t[r * jb + i] = -tau[j0 + i] * s;
+            }
+        }
+
+        blocks.push_back(std::move(t));
+    }
+
+    // c = (I - V T V^T) c, or with T^T when transpose, for the panel p and a
+    // column major c of k columns with m rows.
+    void apply_block(const size_t p, A *c, const size_t k, const bool transpose) const {
+        const size_t j0 = p * panel;
+        const size_t jb = std::min(panel, n - j0);
+        const std::vector<A> &t = blocks[p];
+
+        std::vector<A> w(jb * k);
+        block_reduce(j0 + 1, m, jb * k, w.data(), [&](size_t lo, size_t hi, A *s) {
+            for (size_t col = 0; col != k; col++) {
+                const A *cc = c + col * m;
+
+                for (size_t r = 0; r != jb; r++) {
+                    const A *v = column(j0 + r);
+                    A sum = 0;
+
+                    for (size_t i = std::max(lo, j0 + r + 1); i < hi; i++) {
+                        sum += v[i] * cc[i];
+                    }
+
+                    s[r * k + col] += sum;
+                }
+            }
+        });
+
+        for (size_t col = 0; col != k; col++) {
+            for (size_t r = 0; r != jb; r++) {
+                w[r * k + col] += c[col * m + j0 + r];
+            }
+        }
+
+        std::vector<A> tw(jb * k, A(0));
+        for (size_t r = 0; r != jb; r++) {
+            for (size_t col = 0; col != k; col++) {
+                A s = 0;
+
+                if (transpose) {
+                    for (size_t q = 0; q <= r; q++) {
+                        s += t[q * jb + r] * w[q * k + col];
+                    }
+                } else {
+                    for (size_t q = r; q != jb; q++) {
+                        s += t[r * jb + q] * w[q * k + col];
+                    }
+                }
+
+                tw[r * k + col] = s;
+            }
+        }
+
+        parallel_for(j0, m, row_block, [&](size_t lo, size_t hi) {
+            for (size_t col = 0; col != k; col++) {
+                A *cc = c + col * m;
+
+                for (size_t r = 0; r != jb; r++) {
+                    const A *v = column(j0 + r);
+                    const A s = tw[r * k + col];
+
+                    if (j0 + r >= lo && j0 + r < hi) {
+                        cc[j0 + r] -= s;
+                    }
+
+                    for (size_t i = std::max(lo, j0 + r + 1); i < hi; i++) {
+                        cc[i] -= v[i] * s;
+                    }
+                }
+            }
+        });
+    }
+
+    void factor_blocked() {
+        for (size_t j0 = 0; j0 < n; j0 += panel) {
+            const size_t jb = std::min(panel, n - j0);
+
+            for (size_t j = j0; j != j0 + jb; j++) {
+                reflect(j, j0 + jb);
+            }
+
+            build_block(j0, jb);
+
+            if (j0 + jb < n) {
+                apply_block(j0 / panel, column(j0 + jb), n - j0 - jb, true);
+            }
+        }
+    }
+
+    // Businger-Golub pivoting with the norm downdating of LAPACK's xLAQP2,
+    // recomputing a norm once cancellation has eaten most of its digits.
+    void factor_pivoted() {
+        std::vector<A> norms(n), original(n);
+        const A limit = std::sqrt(std::numeric_limits<A>::epsilon());
+
+        for (size_t j = 0; j != n; j++) {
+            norms[j] = original[j] = std::sqrt(norm2(j, 0));
+        }
+
+        for (size_t j = 0; j != n; j++) {
+            const size_t p = std::max_element(norms.begin() + j, norms.end()) - norms.begin();
+
+            if (p != j) {
+                std::swap_ranges(column(j), column(j) + m, column(p));
+                std::swap(perm[j], perm[p]);
+                std::swap(norms[j], norms[p]);
+                std::swap(original[j], original[p]);
+            }
+
+            reflect(j, n);
+
+            for (size_t k = j + 1; k != n; k++) {
+                if (norms[k] == 0) {
+                    continue;
+                }
+
+                const A r = std::fabs(column(k)[j]) / norms[k];
+                const A left = std::max(A(0), (1 - r) * (1 + r));
+                const A ratio = norms[k] / original[k];
+
+                if (left * ratio * ratio <= limit) {
+                    norms[k] = original[k] = j + 1 < m ? std::sqrt(norm2(k, j + 1)) : A(0);
+                } else {
+                    norms[k] *= std::sqrt(left);
+                }
+            }
+        }
+
+        for (size_t j0 = 0; j0 < n; j0 += panel) {
+            build_block(j0, std::min(panel, n - j0));
+        }
+    }
+
+    std::vector<A> to_columns(const Matrix<T> &b) const {
+        if (b.rows != m) {
+            throw std::length_error("matrix rows should be equal to factored rows");
+        }
+
+        std::vector<A> c(m * b.cols);
+        for (size_t i = 0; i != m; i++) {
+            for (size_t j = 0; j != b.cols; j++) {
+                c[j * m + i] = static_cast<A>(b[i][j]);
+            }
+        }
+
+        return c;
+    }
+
+    void from_columns(const std::vector<A> &c, Matrix<T> &b) const {
+        for (size_t i = 0; i != m; i++) {
+            for (size_t j = 0; j != b.cols; j++) {
+                b[i][j] = static_cast<T>(c[j * m + i]);
+            }
+        }
+    }
+
+    void apply_qt(A *c, const size_t k) const {
+        for (size_t p = 0; p != blocks.size(); p++) {
+            apply_block(p, c, k, true);
+        }
+    }
+
+    void apply_q(A *c, const size_t k) const {
+        for (size_t p = blocks.size(); p-- != 0;) {
+            apply_block(p, c, k, false);
+        }
+    }
+
+public:
+    QR(const Matrix<T> &matrix, const bool pivoting = false):
+        m(matrix.rows), n(matrix.cols), pivoting(pivoting), a(m * n), tau(n), perm(n)
+    {
+        if (m < n) {
+            throw std::length_error("matrix rows should not be less than cols");
+        }
+
+        for (size_t i = 0; i != m; i++) {
+            for (size_t j = 0; j != n; j++) {
+                a[j * m + i] = static_cast<A>(matrix[i][j]);
+            }
+        }
+
+        for (size_t j = 0; j != n; j++) {
+            perm[j] = j;
+        }
+
+        if (pivoting) {
+            factor_pivoted();
+        } else {
+            factor_blocked();
+        }
+    }
+
+    size_t rows() const {
+        return m;
+    }
+
+    size_t cols() const {
+        return n;
+    }
+
+    // The n x n upper triangular factor.
+    Matrix<T> r() const {
+        Matrix<T> r(n, n);
+
+        for (size_t i = 0; i != n; i++) {
+            for (size_t j = i; j != n; j++) {
+                r[i][j] = static_cast<T>(column(j)[i]);
+            }
+        }
+
+        return r;
+    }
+
+    // Column j of R belongs to column permutation()[j] of the matrix.
+    const std::vector<size_t>& permutation() const {
+        return perm;
+    }
+
+    // Number of diagonal entries of R above tolerance, which defaults to
+    // max(m, n) * epsilon * |R(0, 0)|. Only meaningful with pivoting, which
+    // keeps the diagonal decreasing.
+    size_t rank(A tolerance = -1) const {
+        if (n == 0) {
+            return 0;
+        }
+
+        if (tolerance < 0) {
+            tolerance = std::max(m, n) * std::numeric_limits<A>::epsilon() * std::fabs(a[0]);
+        }
+
+        size_t r = 0;
+        for (size_t i = 0; i != n; i++) {
+            if (std::fabs(column(i)[i]) > tolerance) {
+                r++;
+            }
+        }
+
+        return r;
+    }
+
+    // b = Q^T b and b = Q b for b with m rows.
+    void apply_qt(Matrix<T> &b) const {
+        std::vector<A> c = to_columns(b);
+
+        apply_qt(c.data(), b.cols);
+        from_columns(c, b);
+    }
+
+    void apply_q(Matrix<T> &b) const {
+        std::vector<A> c = to_columns(b);
+
+        apply_q(c.data(), b.cols);
+        from_columns(c, b);
+    }
+
+    // The first n columns of Q.
+    Matrix<T> q() const {
+        std::vector<A> c(m * n, A(0));
+        for (size_t j = 0; j != n; j++) {
+            c[j * m + j] = 1;
+        }
+
+        apply_q(c.data(), n);
+
+        Matrix<T> r(m, n);
+        from_columns(c, r);
+
+        return r;
+    }
+
+    // Least squares solution x minimizing |A x - b| for each column of b.
+    // With pivoting, columns past the rank get 0 (the basic solution);
+    // without it a zero on the diagonal of R throws.
+    Matrix<T> solve(const Matrix<T> &b) const {
+        std::vector<A> c = to_columns(b);
+        apply_qt(c.data(), b.cols);
+
+        const size_t r = pivoting ? rank() : n;
+        if (!pivoting) {
+            for (size_t i = 0; i != n; i++) {
+                if (column(i)[i] == 0) {
+                    throw std::domain_error("matrix is rank deficient");
+                }
+            }
+        }
+
+        Matrix<T> x(n, b.cols);
+        std::vector<A> y(r);
+
+        for (size_t k = 0; k != b.cols; k++) {
+            const A *ck = c.data() + k * m;
+
+            for (size_t i = r; i-- != 0;) {
+                A s = ck[i];
+
+                for (size_t j = i + 1; j != r; j++) {
+                    s -= column(j)[i] * y[j];
+                }
+
+                y[i] = s / column(i)[i];
+            }
+
+            for (size_t i = 0; i != r; i++) {
+                x[perm[i]][k] = static_cast<T>(y[i]);
+            }
+        }
+
+        return x;
+    }
+
+    std::vector<T> solve(const std::vector<T> &b) const {
+        Matrix<T> c(b.size(), 1);
+        for (size_t i = 0; i != b.size(); i++) {
+            c[i][0] = b[i];
+        }
+
+        Matrix<T> x = solve(c);
+
+        std::vector<T> r(n);
+        for (size_t i = 0; i != n; i++) {
+            r[i] = x[i][0];
+        }
+
+        return r;
+    }
+};
+
+#endif
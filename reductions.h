@@ -0,0 +1,348 @@
+#ifndef REDUCTIONS_H
+#define REDUCTIONS_H
+
+#include <vector>
+#include <cmath>
+#include <algorithm>
+#include <stdexcept>
+#include <type_traits>
+
+#include "geometry.h"
+#include "parallel.h"
+
+// Reductions
+//
+// Sums, norms, extrema and moments of vectors, matrices and Vec3 arrays.
+// The input is cut into blocks of a fixed size, which the pool reduces in
+// any order into one slot each, and the slots are then combined in a
+// balanced tree in block order, so a result depends neither on the policy
+// nor on the number of threads.
+//
+// Terms within a block are summed with the method of the Accumulate policy,
+// PairwiseSum unless given. Its leaves sum eight interleaved lanes, which
+// the compiler can keep in one or two vector registers, and add the lanes
+// in a fixed tree, so the order of operations is the same on every target.
+
+const size_t reduction_block = 4096;
+
+// Sum of f(i) for i in [lo, hi), by the method M.
+template <typename R, typename F>
+R sum_terms(const size_t lo, const size_t hi, NaiveSum, F f) {
+    R r = R();
+
+    for (size_t i = lo; i != hi; i++) {
+        r += f(i);
+    }
+
+    return r;
+}
+
+template <typename R, typename F>
+R sum_terms(const size_t lo, const size_t hi, KahanSum, F f) {
+    R r = R();
+    R c = R();
+
+    for (size_t i = lo; i != hi; i++) {
+        const R y = f(i) - c;
+        const R t = r + y;
+
+        c = (t - r) - y;
+        r = t;
+    }
+
+    return r;
+}
+
+template <typename R, typename F>
+R sum_terms(const size_t lo, const size_t hi, PairwiseSum, F f) {
+    if (hi - lo > 256) {
+        const size_t mid = lo + (hi - lo) / 2;
+
+        return sum_terms<R>(lo, mid, PairwiseSum(), f) + sum_terms<R>(mid, hi, PairwiseSum(), f);
+    }
+
+    R s[8] = {};
+    size_t i = lo;
+
+    for (; i + 8 <= hi; i += 8) {
+        for (size_t l = 0; l != 8; l++) {
+            s[l] += f(i + l);
+        }
+    }
+
+    R r = ((s[0] + s[1]) + (s[2] + s[3])) + ((s[4] + s[5]) + (s[6] + s[7]));
+    for (; i != hi; i++) {
+        r += f(i);
+    }
+
+    return r;
+}
+
+// Calls f(lo, hi) for each block of [0, n), on the pool when e allows it
+// and n is at least the threshold, and returns the results in block order.
+template <typename R, typename F>
+std::vector<R> reduce_blocks(const size_t n, const Execution e, F f) {
+    const size_t blocks = (n + reduction_block - 1) / reduction_block;
+    std::vector<R> partial(blocks);
+
+    const bool serial = e == Execution::sequential || n < ExecutionSettings::threshold();
+
+    parallel_for(0, blocks, serial ? blocks : 1, [&](size_t lo, size_t hi) {
+        for (size_t b = lo; b != hi; b++) {
+            partial[b] = f(b * reduction_block, std::min(n, (b + 1) * reduction_block));
+        }
+    });
+
+    return partial;
+}
+
+template <typename R>
+R sum_tree(const R *x, const size_t n) {
+    if (n == 0) {
+        return R();
+    }
+
+    if (n == 1) {
+        return x[0];
+    }
+
+    return sum_tree(x, n / 2) + sum_tree(x + n / 2, n - n / 2);
+}
+
+// Sum of f(i) for i in [0, n).
+template <typename R, typename M, typename F>
+R reduce_sum(const size_t n, M method, const Execution e, F f) {
+    const std::vector<R> partial = reduce_blocks<R>(n, e, [&](size_t lo, size_t hi) {
+        return sum_terms<R>(lo, hi, method, f);
+    });
+
+    return sum_tree(partial.data(), partial.size());
+}
+
+template <typename T, typename A = typename accumulate_type<typename std::remove_const<T>::type>::type, typename M = PairwiseSum>
+A sum(const VectorView<T> &x, Accumulate<A, M> = Accumulate<A, M>(), const Execution e = ExecutionSettings::policy()) {
+    return reduce_sum<A>(x.size, M(), e, [&](size_t i) { return static_cast<A>(x[i]); });
+}
+
+template <typename T, typename A, typename M>
+A sum(const Matrix<T> &m, Accumulate<A, M> policy, const Execution e = ExecutionSettings::policy()) {
+    return sum(VectorView<const T>(m.data(), m.rows * m.cols), policy, e);
+}
+
+// Largest absolute value, 0 for an empty x, and NaN if x holds one.
+template <typename T, typename A = typename accumulate_type<typename std::remove_const<T>::type>::type>
+A max_abs(const VectorView<T> &x, const Execution e = ExecutionSettings::policy()) {
+    const std::vector<A> partial = reduce_blocks<A>(x.size, e, [&](size_t lo, size_t hi) {
+        A r = 0;
+
+        for (size_t i = lo; i != hi; i++) {
+            const A a = std::fabs(static_cast<A>(x[i]));
+
+            if (a != a) {
+                return a;
+            }
+            if (a > r) {
+                r = a;
+            }
+        }
+
+        return r;
+    });
+
+    A r = 0;
+    for (size_t b = 0; b != partial.size(); b++) {
+        if (partial[b] != partial[b]) {
+            return partial[b];
+        }
+        if (partial[b] > r) {
+            r = partial[b];
+        }
+    }
+
+    return r;
+}
+
+// Euclidean norm. The squares are summed scaled by the largest absolute
+// value, so the result does not overflow or underflow where the norm
+// itself is representable.
+template <typename T, typename A = typename accumulate_type<typename std::remove_const<T>::type>::type, typename M = PairwiseSum>
+A norm(const VectorView<T> &x, Accumulate<A, M> = Accumulate<A, M>(), const Execution e = ExecutionSettings::policy()) {
+    const A scale = max_abs(x, e);
+
+    if (scale == 0 || !std::isfinite(scale)) {
+        return scale;
+    }
+
+    const A r = reduce_sum<A>(x.size, M(), e, [&](size_t i) {
+        const A a = static_cast<A>(x[i]) / scale;
+        return a * a;
+    });
+
+    return scale * std::sqrt(r);
+}
+
+// Frobenius norm, computed as the Euclidean norm above.
+template <typename T, typename A, typename M>
+A norm(const Matrix<T> &m, Accumulate<A, M> policy, const Execution e = ExecutionSettings::policy()) {
+    return norm(VectorView<const T>(m.data(), m.rows * m.cols), policy, e);
+}
+
+// Sum of absolute values.
+template <typename T, typename A = typename accumulate_type<typename std::remove_const<T>::type>::type, typename M = PairwiseSum>
+A norm_1(const VectorView<T> &x, Accumulate<A, M> = Accumulate<A, M>(), const Execution e = ExecutionSettings::policy()) {
+    return reduce_sum<A>(x.size, M(), e, [&](size_t i) { return std::fabs(static_cast<A>(x[i])); });
+}
+
+// Largest absolute value.
+template <typename T, typename A = typename accumulate_type<typename std::remove_const<T>::type>::type>
+A norm_inf(const VectorView<T> &x, const Execution e = ExecutionSettings::policy()) {
+    return max_abs(x, e);
+}
+
+// For matrices, norm_1 and norm_inf are the induced norms: the largest
+// absolute column sum and the largest absolute row sum.
+template <typename T, typename A = typename accumulate_type<T>::type, typename M = PairwiseSum>
+A norm_1(const Matrix<T> &m, Accumulate<A, M> policy = Accumulate<A, M>(), const Execution e = ExecutionSettings::policy()) {
+    const bool serial = e == Execution::sequential || m.rows * m.cols < ExecutionSettings::threshold();
+    std::vector<A> sums(m.cols);
+
+    parallel_for(0, m.cols, serial ? m.cols : 16, [&](size_t lo, size_t hi) {
+        for (size_t j = lo; j != hi; j++) {
+            sums[j] = norm_1(col_view(m, j), policy, Execution::sequential);
+        }
+    });
+
+    return max_abs(view(static_cast<const std::vector<A>&>(sums)), Execution::sequential);
+}
+
+template <typename T, typename A = typename accumulate_type<T>::type, typename M = PairwiseSum>
+A norm_inf(const Matrix<T> &m, Accumulate<A, M> policy = Accumulate<A, M>(), const Execution e = ExecutionSettings::policy()) {
+    const bool serial = e == Execution::sequential || m.rows * m.cols < ExecutionSettings::threshold();
+    std::vector<A> sums(m.rows);
+
+    parallel_for(0, m.rows, serial ? m.rows : std::max<size_t>(1, 16384 / std::max<size_t>(m.cols, 1)), [&](size_t lo, size_t hi) {
+        for (size_t i = lo; i != hi; i++) {
+            sums[i] = norm_1(row_view(m, i), policy, Execution::sequential);
+        }
+    });
+
+    return max_abs(view(static_cast<const std::vector<A>&>(sums)), Execution::sequential);
+}
+
+// IndexedValue
+//
+// An element and its position. For a Matrix, index is row * cols + col.
+template <typename T>
+class IndexedValue {
+public:
+    T value;
+    size_t index;
+
+    IndexedValue(): value(), index(0) {}
+
+    IndexedValue(const T value, const size_t index): value(value), index(index) {}
+};
+
+// First position of the extreme of x by less: min_index with <, max_index
+// with >. NaNs are never picked unless x holds nothing else.
+template <typename T, typename L>
+IndexedValue<typename std::remove_const<T>::type> extreme_index(const VectorView<T> &x, const Execution e, L less) {
+    typedef typename std::remove_const<T>::type R;
+
+    if (x.size == 0) {
+        throw std::length_error("x should not be empty");
+    }
+
+    auto better = [&](const R a, const R b) {
+        return less(a, b) || (b != b && a == a);
+    };
+
+    const std::vector<IndexedValue<R>> partial = reduce_blocks<IndexedValue<R>>(x.size, e, [&](size_t lo, size_t hi) {
+        IndexedValue<R> r(x[lo], lo);
+
+        for (size_t i = lo + 1; i != hi; i++) {
+            if (better(x[i], r.value)) {
+                r = IndexedValue<R>(x[i], i);
+            }
+        }
+
+        return r;
+    });
+
+    IndexedValue<R> r = partial[0];
+    for (size_t b = 1; b != partial.size(); b++) {
+        if (better(partial[b].value, r.value)) {
+            r = partial[b];
+        }
+    }
+
+    return r;
+}
+
+template <typename T>
+IndexedValue<typename std::remove_const<T>::type> min_index(const VectorView<T> &x, const Execution e = ExecutionSettings::policy()) {
+    typedef typename std::remove_const<T>::type R;
+
+    return extreme_index(x, e, [](const R a, const R b) { return a < b; });
+}
+
+template <typename T>
+IndexedValue<typename std::remove_const<T>::type> max_index(const VectorView<T> &x, const Execution e = ExecutionSettings::policy()) {
+    typedef typename std::remove_const<T>::type R;
+
+    return extreme_index(x, e, [](const R a, const R b) { return a > b; });
+}
+
+template <typename T>
+IndexedValue<T> min_index(const Matrix<T> &m, const Execution e = ExecutionSettings::policy()) {
+    return min_index(VectorView<const T>(m.data(), m.rows * m.cols), e);
+}
+
+template <typename T>
+IndexedValue<T> max_index(const Matrix<T> &m, const Execution e = ExecutionSettings::policy()) {
+    return max_index(VectorView<const T>(m.data(), m.rows * m.cols), e);
+}
+
+// Mean of points.
+template <typename T, typename A = typename accumulate_type<T>::type, typename M = PairwiseSum>
+Vec3<A> mean(const std::vector<Vec3<T>> &points, Accumulate<A, M> = Accumulate<A, M>(),
+             const Execution e = ExecutionSettings::policy()) {
+    if (points.empty()) {
+        throw std::length_error("points should not be empty");
+    }
+
+    const Vec3<A> s = reduce_sum<Vec3<A>>(points.size(), M(), e, [&](size_t i) { return Vec3<A>(points[i]); });
+
+    return s / static_cast<A>(points.size());
+}
+
+// Covariance of points, divided by their number, as a symmetric 3 x 3
+// matrix. Moments are taken about the mean in a second pass, which avoids
+// the cancellation of the one pass formula when the points are far from
+// the origin.
+template <typename T, typename A = typename accumulate_type<T>::type, typename M = PairwiseSum>
+Matrix<A> covariance(const std::vector<Vec3<T>> &points, Accumulate<A, M> policy = Accumulate<A, M>(),
+                     const Execution e = ExecutionSettings::policy()) {
+    const Vec3<A> c = mean(points, policy, e);
+
+    // xx, yy, zz and xy, xz, yz.
+    const Vec3<A> d = reduce_sum<Vec3<A>>(points.size(), M(), e, [&](size_t i) {
+        const Vec3<A> p = Vec3<A>(points[i]) - c;
+        return Vec3<A>(p.x * p.x, p.y * p.y, p.z * p.z);
+    });
+
+    const Vec3<A> o = reduce_sum<Vec3<A>>(points.size(), M(), e, [&](size_t i) {
+        const Vec3<A> p = Vec3<A>(points[i]) - c;
+        return Vec3<A>(p.x * p.y, p.x * p.z, p.y * p.z);
+    });
+
+    const A n = static_cast<A>(points.size());
+
+    return Matrix<A>({
+        {d.x / n, o.x / n, o.y / n},
+        {o.x / n, d.y / n, o.z / n},
+        {o.y / n, o.z / n, d.z / n}
+    });
+}
+
+#endif
@@ -0,0 +1,162 @@
+#ifndef SHARED_H
+#define SHARED_H
+
+#include <atomic>
+#include <memory>
+#include <utility>
+
+#include "geometry.h"
+
+// SharedMatrix
+//
+// A Matrix behind a reference counted pointer, copied on write. Copies
+// share one Matrix and cost an atomic increment; the first mutation of a
+// copy whose storage is shared clones it, so fanning a matrix out to many
+// readers never copies the data.
+//
+// Anything that can write, the non-const operator [] and write(), clones
+// first if needed. A reference obtained that way must not be kept across
+// a copy of the SharedMatrix: writing through it afterwards would change
+// the copy too.
+//
+// Reading from one SharedMatrix on several threads is safe, as is writing
+// to different SharedMatrix objects that share storage.
+template <typename T>
+class SharedMatrix {
+private:
+    std::shared_ptr<Matrix<T>> data;
+
+    // use_count() is a relaxed load. When it says this is the last owner,
+    // the fence orders the reads other owners made before letting go,
+    // which released their count, before the writes that follow.
+    void detach() {
+        if (data.use_count() > 1) {
+            data = std::make_shared<Matrix<T>>(*data);
+        } else {
+            std::atomic_thread_fence(std::memory_order_acquire);
+        }
+    }
+
+    template <typename U>
+    static const Matrix<U>& unwrap(const SharedMatrix<U> &m) {
+        return m.matrix();
+    }
+
+    template <typename U>
+    static const U& unwrap(const U &value) {
+        return value;
+    }
+
+public:
+    SharedMatrix(): data(std::make_shared<Matrix<T>>()) {}
+
+    SharedMatrix(const size_t rows, const size_t cols, const T value = 0):
+        data(std::make_shared<Matrix<T>>(rows, cols, value)) {}
+
+    SharedMatrix(const Matrix<T> &m): data(std::make_shared<Matrix<T>>(m)) {}
+
+    SharedMatrix(Matrix<T> &&m): data(std::make_shared<Matrix<T>>(std::move(m))) {}
+
+    size_t rows() const {
+        return data->rows;
+    }
+
+    size_t cols() const {
+        return data->cols;
+    }
+
+    // True when no other SharedMatrix uses the same storage, so writing
+    // will not copy.
+    bool unique() const {
+        return data.use_count() == 1;
+    }
+
+    const Matrix<T>& matrix() const {
+        return *data;
+    }
+
+    operator const Matrix<T>& () const {
+        return *data;
+    }
+
+    Matrix<T>& write() {
+        detach();
+        return *data;
+    }
+
+    decltype(auto) operator [] (const size_t i) const {
+        return static_cast<const Matrix<T>&>(*data)[i];
+    }
+
+    decltype(auto) operator [] (const size_t i) {
+        detach();
+        return (*data)[i];
+    }
+
+    template <typename U>
+    SharedMatrix& operator += (const U &rhs) {
+        write() += unwrap(rhs);
+        return *this;
+    }
+
+    template <typename U>
+    SharedMatrix& operator -= (const U &rhs) {
+        write() -= unwrap(rhs);
+        return *this;
+    }
+
+    template <typename U>
+    SharedMatrix& operator *= (const U &rhs) {
+        write() *= unwrap(rhs);
+        return *this;
+    }
+
+    template <typename U>
+    SharedMatrix& operator /= (const U &rhs) {
+        write() /= unwrap(rhs);
+        return *this;
+    }
+
+    SharedMatrix& transpose() {
+        write().transpose();
+        return *this;
+    }
+
+    SharedMatrix& invert() {
+        write().invert();
+        return *this;
+    }
+};
+
+// The left operand is taken by value: a temporary that owns its storage is
+// updated in place, and anything else is cloned once, for the result.
+template <typename T, typename U>
+SharedMatrix<T> operator + (SharedMatrix<T> lhs, const U &rhs) {
+    lhs += rhs;
+    return lhs;
+}
+
+template <typename T, typename U>
+SharedMatrix<T> operator - (SharedMatrix<T> lhs, const U &rhs) {
+    lhs -= rhs;
+    return lhs;
+}
+
+template <typename T, typename U>
+SharedMatrix<T> operator * (SharedMatrix<T> lhs, const U &rhs) {
+    lhs *= rhs;
+    return lhs;
+}
+
+template <typename T, typename U>
+SharedMatrix<T> operator / (SharedMatrix<T> lhs, const U &rhs) {
+    lhs /= rhs;
+    return lhs;
+}
+
+template <typename T>
+std::ostream& operator << (std::ostream &os, const SharedMatrix<T> &m) {
+    return os << m.matrix();
+}
+
+#endif
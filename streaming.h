@@ -0,0 +1,325 @@
+#ifndef STREAMING_H
+#define STREAMING_H
+
+#include <vector>
+#include <cmath>
+#include <algorithm>
+#include <stdexcept>
+
+#include "geometry.h"
+#include "parallel.h"
+
+// StreamingQR
+//
+// Least squares fit of y ~ x . c over a stream of rows (x, y) with n
+// columns, kept as the n x n upper triangular R and z = Q^T y of the QR
+// factorization of all rows seen, plus the norm of the residual. A new row
+// is rotated into R with n Givens rotations, O(n^2), so fitting never looks
+// at old rows again and memory does not grow with the stream.
+//
+// With a window, only the last window rows are fitted: they are kept in a
+// ring buffer, and the oldest is taken out of R with the LINPACK downdate
+// (dchdd) when a new one comes in. Downdating loses accuracy where
+// updating does not, so the factor is rebuilt from the buffer once every
+// window downdates, which is O(n^2) per row amortized, and whenever a
+// downdate fails.
+template <typename T>
+class StreamingQR {
+private:
+    typedef typename accumulate_type<T>::type A;
+
+    size_t n;
+    size_t window;
+    size_t count;
+    size_t downdates;
+    std::vector<A> factor, z;
+    A rho;
+
+    // Ring buffer of window rows of n + 1 values, x then y; the oldest row
+    // is at head.
+    std::vector<A> rows;
+    size_t head;
+
+    A* row(const size_t i) {
+        return factor.data() + i * n;
+    }
+
+    const A* row(const size_t i) const {
+        return factor.data() + i * n;
+    }
+
+    // Rotates the row x with response y into r, z and rho, destroying x.
+    static void rotate_in(const size_t n, A *r, A *z, A &rho, A *x, A y) {
+        for (size_t j = 0; j != n; j++) {
+            if (x[j] == 0) {
+                continue;
+            }
+
+            A *rj = r + j * n;
+            const A h = std::hypot(rj[j], x[j]);
+            const A c = rj[j] / h, s = x[j] / h;
+
+            rj[j] = h;
+            x[j] = 0;
+            for (size_t k = j + 1; k != n; k++) {
+                const A t = c * rj[k] + s * x[k];
+                x[k] = c * x[k] - s * rj[k];
+                rj[k] = t;
+            }
+
+            const A t = c * z[j] + s * y;
+            y = c * y - s * z[j];
+            z[j] = t;
+        }
+
+        rho = std::hypot(rho, y);
+    }
+
+    // Takes the row x with response y out of the factor. Returns false,
+    // leaving the factor as it was, when the rows left would not have full
+    // rank as far as the factor can tell.
+    bool rotate_out(const A *x, const A y) {
+        // R^T a = x.
+        std::vector<A> a(x, x + n), c(n), s(n);
+        for (size_t i = 0; i != n; i++) {
+            if (row(i)[i] == 0) {
+                return false;
+            }
+
+            a[i] /= row(i)[i];
+            for (size_t k = i + 1; k != n; k++) {
+                a[k] -= row(i)[k] * a[i];
+            }
+        }
+
+        A norm = 0;
+        for (size_t i = 0; i != n; i++) {
+            norm += a[i] * a[i];
+        }
+
+        if (!(norm < 1)) {
+            return false;
+        }
+
+        A alpha = std::sqrt(1 - norm);
+        for (size_t i = n; i-- != 0;) {
+            const A scale = alpha + std::fabs(a[i]);
+            const A p = alpha / scale, q = a[i] / scale;
+            const A h = std::sqrt(p * p + q * q);
+
+            c[i] = p / h;
+            s[i] = q / h;
+            alpha = scale * h;
+        }
+
+        std::vector<A> carry(n, A(0));
+        for (size_t i = n; i-- != 0;) {
+            A *ri = row(i);
+
+            for (size_t j = i; j != n; j++) {
+                const A t = c[i] * carry[j] + s[i] * ri[j];
+                ri[j] = c[i] * ri[j] - s[i] * carry[j];
+                carry[j] = t;
+            }
+        }
+
+        A zeta = y;
+        for (size_t i = 0; i != n; i++) {
+            z[i] = (z[i] - s[i] * zeta) / c[i];
+            zeta = c[i] * zeta - s[i] * z[i];
+        }
+
+        rho = std::fabs(zeta) < rho ? rho * std::sqrt(1 - (zeta / rho) * (zeta / rho)) : A(0);
+
+        return true;
+    }
+
+    void reset() {
+        std::fill(factor.begin(), factor.end(), A(0));
+        std::fill(z.begin(), z.end(), A(0));
+        rho = 0;
+    }
+
+    // Builds the factor again from the rows in the buffer.
+    void refit() {
+        reset();
+
+        std::vector<A> x(n);
+        for (size_t k = 0; k != count; k++) {
+            const A *rk = rows.data() + ((head + k) % window) * (n + 1);
+
+            std::copy(rk, rk + n, x.begin());
+            rotate_in(n, factor.data(), z.data(), rho, x.data(), rk[n]);
+        }
+
+        downdates = 0;
+    }
+
+    void push(const A *x, const A y) {
+        std::vector<A> w(x, x + n);
+        rotate_in(n, factor.data(), z.data(), rho, w.data(), y);
+        count++;
+    }
+
+    // Merges the rows of another factor, which carry the same information
+    // as the rows it was built from.
+    void merge(const std::vector<A> &other, const std::vector<A> &other_z, const A other_rho) {
+        std::vector<A> x(n);
+
+        for (size_t i = 0; i != n; i++) {
+            std::copy(other.begin() + i * n, other.begin() + (i + 1) * n, x.begin());
+            rotate_in(n, factor.data(), z.data(), rho, x.data(), other_z[i]);
+        }
+
+        rho = std::hypot(rho, other_rho);
+    }
+
+public:
+    // A window of 0 fits every row.
+    StreamingQR(const size_t cols, const size_t window = 0):
+        n(cols), window(window), count(0), downdates(0), factor(n * n, A(0)), z(n, A(0)), rho(0),
+        rows(window * (n + 1)), head(0) {}
+
+    size_t cols() const {
+        return n;
+    }
+
+    // Number of rows in the fit.
+    size_t size() const {
+        return count;
+    }
+
+    void add_row(const std::vector<T> &x, const T y) {
+        if (x.size() != n) {
+            throw std::length_error("row size should be equal to cols");
+        }
+
+        std::vector<A> w(x.begin(), x.end());
+
+        if (window == 0) {
+            push(w.data(), static_cast<A>(y));
+            return;
+        }
+
+        if (count == window) {
+            remove_oldest();
+        }
+
+        A *slot = rows.data() + ((head + count) % window) * (n + 1);
+        std::copy(w.begin(), w.end(), slot);
+        slot[n] = static_cast<A>(y);
+
+        push(w.data(), static_cast<A>(y));
+    }
+
+    // Adds the rows of x with responses y. Without a window, a batch of
+    // many rows is split over the pool: each part is factored on its own
+    // from zero and the factors are then rotated into this one, O(k n^2 / p
+    // + p n^3) for k rows on p threads.
+    void add_rows(const Matrix<T> &x, const std::vector<T> &y) {
+        if (x.cols != n || x.rows != y.size()) {
+            throw std::length_error("rows should have cols columns and one response each");
+        }
+
+        const size_t parts = std::min(thread_count(), x.rows / std::max<size_t>(4 * n, 1));
+
+        if (window != 0 || parts <= 1) {
+            std::vector<T> w(n);
+
+            for (size_t i = 0; i != x.rows; i++) {
+                for (size_t j = 0; j != n; j++) {
+                    w[j] = x[i][j];
+                }
+
+                add_row(w, y[i]);
+            }
+
+            return;
+        }
+
+        std::vector<std::vector<A>> pr(parts, std::vector<A>(n * n, A(0))), pz(parts, std::vector<A>(n, A(0)));
+        std::vector<A> prho(parts, A(0));
+
+        parallel_for(0, parts, 1, [&](size_t lo, size_t hi) {
+            std::vector<A> w(n);
+
+            for (size_t p = lo; p != hi; p++) {
+                for (size_t i = p * x.rows / parts; i != (p + 1) * x.rows / parts; i++) {
+                    for (size_t j = 0; j != n; j++) {
+                        w[j] = x[i][j];
+                    }
+
+                    rotate_in(n, pr[p].data(), pz[p].data(), prho[p], w.data(), static_cast<A>(y[i]));
+                }
+            }
+        });
+
+        for (size_t p = 0; p != parts; p++) {
+            merge(pr[p], pz[p], prho[p]);
+        }
+
+        count += x.rows;
+    }
+
+    // Takes the oldest row in the window out of the fit.
+    void remove_oldest() {
+        if (window == 0) {
+            throw std::logic_error("rows can only be removed with a window");
+        }
+
+        if (count == 0) {
+            throw std::out_of_range("window is empty");
+        }
+
+        const A *oldest = rows.data() + head * (n + 1);
+        const bool removed = rotate_out(oldest, oldest[n]);
+
+        head = (head + 1) % window;
+        count--;
+
+        if (!removed || ++downdates == window) {
+            refit();
+        }
+    }
+
+    // The n x n upper triangular factor.
+    Matrix<T> r() const {
+        Matrix<T> m(n, n);
+
+        for (size_t i = 0; i != n; i++) {
+            for (size_t j = i; j != n; j++) {
+                m[i][j] = static_cast<T>(row(i)[j]);
+            }
+        }
+
+        return m;
+    }
+
+    // Coefficients minimizing the residual over the rows in the fit, by
+    // back substitution in O(n^2).
+    std::vector<T> solve() const {
+        std::vector<A> c(n);
+
+        for (size_t i = n; i-- != 0;) {
+            if (row(i)[i] == 0) {
+                throw std::domain_error("matrix is rank deficient");
+            }
+
+            A s = z[i];
+            for (size_t j = i + 1; j != n; j++) {
+                s -= row(i)[j] * c[j];
+            }
+
+            c[i] = s / row(i)[i];
+        }
+
+        return std::vector<T>(c.begin(), c.end());
+    }
+
+    // Norm of the residual of solve() over the rows in the fit.
+    A residual() const {
+        return rho;
+    }
+};
+
+#endif
@@ -0,0 +1,949 @@
+#ifndef STRUCTURED_H
+#define STRUCTURED_H
+
+#include <vector>
+#include <algorithm>
+#include <stdexcept>
+
+#include "geometry.h"
+#include "parallel.h"
+#include "cholesky.h"
+
+// Square matrices with structure, each storing only the entries the
+// structure allows. Products with a Matrix only touch those entries, so a
+// diagonal times a dense n x n matrix is O(n^2) and a banded one with
+// bandwidths kl and ku is O(n^2 (kl + ku)), against O(n^3) dense.
+//
+// Each type has product(b) = S b and left_product(b) = b S for a Matrix b,
+// which the operators below call, and converts to Matrix with to_matrix().
+// Constructing one from a Matrix reads only the entries of the structure.
+
+// Marks the structured types for the generic operators, like vec_traits
+// does for the Vec classes.
+template <typename S>
+struct structured_traits;
+
+// Calls f(lo, hi) over rows, on the pool when the execution policy allows
+// it and the product is large enough.
+template <typename F>
+void structured_rows(const size_t rows, const size_t work, F f) {
+    if (ExecutionSettings::policy() == Execution::sequential || rows * work < ExecutionSettings::threshold()) {
+        f(0, rows);
+        return;
+    }
+
+    parallel_for(0, rows, std::max<size_t>(1, 16384 / std::max<size_t>(work, 1)), f);
+}
+
+// Applies f, from Matrix to Matrix, to b as a single column.
+template <typename T, typename F>
+std::vector<T> apply_column(const std::vector<T> &b, F f) {
+    Matrix<T> c(b.size(), 1);
+    for (size_t i = 0; i != b.size(); i++) {
+        c[i][0] = b[i];
+    }
+
+    const Matrix<T> r = f(c);
+
+    std::vector<T> x(r.rows);
+    for (size_t i = 0; i != r.rows; i++) {
+        x[i] = r[i][0];
+    }
+
+    return x;
+}
+
+// DiagonalMatrix
+template <typename T>
+class DiagonalMatrix {
+private:
+    std::vector<T> d;
+
+public:
+    DiagonalMatrix(const size_t size, const T value = 0): d(size, value) {}
+
+    DiagonalMatrix(const std::vector<T> &diagonal): d(diagonal) {}
+
+    DiagonalMatrix(const Matrix<T> &m): d(m.rows) {
+        if (m.rows != m.cols) {
+            throw std::length_error("rows must be equal to cols for diagonal matrix");
+        }
+
+        for (size_t i = 0; i != m.rows; i++) {
+            d[i] = m[i][i];
+        }
+    }
+
+    size_t size() const {
+        return d.size();
+    }
+
+    T& operator [] (const size_t i) {
+        return d[i];
+    }
+
+    const T& operator [] (const size_t i) const {
+        return d[i];
+    }
+
+    T operator () (const size_t i, const size_t j) const {
+        return i == j ? d[i] : T(0);
+    }
+
+    Matrix<T> to_matrix() const {
+        Matrix<T> r(d.size(), d.size());
+
+        for (size_t i = 0; i != d.size(); i++) {
+            r[i][i] = d[i];
+        }
+
+        return r;
+    }
+
+    DiagonalMatrix transpose() const {
+        return *this;
+    }
+
+    DiagonalMatrix inverse() const {
+        DiagonalMatrix r(*this);
+
+        for (size_t i = 0; i != d.size(); i++) {
+            if (d[i] == 0) {
+                throw std::domain_error("matrix is singular");
+            }
+
+            r.d[i] = T(1) / d[i];
+        }
+
+        return r;
+    }
+
+    // Scales row i of b by d[i].
+    Matrix<T> product(const Matrix<T> &b) const {
+        if (b.rows != d.size()) {
+            throw std::length_error("rhs.rows should be equal to matrix size");
+        }
+
+        Matrix<T> r(b.rows, b.cols);
+        structured_rows(b.rows, b.cols, [&](size_t lo, size_t hi) {
+            for (size_t i = lo; i != hi; i++) {
+                for (size_t j = 0; j != b.cols; j++) {
+                    r[i][j] = d[i] * b[i][j];
+                }
+            }
+        });
+
+        return r;
+    }
+
+    // Scales column j of b by d[j].
+    Matrix<T> left_product(const Matrix<T> &b) const {
+        if (b.cols != d.size()) {
+            throw std::length_error("lhs.cols should be equal to matrix size");
+        }
+
+        Matrix<T> r(b.rows, b.cols);
+        structured_rows(b.rows, b.cols, [&](size_t lo, size_t hi) {
+            for (size_t i = lo; i != hi; i++) {
+                for (size_t j = 0; j != b.cols; j++) {
+                    r[i][j] = b[i][j] * d[j];
+                }
+            }
+        });
+
+        return r;
+    }
+
+    Matrix<T> solve(const Matrix<T> &b) const {
+        return inverse().product(b);
+    }
+
+    std::vector<T> solve(const std::vector<T> &b) const {
+        return apply_column(b, [&](const Matrix<T> &c) { return solve(c); });
+    }
+};
+
+// Which half a TriangularMatrix keeps, diagonal included.
+enum class Triangle {
+    lower,
+    upper
+};
+
+// TriangularMatrix
+//
+// The n (n + 1) / 2 entries of the triangle, packed by rows for lower and
+// by columns for upper. Both put (i, j) of one where (j, i) of the other
+// goes, so transpose() keeps the storage and flips the triangle.
+template <typename T>
+class TriangularMatrix {
+private:
+    typedef typename accumulate_type<T>::type A;
+
+    size_t n;
+    Triangle part;
+    std::vector<T> p;
+
+    static size_t packed(const size_t i, const size_t j) {
+        return i * (i + 1) / 2 + j;
+    }
+
+    size_t index(const size_t i, const size_t j) const {
+        return part == Triangle::lower ? packed(i, j) : packed(j, i);
+    }
+
+    // First and one past the last column of row i inside the triangle.
+    size_t first(const size_t i) const {
+        return part == Triangle::lower ? 0 : i;
+    }
+
+    size_t last(const size_t i) const {
+        return part == Triangle::lower ? i + 1 : n;
+    }
+
+public:
+    TriangularMatrix(const size_t size, const Triangle triangle = Triangle::lower):
+        n(size), part(triangle), p(size * (size + 1) / 2, T(0)) {}
+
+    TriangularMatrix(const Matrix<T> &m, const Triangle triangle = Triangle::lower):
+        n(m.rows), part(triangle), p(m.rows * (m.rows + 1) / 2)
+    {
+        if (m.rows != m.cols) {
+            throw std::length_error("rows must be equal to cols for triangular matrix");
+        }
+
+        for (size_t i = 0; i != n; i++) {
+            for (size_t j = first(i); j != last(i); j++) {
+                p[index(i, j)] = m[i][j];
+            }
+        }
+    }
+
+    size_t size() const {
+        return n;
+    }
+
+    Triangle triangle() const {
+        return part;
+    }
+
+    bool contains(const size_t i, const size_t j) const {
+        return part == Triangle::lower ? j <= i : i <= j;
+    }
+
+    T operator () (const size_t i, const size_t j) const {
+        return contains(i, j) ? p[index(i, j)] : T(0);
+    }
+
+    T& at(const size_t i, const size_t j) {
+        if (i >= n || j >= n || !contains(i, j)) {
+            throw std::out_of_range("element is outside the triangle");
+        }
+
+        return p[index(i, j)];
+    }
+
+    Matrix<T> to_matrix() const {
+        Matrix<T> r(n, n);
+
+        for (size_t i = 0; i != n; i++) {
+            for (size_t j = first(i); j != last(i); j++) {
+                r[i][j] = p[index(i, j)];
+            }
+        }
+
+        return r;
+    }
+
+    TriangularMatrix transpose() const {
+        TriangularMatrix r(*this);
+        r.part = part == Triangle::lower ? Triangle::upper : Triangle::lower;
+
+        return r;
+    }
+
+    Matrix<T> product(const Matrix<T> &b) const {
+        if (b.rows != n) {
+            throw std::length_error("rhs.rows should be equal to matrix size");
+        }
+
+        Matrix<T> r(n, b.cols);
+        structured_rows(n, b.cols * (n + 1) / 2, [&](size_t lo, size_t hi) {
+            std::vector<A> s(b.cols);
+
+            for (size_t i = lo; i != hi; i++) {
+                std::fill(s.begin(), s.end(), A(0));
+
+                for (size_t k = first(i); k != last(i); k++) {
+                    const A a = p[index(i, k)];
+
+                    for (size_t j = 0; j != b.cols; j++) {
+                        s[j] += a * b[k][j];
+                    }
+                }
+
+                for (size_t j = 0; j != b.cols; j++) {
+                    r[i][j] = static_cast<T>(s[j]);
+                }
+            }
+        });
+
+        return r;
+    }
+
+    Matrix<T> left_product(const Matrix<T> &b) const {
+        if (b.cols != n) {
+            throw std::length_error("lhs.cols should be equal to matrix size");
+        }
+
+        Matrix<T> r(b.rows, n);
+        structured_rows(b.rows, n * (n + 1) / 2, [&](size_t lo, size_t hi) {
+            std::vector<A> s(n);
+
+            for (size_t i = lo; i != hi; i++) {
+                std::fill(s.begin(), s.end(), A(0));
+
+                for (size_t k = 0; k != n; k++) {
+                    const A a = b[i][k];
+
+                    for (size_t j = first(k); j != last(k); j++) {
+                        s[j] += a * p[index(k, j)];
+                    }
+                }
+
+                for (size_t j = 0; j != n; j++) {
+                    r[i][j] = static_cast<T>(s[j]);
+                }
+            }
+        });
+
+        return r;
+    }
+
+    // Forward substitution for lower, back substitution for upper, on all
+    // columns of b at once.
+    Matrix<T> solve(const Matrix<T> &b) const {
+        if (b.rows != n) {
+            throw std::length_error("rhs.rows should be equal to matrix size");
+        }
+
+        std::vector<A> x(n * b.cols);
+        for (size_t step = 0; step != n; step++) {
+            const size_t i = part == Triangle::lower ? step : n - 1 - step;
+            const A d = p[index(i, i)];
+
+            if (d == 0) {
+                throw std::domain_error("matrix is singular");
+            }
+
+            A *xi = x.data() + i * b.cols;
+            for (size_t j = 0; j != b.cols; j++) {
+                xi[j] = b[i][j];
+            }
+
+            for (size_t k = first(i); k != last(i); k++) {
+                if (k == i) {
+                    continue;
+                }
+
+                const A a = p[index(i, k)];
+                const A *xk = x.data() + k * b.cols;
+
+                for (size_t j = 0; j != b.cols; j++) {
+                    xi[j] -= a * xk[j];
+                }
+            }
+
+            for (size_t j = 0; j != b.cols; j++) {
+                xi[j] /= d;
+            }
+        }
+
+        Matrix<T> r(n, b.cols);
+        for (size_t i = 0; i != n; i++) {
+            for (size_t j = 0; j != b.cols; j++) {
+                r[i][j] = static_cast<T>(x[i * b.cols + j]);
+            }
+        }
+
+        return r;
+    }
+
+    std::vector<T> solve(const std::vector<T> &b) const {
+        return apply_column(b, [&](const Matrix<T> &c) { return solve(c); });
+    }
+};
+
+// SymmetricMatrix
+//
+// The lower triangle packed by rows; (i, j) and (j, i) are one entry.
+template <typename T>
+class SymmetricMatrix {
+private:
+    typedef typename accumulate_type<T>::type A;
+
+    size_t n;
+    std::vector<T> p;
+
+    static size_t index(const size_t i, const size_t j) {
+        return i >= j ? i * (i + 1) / 2 + j : j * (j + 1) / 2 + i;
+    }
+
+public:
+    SymmetricMatrix(const size_t size): n(size), p(size * (size + 1) / 2, T(0)) {}
+
+    SymmetricMatrix(const Matrix<T> &m): n(m.rows), p(m.rows * (m.rows + 1) / 2) {
+        if (m.rows != m.cols) {
+            throw std::length_error("rows must be equal to cols for symmetric matrix");
+        }
+
+        for (size_t i = 0; i != n; i++) {
+            for (size_t j = 0; j <= i; j++) {
+                p[index(i, j)] = m[i][j];
+            }
+        }
+    }
+
+    size_t size() const {
+        return n;
+    }
+
+    T operator () (const size_t i, const size_t j) const {
+        return p[index(i, j)];
+    }
+
+    // Setting (i, j) also sets (j, i).
+    T& at(const size_t i, const size_t j) {
+        if (i >= n || j >= n) {
+            throw std::out_of_range("element is outside the matrix");
+        }
+
+        return p[index(i, j)];
+    }
+
+    Matrix<T> to_matrix() const {
+        Matrix<T> r(n, n);
+
+        for (size_t i = 0; i != n; i++) {
+            for (size_t j = 0; j <= i; j++) {
+                r[i][j] = r[j][i] = p[index(i, j)];
+            }
+        }
+
+        return r;
+    }
+
+    SymmetricMatrix transpose() const {
+        return *this;
+    }
+
+    Matrix<T> product(const Matrix<T> &b) const {
+        if (b.rows != n) {
+            throw std::length_error("rhs.rows should be equal to matrix size");
+        }
+
+        Matrix<T> r(n, b.cols);
+        structured_rows(n, n * b.cols, [&](size_t lo, size_t hi) {
+            std::vector<A> s(b.cols);
+
+            for (size_t i = lo; i != hi; i++) {
+                std::fill(s.begin(), s.end(), A(0));
+
+                for (size_t k = 0; k != n; k++) {
+                    const A a = p[index(i, k)];
+
+                    for (size_t j = 0; j != b.cols; j++) {
+                        s[j] += a * b[k][j];
+                    }
+                }
+
+                for (size_t j = 0; j != b.cols; j++) {
+                    r[i][j] = static_cast<T>(s[j]);
+                }
+            }
+        });
+
+        return r;
+    }
+
+    // b S = (S b^T)^T, computed a row of b at a time.
+    Matrix<T> left_product(const Matrix<T> &b) const {
+        if (b.cols != n) {
+            throw std::length_error("lhs.cols should be equal to matrix size");
+        }
+
+        Matrix<T> r(b.rows, n);
+        structured_rows(b.rows, n * n, [&](size_t lo, size_t hi) {
+            for (size_t i = lo; i != hi; i++) {
+                for (size_t j = 0; j != n; j++) {
+                    A s = 0;
+
+                    for (size_t k = 0; k != n; k++) {
+                        s += b[i][k] * p[index(j, k)];
+                    }
+
+                    r[i][j] = static_cast<T>(s);
+                }
+            }
+        });
+
+        return r;
+    }
+
+    // For positive definite matrices, through Cholesky; anything else
+    // throws domain_error.
+    Matrix<T> solve(const Matrix<T> &b) const {
+        Matrix<T> lower(n, n);
+
+        for (size_t i = 0; i != n; i++) {
+            for (size_t j = 0; j <= i; j++) {
+                lower[i][j] = p[index(i, j)];
+            }
+        }
+
+        return Cholesky<T>(lower).solve(b);
+    }
+
+    std::vector<T> solve(const std::vector<T> &b) const {
+        return apply_column(b, [&](const Matrix<T> &c) { return solve(c); });
+    }
+};
+
+// BandedMatrix
+//
+// Entries (i, j) with i - kl <= j <= i + ku, stored by rows with
+// kl + ku + 1 slots each, the diagonal at slot kl. Slots that fall outside
+// the matrix in the first and last rows are kept at zero.
+template <typename T>
+class BandedMatrix {
+private:
+    typedef typename accumulate_type<T>::type A;
+
+    size_t n, kl, ku;
+    std::vector<T> band;
+
+    size_t index(const size_t i, const size_t j) const {
+        return i * (kl + ku + 1) + (j + kl - i);
+    }
+
+    size_t first(const size_t i) const {
+        return i > kl ? i - kl : 0;
+    }
+
+    size_t last(const size_t i) const {
+        return std::min(n, i + ku + 1);
+    }
+
+public:
+    BandedMatrix(const size_t size, const size_t lower, const size_t upper):
+        n(size), kl(lower), ku(upper), band(size * (lower + upper + 1), T(0)) {}
+
+    BandedMatrix(const Matrix<T> &m, const size_t lower, const size_t upper):
+        n(m.rows), kl(lower), ku(upper), band(m.rows * (lower + upper + 1), T(0))
+    {
+        if (m.rows != m.cols) {
+            throw std::length_error("rows must be equal to cols for banded matrix");
+        }
+
+        for (size_t i = 0; i != n; i++) {
+            for (size_t j = first(i); j != last(i); j++) {
+                band[index(i, j)] = m[i][j];
+            }
+        }
+    }
+
+    size_t size() const {
+        return n;
+    }
+
+    size_t lower() const {
+        return kl;
+    }
+
+    size_t upper() const {
+        return ku;
+    }
+
+    bool contains(const size_t i, const size_t j) const {
+        return j + kl >= i && j <= i + ku;
+    }
+
+    T operator () (const size_t i, const size_t j) const {
+        return contains(i, j) ? band[index(i, j)] : T(0);
+    }
+
+    T& at(const size_t i, const size_t j) {
+        if (i >= n || j >= n || !contains(i, j)) {
+            throw std::out_of_range("element is outside the band");
+        }
+
+        return band[index(i, j)];
+    }
+
+    Matrix<T> to_matrix() const {
+        Matrix<T> r(n, n);
+
+        for (size_t i = 0; i != n; i++) {
+            for (size_t j = first(i); j != last(i); j++) {
+                r[i][j] = band[index(i, j)];
+            }
+        }
+
+        return r;
+    }
+
+    BandedMatrix transpose() const {
+        BandedMatrix r(n, ku, kl);
+
+        for (size_t i = 0; i != n; i++) {
+            for (size_t j = first(i); j != last(i); j++) {
+                r.band[r.index(j, i)] = band[index(i, j)];
+            }
+        }
+
+        return r;
+    }
+
+    Matrix<T> product(const Matrix<T> &b) const {
+        if (b.rows != n) {
+            throw std::length_error("rhs.rows should be equal to matrix size");
+        }
+
+        Matrix<T> r(n, b.cols);
+        structured_rows(n, b.cols * (kl + ku + 1), [&](size_t lo, size_t hi) {
+            std::vector<A> s(b.cols);
+
+            for (size_t i = lo; i != hi; i++) {
+                std::fill(s.begin(), s.end(), A(0));
+
+                for (size_t k = first(i); k != last(i); k++) {
+                    const A a = band[index(i, k)];
+
+                    for (size_t j = 0; j != b.cols; j++) {
+                        s[j] += a * b[k][j];
+                    }
+                }
+
+                for (size_t j = 0; j != b.cols; j++) {
+                    r[i][j] = static_cast<T>(s[j]);
+                }
+            }
+        });
+
+        return r;
+    }
+
+    Matrix<T> left_product(const Matrix<T> &b) const {
+        if (b.cols != n) {
+            throw std::length_error("lhs.cols should be equal to matrix size");
+        }
+
+        Matrix<T> r(b.rows, n);
+        structured_rows(b.rows, n * (kl + ku + 1), [&](size_t lo, size_t hi) {
+            std::vector<A> s(n);
+
+            for (size_t i = lo; i != hi; i++) {
+                std::fill(s.begin(), s.end(), A(0));
+
+                for (size_t k = 0; k != n; k++) {
+                    const A a = b[i][k];
+
+                    for (size_t j = first(k); j != last(k); j++) {
+                        s[j] += a * band[index(k, j)];
+                    }
+                }
+
+                for (size_t j = 0; j != n; j++) {
+                    r[i][j] = static_cast<T>(s[j]);
+                }
+            }
+        });
+
+        return r;
+    }
+
+    // Gaussian elimination with partial pivoting inside the band, as in
+    // LAPACK's gbsv: row swaps widen the upper bandwidth to kl + ku, so the
+    // factor is worked out in a copy with that many more slots per row.
+    // O(n kl (kl + ku)) for the factor plus O(n (2 kl + ku)) per column of b.
+    Matrix<T> solve(const Matrix<T> &b) const {
+        if (b.rows != n) {
+            throw std::length_error("rhs.rows should be equal to matrix size");
+        }
+
+        const size_t width = 2 * kl + ku + 1, k = b.cols;
+        std::vector<A> lu(n * width, A(0)), x(n * k);
+
+        // Slot j - i + kl of row i, for i - kl <= j <= i + kl + ku.
+        auto at = [&](size_t i, size_t j) -> A& {
+            return lu[i * width + (j + kl - i)];
+        };
+
+        for (size_t i = 0; i != n; i++) {
+            for (size_t j = first(i); j != last(i); j++) {
+                at(i, j) = band[index(i, j)];
+            }
+
+            for (size_t j = 0; j != k; j++) {
+                x[i * k + j] = b[i][j];
+            }
+        }
+
+        for (size_t c = 0; c != n; c++) {
+            const size_t end = std::min(n, c + kl + 1);
+            const size_t right = std::min(n, c + kl + ku + 1);
+
+            size_t pivot = c;
+            for (size_t i = c + 1; i != end; i++) {
+                if (std::fabs(at(i, c)) > std::fabs(at(pivot, c))) {
+                    pivot = i;
+                }
+            }
+
+            if (at(pivot, c) == 0) {
+                throw std::domain_error("matrix is singular");
+            }
+
+            if (pivot != c) {
+                for (size_t j = c; j != right; j++) {
+                    std::swap(at(c, j), at(pivot, j));
+                }
+
+                std::swap_ranges(x.begin() + c * k, x.begin() + (c + 1) * k, x.begin() + pivot * k);
+            }
+
+            for (size_t i = c + 1; i != end; i++) {
+                const A f = at(i, c) / at(c, c);
+                if (f == 0) {
+                    continue;
+                }
+
+                for (size_t j = c + 1; j != right; j++) {
+                    at(i, j) -= f * at(c, j);
+                }
+
+                for (size_t j = 0; j != k; j++) {
+                    x[i * k + j] -= f * x[c * k + j];
+                }
+            }
+        }
+
+        for (size_t i = n; i-- != 0;) {
+            A *xi = x.data() + i * k;
+            const size_t right = std::min(n, i + kl + ku + 1);
+
+            for (size_t c = i + 1; c != right; c++) {
+                const A a = at(i, c);
+
+                for (size_t j = 0; j != k; j++) {
+                    xi[j] -= a * x[c * k + j];
+                }
+            }
+
+            for (size_t j = 0; j != k; j++) {
+                xi[j] /= at(i, i);
+            }
+        }
+
+        Matrix<T> r(n, k);
+        for (size_t i = 0; i != n; i++) {
+            for (size_t j = 0; j != k; j++) {
+                r[i][j] = static_cast<T>(x[i * k + j]);
+            }
+        }
+
+        return r;
+    }
+
+    std::vector<T> solve(const std::vector<T> &b) const {
+        return apply_column(b, [&](const Matrix<T> &c) { return solve(c); });
+    }
+};
+
+template <typename T>
+struct structured_traits<DiagonalMatrix<T>> {
+    typedef T value_type;
+};
+
+template <typename T>
+struct structured_traits<TriangularMatrix<T>> {
+    typedef T value_type;
+};
+
+template <typename T>
+struct structured_traits<SymmetricMatrix<T>> {
+    typedef T value_type;
+};
+
+template <typename T>
+struct structured_traits<BandedMatrix<T>> {
+    typedef T value_type;
+};
+
+// Products with Matrix, column vectors and Vec rows, for any of the
+// structured types.
+template <typename T, template <typename> class S, typename = typename structured_traits<S<T>>::value_type>
+Matrix<T> operator * (const S<T> &lhs, const Matrix<T> &rhs) {
+    return lhs.product(rhs);
+}
+
+template <typename T, template <typename> class S, typename = typename structured_traits<S<T>>::value_type>
+Matrix<T> operator * (const Matrix<T> &lhs, const S<T> &rhs) {
+    return rhs.left_product(lhs);
+}
+
+template <typename T, template <typename> class S, typename = typename structured_traits<S<T>>::value_type>
+std::vector<T> operator * (const S<T> &lhs, const std::vector<T> &rhs) {
+    return apply_column(rhs, [&](const Matrix<T> &c) { return lhs.product(c); });
+}
+
+template <typename V, typename S, size_t N = vec_traits<V>::size>
+V structured_left_product(const V &lhs, const S &rhs) {
+    if (rhs.size() != N) {
+        throw std::length_error("matrix size should be equal to vector size");
+    }
+
+    Matrix<typename vec_traits<V>::value_type> row(1, N);
+    for (size_t i = 0; i != N; i++) {
+        row[0][i] = lhs[i];
+    }
+
+    const Matrix<typename vec_traits<V>::value_type> r = rhs.left_product(row);
+
+    V v(lhs);
+    for (size_t i = 0; i != N; i++) {
+        v[i] = r[0][i];
+    }
+
+    return v;
+}
+
+template <typename T, template <typename> class S, typename = typename structured_traits<S<T>>::value_type>
+Vec2<T> operator * (const Vec2<T> &lhs, const S<T> &rhs) {
+    return structured_left_product(lhs, rhs);
+}
+
+template <typename T, template <typename> class S, typename = typename structured_traits<S<T>>::value_type>
+Vec3<T> operator * (const Vec3<T> &lhs, const S<T> &rhs) {
+    return structured_left_product(lhs, rhs);
+}
+
+template <typename T, template <typename> class S, typename = typename structured_traits<S<T>>::value_type>
+Vec4<T> operator * (const Vec4<T> &lhs, const S<T> &rhs) {
+    return structured_left_product(lhs, rhs);
+}
+
+// Products that keep a structure.
+template <typename T>
+DiagonalMatrix<T> operator * (const DiagonalMatrix<T> &lhs, const DiagonalMatrix<T> &rhs) {
+    if (lhs.size() != rhs.size()) {
+        throw std::length_error("matrix sizes should be equal");
+    }
+
+    DiagonalMatrix<T> r(lhs);
+    for (size_t i = 0; i != r.size(); i++) {
+        r[i] *= rhs[i];
+    }
+
+    return r;
+}
+
+template <typename T>
+TriangularMatrix<T> operator * (const DiagonalMatrix<T> &lhs, const TriangularMatrix<T> &rhs) {
+    if (lhs.size() != rhs.size()) {
+        throw std::length_error("matrix sizes should be equal");
+    }
+
+    TriangularMatrix<T> r(rhs);
+    for (size_t i = 0; i != r.size(); i++) {
+        for (size_t j = 0; j != r.size(); j++) {
+            if (r.contains(i, j)) {
+                r.at(i, j) *= lhs[i];
+            }
+        }
+    }
+
+    return r;
+}
+
+template <typename T>
+TriangularMatrix<T> operator * (const TriangularMatrix<T> &lhs, const DiagonalMatrix<T> &rhs) {
+    if (lhs.size() != rhs.size()) {
+        throw std::length_error("matrix sizes should be equal");
+    }
+
+    TriangularMatrix<T> r(lhs);
+    for (size_t i = 0; i != r.size(); i++) {
+        for (size_t j = 0; j != r.size(); j++) {
+            if (r.contains(i, j)) {
+                r.at(i, j) *= rhs[j];
+            }
+        }
+    }
+
+    return r;
+}
+
+template <typename T>
+BandedMatrix<T> operator * (const DiagonalMatrix<T> &lhs, const BandedMatrix<T> &rhs) {
+    if (lhs.size() != rhs.size()) {
+        throw std::length_error("matrix sizes should be equal");
+    }
+
+    BandedMatrix<T> r(rhs);
+    for (size_t i = 0; i != r.size(); i++) {
+        for (size_t j = i > r.lower() ? i - r.lower() : 0; j != std::min(r.size(), i + r.upper() + 1); j++) {
+            r.at(i, j) *= lhs[i];
+        }
+    }
+
+    return r;
+}
+
+template <typename T>
+BandedMatrix<T> operator * (const BandedMatrix<T> &lhs, const DiagonalMatrix<T> &rhs) {
+    if (lhs.size() != rhs.size()) {
+        throw std::length_error("matrix sizes should be equal");
+    }
+
+    BandedMatrix<T> r(lhs);
+    for (size_t i = 0; i != r.size(); i++) {
+        for (size_t j = i > r.lower() ? i - r.lower() : 0; j != std::min(r.size(), i + r.upper() + 1); j++) {
+            r.at(i, j) *= rhs[j];
+        }
+    }
+
+    return r;
+}
+
+// Bandwidths add, up to n - 1.
+template <typename T>
+BandedMatrix<T> operator * (const BandedMatrix<T> &lhs, const BandedMatrix<T> &rhs) {
+    if (lhs.size() != rhs.size()) {
+        throw std::length_error("matrix sizes should be equal");
+    }
+
+    typedef typename accumulate_type<T>::type A;
+
+    const size_t n = lhs.size();
+    const size_t kl = std::min(lhs.lower() + rhs.lower(), n ? n - 1 : 0);
+    const size_t ku = std::min(lhs.upper() + rhs.upper(), n ? n - 1 : 0);
+
+    BandedMatrix<T> r(n, kl, ku);
+    for (size_t i = 0; i != n; i++) {
+        for (size_t j = i > kl ? i - kl : 0; j != std::min(n, i + ku + 1); j++) {
+            const size_t k0 = std::max(i > lhs.lower() ? i - lhs.lower() : 0, j > rhs.upper() ? j - rhs.upper() : 0);
+            const size_t k1 = std::min(std::min(n, i + lhs.upper() + 1), j + rhs.lower() + 1);
+
+            A s = 0;
+            for (size_t k = k0; k < k1; k++) {
+                s += lhs(i, k) * rhs(k, j);
+            }
+
+            r.at(i, j) = static_cast<T>(s);
+        }
+    }
+
+    return r;
+}
+
+#endif